@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/**
+ * \class BatchBuffer
+ * \brief Single-producer, multi-consumer ring of batches
+ *
+ * Every consumer sees every batch. A slot is recycled once all consumers have released it. Slot handoff
+ * is done with atomics only; waiting threads spin briefly and then back off with short sleeps. Batches are
+ * only ever cleared by the producer, so elements are always destroyed on the producer thread.
+ */
+template<typename T>
+class BatchBuffer {
+    public:
+        using Batch = std::vector<T>;
+
+    private:
+        struct Slot {
+            Batch batch;
+            std::atomic<size_t> pending_consumers{0};
+        };
+
+        static constexpr size_t SPIN_LIMIT_ = 64;
+        static constexpr std::chrono::microseconds BACKOFF_{50};
+
+        const size_t num_consumers_;
+        std::vector<Slot> slots_;
+        std::atomic<uint64_t> num_published_{0};
+        std::atomic<bool> finished_{false};
+
+        template<typename Condition>
+        static inline void waitFor_(Condition&& condition) {
+            size_t spins = 0;
+            while(!condition()) {
+                if(spins < SPIN_LIMIT_) {
+                    ++spins;
+                    std::this_thread::yield();
+                }
+                else {
+                    std::this_thread::sleep_for(BACKOFF_);
+                }
+            }
+        }
+
+        inline Slot& getSlot_(const uint64_t seq) {
+            return slots_[seq % slots_.size()];
+        }
+
+    public:
+        /**
+         * Constructs a BatchBuffer
+         * \param num_consumers Number of consumers that must release each batch
+         * \param num_slots Number of batches that can be in flight at once
+         * \param batch_size Capacity reserved for each batch
+         */
+        BatchBuffer(const size_t num_consumers, const size_t num_slots, const size_t batch_size) :
+            num_consumers_(num_consumers),
+            slots_(num_slots)
+        {
+            for(auto& slot: slots_) {
+                slot.batch.reserve(batch_size);
+            }
+        }
+
+        /**
+         * Gets an empty batch to fill. Blocks until the slot has been released by every consumer.
+         * Must be followed by publish().
+         */
+        inline Batch& acquire() {
+            auto& slot = getSlot_(num_published_.load(std::memory_order_relaxed));
+            waitFor_([&slot]() { return slot.pending_consumers.load(std::memory_order_acquire) == 0; });
+            slot.batch.clear();
+            return slot.batch;
+        }
+
+        /**
+         * Makes the most recently acquired batch visible to consumers
+         */
+        inline void publish() {
+            const auto seq = num_published_.load(std::memory_order_relaxed);
+            getSlot_(seq).pending_consumers.store(num_consumers_, std::memory_order_relaxed);
+            num_published_.store(seq + 1, std::memory_order_release);
+        }
+
+        /**
+         * Signals that no more batches will be published
+         */
+        inline void finish() {
+            finished_.store(true, std::memory_order_release);
+        }
+
+        /**
+         * Waits for batch number seq to become available
+         * \returns nullptr if the producer finished without publishing batch seq
+         */
+        inline const Batch* wait(const uint64_t seq) {
+            waitFor_([this, seq]() {
+                return num_published_.load(std::memory_order_acquire) > seq || finished_.load(std::memory_order_acquire);
+            });
+
+            // Recheck in case the final batch was published just before finish()
+            if(num_published_.load(std::memory_order_acquire) > seq) {
+                return &getSlot_(seq).batch;
+            }
+            return nullptr;
+        }
+
+        /**
+         * Releases batch number seq so that the producer can reuse its slot
+         */
+        inline void release(const uint64_t seq) {
+            getSlot_(seq).pending_consumers.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        /**
+         * Waits for every consumer to release every batch, then clears all of the batches. Called by the
+         * producer after finish() so that no element outlives the producer thread.
+         */
+        inline void recycleAll() {
+            for(auto& slot: slots_) {
+                waitFor_([&slot]() { return slot.pending_consumers.load(std::memory_order_acquire) == 0; });
+                slot.batch.clear();
+            }
+        }
+
+        /**
+         * Calls callback on every published batch in order, releasing each batch afterward.
+         * Returns once the producer has finished and every batch has been consumed.
+         * \param callback Function that takes a const Batch&
+         */
+        template<typename Callback>
+        inline void consumeAll(Callback&& callback) {
+            uint64_t seq = 0;
+            while(const auto* const batch = wait(seq)) {
+                callback(*batch);
+                release(seq);
+                ++seq;
+            }
+        }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "batch_buffer.hpp"
+#include "branch_predictor.hpp"
+
+namespace branch_predictor {
+    /**
+     * \class BranchBatchBuffer
+     * \brief Single-producer, multi-consumer ring of branch batches
+     */
+    class BranchBatchBuffer : public BatchBuffer<BranchRecord> {
+        private:
+            std::atomic<bool> stopped_{false};
+
+        public:
+            using BatchBuffer::BatchBuffer;
+
+            /**
+             * Tells publishAll() to stop reading after the current batch. Called by a consumer that has failed.
+             * The consumer must keep releasing batches until the buffer finishes so that the producer can't block.
+             */
+            inline void stop() {
+                stopped_.store(true, std::memory_order_release);
+            }
+
+            /**
+             * Converts every branch from a branch reader and publishes them in batches, then calls finish().
+             * Stops early if a consumer calls stop().
+             * \param reader Branch reader (e.g. stf::STFBranchReader)
+             * \param batch_size Number of branches per batch
+             */
+            template<typename BranchReaderType>
+            inline void publishAll(BranchReaderType& reader, const size_t batch_size) {
+                auto* batch = &acquire();
+                for(const auto& branch: reader) {
+                    batch->emplace_back(BranchRecord{branch.index(),
+                                                     branch.getPC(),
+                                                     branch.getTargetPC(),
+                                                     branch.getOpcode(),
+                                                     branch.isTaken(),
+                                                     branch.isConditional(),
+                                                     branch.isCall(),
+                                                     branch.isReturn(),
+                                                     branch.isIndirect()});
+                    if(STF_EXPECT_FALSE(batch->size() == batch_size)) {
+                        publish();
+                        batch = nullptr;
+                        if(STF_EXPECT_FALSE(stopped_.load(std::memory_order_acquire))) {
+                            break;
+                        }
+                        batch = &acquire();
+                    }
+                }
+
+                if(batch && !batch->empty()) {
+                    publish();
+                }
+                finish();
+            }
+    };
+} // end namespace branch_predictor
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * \file branch_history.hpp
+ * \brief Counter and history building blocks shared by the branch and front-end predictor models
+ */
+namespace branch_predictor {
+    /**
+     * \class SaturatingCounter
+     * \brief Signed saturating counter. Values >= 0 predict taken.
+     */
+    template<typename T, int BITS>
+    class SaturatingCounter {
+        private:
+            static_assert(BITS > 0 && BITS < 8 * sizeof(T), "Counter does not fit in storage type");
+            static constexpr T MAX_ = static_cast<T>((1 << (BITS - 1)) - 1);
+            static constexpr T MIN_ = static_cast<T>(-(1 << (BITS - 1)));
+
+            T val_ = 0;
+
+        public:
+            SaturatingCounter() = default;
+
+            explicit SaturatingCounter(const T val) :
+                val_(val)
+            {
+            }
+
+            inline void update(const bool taken) {
+                if(taken) {
+                    val_ = static_cast<T>(val_ + (val_ < MAX_));
+                }
+                else {
+                    val_ = static_cast<T>(val_ - (val_ > MIN_));
+                }
+            }
+
+            inline bool taken() const {
+                return val_ >= 0;
+            }
+
+            inline bool weak() const {
+                return val_ == 0 || val_ == -1;
+            }
+
+            inline T get() const {
+                return val_;
+            }
+
+            inline void set(const T val) {
+                val_ = val;
+            }
+
+            inline int centered() const {
+                return 2 * val_ + 1;
+            }
+    };
+
+    /**
+     * \class GlobalHistory
+     * \brief Circular buffer of branch outcomes. Index 0 is the most recent outcome.
+     */
+    class GlobalHistory {
+        private:
+            std::vector<uint8_t> bits_;
+            size_t head_ = 0;
+
+        public:
+            explicit GlobalHistory(const size_t length) :
+                bits_(length + 1, 0)
+            {
+            }
+
+            inline void push(const bool taken) {
+                head_ = head_ == 0 ? bits_.size() - 1 : head_ - 1;
+                bits_[head_] = taken;
+            }
+
+            inline uint8_t operator[](const size_t age) const {
+                const size_t idx = head_ + age;
+                return bits_[idx >= bits_.size() ? idx - bits_.size() : idx];
+            }
+    };
+
+    /**
+     * \class FoldedHistory
+     * \brief Incrementally maintained XOR-folding of the most recent original_length bits of a GlobalHistory
+     */
+    class FoldedHistory {
+        private:
+            uint32_t comp_ = 0;
+            size_t original_length_ = 0;
+            size_t compressed_length_ = 0;
+            size_t outpoint_ = 0;
+
+        public:
+            FoldedHistory() = default;
+
+            FoldedHistory(const size_t original_length, const size_t compressed_length) :
+                original_length_(original_length),
+                compressed_length_(compressed_length),
+                outpoint_(original_length % compressed_length)
+            {
+            }
+
+            /**
+             * Must be called after the new outcome has been pushed into the history
+             */
+            inline void update(const GlobalHistory& history) {
+                comp_ = (comp_ << 1) | history[0];
+                comp_ ^= static_cast<uint32_t>(history[original_length_]) << outpoint_;
+                comp_ ^= comp_ >> compressed_length_;
+                comp_ &= (1U << compressed_length_) - 1;
+            }
+
+            inline uint32_t get() const {
+                return comp_;
+            }
+    };
+
+    /**
+     * Hashes a PC down to a table index. The low bit is dropped since branches are at least 2-byte aligned.
+     */
+    inline uint64_t pcHash(const uint64_t pc) {
+        return pc >> 1;
+    }
+} // end namespace branch_predictor
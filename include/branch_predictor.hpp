@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "stf_exception.hpp"
+#include "tools_util.hpp"
+
+/**
+ * \namespace branch_predictor
+ * \brief Interfaces shared by the branch predictor models in stf_branch_predictor_sim and by external
+ * predictor plugins
+ */
+namespace branch_predictor {
+    /**
+     * \struct BranchRecord
+     * \brief Compact, trivially copyable summary of an stf::STFBranch that is passed to predictor models
+     */
+    struct BranchRecord {
+        uint64_t index = 0;         /**< Instruction index of the branch */
+        uint64_t pc = 0;            /**< Branch PC */
+        uint64_t target = 0;        /**< Branch target (only meaningful if taken) */
+        uint32_t opcode = 0;        /**< Branch opcode */
+        bool taken = false;         /**< Actual branch direction */
+        bool conditional = false;   /**< Set if the branch is conditional */
+        bool call = false;          /**< Set if the branch is a call */
+        bool ret = false;           /**< Set if the branch is a return */
+        bool indirect = false;      /**< Set if the branch is indirect */
+    };
+
+    /**
+     * \class PredictorParams
+     * \brief Parses predictor parameter strings of the form key=value[,key=value...]
+     */
+    class PredictorParams {
+        private:
+            std::string str_;
+            std::map<std::string, std::string, std::less<>> params_;
+
+        public:
+            static constexpr size_t MAX_LOG2 = 31;
+
+            PredictorParams() = default;
+
+            /**
+             * Constructs a PredictorParams
+             * \param str Parameter string
+             */
+            explicit PredictorParams(const std::string_view str) :
+                str_(str)
+            {
+                size_t pos = 0;
+                while(pos < str.size()) {
+                    auto end = str.find(',', pos);
+                    if(end == std::string_view::npos) {
+                        end = str.size();
+                    }
+
+                    const auto param = str.substr(pos, end - pos);
+                    const auto eq = param.find('=');
+                    stf_assert(eq != std::string_view::npos && eq != 0,
+                               "Invalid predictor parameter: " << param << ". Parameters must be specified as key=value");
+                    params_.emplace(param.substr(0, eq), param.substr(eq + 1));
+                    pos = end + 1;
+                }
+            }
+
+            /**
+             * Gets an integer parameter, returning a default value if it was not specified
+             * \param key Parameter name
+             * \param default_value Value to return if the parameter was not specified
+             */
+            template<typename T>
+            inline T get(const std::string_view key, const T default_value) const {
+                const auto it = params_.find(key);
+                if(it == params_.end()) {
+                    return default_value;
+                }
+                return parseInt<T>(it->second);
+            }
+
+            /**
+             * Gets a log2 table size parameter, returning a default value if it was not specified.
+             * Table indices are folded into 32-bit values (see FoldedHistory), so the value must be between 1 and
+             * MAX_LOG2.
+             * \param key Parameter name
+             * \param default_value Value to return if the parameter was not specified
+             */
+            inline size_t getLog2(const std::string_view key, const size_t default_value) const {
+                const auto value = get<size_t>(key, default_value);
+                stf_assert(value >= 1 && value <= MAX_LOG2,
+                           "Predictor parameter " << key << " must be between 1 and " << MAX_LOG2);
+                return value;
+            }
+
+            /**
+             * Gets a string parameter, returning a default value if it was not specified
+             * \param key Parameter name
+             * \param default_value Value to return if the parameter was not specified
+             */
+            inline std::string getString(const std::string_view key, const std::string_view default_value) const {
+                const auto it = params_.find(key);
+                if(it == params_.end()) {
+                    return std::string(default_value);
+                }
+                return it->second;
+            }
+
+            /**
+             * Gets the unparsed parameter string
+             */
+            inline const std::string& str() const {
+                return str_;
+            }
+    };
+
+    /**
+     * \class BranchPredictor
+     * \brief Base class for direction predictors
+     *
+     * predict() and update() are only called for conditional branches. trackUnconditional() is called for
+     * every other branch so that models can maintain path history if they wish.
+     */
+    class BranchPredictor {
+        public:
+            using Handle = std::unique_ptr<BranchPredictor>;
+
+            virtual ~BranchPredictor() = default;
+
+            /**
+             * Gets a descriptive name (including parameters) used in reports
+             */
+            virtual std::string getName() const = 0;
+
+            /**
+             * Predicts the direction of a conditional branch
+             * \param branch Branch to predict. The taken field must not be used.
+             */
+            virtual bool predict(const BranchRecord& branch) = 0;
+
+            /**
+             * Trains the predictor with the resolved direction of a conditional branch.
+             * Always called immediately after predict() for the same branch.
+             * \param branch Resolved branch
+             * \param predicted Direction returned by predict()
+             */
+            virtual void update(const BranchRecord& branch, bool predicted) = 0;
+
+            /**
+             * Informs the predictor about an unconditional branch
+             * \param branch Unconditional branch
+             */
+            virtual void trackUnconditional(const BranchRecord& branch) {
+            }
+    };
+
+    /**
+     * Name of the factory function every predictor plugin must export
+     */
+    static inline constexpr const char* PLUGIN_CREATE_FUNC = "stf_create_branch_predictor";
+
+    /**
+     * Name of the function every predictor plugin must export to free predictors it created
+     */
+    static inline constexpr const char* PLUGIN_DESTROY_FUNC = "stf_destroy_branch_predictor";
+
+    using PluginCreateFunc = BranchPredictor* (*)(const char*);
+    using PluginDestroyFunc = void (*)(BranchPredictor*);
+} // end namespace branch_predictor
+
+/**
+ * Exports the plugin entry points for a BranchPredictor subclass. The class must be constructible from
+ * a const branch_predictor::PredictorParams&. Use it once in a shared library, e.g.:
+ *     STF_BRANCH_PREDICTOR_PLUGIN(MyPredictor)
+ * and load it with stf_branch_predictor_sim -p plugin:path=libmypredictor.so[,key=value...]
+ */
+#define STF_BRANCH_PREDICTOR_PLUGIN(cls) \
+    extern "C" branch_predictor::BranchPredictor* stf_create_branch_predictor(const char* params) { \
+        return new cls(branch_predictor::PredictorParams(params)); \
+    } \
+    extern "C" void stf_destroy_branch_predictor(branch_predictor::BranchPredictor* predictor) { \
+        delete predictor; \
+    }
@@ -17,6 +17,7 @@
 #include <unistd.h>
 
 #include "format_utils.hpp"
+#include "profiling.hpp"
 #include "tools_util.hpp"
 #include "stf_enum_utils.hpp"
 
@@ -468,6 +469,45 @@ namespace trace_tools {
                     }
             };
 
+            static constexpr std::string_view PROFILE_FLAG_ = "--profile";
+
+            /**
+             * Removes the --profile flag shared by all tools from argv and enables profiling if it was specified
+             * \param argc argc from main
+             * \param argv argv from main
+             * \returns The new argc
+             */
+            static int extractProfileFlag_(const int argc, char** argv) {
+                int new_argc = 1;
+                for(int i = 1; i < argc; ++i) {
+                    const std::string_view arg(argv[i]);
+                    if(arg == "--") {
+                        for(; i < argc; ++i) {
+                            argv[new_argc++] = argv[i];
+                        }
+                        break;
+                    }
+
+                    if(arg.compare(0, PROFILE_FLAG_.size(), PROFILE_FLAG_) != 0 ||
+                       (arg.size() != PROFILE_FLAG_.size() && arg[PROFILE_FLAG_.size()] != '=')) {
+                        argv[new_argc++] = argv[i];
+                        continue;
+                    }
+
+#ifdef ENABLE_TRACE_TOOLS_PROFILING
+                    const auto spec = arg.substr(std::min(arg.size(), PROFILE_FLAG_.size() + 1));
+                    if(STF_EXPECT_FALSE(!trace_tools::profiling::Profiler::isValidSpec(spec))) {
+                        throw InvalidArgumentException("Invalid profiling report specification: " + std::string(spec));
+                    }
+                    TRACE_TOOLS_PROFILE_ENABLE(spec);
+#else
+                    std::cerr << "Ignoring " << PROFILE_FLAG_ << " because stf_tools was built without profiling support" << std::endl;
+#endif
+                }
+
+                return new_argc;
+            }
+
             inline const auto& getPositionalArgument_(const size_t idx) const {
                 const auto& a = positional_arguments_.at(idx);
                 if(STF_EXPECT_FALSE(!a->isSet())) {
@@ -701,6 +741,11 @@ namespace trace_tools {
                     os << a->getHelpMessage() << std::endl;
                 }
 
+#ifdef ENABLE_TRACE_TOOLS_PROFILING
+                stf::format_utils::formatSpaces(os, TAB_WIDTH);
+                os << PROFILE_FLAG_ << "[=spec] write a profiling report on exit (table, json, table:<file> or json:<file>)" << std::endl;
+#endif
+
                 os << help_addendum_.rdbuf() << std::endl;
             }
 
@@ -712,6 +757,8 @@ namespace trace_tools {
 
             void parseArguments(int argc, char** argv) {
                 try {
+                    argc = extractProfileFlag_(argc, argv);
+
                     int c;
                     opterr = 0;
                     while((c = getopt(argc, argv, arg_str_.str().c_str())) != -1) {
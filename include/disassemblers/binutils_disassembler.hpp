@@ -5,6 +5,7 @@
 #include <string_view>
 
 #include "base_disassembler.hpp"
+#include "disassembly_cache.hpp"
 #include "binutils_wrapper.hpp"
 
 namespace stf {
@@ -21,6 +22,9 @@ namespace stf {
                 //! Tracks whether we encountered an unknown instruction
                 mutable bool unknown_disasm_ = false;
 
+                //! binutils prints PC-relative targets as absolute addresses, so the cache is keyed by (PC, opcode)
+                mutable DisassemblyCache<true> cache_;
+
                 /**
                  * \brief Print the disassembly code of an opcode
                  * \param pc PC address of the instruction
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <exception>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "profiling.hpp"
+#include "stf_env_var.hpp"
+#include "stf_exception.hpp"
+
+namespace stf {
+    namespace disassemblers {
+        /**
+         * \class DisassemblyCache
+         * \brief Bounded cache of rendered disassembly strings
+         *
+         * Hot code executes the same few thousand static instructions over and over, so the backends only need to
+         * render each one once. The cache is direct-mapped: a miss simply replaces whatever occupied the entry, so
+         * memory use is bounded and a hit is just a table lookup and a string copy.
+         *
+         * The number of entries can be set with the STF_DISASM_CACHE_SIZE environment variable (rounded up to a
+         * power of 2, at most MAX_NUM_ENTRIES). Setting it to 0 disables the cache.
+         *
+         * \tparam KEY_ON_PC If true, entries are keyed by (PC, opcode). Needed by backends that print PC-relative
+         * targets as absolute addresses. Otherwise entries are keyed by opcode alone.
+         */
+        template<bool KEY_ON_PC>
+        class DisassemblyCache {
+            public:
+                static constexpr size_t DEFAULT_NUM_ENTRIES = 1 << 14;
+                static constexpr size_t MAX_NUM_ENTRIES = 1 << 24;
+
+            private:
+                struct Entry {
+                    uint64_t pc = 0;
+                    uint32_t opcode = 0;
+                    bool valid = false;
+                    std::string text;
+                };
+
+                std::vector<Entry> entries_;
+                size_t mask_ = 0;
+                std::ostringstream render_stream_;
+
+                static size_t getNumEntries_() {
+                    const auto size_str = STFEnvVar("STF_DISASM_CACHE_SIZE", std::to_string(DEFAULT_NUM_ENTRIES)).get();
+
+                    // std::stoull silently accepts a leading '-' and stops at the first non-digit, so check both
+                    size_t size = 0;
+                    size_t pos = 0;
+                    bool valid = !size_str.empty() && std::isdigit(static_cast<unsigned char>(size_str.front()));
+                    if(valid) {
+                        try {
+                            size = std::stoull(size_str, &pos);
+                        }
+                        catch(const std::exception&) {
+                            valid = false;
+                        }
+                    }
+
+                    stf_assert(valid && pos == size_str.size(),
+                               "Invalid STF_DISASM_CACHE_SIZE value: " << size_str);
+                    stf_assert(size <= MAX_NUM_ENTRIES,
+                               "STF_DISASM_CACHE_SIZE must be at most " << MAX_NUM_ENTRIES << ", got " << size_str);
+
+                    if(size == 0) {
+                        return 0;
+                    }
+
+                    size_t num_entries = 1;
+                    while(num_entries < size) {
+                        num_entries <<= 1;
+                    }
+                    return num_entries;
+                }
+
+                inline size_t getIndex_(const uint64_t pc, const uint32_t opcode) const {
+                    // Instructions are at least 2-byte aligned, so the lowest PC bit carries no information
+                    const uint64_t hash = (KEY_ON_PC ? ((pc >> 1) ^ (static_cast<uint64_t>(opcode) << 32) ^ opcode) : opcode) *
+                                          0x9e3779b97f4a7c15ULL;
+                    return static_cast<size_t>(hash ^ (hash >> 32)) & mask_;
+                }
+
+            public:
+                DisassemblyCache() :
+                    entries_(getNumEntries_())
+                {
+                    if(!entries_.empty()) {
+                        mask_ = entries_.size() - 1;
+                    }
+                }
+
+                /**
+                 * Prints the disassembly of an instruction, rendering it first if it isn't cached
+                 * \param os The ostream to write the assembly to
+                 * \param pc PC address of the instruction
+                 * \param opcode Opcode of the instruction
+                 * \param render Function that takes (std::ostream&) and renders the disassembly into it
+                 */
+                template<typename RenderFunc>
+                inline void print(std::ostream& os, const uint64_t pc, const uint32_t opcode, RenderFunc&& render) {
+                    if(STF_EXPECT_FALSE(entries_.empty())) {
+                        render(os);
+                        return;
+                    }
+
+                    const uint64_t key_pc = KEY_ON_PC ? pc : 0;
+                    auto& entry = entries_[getIndex_(key_pc, opcode)];
+
+                    if(STF_EXPECT_TRUE(entry.valid && entry.opcode == opcode && entry.pc == key_pc)) {
+                        TRACE_TOOLS_PROFILE_COUNT("disasm.cache_hit", 1);
+                        os << entry.text;
+                        return;
+                    }
+
+                    TRACE_TOOLS_PROFILE_COUNT("disasm.cache_miss", 1);
+
+                    // Invalidate first in case render throws
+                    entry.valid = false;
+                    render_stream_.str(std::string());
+                    render(static_cast<std::ostream&>(render_stream_));
+                    entry.text = render_stream_.str();
+                    entry.pc = key_pc;
+                    entry.opcode = opcode;
+                    entry.valid = true;
+
+                    os << entry.text;
+                }
+        };
+    } //end namespace disassemblers
+} //end namespace stf
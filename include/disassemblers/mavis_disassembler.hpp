@@ -1,8 +1,11 @@
 #pragma once
 
 #include <iostream>
+#include <mutex>
+#include "profiling.hpp"
 #include "stf_decoder.hpp"
 #include "base_disassembler.hpp"
+#include "disassembly_cache.hpp"
 
 namespace stf {
     namespace disassemblers {
@@ -15,6 +18,9 @@ namespace stf {
             private:
                 mutable STFDecoder decoder_;
 
+                //! Mavis disassembly does not depend on the PC, so it is cached by opcode
+                mutable DisassemblyCache<false> cache_;
+
                 /**
                  * \brief Print the disassembly code of an opcode
                  * \param pc PC address of the instruction
@@ -24,7 +30,10 @@ namespace stf {
                 void printDisassembly_(std::ostream& os,
                                        const uint64_t pc,
                                        const uint32_t opcode) const final {
-                    os << decoder_.decode(opcode).getDisassembly();
+                    cache_.print(os, pc, opcode, [this, opcode](std::ostream& render_os) {
+                        TRACE_TOOLS_PROFILE_SCOPE("disasm.mavis");
+                        render_os << decoder_.decode(opcode).getDisassembly();
+                    });
                 }
 
             public:
@@ -46,16 +55,20 @@ namespace stf {
                 }
 
                 ~MavisDisassembler() {
+                    // Every stf_dump -j worker owns a disassembler, so only the first one to finish reports the problem
+                    static std::once_flag unknown_disasm_warning;
                     if(decoder_.hasUnknownDisasm()) {
-                        std::cerr << "One or more unknown instructions were encountered." << std::endl
+                        std::call_once(unknown_disasm_warning, []() {
+                            std::cerr << "One or more unknown instructions were encountered." << std::endl
 #ifdef MULTIPLE_DISASSEMBLERS_ENABLED
     #ifdef ENABLE_BINUTILS_DISASM
-                                  << "Try running again with STF_DISASM=BINUTILS or updating to the latest version of Mavis"
+                                      << "Try running again with STF_DISASM=BINUTILS or updating to the latest version of Mavis"
     #endif
 #else
-                                  << "Rebuild stf_tools with binutils support or update to the latest version of Mavis"
+                                      << "Rebuild stf_tools with binutils support or update to the latest version of Mavis"
 #endif
-                                  << std::endl;
+                                      << std::endl;
+                        });
                     }
                 }
 
@@ -0,0 +1,506 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "filesystem.hpp"
+#include "stf_exception.hpp"
+
+/**
+ * \namespace npy_columnar
+ * \brief Reads and writes columnar datasets stored as a directory of NumPy .npy files
+ *
+ * Each column is a 1-dimensional, C-ordered, uncompressed .npy file named <column>.npy. Since the data
+ * is stored as a flat array of fixed-width little-endian values, the files can be passed directly to
+ * numpy.load(..., mmap_mode='r') or accessed through npy_columnar::Dataset without any deserialization.
+ */
+namespace npy_columnar {
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "npy_columnar only supports little-endian hosts");
+
+    /**
+     * Magic string that starts every .npy file
+     */
+    static inline constexpr std::string_view MAGIC{"\x93NUMPY", 6};
+
+    /**
+     * File extension used for column files
+     */
+    static inline constexpr std::string_view EXTENSION{".npy"};
+
+    /**
+     * Gets the NumPy type descriptor for an integer type with the given size and signedness
+     * \param size Size of the type in bytes
+     * \param is_signed If true, the type is signed
+     */
+    inline std::string makeIntDescr(const size_t size, const bool is_signed) {
+        stf_assert(size == 1 || size == 2 || size == 4 || size == 8, "Unsupported integer column size: " << size);
+        return std::string(size == 1 ? "|" : "<") + (is_signed ? 'i' : 'u') + std::to_string(size);
+    }
+
+    /**
+     * Gets the NumPy type descriptor for a C++ type
+     */
+    template<typename T>
+    inline std::string getDescr() {
+        if constexpr(std::is_same_v<T, bool>) {
+            return "|b1";
+        }
+        else if constexpr(std::is_floating_point_v<T>) {
+            return "<f" + std::to_string(sizeof(T));
+        }
+        else {
+            static_assert(std::is_integral_v<T>, "Unsupported column type");
+            return makeIntDescr(sizeof(T), std::is_signed_v<T>);
+        }
+    }
+
+    /**
+     * \class ColumnWriter
+     * \brief Writes a single column to a .npy file
+     *
+     * The header is padded to a fixed size so that the final shape can be filled in when the file is closed.
+     */
+    class ColumnWriter {
+        private:
+            static constexpr size_t HEADER_SIZE_ = 128; /**< Total header size, including magic and length fields */
+            static constexpr size_t PREAMBLE_SIZE_ = MAGIC.size() + 4; /**< Size of magic + version + header length */
+
+            std::string filename_;
+            std::string descr_;
+            size_t item_size_ = 0;
+            uint64_t num_items_ = 0;
+            std::ofstream file_;
+            std::vector<char> scratch_;
+
+            void writeHeader_() {
+                std::ostringstream ss;
+                ss << "{'descr': '" << descr_ << "', 'fortran_order': False, 'shape': (" << num_items_ << ",), }";
+                std::string header = ss.str();
+                const size_t header_len = HEADER_SIZE_ - PREAMBLE_SIZE_;
+                stf_assert(header.size() < header_len, "NPY header for " << filename_ << " is too long");
+                header.resize(header_len - 1, ' ');
+                header.push_back('\n');
+
+                file_.seekp(0);
+                file_.write(MAGIC.data(), static_cast<std::streamsize>(MAGIC.size()));
+                const char version_and_len[4] = {1,
+                                                 0,
+                                                 static_cast<char>(header_len & 0xFF),
+                                                 static_cast<char>((header_len >> 8) & 0xFF)};
+                file_.write(version_and_len, sizeof(version_and_len));
+                file_.write(header.data(), static_cast<std::streamsize>(header.size()));
+            }
+
+        public:
+            ColumnWriter() = default;
+
+            /**
+             * Constructs a ColumnWriter
+             * \param filename Path to the .npy file
+             * \param descr NumPy type descriptor
+             * \param item_size Size of each element in bytes
+             */
+            ColumnWriter(const std::string& filename, const std::string& descr, const size_t item_size) {
+                open(filename, descr, item_size);
+            }
+
+            ColumnWriter(const ColumnWriter&) = delete;
+            ColumnWriter(ColumnWriter&&) = default;
+
+            ~ColumnWriter() {
+                close();
+            }
+
+            /**
+             * Opens a .npy file for writing
+             * \param filename Path to the .npy file
+             * \param descr NumPy type descriptor
+             * \param item_size Size of each element in bytes
+             */
+            void open(const std::string& filename, const std::string& descr, const size_t item_size) {
+                filename_ = filename;
+                descr_ = descr;
+                item_size_ = item_size;
+                num_items_ = 0;
+                file_.open(filename_, std::ios::binary | std::ios::trunc);
+                stf_assert(file_, "Failed to open " << filename_ << " for writing: " << strerror(errno));
+                writeHeader_();
+            }
+
+            /**
+             * Appends contiguous elements to the column
+             * \param data Pointer to the elements
+             * \param num_items Number of elements to write
+             */
+            inline void append(const void* const data, const size_t num_items) {
+                file_.write(static_cast<const char*>(data), static_cast<std::streamsize>(num_items * item_size_));
+                num_items_ += num_items;
+            }
+
+            /**
+             * Appends elements that are interleaved in an array of structs
+             * \param base Pointer to the first element
+             * \param stride Distance in bytes between consecutive elements
+             * \param num_items Number of elements to write
+             */
+            inline void appendStrided(const void* const base, const size_t stride, const size_t num_items) {
+                scratch_.resize(num_items * item_size_);
+                const auto* src = static_cast<const char*>(base);
+                for(size_t i = 0; i < num_items; ++i) {
+                    memcpy(scratch_.data() + i * item_size_, src, item_size_);
+                    src += stride;
+                }
+                append(scratch_.data(), num_items);
+            }
+
+            /**
+             * Fills in the final shape and closes the file
+             */
+            void close() {
+                if(file_.is_open()) {
+                    writeHeader_();
+                    file_.close();
+                }
+            }
+
+            /**
+             * Gets the number of elements written so far
+             */
+            inline uint64_t size() const {
+                return num_items_;
+            }
+    };
+
+    /**
+     * \class Column
+     * \brief Memory-mapped, read-only view of a single .npy column
+     */
+    class Column {
+        private:
+            std::string filename_;
+            std::string descr_;
+            int fd_ = -1;
+            void* file_ptr_ = nullptr;
+            size_t file_size_ = 0;
+            const char* data_ = nullptr;
+            size_t item_size_ = 0;
+            uint64_t num_items_ = 0;
+
+            static std::string_view getHeaderValue_(const std::string_view header, const std::string_view key) {
+                const auto key_pos = header.find(key);
+                stf_assert(key_pos != std::string_view::npos, "NPY header is missing key " << key);
+                const auto value_start = header.find_first_not_of(" :", key_pos + key.size());
+                stf_assert(value_start != std::string_view::npos, "NPY header is malformed");
+                const auto value_end = header.find_first_of(",}", header[value_start] == '(' ? header.find(')', value_start) : value_start);
+                return header.substr(value_start, value_end - value_start);
+            }
+
+            void parseHeader_() {
+                const auto* const base = static_cast<const char*>(file_ptr_);
+                stf_assert(file_size_ >= MAGIC.size() + 4 && std::string_view(base, MAGIC.size()) == MAGIC,
+                           filename_ << " is not a valid .npy file");
+
+                const auto major_version = static_cast<uint8_t>(base[MAGIC.size()]);
+                const auto* const len_ptr = reinterpret_cast<const uint8_t*>(base + MAGIC.size() + 2);
+                size_t header_len = static_cast<size_t>(len_ptr[0]) | (static_cast<size_t>(len_ptr[1]) << 8);
+                size_t header_start = MAGIC.size() + 4;
+                if(major_version >= 2) {
+                    stf_assert(file_size_ >= MAGIC.size() + 6, filename_ << " is not a valid .npy file");
+                    header_len |= (static_cast<size_t>(len_ptr[2]) << 16) | (static_cast<size_t>(len_ptr[3]) << 24);
+                    header_start += 2;
+                }
+                stf_assert(header_start + header_len <= file_size_, filename_ << " has a truncated header");
+
+                const std::string_view header(base + header_start, header_len);
+
+                const auto descr = getHeaderValue_(header, "'descr'");
+                stf_assert(descr.size() > 2, filename_ << " has an invalid descr field");
+                descr_ = std::string(descr.substr(1, descr.size() - 2));
+                stf_assert(descr_.size() >= 3 && descr_[0] != '>', filename_ << " has an unsupported dtype: " << descr_);
+                item_size_ = std::stoul(descr_.substr(2));
+
+                stf_assert(getHeaderValue_(header, "'fortran_order'") == "False",
+                           filename_ << " must be stored in C order");
+
+                const auto shape = getHeaderValue_(header, "'shape'");
+                stf_assert(shape.size() > 2 && shape.front() == '(' && shape.find(',') == shape.rfind(','),
+                           filename_ << " must be 1-dimensional");
+                num_items_ = std::stoull(std::string(shape.substr(1)));
+
+                data_ = base + header_start + header_len;
+                stf_assert(header_start + header_len + num_items_ * item_size_ <= file_size_,
+                           filename_ << " is truncated");
+            }
+
+        public:
+            Column() = default;
+
+            /**
+             * Opens and maps a .npy file
+             * \param filename Path to the .npy file
+             */
+            explicit Column(const std::string& filename) {
+                open(filename);
+            }
+
+            Column(const Column&) = delete;
+
+            Column(Column&& rhs) noexcept :
+                filename_(std::move(rhs.filename_)),
+                descr_(std::move(rhs.descr_)),
+                fd_(rhs.fd_),
+                file_ptr_(rhs.file_ptr_),
+                file_size_(rhs.file_size_),
+                data_(rhs.data_),
+                item_size_(rhs.item_size_),
+                num_items_(rhs.num_items_)
+            {
+                rhs.fd_ = -1;
+                rhs.file_ptr_ = nullptr;
+            }
+
+            ~Column() {
+                close();
+            }
+
+            /**
+             * Opens and maps a .npy file
+             * \param filename Path to the .npy file
+             */
+            void open(const std::string& filename) {
+                close();
+                filename_ = filename;
+                fd_ = ::open(filename_.c_str(), O_RDONLY);
+                stf_assert(fd_ >= 0, "Failed to open " << filename_ << ": " << strerror(errno));
+                file_size_ = static_cast<size_t>(lseek(fd_, 0, SEEK_END));
+                file_ptr_ = mmap(nullptr, file_size_, PROT_READ, MAP_FILE | MAP_SHARED, fd_, 0);
+                stf_assert(file_ptr_ && file_ptr_ != MAP_FAILED, "Failed to mmap file: " << strerror(errno));
+                parseHeader_();
+            }
+
+            /**
+             * Unmaps and closes the file
+             */
+            void close() {
+                if(file_ptr_ && file_ptr_ != MAP_FAILED) {
+                    munmap(file_ptr_, file_size_);
+                }
+                file_ptr_ = nullptr;
+                data_ = nullptr;
+                if(fd_ >= 0) {
+                    ::close(fd_);
+                    fd_ = -1;
+                }
+            }
+
+            /**
+             * Gets the NumPy type descriptor of the column
+             */
+            inline const std::string& getDescr() const {
+                return descr_;
+            }
+
+            /**
+             * Gets the size of each element in bytes
+             */
+            inline size_t getItemSize() const {
+                return item_size_;
+            }
+
+            /**
+             * Gets the number of elements in the column
+             */
+            inline uint64_t size() const {
+                return num_items_;
+            }
+
+            /**
+             * Gets a pointer to the raw column data
+             */
+            inline const void* raw() const {
+                return data_;
+            }
+
+            /**
+             * Gets a typed pointer to the column data. The requested type must match the column dtype.
+             */
+            template<typename T>
+            inline const T* data() const {
+                stf_assert(npy_columnar::getDescr<T>() == descr_,
+                           "Requested type " << npy_columnar::getDescr<T>() << " does not match column type " << descr_);
+                return reinterpret_cast<const T*>(data_);
+            }
+
+            /**
+             * Gets a single element from the column. The requested type must match the column dtype.
+             * \param idx Element index
+             */
+            template<typename T>
+            inline T at(const uint64_t idx) const {
+                stf_assert(idx < num_items_, "Index " << idx << " is out of range for " << filename_);
+                return data<T>()[idx];
+            }
+
+            /**
+             * Gets a single element from an integer column, widened to int64_t regardless of the stored width
+             * \param idx Element index
+             */
+            inline int64_t getInt(const uint64_t idx) const {
+                stf_assert(idx < num_items_, "Index " << idx << " is out of range for " << filename_);
+                const auto* const ptr = data_ + idx * item_size_;
+                const bool is_signed = descr_[1] == 'i';
+                switch(item_size_) {
+                    case 1:
+                        return is_signed ? *reinterpret_cast<const int8_t*>(ptr) : *reinterpret_cast<const uint8_t*>(ptr);
+                    case 2:
+                        return is_signed ? *reinterpret_cast<const int16_t*>(ptr) : *reinterpret_cast<const uint16_t*>(ptr);
+                    case 4:
+                        return is_signed ? *reinterpret_cast<const int32_t*>(ptr) : *reinterpret_cast<const uint32_t*>(ptr);
+                    case 8:
+                        return *reinterpret_cast<const int64_t*>(ptr);
+                    default:
+                        stf_throw("Unsupported integer column size: " << item_size_);
+                }
+            }
+    };
+
+    /**
+     * \class Dataset
+     * \brief A directory of equal-length .npy columns
+     */
+    class Dataset {
+        private:
+            std::map<std::string, Column> columns_;
+            uint64_t num_rows_ = 0;
+
+        public:
+            Dataset() = default;
+
+            /**
+             * Opens every .npy file in a directory
+             * \param directory Dataset directory
+             */
+            explicit Dataset(const std::string& directory) {
+                open(directory);
+            }
+
+            /**
+             * Opens every .npy file in a directory
+             * \param directory Dataset directory
+             */
+            void open(const std::string& directory) {
+                columns_.clear();
+                num_rows_ = 0;
+
+                for(const auto& entry: fs::directory_iterator(directory)) {
+                    const auto& path = entry.path();
+                    if(path.extension() != EXTENSION) {
+                        continue;
+                    }
+
+                    const auto it = columns_.emplace(path.stem().string(), Column(path.string())).first;
+                    if(columns_.size() == 1) {
+                        num_rows_ = it->second.size();
+                    }
+                    stf_assert(it->second.size() == num_rows_,
+                               "Column " << it->first << " has " << it->second.size() << " rows, expected " << num_rows_);
+                }
+
+                stf_assert(!columns_.empty(), directory << " does not contain any columns");
+            }
+
+            /**
+             * Gets the number of rows in the dataset
+             */
+            inline uint64_t numRows() const {
+                return num_rows_;
+            }
+
+            /**
+             * Returns whether the dataset contains the specified column
+             * \param name Column name
+             */
+            inline bool hasColumn(const std::string& name) const {
+                return columns_.count(name);
+            }
+
+            /**
+             * Gets a column by name
+             * \param name Column name
+             */
+            inline const Column& getColumn(const std::string& name) const {
+                const auto it = columns_.find(name);
+                stf_assert(it != columns_.end(), "Dataset does not contain column " << name);
+                return it->second;
+            }
+
+            /**
+             * Gets all of the columns in the dataset
+             */
+            inline const auto& getColumns() const {
+                return columns_;
+            }
+    };
+
+    /**
+     * \class DatasetWriter
+     * \brief Writes a directory of equal-length .npy columns
+     */
+    class DatasetWriter {
+        private:
+            fs::path directory_;
+            std::vector<ColumnWriter> columns_;
+
+        public:
+            /**
+             * Constructs a DatasetWriter, creating the output directory if it does not already exist
+             * \param directory Dataset directory
+             */
+            explicit DatasetWriter(const std::string& directory) :
+                directory_(directory)
+            {
+                fs::create_directories(directory_);
+            }
+
+            /**
+             * Adds a column to the dataset
+             * \param name Column name
+             * \param descr NumPy type descriptor
+             * \param item_size Size of each element in bytes
+             * \returns Index of the new column
+             */
+            inline size_t addColumn(const std::string& name, const std::string& descr, const size_t item_size) {
+                columns_.emplace_back((directory_ / (name + std::string(EXTENSION))).string(), descr, item_size);
+                return columns_.size() - 1;
+            }
+
+            /**
+             * Gets a column writer by index
+             * \param idx Column index returned by addColumn
+             */
+            inline ColumnWriter& getColumn(const size_t idx) {
+                return columns_[idx];
+            }
+
+            /**
+             * Gets the number of columns
+             */
+            inline size_t numColumns() const {
+                return columns_.size();
+            }
+    };
+} // end namespace npy_columnar
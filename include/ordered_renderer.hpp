@@ -0,0 +1,275 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "profiling.hpp"
+#include "stf_exception.hpp"
+#include "text_writer.hpp"
+
+/**
+ * \class OrderedRenderer
+ * \brief Renders batches of items to text on a pool of worker threads and writes the text in the original order
+ *
+ * The calling thread fills batches with acquire()/publish(). Each worker thread claims the next unrendered batch,
+ * renders every item in it into a private text buffer and hands the buffer back to the batch's slot. A dedicated
+ * writer thread copies the rendered buffers to the output TextWriter strictly in publication order, so the output is
+ * identical to rendering every item serially.
+ *
+ * Each worker gets its own renderer, created on the worker thread by calling the factory passed to the
+ * constructor. The renderer must be callable as renderer(TextWriter&, const T&). Anything it needs that is not
+ * thread-safe (e.g. a disassembler) should be created inside the factory.
+ *
+ * As with BatchBuffer, batches are only ever cleared by the calling thread, so items are always destroyed on the
+ * thread that created them.
+ */
+template<typename T>
+class OrderedRenderer {
+    public:
+        using Batch = std::vector<T>;
+
+        static constexpr size_t DEFAULT_BATCH_SIZE = 1024;
+
+    private:
+        enum class SlotState : uint8_t {
+            FREE,
+            FILLED,
+            RENDERED
+        };
+
+        struct Slot {
+            Batch batch;
+            std::string text;
+            std::atomic<SlotState> state{SlotState::FREE};
+        };
+
+        static constexpr size_t SLOTS_PER_WORKER_ = 4;
+        static constexpr size_t WORKER_BUFFER_SIZE_ = 1 << 16;
+        static constexpr size_t SPIN_LIMIT_ = 64;
+        static constexpr std::chrono::microseconds BACKOFF_{50};
+
+        TextWriter& out_;
+        std::vector<Slot> slots_;
+        std::atomic<uint64_t> num_published_{0};
+        std::atomic<uint64_t> next_render_{0};
+        std::atomic<bool> finished_{false};
+        std::atomic<bool> failed_{false};
+        std::mutex exception_mutex_;
+        std::exception_ptr exception_;
+        std::vector<std::thread> workers_;
+        std::thread writer_;
+
+        template<typename Condition>
+        static inline void waitFor_(Condition&& condition) {
+            size_t spins = 0;
+            while(!condition()) {
+                if(spins < SPIN_LIMIT_) {
+                    ++spins;
+                    std::this_thread::yield();
+                }
+                else {
+                    std::this_thread::sleep_for(BACKOFF_);
+                }
+            }
+        }
+
+        inline Slot& getSlot_(const uint64_t seq) {
+            return slots_[seq % slots_.size()];
+        }
+
+        /**
+         * Records the first exception thrown by a worker or the writer and tells every thread to stop
+         */
+        void fail_() {
+            {
+                const std::lock_guard<std::mutex> lock(exception_mutex_);
+                if(!exception_) {
+                    exception_ = std::current_exception();
+                }
+            }
+            failed_.store(true, std::memory_order_release);
+        }
+
+        /**
+         * Waits for batch number seq to be published
+         * \returns false if the producer finished without publishing batch seq or a thread failed
+         */
+        inline bool waitPublished_(const uint64_t seq) {
+            waitFor_([this, seq]() {
+                return num_published_.load(std::memory_order_acquire) > seq ||
+                       finished_.load(std::memory_order_acquire) ||
+                       failed_.load(std::memory_order_acquire);
+            });
+
+            // Recheck in case the final batch was published just before finish()
+            return !failed_.load(std::memory_order_acquire) && num_published_.load(std::memory_order_acquire) > seq;
+        }
+
+        template<typename RendererFactory>
+        void render_(RendererFactory& factory) {
+            try {
+                auto renderer = factory();
+                std::string text;
+                TextWriter writer(text, WORKER_BUFFER_SIZE_);
+                writer.setPadding(out_.padding());
+
+                while(true) {
+                    const uint64_t seq = next_render_.fetch_add(1, std::memory_order_relaxed);
+                    if(!waitPublished_(seq)) {
+                        break;
+                    }
+
+                    // The slot cannot be reused until the writer has consumed it, so it still holds batch seq
+                    auto& slot = getSlot_(seq);
+                    {
+                        TRACE_TOOLS_PROFILE_SCOPE("renderer.render");
+                        for(const auto& item: slot.batch) {
+                            renderer(writer, item);
+                        }
+                        writer.flush();
+                    }
+                    // Swap buffers so that both keep their capacity
+                    std::swap(slot.text, text);
+                    text.clear();
+                    slot.state.store(SlotState::RENDERED, std::memory_order_release);
+                }
+            }
+            catch(...) {
+                fail_();
+            }
+        }
+
+        void write_() {
+            TRACE_TOOLS_PROFILE_SCOPE("renderer.write");
+
+            try {
+                for(uint64_t seq = 0; waitPublished_(seq); ++seq) {
+                    auto& slot = getSlot_(seq);
+                    waitFor_([this, &slot]() {
+                        return slot.state.load(std::memory_order_acquire) == SlotState::RENDERED ||
+                               failed_.load(std::memory_order_acquire);
+                    });
+                    if(STF_EXPECT_FALSE(failed_.load(std::memory_order_acquire))) {
+                        break;
+                    }
+                    out_.write(slot.text);
+                    slot.state.store(SlotState::FREE, std::memory_order_release);
+                }
+            }
+            catch(...) {
+                fail_();
+            }
+        }
+
+        /**
+         * Stops and joins every thread, then clears all of the batches
+         */
+        void join_() {
+            for(auto& worker: workers_) {
+                worker.join();
+            }
+            workers_.clear();
+            if(writer_.joinable()) {
+                writer_.join();
+            }
+
+            for(auto& slot: slots_) {
+                slot.batch.clear();
+            }
+        }
+
+        /**
+         * Rethrows the exception that stopped the worker threads
+         */
+        inline void rethrowFailure_() {
+            finished_.store(true, std::memory_order_release);
+            join_();
+            std::rethrow_exception(exception_);
+        }
+
+    public:
+        /**
+         * Constructs an OrderedRenderer and starts its threads
+         * \param out TextWriter that receives the rendered text. Must not be used by anything else until finish()
+         * returns.
+         * \param num_workers Number of rendering threads
+         * \param factory Function that returns a renderer. Called once on each worker thread.
+         * \param batch_size Capacity reserved for each batch
+         */
+        template<typename RendererFactory>
+        OrderedRenderer(TextWriter& out,
+                        const size_t num_workers,
+                        RendererFactory factory,
+                        const size_t batch_size = DEFAULT_BATCH_SIZE) :
+            out_(out),
+            slots_(SLOTS_PER_WORKER_ * num_workers)
+        {
+            stf_assert(num_workers > 0, "OrderedRenderer requires at least one worker thread");
+
+            for(auto& slot: slots_) {
+                slot.batch.reserve(batch_size);
+            }
+
+            workers_.reserve(num_workers);
+            for(size_t i = 0; i < num_workers; ++i) {
+                workers_.emplace_back([this, factory]() mutable { render_(factory); });
+            }
+            writer_ = std::thread([this]() { write_(); });
+        }
+
+        OrderedRenderer(const OrderedRenderer&) = delete;
+        OrderedRenderer& operator=(const OrderedRenderer&) = delete;
+
+        ~OrderedRenderer() {
+            if(writer_.joinable()) {
+                finished_.store(true, std::memory_order_release);
+                join_();
+            }
+        }
+
+        /**
+         * Gets an empty batch to fill. Blocks until the writer has consumed the slot's previous batch.
+         * Must be followed by publish(). Rethrows the exception if a worker has failed.
+         */
+        inline Batch& acquire() {
+            auto& slot = getSlot_(num_published_.load(std::memory_order_relaxed));
+            waitFor_([this, &slot]() {
+                return slot.state.load(std::memory_order_acquire) == SlotState::FREE ||
+                       failed_.load(std::memory_order_acquire);
+            });
+            if(STF_EXPECT_FALSE(failed_.load(std::memory_order_acquire))) {
+                rethrowFailure_();
+            }
+            slot.batch.clear();
+            return slot.batch;
+        }
+
+        /**
+         * Hands the most recently acquired batch to the workers
+         */
+        inline void publish() {
+            const auto seq = num_published_.load(std::memory_order_relaxed);
+            getSlot_(seq).state.store(SlotState::FILLED, std::memory_order_relaxed);
+            num_published_.store(seq + 1, std::memory_order_release);
+        }
+
+        /**
+         * Signals that no more batches will be published and waits for everything to be written.
+         * Rethrows the exception if a worker has failed.
+         */
+        void finish() {
+            finished_.store(true, std::memory_order_release);
+            join_();
+            if(STF_EXPECT_FALSE(exception_)) {
+                std::rethrow_exception(exception_);
+            }
+        }
+};
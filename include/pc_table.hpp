@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "stf_exception.hpp"
+
+/**
+ * \class PCTable
+ * \brief Flat open-addressed table that aggregates a value per static PC
+ *
+ * Lookups and insertions use linear probing over a single contiguous array, so the hot loop of a per-PC
+ * analysis never allocates or chases tree pointers. Entries are unordered; use getSortedEntries() to report
+ * them in PC order.
+ *
+ * ValueType must be default-constructible. References returned by the table are invalidated by any insertion.
+ */
+template<typename ValueType>
+class PCTable {
+    private:
+        static constexpr size_t INITIAL_CAPACITY_ = 1024;
+
+        struct Slot_ {
+            uint64_t pc = 0;
+            bool occupied = false;
+            ValueType value{};
+        };
+
+        std::vector<Slot_> slots_;
+        size_t mask_ = 0;
+        size_t size_ = 0;
+
+        static inline size_t hash_(const uint64_t pc) {
+            // Fibonacci hashing spreads the (mostly aligned) PCs across the table
+            static constexpr uint64_t HASH_MULT = 0x9e3779b97f4a7c15ULL;
+            return static_cast<size_t>((pc >> 1) * HASH_MULT >> 32);
+        }
+
+        inline size_t findSlot_(const uint64_t pc) const {
+            size_t slot = hash_(pc) & mask_;
+            while(slots_[slot].occupied && slots_[slot].pc != pc) {
+                slot = (slot + 1) & mask_;
+            }
+            return slot;
+        }
+
+        void resize_(const size_t capacity) {
+            std::vector<Slot_> old_slots(capacity);
+            old_slots.swap(slots_);
+            mask_ = capacity - 1;
+
+            for(auto& old_slot: old_slots) {
+                if(old_slot.occupied) {
+                    slots_[findSlot_(old_slot.pc)] = std::move(old_slot);
+                }
+            }
+        }
+
+    public:
+        PCTable() {
+            resize_(INITIAL_CAPACITY_);
+        }
+
+        /**
+         * Gets the value for a PC, default-constructing it if the PC has not been seen before
+         * \param pc PC to look up
+         * \returns Reference to the value and whether it was inserted
+         */
+        inline std::pair<ValueType&, bool> tryEmplace(const uint64_t pc) {
+            size_t slot = findSlot_(pc);
+
+            if(STF_EXPECT_TRUE(slots_[slot].occupied)) {
+                return {slots_[slot].value, false};
+            }
+
+            // Keep the load factor at or below 1/2 so probe sequences stay short
+            if((size_ + 1) * 2 > slots_.size()) {
+                resize_(slots_.size() * 2);
+                slot = findSlot_(pc);
+            }
+
+            auto& new_slot = slots_[slot];
+            new_slot.pc = pc;
+            new_slot.occupied = true;
+            ++size_;
+            return {new_slot.value, true};
+        }
+
+        /**
+         * Gets the value for a PC, default-constructing it if the PC has not been seen before
+         */
+        inline ValueType& operator[](const uint64_t pc) {
+            return tryEmplace(pc).first;
+        }
+
+        /**
+         * Looks up a PC without inserting it
+         * \returns Pointer to the value, or nullptr if the PC is not in the table
+         */
+        inline const ValueType* find(const uint64_t pc) const {
+            const auto& slot = slots_[findSlot_(pc)];
+            return slot.occupied ? &slot.value : nullptr;
+        }
+
+        /**
+         * Looks up a PC without inserting it
+         * \returns Pointer to the value, or nullptr if the PC is not in the table
+         */
+        inline ValueType* find(const uint64_t pc) {
+            auto& slot = slots_[findSlot_(pc)];
+            return slot.occupied ? &slot.value : nullptr;
+        }
+
+        /**
+         * Gets every entry, sorted by PC
+         */
+        std::vector<std::pair<uint64_t, const ValueType*>> getSortedEntries() const {
+            std::vector<std::pair<uint64_t, const ValueType*>> sorted;
+            sorted.reserve(size_);
+            for(const auto& slot: slots_) {
+                if(slot.occupied) {
+                    sorted.emplace_back(slot.pc, &slot.value);
+                }
+            }
+            std::sort(sorted.begin(), sorted.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+            return sorted;
+        }
+
+        /**
+         * Gets the number of PCs in the table
+         */
+        inline size_t size() const {
+            return size_;
+        }
+};
+
+/**
+ * \class MnemonicTable
+ * \brief Assigns integer IDs to instruction mnemonics
+ *
+ * Opcodes are only decoded the first time they are seen, so hot loops can aggregate by mnemonic ID without
+ * decoding or hashing strings. The strings are only needed again at report time.
+ */
+template<typename DecoderType>
+class MnemonicTable {
+    private:
+        DecoderType& decoder_;
+        std::unordered_map<uint32_t, uint32_t> opcode_ids_;
+        std::unordered_map<std::string, uint32_t> mnemonic_ids_;
+        std::vector<std::string> mnemonics_;
+
+    public:
+        /**
+         * Constructs a MnemonicTable
+         * \param decoder Decoder used to look up the mnemonic of new opcodes
+         */
+        explicit MnemonicTable(DecoderType& decoder) :
+            decoder_(decoder)
+        {
+        }
+
+        /**
+         * Gets the mnemonic ID for an opcode
+         */
+        inline uint32_t getId(const uint32_t opcode) {
+            const auto it = opcode_ids_.find(opcode);
+            if(STF_EXPECT_TRUE(it != opcode_ids_.end())) {
+                return it->second;
+            }
+
+            const auto& mnemonic = decoder_.decode(opcode).getMnemonic();
+            const auto result = mnemonic_ids_.try_emplace(mnemonic, static_cast<uint32_t>(mnemonics_.size()));
+            if(result.second) {
+                mnemonics_.emplace_back(mnemonic);
+            }
+            opcode_ids_.emplace(opcode, result.first->second);
+            return result.first->second;
+        }
+
+        /**
+         * Gets the mnemonic for an ID
+         */
+        inline const std::string& getMnemonic(const uint32_t id) const {
+            stf_assert(id < mnemonics_.size(), "Invalid mnemonic ID: " << id);
+            return mnemonics_[id];
+        }
+
+        /**
+         * Gets the number of distinct mnemonics
+         */
+        inline size_t size() const {
+            return mnemonics_.size();
+        }
+};
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "batch_buffer.hpp"
+#include "profiling.hpp"
+#include "stf_exception.hpp"
+
+/**
+ * \class PipelinedReader
+ * \brief Runs an STF reader on its own thread and hands its output to the calling thread in batches
+ *
+ * Decompression, record parsing and instruction/branch assembly all happen on the reading thread, which
+ * runs ahead of the consumer by up to NUM_BATCH_SLOTS_ batches. Batches are passed through a single-consumer
+ * BatchBuffer, so the handoff only uses atomics. Iterating a PipelinedReader works the same way as iterating
+ * the underlying reader, except that it can only be done once.
+ *
+ * ReaderType must be iterable (e.g. stf::STFInstReader or stf::STFBranchReader) and its items must be
+ * copyable. Items are copied into the batches and destroyed on the reading thread.
+ */
+template<typename ReaderType>
+class PipelinedReader {
+    public:
+        using value_type = std::decay_t<decltype(*std::declval<ReaderType&>().begin())>;
+
+    private:
+        using ItemBatchBuffer = BatchBuffer<value_type>;
+
+        static constexpr size_t NUM_BATCH_SLOTS_ = 8;
+        static constexpr size_t BATCH_SIZE_ = 4096;
+
+        ReaderType reader_;
+        ItemBatchBuffer buffer_;
+        std::atomic<bool> stop_{false};
+        std::exception_ptr read_exception_;
+        std::thread thread_;
+
+        // Consumer state
+        bool started_ = false;
+        uint64_t seq_ = 0;
+        const typename ItemBatchBuffer::Batch* batch_ = nullptr;
+        size_t idx_ = 0;
+
+        void read_() {
+            TRACE_TOOLS_PROFILE_SCOPE("reader.pipelined.read");
+
+            try {
+                auto* batch = &buffer_.acquire();
+                for(const auto& item: reader_) {
+                    batch->emplace_back(item);
+                    if(STF_EXPECT_FALSE(batch->size() == BATCH_SIZE_)) {
+                        buffer_.publish();
+                        batch = nullptr;
+                        // The consumer is being destroyed, so there is no point in reading any further
+                        if(STF_EXPECT_FALSE(stop_.load(std::memory_order_relaxed))) {
+                            break;
+                        }
+                        batch = &buffer_.acquire();
+                    }
+                }
+
+                if(batch && !batch->empty()) {
+                    buffer_.publish();
+                }
+            }
+            catch(...) {
+                read_exception_ = std::current_exception();
+            }
+
+            buffer_.finish();
+            // Items have to be destroyed on the thread that read them
+            buffer_.recycleAll();
+        }
+
+        /**
+         * Waits for the next batch
+         * \returns false if there are no more batches
+         */
+        inline bool fetch_() {
+            {
+                TRACE_TOOLS_PROFILE_SCOPE("reader.pipelined.wait");
+                batch_ = buffer_.wait(seq_);
+            }
+            idx_ = 0;
+            if(STF_EXPECT_FALSE(!batch_)) {
+                if(read_exception_) {
+                    std::rethrow_exception(read_exception_);
+                }
+                return false;
+            }
+            return true;
+        }
+
+        inline void releaseBatch_() {
+            buffer_.release(seq_);
+            ++seq_;
+            batch_ = nullptr;
+        }
+
+        /**
+         * Moves to the next item
+         * \returns false if there are no more items
+         */
+        inline bool advance_() {
+            if(STF_EXPECT_TRUE(++idx_ < batch_->size())) {
+                return true;
+            }
+            releaseBatch_();
+            return fetch_();
+        }
+
+        inline const value_type& current_() const {
+            return (*batch_)[idx_];
+        }
+
+    public:
+        /**
+         * \class iterator
+         * \brief Single-pass iterator over a PipelinedReader
+         */
+        class iterator {
+            private:
+                PipelinedReader* reader_ = nullptr;
+
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type = typename PipelinedReader::value_type;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const value_type*;
+                using reference = const value_type&;
+
+                iterator() = default;
+
+                explicit iterator(PipelinedReader* reader) :
+                    reader_(reader)
+                {
+                }
+
+                inline reference operator*() const {
+                    return reader_->current_();
+                }
+
+                inline pointer operator->() const {
+                    return &reader_->current_();
+                }
+
+                inline iterator& operator++() {
+                    if(STF_EXPECT_FALSE(!reader_->advance_())) {
+                        reader_ = nullptr;
+                    }
+                    return *this;
+                }
+
+                inline bool operator==(const iterator& rhs) const {
+                    return reader_ == rhs.reader_;
+                }
+
+                inline bool operator!=(const iterator& rhs) const {
+                    return !(*this == rhs);
+                }
+        };
+
+        /**
+         * Opens the underlying reader and starts reading ahead
+         * \param args Arguments passed to the ReaderType constructor
+         */
+        template<typename ... Args>
+        explicit PipelinedReader(Args&&... args) :
+            reader_(std::forward<Args>(args)...),
+            buffer_(1, NUM_BATCH_SLOTS_, BATCH_SIZE_),
+            thread_([this]() { read_(); })
+        {
+        }
+
+        PipelinedReader(const PipelinedReader&) = delete;
+        PipelinedReader& operator=(const PipelinedReader&) = delete;
+
+        ~PipelinedReader() {
+            stop_.store(true, std::memory_order_relaxed);
+
+            // Release everything the reading thread publishes so that it can finish
+            if(batch_) {
+                releaseBatch_();
+            }
+            while(buffer_.wait(seq_)) {
+                releaseBatch_();
+            }
+
+            thread_.join();
+        }
+
+        /**
+         * Gets an iterator to the first item. Can only be called once.
+         */
+        iterator begin() {
+            stf_assert(!started_, "A PipelinedReader can only be iterated once");
+            started_ = true;
+            return fetch_() ? iterator(this) : end();
+        }
+
+        /**
+         * Gets the end iterator
+         */
+        iterator end() const {
+            return iterator();
+        }
+
+        /**
+         * Gets the number of records read by the underlying reader. Only valid once iteration has reached the end.
+         */
+        inline size_t numRecordsRead() const {
+            return reader_.numRecordsRead();
+        }
+
+        /**
+         * Gets the number of instructions read by the underlying reader. Only valid once iteration has reached the
+         * end.
+         */
+        inline size_t numInstsRead() const {
+            return reader_.numInstsRead();
+        }
+};
@@ -0,0 +1,650 @@
+#pragma once
+
+/**
+ * \file profiling.hpp
+ * \brief Built-in phase timers, counters and histograms
+ *
+ * Instrumentation is compiled in when ENABLE_TRACE_TOOLS_PROFILING is defined (cmake -DENABLE_TRACE_TOOLS_PROFILING=1)
+ * and enabled at runtime by setting the STF_TOOLS_PROFILE environment variable or passing --profile to any tool.
+ * Both accept an optional report specification:
+ *
+ *     table            Print a table to stderr (default)
+ *     json             Print JSON to stderr
+ *     table:<file>     Write a table to <file>
+ *     json:<file>      Write JSON to <file>
+ *
+ * The report is written when the tool exits.
+ *
+ * Instrumentation points use the TRACE_TOOLS_PROFILE_* macros, which compile to no-ops when profiling is compiled out.
+ * When it is compiled in but not enabled, each point costs a predictable branch.
+ *
+ * Phase timers are scoped and may nest. Each phase records its total time and its self time, which excludes time
+ * spent in nested phases on the same thread, so the self times add up to the instrumented portion of the run.
+ */
+
+#ifdef ENABLE_TRACE_TOOLS_PROFILING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "stf_exception.hpp"
+
+namespace trace_tools {
+    namespace profiling {
+        /**
+         * \class Phase
+         * \brief Accumulated timing for a named phase
+         */
+        class Phase {
+            private:
+                std::atomic<uint64_t> calls_{0};
+                std::atomic<uint64_t> total_ns_{0};
+                std::atomic<uint64_t> child_ns_{0};
+
+            public:
+                inline void add(const uint64_t total_ns, const uint64_t child_ns) {
+                    calls_.fetch_add(1, std::memory_order_relaxed);
+                    total_ns_.fetch_add(total_ns, std::memory_order_relaxed);
+                    child_ns_.fetch_add(child_ns, std::memory_order_relaxed);
+                }
+
+                inline uint64_t getCalls() const {
+                    return calls_.load(std::memory_order_relaxed);
+                }
+
+                inline uint64_t getTotalNs() const {
+                    return total_ns_.load(std::memory_order_relaxed);
+                }
+
+                inline uint64_t getSelfNs() const {
+                    return getTotalNs() - child_ns_.load(std::memory_order_relaxed);
+                }
+        };
+
+        /**
+         * \class Counter
+         * \brief Named event counter
+         */
+        class Counter {
+            private:
+                std::atomic<uint64_t> value_{0};
+
+            public:
+                inline void add(const uint64_t n) {
+                    value_.fetch_add(n, std::memory_order_relaxed);
+                }
+
+                inline uint64_t get() const {
+                    return value_.load(std::memory_order_relaxed);
+                }
+        };
+
+        /**
+         * \class Histogram
+         * \brief Histogram of values with power-of-2 buckets
+         *
+         * Bucket 0 holds zeroes and bucket N holds values in [2^(N-1), 2^N).
+         */
+        class Histogram {
+            public:
+                static constexpr size_t NUM_BUCKETS = 65;
+
+            private:
+                std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets_{};
+                std::atomic<uint64_t> count_{0};
+                std::atomic<uint64_t> sum_{0};
+                std::atomic<uint64_t> min_{std::numeric_limits<uint64_t>::max()};
+                std::atomic<uint64_t> max_{0};
+
+                static inline size_t getBucket_(const uint64_t value) {
+                    return value ? static_cast<size_t>(64 - __builtin_clzll(value)) : 0;
+                }
+
+            public:
+                inline void add(const uint64_t value) {
+                    buckets_[getBucket_(value)].fetch_add(1, std::memory_order_relaxed);
+                    count_.fetch_add(1, std::memory_order_relaxed);
+                    sum_.fetch_add(value, std::memory_order_relaxed);
+
+                    uint64_t cur = min_.load(std::memory_order_relaxed);
+                    while(value < cur && !min_.compare_exchange_weak(cur, value, std::memory_order_relaxed));
+                    cur = max_.load(std::memory_order_relaxed);
+                    while(value > cur && !max_.compare_exchange_weak(cur, value, std::memory_order_relaxed));
+                }
+
+                inline uint64_t getCount() const {
+                    return count_.load(std::memory_order_relaxed);
+                }
+
+                inline uint64_t getSum() const {
+                    return sum_.load(std::memory_order_relaxed);
+                }
+
+                inline uint64_t getMin() const {
+                    return getCount() ? min_.load(std::memory_order_relaxed) : 0;
+                }
+
+                inline uint64_t getMax() const {
+                    return max_.load(std::memory_order_relaxed);
+                }
+
+                inline uint64_t getBucket(const size_t idx) const {
+                    return buckets_[idx].load(std::memory_order_relaxed);
+                }
+
+                /**
+                 * Gets the smallest value that falls in a bucket
+                 */
+                static inline uint64_t getBucketLow(const size_t idx) {
+                    return idx ? 1ULL << (idx - 1) : 0;
+                }
+
+                /**
+                 * Gets the largest value that falls in a bucket
+                 */
+                static inline uint64_t getBucketHigh(const size_t idx) {
+                    return idx ? (getBucketLow(idx) << 1) - 1 : 0;
+                }
+        };
+
+        /**
+         * \class Profiler
+         * \brief Owns all of the instrumentation points and writes the report
+         *
+         * The profiler is never destroyed, so instrumentation points stay valid during static destruction. The
+         * report is written by an atexit handler instead.
+         */
+        class Profiler {
+            public:
+                enum class Format {
+                    TABLE,
+                    JSON
+                };
+
+            private:
+                inline static bool enabled_ = false;
+                static const bool env_checked_;
+
+                std::mutex mutex_;
+                // std::map keeps the report sorted by name and never moves its values
+                std::map<std::string, Phase, std::less<>> phases_;
+                std::map<std::string, Counter, std::less<>> counters_;
+                std::map<std::string, Histogram, std::less<>> histograms_;
+                Format format_ = Format::TABLE;
+                std::string output_filename_;
+                bool report_registered_ = false;
+                std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+                Profiler() {
+                    if(const char* spec = std::getenv("STF_TOOLS_PROFILE")) {
+                        if(isValidSpec(spec)) {
+                            enable(spec);
+                        }
+                        else {
+                            std::cerr << "Ignoring invalid STF_TOOLS_PROFILE value: " << spec << std::endl;
+                        }
+                    }
+                }
+
+                template<typename T>
+                T& get_(std::map<std::string, T, std::less<>>& map, const std::string_view name) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if(auto it = map.find(name); it != map.end()) {
+                        return it->second;
+                    }
+                    return map.try_emplace(std::string(name)).first->second;
+                }
+
+                static void report_() {
+                    auto& profiler = get();
+                    if(profiler.output_filename_.empty()) {
+                        profiler.report(std::cerr);
+                        return;
+                    }
+
+                    std::ofstream os(profiler.output_filename_);
+                    if(!os) {
+                        std::cerr << "Failed to open profiling report " << profiler.output_filename_ << std::endl;
+                        return;
+                    }
+                    profiler.report(os);
+                }
+
+                static inline double toSeconds_(const uint64_t ns) {
+                    return static_cast<double>(ns) / 1e9;
+                }
+
+                static void writeJSONString_(std::ostream& os, const std::string_view str) {
+                    os << '"';
+                    for(const char c: str) {
+                        if(c == '"' || c == '\\') {
+                            os << '\\';
+                        }
+                        os << c;
+                    }
+                    os << '"';
+                }
+
+                void reportTable_(std::ostream& os, const uint64_t wall_ns) const {
+                    static constexpr int NAME_WIDTH = 32;
+                    static constexpr int NUM_WIDTH = 16;
+
+                    os << std::fixed << std::setprecision(6);
+                    os << "Wall time: " << toSeconds_(wall_ns) << " s" << std::endl;
+
+                    if(!phases_.empty()) {
+                        os << std::endl
+                           << std::left << std::setw(NAME_WIDTH) << "Phase"
+                           << std::right
+                           << std::setw(NUM_WIDTH) << "Calls"
+                           << std::setw(NUM_WIDTH) << "Total (s)"
+                           << std::setw(NUM_WIDTH) << "Self (s)"
+                           << std::setw(NUM_WIDTH) << "Self %"
+                           << std::setw(NUM_WIDTH) << "ns/call"
+                           << std::endl;
+                        for(const auto& p: phases_) {
+                            const auto calls = p.second.getCalls();
+                            const auto total_ns = p.second.getTotalNs();
+                            const auto self_ns = p.second.getSelfNs();
+                            os << std::left << std::setw(NAME_WIDTH) << p.first
+                               << std::right
+                               << std::setw(NUM_WIDTH) << calls
+                               << std::setw(NUM_WIDTH) << toSeconds_(total_ns)
+                               << std::setw(NUM_WIDTH) << toSeconds_(self_ns)
+                               << std::setprecision(2)
+                               << std::setw(NUM_WIDTH) << (wall_ns ? 100.0 * static_cast<double>(self_ns) / static_cast<double>(wall_ns) : 0.0)
+                               << std::setw(NUM_WIDTH) << (calls ? static_cast<double>(total_ns) / static_cast<double>(calls) : 0.0)
+                               << std::setprecision(6)
+                               << std::endl;
+                        }
+                    }
+
+                    if(!counters_.empty()) {
+                        os << std::endl
+                           << std::left << std::setw(NAME_WIDTH) << "Counter"
+                           << std::right << std::setw(NUM_WIDTH) << "Value"
+                           << std::endl;
+                        for(const auto& p: counters_) {
+                            os << std::left << std::setw(NAME_WIDTH) << p.first
+                               << std::right << std::setw(NUM_WIDTH) << p.second.get()
+                               << std::endl;
+                        }
+                    }
+
+                    for(const auto& p: histograms_) {
+                        const auto& hist = p.second;
+                        const auto count = hist.getCount();
+                        os << std::endl
+                           << "Histogram " << p.first << ": count " << count
+                           << ", min " << hist.getMin()
+                           << ", max " << hist.getMax()
+                           << ", mean " << std::setprecision(2)
+                           << (count ? static_cast<double>(hist.getSum()) / static_cast<double>(count) : 0.0)
+                           << std::setprecision(6)
+                           << std::endl;
+                        for(size_t i = 0; i < Histogram::NUM_BUCKETS; ++i) {
+                            if(const auto bucket_count = hist.getBucket(i)) {
+                                std::ostringstream range;
+                                range << '[' << Histogram::getBucketLow(i) << ", " << Histogram::getBucketHigh(i) << ']';
+                                os << "    " << std::left << std::setw(NAME_WIDTH) << range.str()
+                                   << std::right << std::setw(NUM_WIDTH) << bucket_count
+                                   << std::endl;
+                            }
+                        }
+                    }
+                }
+
+                void reportJSON_(std::ostream& os, const uint64_t wall_ns) const {
+                    os << "{\n  \"wall_ns\": " << wall_ns << ",\n  \"phases\": [";
+                    bool first = true;
+                    for(const auto& p: phases_) {
+                        os << (first ? "\n" : ",\n") << "    {\"name\": ";
+                        writeJSONString_(os, p.first);
+                        os << ", \"calls\": " << p.second.getCalls()
+                           << ", \"total_ns\": " << p.second.getTotalNs()
+                           << ", \"self_ns\": " << p.second.getSelfNs()
+                           << '}';
+                        first = false;
+                    }
+                    os << (first ? "" : "\n  ") << "],\n  \"counters\": {";
+
+                    first = true;
+                    for(const auto& p: counters_) {
+                        os << (first ? "\n" : ",\n") << "    ";
+                        writeJSONString_(os, p.first);
+                        os << ": " << p.second.get();
+                        first = false;
+                    }
+                    os << (first ? "" : "\n  ") << "},\n  \"histograms\": [";
+
+                    first = true;
+                    for(const auto& p: histograms_) {
+                        const auto& hist = p.second;
+                        os << (first ? "\n" : ",\n") << "    {\"name\": ";
+                        writeJSONString_(os, p.first);
+                        os << ", \"count\": " << hist.getCount()
+                           << ", \"sum\": " << hist.getSum()
+                           << ", \"min\": " << hist.getMin()
+                           << ", \"max\": " << hist.getMax()
+                           << ", \"buckets\": [";
+                        bool first_bucket = true;
+                        for(size_t i = 0; i < Histogram::NUM_BUCKETS; ++i) {
+                            if(const auto bucket_count = hist.getBucket(i)) {
+                                os << (first_bucket ? "" : ", ")
+                                   << "{\"low\": " << Histogram::getBucketLow(i)
+                                   << ", \"high\": " << Histogram::getBucketHigh(i)
+                                   << ", \"count\": " << bucket_count
+                                   << '}';
+                                first_bucket = false;
+                            }
+                        }
+                        os << "]}";
+                        first = false;
+                    }
+                    os << (first ? "" : "\n  ") << "]\n}" << std::endl;
+                }
+
+                static bool parseFormat_(const std::string_view format, Format& result) {
+                    if(format.empty() || format == "1" || format == "table") {
+                        result = Format::TABLE;
+                        return true;
+                    }
+                    if(format == "json") {
+                        result = Format::JSON;
+                        return true;
+                    }
+                    return false;
+                }
+
+            public:
+                Profiler(const Profiler&) = delete;
+                Profiler& operator=(const Profiler&) = delete;
+
+                /**
+                 * Gets the profiler singleton
+                 */
+                static Profiler& get() {
+                    static Profiler* profiler = new Profiler();
+                    return *profiler;
+                }
+
+                /**
+                 * Returns whether profiling is enabled
+                 */
+                static inline bool enabled() {
+                    return STF_EXPECT_FALSE(enabled_);
+                }
+
+                /**
+                 * Returns whether a report specification is valid
+                 * \param spec Report specification (see the top of this file)
+                 */
+                static bool isValidSpec(const std::string_view spec) {
+                    Format format;
+                    return parseFormat_(spec.substr(0, spec.find(':')), format);
+                }
+
+                /**
+                 * Enables profiling. Should be called before any threads are started.
+                 * \param spec Report specification (see the top of this file)
+                 */
+                void enable(const std::string_view spec) {
+                    const auto colon = spec.find(':');
+                    stf_assert(parseFormat_(spec.substr(0, colon), format_),
+                               "Invalid profiling report format: " << spec.substr(0, colon));
+
+                    if(colon != std::string_view::npos) {
+                        output_filename_ = spec.substr(colon + 1);
+                    }
+
+                    enabled_ = true;
+                    start_ = std::chrono::steady_clock::now();
+
+                    if(!report_registered_) {
+                        std::atexit(report_);
+                        report_registered_ = true;
+                    }
+                }
+
+                /**
+                 * Gets the phase with the given name, creating it if necessary
+                 */
+                Phase& getPhase(const std::string_view name) {
+                    return get_(phases_, name);
+                }
+
+                /**
+                 * Gets the counter with the given name, creating it if necessary
+                 */
+                Counter& getCounter(const std::string_view name) {
+                    return get_(counters_, name);
+                }
+
+                /**
+                 * Gets the histogram with the given name, creating it if necessary
+                 */
+                Histogram& getHistogram(const std::string_view name) {
+                    return get_(histograms_, name);
+                }
+
+                /**
+                 * Writes the report in the configured format
+                 * \param os Stream to write to
+                 */
+                void report(std::ostream& os) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    const auto wall_ns = static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count()
+                    );
+
+                    if(format_ == Format::JSON) {
+                        reportJSON_(os, wall_ns);
+                    }
+                    else {
+                        reportTable_(os, wall_ns);
+                    }
+                }
+        };
+
+        // Reads STF_TOOLS_PROFILE before main() runs
+        inline const bool Profiler::env_checked_ = (Profiler::get(), true);
+
+        /**
+         * \class ScopedTimer
+         * \brief Adds the lifetime of the object to a phase
+         */
+        class ScopedTimer {
+            private:
+                inline static thread_local ScopedTimer* current_ = nullptr;
+
+                Phase* phase_ = nullptr;
+                ScopedTimer* parent_ = nullptr;
+                uint64_t child_ns_ = 0;
+                std::chrono::steady_clock::time_point start_;
+
+            public:
+                explicit ScopedTimer(Phase* phase) :
+                    phase_(phase)
+                {
+                    if(STF_EXPECT_FALSE(phase_)) {
+                        parent_ = current_;
+                        current_ = this;
+                        start_ = std::chrono::steady_clock::now();
+                    }
+                }
+
+                ScopedTimer(const ScopedTimer&) = delete;
+                ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+                ~ScopedTimer() {
+                    if(STF_EXPECT_FALSE(phase_)) {
+                        const auto elapsed = static_cast<uint64_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count()
+                        );
+                        phase_->add(elapsed, child_ns_);
+                        if(parent_) {
+                            parent_->child_ns_ += elapsed;
+                        }
+                        current_ = parent_;
+                    }
+                }
+        };
+
+        /**
+         * \class ProfiledRange
+         * \brief Wraps an iterable object (e.g. an STF reader) so that advancing its iterators is timed as a phase
+         */
+        template<typename RangeType>
+        class ProfiledRange {
+            private:
+                using BaseIterator = decltype(std::declval<RangeType&>().begin());
+                using BaseSentinel = decltype(std::declval<RangeType&>().end());
+
+                RangeType& range_;
+                Phase* phase_;
+
+            public:
+                class iterator;
+
+                class sentinel {
+                    private:
+                        BaseSentinel end_;
+
+                        friend class iterator;
+
+                    public:
+                        explicit sentinel(BaseSentinel&& end) :
+                            end_(std::move(end))
+                        {
+                        }
+                };
+
+                class iterator {
+                    private:
+                        BaseIterator it_;
+                        Phase* phase_;
+
+                    public:
+                        iterator(BaseIterator&& it, Phase* phase) :
+                            it_(std::move(it)),
+                            phase_(phase)
+                        {
+                        }
+
+                        inline decltype(auto) operator*() const {
+                            return *it_;
+                        }
+
+                        inline iterator& operator++() {
+                            ScopedTimer timer(phase_);
+                            ++it_;
+                            return *this;
+                        }
+
+                        inline bool operator!=(const sentinel& rhs) const {
+                            return it_ != rhs.end_;
+                        }
+                };
+
+                ProfiledRange(RangeType& range, Phase* phase) :
+                    range_(range),
+                    phase_(phase)
+                {
+                }
+
+                inline iterator begin() {
+                    ScopedTimer timer(phase_);
+                    return iterator(range_.begin(), phase_);
+                }
+
+                inline sentinel end() {
+                    return sentinel(range_.end());
+                }
+        };
+    } // end namespace profiling
+} // end namespace trace_tools
+
+#define TRACE_TOOLS_PROFILE_CONCAT_(a, b) a ## b
+#define TRACE_TOOLS_PROFILE_VAR_(prefix, line) TRACE_TOOLS_PROFILE_CONCAT_(prefix, line)
+
+#define TRACE_TOOLS_PROFILE_PHASE_(name) \
+    (trace_tools::profiling::Profiler::enabled() ? \
+     [] { \
+         static auto& phase = trace_tools::profiling::Profiler::get().getPhase(name); \
+         return &phase; \
+     }() : nullptr)
+
+/**
+ * Times the rest of the enclosing scope as the named phase. The name must be a string literal.
+ */
+#define TRACE_TOOLS_PROFILE_SCOPE(name) \
+    trace_tools::profiling::ScopedTimer TRACE_TOOLS_PROFILE_VAR_(trace_tools_profile_timer_, __LINE__)(TRACE_TOOLS_PROFILE_PHASE_(name))
+
+/**
+ * Evaluates an expression as the named phase and returns its result
+ */
+#define TRACE_TOOLS_PROFILE_EXPR(name, ...) \
+    [&]() -> decltype(auto) { \
+        TRACE_TOOLS_PROFILE_SCOPE(name); \
+        return (__VA_ARGS__); \
+    }()
+
+/**
+ * Wraps an iterable object so that iterating over it is timed as the named phase
+ */
+#define TRACE_TOOLS_PROFILE_RANGE(name, range) \
+    trace_tools::profiling::ProfiledRange<std::remove_reference_t<decltype(range)>>(range, TRACE_TOOLS_PROFILE_PHASE_(name))
+
+/**
+ * Adds n to the named counter. The name must be a string literal.
+ */
+#define TRACE_TOOLS_PROFILE_COUNT(name, n) \
+    do { \
+        if(trace_tools::profiling::Profiler::enabled()) { \
+            static auto& counter = trace_tools::profiling::Profiler::get().getCounter(name); \
+            counter.add(n); \
+        } \
+    } while(0)
+
+/**
+ * Adds a value to the named histogram. The name must be a string literal.
+ */
+#define TRACE_TOOLS_PROFILE_HISTOGRAM(name, value) \
+    do { \
+        if(trace_tools::profiling::Profiler::enabled()) { \
+            static auto& histogram = trace_tools::profiling::Profiler::get().getHistogram(name); \
+            histogram.add(value); \
+        } \
+    } while(0)
+
+/**
+ * Enables profiling with the given report specification
+ */
+#define TRACE_TOOLS_PROFILE_ENABLE(spec) trace_tools::profiling::Profiler::get().enable(spec)
+
+#else
+
+#define TRACE_TOOLS_PROFILE_SCOPE(name) do {} while(0)
+#define TRACE_TOOLS_PROFILE_EXPR(name, ...) (__VA_ARGS__)
+#define TRACE_TOOLS_PROFILE_RANGE(name, range) (range)
+#define TRACE_TOOLS_PROFILE_COUNT(name, n) do {} while(0)
+#define TRACE_TOOLS_PROFILE_HISTOGRAM(name, value) do {} while(0)
+#define TRACE_TOOLS_PROFILE_ENABLE(spec) do {} while(0)
+
+#endif
@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -11,6 +12,7 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 
+#include "stf_address_range.hpp"
 #include "stf_exception.hpp"
 
 /**
@@ -91,4 +93,15 @@ class STFBinary {
         inline const auto& getFilename() const {
             return filename_;
         }
+
+        /**
+         * Gets the address ranges that may contain instructions. A flat binary has no section information,
+         * so the whole file is returned.
+         */
+        virtual std::vector<STFAddressRange> getExecutableRanges() const {
+            if(!file_size_) {
+                return {};
+            }
+            return {STFAddressRange(base_addr_, base_addr_ + file_size_)};
+        }
 };
@@ -10,6 +10,7 @@
 #include "stf_valid_value.hpp"
 #include "stf_record_types.hpp"
 #include "filesystem.hpp"
+#include "profiling.hpp"
 #include "tools_util.hpp"
 
 namespace stf {
@@ -63,6 +64,7 @@ namespace stf {
 
             const typename MavisType::DecodeInfoType& getDecodeInfo_() const {
                 if(STF_EXPECT_FALSE(has_pending_decode_info_)) {
+                    TRACE_TOOLS_PROFILE_SCOPE("decoder.lookup");
                     try {
                         decode_info_ = mavis_.getInfo(opcode_.get());
                         has_pending_decode_info_ = false;
@@ -70,10 +72,12 @@ namespace stf {
                         disasm_.clear();
                     }
                     catch(const mavis::UnknownOpcode&) {
+                        TRACE_TOOLS_PROFILE_COUNT("decoder.invalid", 1);
                         is_invalid_ = true;
                         throw InvalidInstException(opcode_.get());
                     }
                     catch(const mavis::IllegalOpcode&) {
+                        TRACE_TOOLS_PROFILE_COUNT("decoder.invalid", 1);
                         is_invalid_ = true;
                         throw InvalidInstException(opcode_.get());
                     }
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <map>
+#include <vector>
 
 #include "stf_address_range.hpp"
 #include "stf_bin.hpp"
@@ -88,5 +89,22 @@ class STFElf : public STFBinary {
         inline uint64_t getMaxAddress() const {
             return file_size_;
         }
+
+        /**
+         * Gets the address ranges of every allocated executable section
+         */
+        std::vector<STFAddressRange> getExecutableRanges() const final {
+            std::vector<STFAddressRange> ranges;
+            for(unsigned int i = 0; i < reader_.sections.size(); ++i) {
+                const auto* section = reader_.sections[i];
+                if((section->get_flags() & ELFIO::SHF_EXECINSTR) &&
+                   (section->get_flags() & ELFIO::SHF_ALLOC) &&
+                   section->get_type() != ELFIO::SHT_NOBITS &&
+                   section->get_size()) {
+                    ranges.emplace_back(section->get_address(), section->get_address() + section->get_size());
+                }
+            }
+            return ranges;
+        }
 };
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <unordered_map>
 #include <vector>
 #include "stf_inst_reader.hpp"
 #include "stf_pte.hpp"
@@ -81,34 +83,44 @@ namespace stf {
                 if(stf_writer_) {
                     stf_inst_reader_.copyHeader(*stf_writer_);
                 }
-                for (auto inst_it = stf_inst_reader_.begin(); (inst_it != stf_inst_reader_.end()) && (num_insts_extracted_ < num_to_extract); ++inst_it) {
+                auto inst_it = stf_inst_reader_.begin();
+
+                // Fast-forward to the first extracted instruction. Register writes are coalesced until the
+                // start point so that reg_state_ is only updated once per register.
+                for (; (inst_it != stf_inst_reader_.end()) && (num_insts_read_ < num_to_skip) && (num_insts_extracted_ < num_to_extract); ++inst_it) {
                     const auto& inst = *inst_it;
 
-                    if (num_insts_read_ >= num_to_skip) {
-                        if (num_insts_extracted_ == 0 && num_to_skip > 0) {
-                            if (stf_writer_) {
-                                writeStartingRecords(inst);
-                            }
-                        }
+                    // If we skip this instruction, we may still need to copy some of its records
+                    processSkippedInstRecords(inst);
+
+                    ++num_insts_read_;
 
-                        is_fault_ = inst.isFault();
+                    in_user_code_ = user_mode_only_ || (!inst.isChangeFromUserMode() && (in_user_code_ || inst.isChangeToUserMode()));
+                }
 
-                        const auto& insts_to_write = static_cast<DerivedType*>(this)->filter(inst);
+                applySkippedRegWrites();
+
+                for (; (inst_it != stf_inst_reader_.end()) && (num_insts_extracted_ < num_to_extract); ++inst_it) {
+                    const auto& inst = *inst_it;
 
-                        if (stf_writer_ && !insts_to_write.empty()) {
-                            for (const auto& inst_to_write: insts_to_write) {
-                                inst_to_write.write(*stf_writer_);
-                                ++num_insts_written_;
-                            }
+                    if (num_insts_extracted_ == 0 && num_to_skip > 0) {
+                        if (stf_writer_) {
+                            writeStartingRecords(inst);
                         }
+                    }
 
-                        ++num_insts_extracted_;
+                    is_fault_ = inst.isFault();
 
-                    } else {
-                        // If we skip this instruction, we may still need to copy some of its records
-                        processSkippedInstRecords(inst);
+                    const auto& insts_to_write = static_cast<DerivedType*>(this)->filter(inst);
+
+                    if (stf_writer_ && !insts_to_write.empty()) {
+                        for (const auto& inst_to_write: insts_to_write) {
+                            inst_to_write.write(*stf_writer_);
+                            ++num_insts_written_;
+                        }
                     }
 
+                    ++num_insts_extracted_;
                     ++num_insts_read_;
 
                     in_user_code_ = user_mode_only_ || (!inst.isChangeFromUserMode() && (in_user_code_ || inst.isChangeToUserMode()));
@@ -154,7 +166,7 @@ namespace stf {
                     const auto& reg_rec = rec->as<InstRegRecord>();
                     if ((reg_rec.getOperandType() == Registers::STF_REG_OPERAND_TYPE::REG_DEST) ||
                         (reg_rec.getOperandType() == Registers::STF_REG_OPERAND_TYPE::REG_STATE)) {
-                        reg_state_.regStateUpdate(reg_rec);
+                        skipRegWrite_(reg_rec);
                     }
                 }
 
@@ -199,6 +211,32 @@ namespace stf {
                 }*/
             }
 
+            /**
+             * Applies the register writes coalesced by processSkippedInstRecords() to reg_state_
+             */
+            void applySkippedRegWrites() {
+                if (skipped_reg_writes_.empty()) {
+                    return;
+                }
+
+                // Replaying the last write to each register in the order those writes happened gives the same
+                // result as replaying every write, even when a write updates an aliased register
+                std::vector<const SkippedRegWrite*> writes;
+                writes.reserve(skipped_reg_writes_.size());
+                for (const auto& p: skipped_reg_writes_) {
+                    writes.emplace_back(&p.second);
+                }
+                std::sort(writes.begin(),
+                          writes.end(),
+                          [](const SkippedRegWrite* lhs, const SkippedRegWrite* rhs) { return lhs->seq < rhs->seq; });
+
+                for (const auto* write: writes) {
+                    reg_state_.regStateUpdate(write->record);
+                }
+
+                skipped_reg_writes_.clear();
+            }
+
             /**
              * Writes new STF header
              * \param inst Instruction that will be the first to be extracted
@@ -242,5 +280,30 @@ namespace stf {
             bool dump_ptes_on_demand_ = false; /**< If true, dumps PTEs inline with instructions */
             bool in_user_code_ = false; /**< If true, current instruction is user code */
             bool is_fault_ = false; /**< If true, current instruction is a fault */
+
+        private:
+            /**
+             * \struct SkippedRegWrite
+             * \brief Last write to a register while skipping
+             */
+            struct SkippedRegWrite {
+                uint64_t seq; /**< Orders writes to different registers */
+                InstRegRecord record; /**< Register record */
+            };
+
+            std::unordered_map<Registers::STF_REG, SkippedRegWrite> skipped_reg_writes_; /**< Last write to each register while skipping */
+            uint64_t num_skipped_reg_writes_ = 0; /**< Number of register writes seen while skipping */
+
+            /**
+             * Records a register write from a skipped instruction, replacing any earlier write to the same register
+             */
+            inline void skipRegWrite_(const InstRegRecord& reg_rec) {
+                const uint64_t seq = num_skipped_reg_writes_++;
+                const auto result = skipped_reg_writes_.try_emplace(reg_rec.getReg(), SkippedRegWrite{seq, reg_rec});
+                if (!result.second) {
+                    result.first->second.seq = seq;
+                    result.first->second.record = reg_rec;
+                }
+            }
     };
 } // end namespace stf
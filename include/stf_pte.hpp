@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "format_utils.hpp"
+#include "profiling.hpp"
 #include "stf_exception.hpp"
 #include "stf_record_map.hpp"
 #include "stf_record_types.hpp"
@@ -154,6 +155,9 @@ namespace stf {
              * \param walk_info Page table walk record
              */
             bool UpdatePTE(uint32_t pid, const PageTableWalkRecord* walk_info) {
+                TRACE_TOOLS_PROFILE_SCOPE("pte.update");
+                TRACE_TOOLS_PROFILE_HISTOGRAM("pte.page_size", walk_info->getPageSize());
+
                 const uint64_t page_size_mask = static_cast<uint64_t>(walk_info->getPageSize()) - 1;
                 stf_assert((walk_info->getVA() & page_size_mask) == 0,
                            "Virtual page address is not page-aligned: " << std::hex << walk_info->getVA());
@@ -252,6 +256,8 @@ namespace stf {
              * \returns The physical page address if the PTE exists, otherwise INVALID_PHYS_ADDR
              */
             uint64_t MarkPTE(uint32_t pid, uint64_t vaddr, uint64_t paddr) {
+                TRACE_TOOLS_PROFILE_SCOPE("pte.mark");
+
                 for (const auto& page_size: page_sizes_[pid]) {
                     try {
                         return checkPTE_(pid, vaddr, paddr, page_size);
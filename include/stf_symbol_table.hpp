@@ -8,6 +8,7 @@
 
 #include <boost/core/demangle.hpp>
 
+#include "profiling.hpp"
 #include "stf_dwarf.hpp"
 #include "stf_elf.hpp"
 
@@ -234,6 +235,8 @@ class STFSymbolTable {
 
     public:
         explicit STFSymbolTable(const STFElf& elf) {
+            TRACE_TOOLS_PROFILE_SCOPE("symbol_table.load");
+
             // Try to populate with DWARF info first
             try {
                 STFDwarf dwarf(elf.getFilename());
@@ -298,6 +301,8 @@ class STFSymbolTable {
          * Finds the function containing the specified address
          */
         inline std::pair<STFSymbol::Handle, bool> findFunction(const uint64_t address) const {
+            TRACE_TOOLS_PROFILE_SCOPE("symbol_table.lookup");
+
             if(!validPC(address)) {
                 return std::make_pair(nullptr, false);
             }
@@ -312,13 +317,16 @@ class STFSymbolTable {
             if(!it->first.contains(key)) {
                 stf_assert(it->first.startsAfter(key));
                 bool found = false;
+                uint64_t num_scanned = 0;
                 for(auto search_it = std::next(it); search_it != symbols_.end(); ++search_it) {
+                    ++num_scanned;
                     if(search_it->first.contains(key)) {
                         it = search_it;
                         found = true;
                         break;
                     }
                 }
+                TRACE_TOOLS_PROFILE_HISTOGRAM("symbol_table.lookup_scan", num_scanned);
 
                 if(STF_EXPECT_FALSE(!found)) {
                     return std::make_pair(nullptr, false);
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <unistd.h>
+
+#include "format_utils.hpp"
+#include "stf_exception.hpp"
+
+/**
+ * \class TextWriter
+ * \brief Buffered text output that bypasses iostreams for common fields
+ *
+ * Text is accumulated in a large buffer and written to a file descriptor with write(2) when the buffer fills up,
+ * when flush() is called or when the writer is destroyed. A writer can also be constructed to append to a
+ * std::string instead, e.g. to render text on one thread and output it from another. Hex and decimal values are
+ * converted with lookup tables and padding is copied from a precomputed block of spaces.
+ *
+ * The writer is also a std::streambuf, so anything that only knows how to print to a std::ostream (e.g. record
+ * formatters) can write into the same buffer through stream(), or through std::cout while a Redirect is active.
+ * Either way the output stays in order.
+ *
+ * The field methods produce the same text as the equivalent stf::format_utils functions. If padding is disabled with
+ * setPadding(false), alignment padding is reduced to a single space, which is considerably faster to produce and
+ * consume. Zero-filled hex values are not affected.
+ */
+class TextWriter : private std::streambuf {
+    public:
+        static constexpr size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+        /**
+         * \class Redirect
+         * \brief Points an ostream (usually std::cout) at a TextWriter for the lifetime of the object
+         */
+        class Redirect {
+            private:
+                std::ostream& os_;
+                std::streambuf* orig_buf_;
+
+            public:
+                Redirect(TextWriter& writer, std::ostream& os) :
+                    os_(os),
+                    orig_buf_(os.rdbuf(&writer))
+                {
+                }
+
+                Redirect(const Redirect&) = delete;
+                Redirect& operator=(const Redirect&) = delete;
+
+                ~Redirect() {
+                    os_.flush();
+                    os_.rdbuf(orig_buf_);
+                }
+        };
+
+    private:
+        static constexpr size_t MAX_HEX_DIGITS_ = 16;
+        static constexpr size_t MAX_DEC_DIGITS_ = 20;
+        static constexpr size_t SPACES_SIZE_ = 128;
+
+        static constexpr auto HEX_DIGITS_ = [] {
+            constexpr std::string_view HEX = "0123456789abcdef";
+            std::array<char, 512> table {};
+            for(size_t i = 0; i < 256; ++i) {
+                table[2 * i] = HEX[i >> 4];
+                table[2 * i + 1] = HEX[i & 0xf];
+            }
+            return table;
+        }();
+
+        static constexpr auto DEC_DIGITS_ = [] {
+            std::array<char, 200> table {};
+            for(size_t i = 0; i < 100; ++i) {
+                table[2 * i] = static_cast<char>('0' + i / 10);
+                table[2 * i + 1] = static_cast<char>('0' + i % 10);
+            }
+            return table;
+        }();
+
+        static constexpr auto SPACES_ = [] {
+            std::array<char, SPACES_SIZE_> spaces {};
+            for(auto& c: spaces) {
+                c = ' ';
+            }
+            return spaces;
+        }();
+
+        const int fd_ = -1;
+        std::string* const sink_ = nullptr;
+        const size_t buffer_size_;
+        std::unique_ptr<char[]> buffer_;
+        std::ostream os_;
+        bool pad_ = true;
+
+        /**
+         * Returns a pointer to at least n bytes of free buffer space, flushing first if necessary.
+         * n must not be larger than the buffer.
+         */
+        inline char* reserve_(const size_t n) {
+            if(STF_EXPECT_FALSE(static_cast<size_t>(epptr() - pptr()) < n)) {
+                flush();
+            }
+            return pptr();
+        }
+
+        inline void commit_(const size_t n) {
+            pbump(static_cast<int>(n));
+        }
+
+        void writeAll_(const char* data, size_t size) {
+            if(sink_) {
+                sink_->append(data, size);
+                return;
+            }
+
+            while(size) {
+                const auto result = ::write(fd_, data, size);
+                if(STF_EXPECT_FALSE(result < 0)) {
+                    stf_assert(errno == EINTR, "Failed to write output: " << strerror(errno));
+                    continue;
+                }
+                data += result;
+                size -= static_cast<size_t>(result);
+            }
+        }
+
+        /**
+         * Converts a value to decimal
+         * \param value Value to convert
+         * \param end End of the output buffer. The digits are written backward from here.
+         * \returns Number of digits written
+         */
+        static inline size_t toDec_(uint64_t value, char* end) {
+            char* p = end;
+            while(value >= 100) {
+                const auto idx = 2 * (value % 100);
+                value /= 100;
+                p -= 2;
+                p[0] = DEC_DIGITS_[idx];
+                p[1] = DEC_DIGITS_[idx + 1];
+            }
+            if(value >= 10) {
+                p -= 2;
+                p[0] = DEC_DIGITS_[2 * value];
+                p[1] = DEC_DIGITS_[2 * value + 1];
+            }
+            else {
+                *--p = static_cast<char>('0' + value);
+            }
+            return static_cast<size_t>(end - p);
+        }
+
+        // std::streambuf interface
+        int_type overflow(const int_type ch) final {
+            flush();
+            if(!traits_type::eq_int_type(ch, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(ch);
+                pbump(1);
+            }
+            return traits_type::not_eof(ch);
+        }
+
+        std::streamsize xsputn(const char* s, const std::streamsize n) final {
+            write(std::string_view(s, static_cast<size_t>(n)));
+            return n;
+        }
+
+        int sync() final {
+            flush();
+            return 0;
+        }
+
+    public:
+        /**
+         * Constructs a TextWriter
+         * \param fd File descriptor to write to
+         * \param buffer_size Size of the output buffer
+         */
+        explicit TextWriter(const int fd = STDOUT_FILENO, const size_t buffer_size = DEFAULT_BUFFER_SIZE) :
+            fd_(fd),
+            buffer_size_(std::max(buffer_size, SPACES_SIZE_ + MAX_DEC_DIGITS_)),
+            buffer_(std::make_unique<char[]>(buffer_size_)),
+            os_(this)
+        {
+            setp(buffer_.get(), buffer_.get() + buffer_size_);
+        }
+
+        /**
+         * Constructs a TextWriter that appends to a string
+         * \param sink String to append to. Only guaranteed to be up to date after flush().
+         * \param buffer_size Size of the output buffer
+         */
+        explicit TextWriter(std::string& sink, const size_t buffer_size = DEFAULT_BUFFER_SIZE) :
+            sink_(&sink),
+            buffer_size_(std::max(buffer_size, SPACES_SIZE_ + MAX_DEC_DIGITS_)),
+            buffer_(std::make_unique<char[]>(buffer_size_)),
+            os_(this)
+        {
+            setp(buffer_.get(), buffer_.get() + buffer_size_);
+        }
+
+        TextWriter(const TextWriter&) = delete;
+        TextWriter& operator=(const TextWriter&) = delete;
+
+        ~TextWriter() {
+            flush();
+        }
+
+        /**
+         * Enables or disables alignment padding
+         */
+        inline void setPadding(const bool pad) {
+            pad_ = pad;
+        }
+
+        /**
+         * Returns whether alignment padding is enabled
+         */
+        inline bool padding() const {
+            return pad_;
+        }
+
+        /**
+         * Gets an ostream that writes to this writer
+         */
+        inline std::ostream& stream() {
+            return os_;
+        }
+
+        /**
+         * Writes all buffered text to the file descriptor or string
+         */
+        void flush() {
+            writeAll_(pbase(), static_cast<size_t>(pptr() - pbase()));
+            setp(buffer_.get(), buffer_.get() + buffer_size_);
+        }
+
+        /**
+         * Writes a character
+         */
+        inline TextWriter& put(const char c) {
+            *reserve_(1) = c;
+            commit_(1);
+            return *this;
+        }
+
+        /**
+         * Writes a newline. Unlike std::endl, this does not flush.
+         */
+        inline TextWriter& newline() {
+            return put('\n');
+        }
+
+        /**
+         * Writes a string
+         */
+        inline TextWriter& write(const std::string_view str) {
+            if(STF_EXPECT_FALSE(str.size() > buffer_size_)) {
+                flush();
+                writeAll_(str.data(), str.size());
+                return *this;
+            }
+
+            memcpy(reserve_(str.size()), str.data(), str.size());
+            commit_(str.size());
+            return *this;
+        }
+
+        /**
+         * Writes alignment spaces. Equivalent to stf::format_utils::formatSpaces.
+         */
+        inline TextWriter& spaces(size_t n) {
+            if(STF_EXPECT_FALSE(!pad_)) {
+                return n ? put(' ') : *this;
+            }
+
+            while(n) {
+                const size_t chunk = std::min(n, SPACES_SIZE_);
+                memcpy(reserve_(chunk), SPACES_.data(), chunk);
+                commit_(chunk);
+                n -= chunk;
+            }
+            return *this;
+        }
+
+        /**
+         * Writes a string, left-justified in a field of the given width. Equivalent to
+         * stf::format_utils::formatLeft.
+         */
+        inline TextWriter& left(const std::string_view str, const int width) {
+            write(str);
+            if(const auto len = static_cast<int>(str.size()); len < width) {
+                spaces(static_cast<size_t>(width - len));
+            }
+            return *this;
+        }
+
+        /**
+         * Writes a zero-filled hex value with at least width digits. Equivalent to stf::format_utils::formatHex.
+         */
+        template<typename T>
+        inline TextWriter& hex(const T value, const int width) {
+            static_assert(std::is_unsigned_v<T>, "TextWriter::hex requires an unsigned type");
+
+            std::array<char, MAX_HEX_DIGITS_> digits;
+            const auto val = static_cast<uint64_t>(value);
+            for(size_t i = 0; i < sizeof(uint64_t); ++i) {
+                const auto idx = 2 * ((val >> (8 * i)) & 0xff);
+                digits[MAX_HEX_DIGITS_ - 2 * i - 2] = HEX_DIGITS_[idx];
+                digits[MAX_HEX_DIGITS_ - 2 * i - 1] = HEX_DIGITS_[idx + 1];
+            }
+
+            const size_t num_digits = val ? MAX_HEX_DIGITS_ - (static_cast<size_t>(__builtin_clzll(val)) >> 2) : 1;
+            const size_t min_digits = static_cast<size_t>(std::max(width, 0));
+
+            if(STF_EXPECT_FALSE(min_digits > MAX_HEX_DIGITS_)) {
+                for(size_t i = MAX_HEX_DIGITS_; i < min_digits; ++i) {
+                    put('0');
+                }
+                return write(std::string_view(digits.data(), MAX_HEX_DIGITS_));
+            }
+
+            const size_t len = std::max(num_digits, min_digits);
+            return write(std::string_view(digits.data() + MAX_HEX_DIGITS_ - len, len));
+        }
+
+        /**
+         * Writes a virtual address. Equivalent to stf::format_utils::formatVA.
+         */
+        inline TextWriter& va(const uint64_t value) {
+            return hex(value, stf::format_utils::VA_WIDTH);
+        }
+
+        /**
+         * Writes a physical address. Equivalent to stf::format_utils::formatPA.
+         */
+        inline TextWriter& pa(const uint64_t value) {
+            return hex(value, stf::format_utils::PA_WIDTH);
+        }
+
+        /**
+         * Writes a decimal value. Equivalent to stf::format_utils::formatDec with no width.
+         */
+        template<typename T>
+        inline TextWriter& dec(const T value) {
+            static_assert(std::is_unsigned_v<T>, "TextWriter::dec requires an unsigned type");
+
+            std::array<char, MAX_DEC_DIGITS_> digits;
+            const size_t len = toDec_(static_cast<uint64_t>(value), digits.data() + MAX_DEC_DIGITS_);
+            return write(std::string_view(digits.data() + MAX_DEC_DIGITS_ - len, len));
+        }
+
+        /**
+         * Writes a decimal value, left-justified in a field of the given width. Equivalent to
+         * stf::format_utils::formatDecLeft.
+         */
+        template<typename T>
+        inline TextWriter& decLeft(const T value, const int width) {
+            static_assert(std::is_unsigned_v<T>, "TextWriter::decLeft requires an unsigned type");
+
+            std::array<char, MAX_DEC_DIGITS_> digits;
+            const size_t len = toDec_(static_cast<uint64_t>(value), digits.data() + MAX_DEC_DIGITS_);
+            return left(std::string_view(digits.data() + MAX_DEC_DIGITS_ - len, len), width);
+        }
+};
@@ -8,11 +8,13 @@ extern "C" {
 #include <cstring>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <vector>
 
 #include "binutils_wrapper.hpp"
 #include "disassemblers/binutils_disassembler.hpp"
+#include "profiling.hpp"
 #include "stf_env_var.hpp"
 #include "stf_exception.hpp"
 #include "format_utils.hpp"
@@ -150,6 +152,12 @@ namespace binutils_wrapper {
 
     class DisassemblerInternals {
         private:
+            /**
+             * BFD reference counting and the libopcodes RISC-V printer both use global state, so every call into
+             * them is serialized. This allows separate disassemblers to be used from different threads.
+             */
+            static inline std::mutex libopcodes_mutex_;
+
             /**
              * \class UnTabStream
              * \brief Stream class that transforms tabs into spaces
@@ -332,6 +340,8 @@ namespace binutils_wrapper {
 
             static inline disassembler_ftype initDisasmFunc_(const std::string& elf,
                                                              const char* default_isa) {
+                const std::lock_guard<std::mutex> lock(libopcodes_mutex_);
+
                 std::string isa_str;
                 if(!elf.empty()) {
                     try {
@@ -371,6 +381,8 @@ namespace binutils_wrapper {
                                   const bool use_aliases) :
                 disasm_func_(initDisasmFunc_(elf, default_isa))
             {
+                const std::lock_guard<std::mutex> lock(libopcodes_mutex_);
+
                 init_disassemble_info (
                     &dis_info_,
                     0,
@@ -392,6 +404,8 @@ namespace binutils_wrapper {
             bool disassemble(std::ostream& os,
                              const uint64_t pc,
                              const uint32_t opcode) const {
+                const std::lock_guard<std::mutex> lock(libopcodes_mutex_);
+
                 dismStr_.reset(os);
                 opcode_pc_ = pc;
                 copyU32_(opcode_mem_, opcode);
@@ -413,17 +427,24 @@ namespace stf {
         }
 
         BinutilsDisassembler::~BinutilsDisassembler() {
+            // Every stf_dump -j worker owns a disassembler, so only the first one to finish reports the problem
+            static std::once_flag unknown_disasm_warning;
             if(unknown_disasm_) {
-                std::cerr << "One or more unknown instructions were encountered. "
-                             "Try running again with a different ISA string specified in STF_DISASM_ISA. "
-                             "Alternatively, you can try STF_DISASM=MAVIS" << std::endl;
+                std::call_once(unknown_disasm_warning, []() {
+                    std::cerr << "One or more unknown instructions were encountered. "
+                                 "Try running again with a different ISA string specified in STF_DISASM_ISA. "
+                                 "Alternatively, you can try STF_DISASM=MAVIS" << std::endl;
+                });
             }
         }
 
         void BinutilsDisassembler::printDisassembly_(std::ostream& os,
                                                      const uint64_t pc,
                                                      const uint32_t opcode) const {
-            unknown_disasm_ |= dis_->disassemble(os, pc, opcode);
+            cache_.print(os, pc, opcode, [this, pc, opcode](std::ostream& render_os) {
+                TRACE_TOOLS_PROFILE_SCOPE("disasm.binutils");
+                unknown_disasm_ |= dis_->disassemble(render_os, pc, opcode);
+            });
         }
 
     }
@@ -1,13 +1,12 @@
 #include <iostream>
-#include <map>
 
-#include "format_utils.hpp"
 #include "stf_inst_reader.hpp"
 #include "stf_reader.hpp"
 #include "stf_record_types.hpp"
 
 #include "command_line_parser.hpp"
 #include "file_utils.hpp"
+#include "stf_address_map.hpp"
 #include "tools_util.hpp"
 
 /**
@@ -55,28 +54,6 @@ void parseCommandLine(int argc,
     parser.getPositionalArgument(0, trace_filename);
 }
 
-struct MemAccessCount {
-    uint64_t reads = 0;
-    uint64_t writes = 0;
-};
-
-using AddressMap = std::map<uint64_t, MemAccessCount>;
-
-inline void countAddress(AddressMap& address_map, const stf::InstMemAccessRecord& mem_rec, const uint64_t address_mask) {
-    auto& count = address_map[mem_rec.getAddress() & address_mask];
-
-    if(mem_rec.getType() == stf::INST_MEM_ACCESS::READ) {
-        ++count.reads;
-    }
-    else if(mem_rec.getType() == stf::INST_MEM_ACCESS::WRITE) {
-        ++count.writes;
-    }
-}
-
-inline void countPC(AddressMap& address_map, const uint64_t pc, const uint64_t address_mask) {
-    ++address_map[pc & address_mask].reads;
-}
-
 int main(int argc, char** argv) {
     std::string trace_filename;
     std::string output_filename = "-";
@@ -144,26 +121,7 @@ int main(int argc, char** argv) {
         }
     }
 
-    static constexpr int COLUMN_WIDTH = 20;
-    stf::format_utils::formatLeft(output_file, "Address", COLUMN_WIDTH);
-    stf::format_utils::formatLeft(output_file, "Reads", COLUMN_WIDTH);
-    stf::format_utils::formatLeft(output_file, "Writes", COLUMN_WIDTH);
-    stf::format_utils::formatLeft(output_file, "Total", COLUMN_WIDTH);
-    output_file << std::endl;
-    for(const auto& p: address_map) {
-        const auto reads = p.second.reads;
-        const auto writes = p.second.writes;
-        const auto total = reads + writes;
-        if(total < min_accesses) {
-            continue;
-        }
-        stf::format_utils::formatHex(output_file, p.first);
-        stf::format_utils::formatSpaces(output_file, 4);
-        stf::format_utils::formatDecLeft(output_file, reads, COLUMN_WIDTH);
-        stf::format_utils::formatDecLeft(output_file, writes, COLUMN_WIDTH);
-        stf::format_utils::formatDecLeft(output_file, total, COLUMN_WIDTH);
-        output_file << std::endl;
-    }
+    printAddressMap(output_file, address_map, min_accesses);
 
     return 0;
 }
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+#include "format_utils.hpp"
+#include "stf_record_types.hpp"
+
+#include "file_utils.hpp"
+
+struct MemAccessCount {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+};
+
+using AddressMap = std::map<uint64_t, MemAccessCount>;
+
+inline void countAddress(AddressMap& address_map, const stf::InstMemAccessRecord& mem_rec, const uint64_t address_mask) {
+    auto& count = address_map[mem_rec.getAddress() & address_mask];
+
+    if(mem_rec.getType() == stf::INST_MEM_ACCESS::READ) {
+        ++count.reads;
+    }
+    else if(mem_rec.getType() == stf::INST_MEM_ACCESS::WRITE) {
+        ++count.writes;
+    }
+}
+
+inline void countPC(AddressMap& address_map, const uint64_t pc, const uint64_t address_mask) {
+    ++address_map[pc & address_mask].reads;
+}
+
+/**
+ * Prints an address map
+ * \param os output stream to use
+ * \param address_map access counts
+ * \param min_accesses only print addresses with at least this many accesses
+ */
+inline void printAddressMap(OutputFileStream& os, const AddressMap& address_map, const uint64_t min_accesses) {
+    static constexpr int COLUMN_WIDTH = 20;
+    stf::format_utils::formatLeft(os, "Address", COLUMN_WIDTH);
+    stf::format_utils::formatLeft(os, "Reads", COLUMN_WIDTH);
+    stf::format_utils::formatLeft(os, "Writes", COLUMN_WIDTH);
+    stf::format_utils::formatLeft(os, "Total", COLUMN_WIDTH);
+    os << std::endl;
+    for(const auto& p: address_map) {
+        const auto reads = p.second.reads;
+        const auto writes = p.second.writes;
+        const auto total = reads + writes;
+        if(total < min_accesses) {
+            continue;
+        }
+        stf::format_utils::formatHex(os, p.first);
+        stf::format_utils::formatSpaces(os, 4);
+        stf::format_utils::formatDecLeft(os, reads, COLUMN_WIDTH);
+        stf::format_utils::formatDecLeft(os, writes, COLUMN_WIDTH);
+        stf::format_utils::formatDecLeft(os, total, COLUMN_WIDTH);
+        os << std::endl;
+    }
+}
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "analysis.hpp"
+#include "file_utils.hpp"
+#include "stf_decoder.hpp"
+#include "tools_util.hpp"
+
+#include "stf_address_map.hpp"
+#include "stf_branch_classify.hpp"
+#include "stf_count.hpp"
+#include "stf_function_histogram.hpp"
+#include "stf_imem.hpp"
+#include "stf_imix.hpp"
+
+/**
+ * \class CountAnalysis
+ * \brief Runs stf_count
+ */
+class CountAnalysis : public Analysis {
+    private:
+        STFRecordCounter counter_;
+        bool user_mode_only_ = false;
+        bool in_user_code_ = false;
+
+        static uint64_t getCSVInterval_(const AnalysisOptions& options) {
+            uint64_t csv_interval = 0;
+            options.getValue("i", csv_interval);
+            return csv_interval;
+        }
+
+    public:
+        explicit CountAnalysis(const AnalysisOptions& options) :
+            Analysis(ON_INST),
+            counter_(options.hasOption("v"),
+                     options.hasOption("S"),
+                     options.hasOption("c"),
+                     // If we aren't doing interval dumps, the CSV should always be cumulative
+                     options.hasOption("C") || !getCSVInterval_(options),
+                     getCSVInterval_(options))
+        {
+            options.assertCondition(!(options.hasOption("c") && options.hasOption("v")), "c and v are mutually exclusive");
+            options.assertCondition(!options.hasOption("C") || options.hasOption("c"), "C requires c");
+        }
+
+        void begin(const AnalysisContext& context) final {
+            user_mode_only_ = context.skip_non_user;
+            // Matches STFFilter, which starts out in user code when only user-mode instructions are read
+            in_user_code_ = context.skip_non_user;
+        }
+
+        void onInst(const stf::STFInst& inst) final {
+            counter_.count(inst, inst.isFault(), in_user_code_);
+            in_user_code_ = user_mode_only_ || (!inst.isChangeFromUserMode() && (in_user_code_ || inst.isChangeToUserMode()));
+        }
+
+        void end() final {
+            counter_.finished();
+        }
+};
+
+/**
+ * \class IMixAnalysis
+ * \brief Runs stf_imix
+ */
+class IMixAnalysis : public Analysis {
+    private:
+        std::string output_filename_ = "-";
+        const bool sorted_;
+        const bool by_mnemonic_;
+        const bool by_isa_ext_;
+        stf::INST_IEM iem_ = stf::INST_IEM::STF_INST_IEM_INVALID;
+        IMixCounter imix_;
+
+    public:
+        explicit IMixAnalysis(const AnalysisOptions& options) :
+            Analysis(ON_INST),
+            sorted_(options.hasOption("s")),
+            by_mnemonic_(options.hasOption("m")),
+            by_isa_ext_(options.hasOption("e"))
+        {
+            options.getValue("o", output_filename_);
+            options.assertCondition(!(by_mnemonic_ && by_isa_ext_), "m and e are mutually exclusive");
+        }
+
+        void begin(const AnalysisContext& context) final {
+            iem_ = context.iem;
+        }
+
+        void onInst(const stf::STFInst& inst) final {
+            if(STF_EXPECT_TRUE(!inst.isFault())) {
+                imix_.count(inst.opcode());
+            }
+        }
+
+        void end() final {
+            OutputFileStream output_file(output_filename_);
+            stf::STFDecoder decoder(iem_);
+            imix_.print(output_file, decoder, sorted_, by_mnemonic_, by_isa_ext_);
+        }
+};
+
+/**
+ * \class BranchClassifyAnalysis
+ * \brief Runs stf_branch_classify
+ */
+class BranchClassifyAnalysis : public Analysis {
+    private:
+        const bool verbose_;
+        const bool only_taken_;
+        const bool only_dynamic_;
+        BranchClassifier classifier_;
+
+    public:
+        explicit BranchClassifyAnalysis(const AnalysisOptions& options) :
+            Analysis(ON_BRANCH),
+            verbose_(options.hasOption("v")),
+            only_taken_(options.hasOption("t")),
+            only_dynamic_(options.hasOption("d"))
+        {
+        }
+
+        void onBranch(const stf::STFInst&, const AnalysisBranch& branch) final {
+            classifier_.count(branch);
+        }
+
+        void end() final {
+            classifier_.print(verbose_, only_taken_, only_dynamic_);
+        }
+};
+
+/**
+ * \class AddressMapAnalysis
+ * \brief Runs stf_address_map
+ */
+class AddressMapAnalysis : public Analysis {
+    private:
+        std::string output_filename_ = "-";
+        uint64_t address_mask_ = std::numeric_limits<uint64_t>::max();
+        uint64_t min_accesses_ = 0;
+        AddressMap address_map_;
+
+        static uint32_t getHooks_(const AnalysisOptions& options) {
+            const bool only_instruction_pc = options.hasOption("I");
+            const bool include_instruction_pc = only_instruction_pc || options.hasOption("i");
+            return (only_instruction_pc ? 0 : ON_MEM_ACCESS) | (include_instruction_pc ? ON_INST : 0);
+        }
+
+    public:
+        explicit AddressMapAnalysis(const AnalysisOptions& options) :
+            Analysis(getHooks_(options))
+        {
+            uint64_t alignment = 1;
+            options.getValue("o", output_filename_);
+            options.getValue("a", alignment);
+            options.getValue("m", min_accesses_);
+            options.assertCondition(alignment != 0, "a must be nonzero");
+            address_mask_ <<= log2(alignment);
+        }
+
+        void onInst(const stf::STFInst& inst) final {
+            countPC(address_map_, inst.pc(), address_mask_);
+        }
+
+        void onMemAccess(const stf::STFInst&, const stf::InstMemAccessRecord& access_rec) final {
+            countAddress(address_map_, access_rec, address_mask_);
+        }
+
+        void end() final {
+            OutputFileStream output_file(output_filename_);
+            printAddressMap(output_file, address_map_, min_accesses_);
+        }
+};
+
+/**
+ * \class FunctionHistogramAnalysis
+ * \brief Runs stf_function_histogram
+ */
+class FunctionHistogramAnalysis : public Analysis {
+    private:
+        std::string elf_;
+        std::unique_ptr<SymbolHistogram> hist_;
+
+    public:
+        explicit FunctionHistogramAnalysis(const AnalysisOptions& options) :
+            Analysis(ON_INST)
+        {
+            options.getValue("E", elf_);
+        }
+
+        void begin(const AnalysisContext& context) final {
+            hist_ = std::make_unique<SymbolHistogram>(elf_.empty() ? findElfFromTrace(context.trace_filename) : elf_);
+        }
+
+        void onInst(const stf::STFInst& inst) final {
+            hist_->count(inst.pc());
+        }
+
+        void end() final {
+            hist_->dump();
+        }
+};
+
+/**
+ * \class IMemAnalysis
+ * \brief Runs stf_imem
+ */
+class IMemAnalysis : public Analysis {
+    private:
+        STFImemConfig config_;
+        std::unique_ptr<IMemMapVec> imem_mapvec_;
+        bool done_ = false;
+
+    public:
+        explicit IMemAnalysis(const AnalysisOptions& options) :
+            Analysis(ON_INST)
+        {
+            config_.use_aliases = options.hasOption("A");
+            options.getValue("s", config_.skip_count);
+            config_.java_trace = options.hasOption("j");
+            options.getValue("c", config_.g_hw_tid);
+            options.getValue("g", config_.g_pid);
+            options.getValue("t", config_.g_tid);
+            config_.show_percentage = options.hasOption("p");
+            config_.show_physpc = options.hasOption("P");
+            const bool has_r = options.getValue("r", config_.keep_count);
+
+            // Same order as stf_imem, so the run length does not include the warmup
+            if(has_r) {
+                config_.runlength_count = config_.keep_count - config_.warmup_count;
+            }
+
+            const bool has_w = options.getValue("w", config_.warmup_count);
+            config_.track = has_r || has_w;
+            config_.local_history = options.hasOption("l");
+            config_.output_filename = "-";
+            options.getValue("o", config_.output_filename);
+            config_.sort_output = options.hasOption("S");
+
+            if(config_.java_trace) {
+                imem_mapvec_ = std::make_unique<JavaIMem>();
+            }
+            else {
+                imem_mapvec_ = std::make_unique<IMem>();
+            }
+        }
+
+        void begin(const AnalysisContext& context) final {
+            config_.trace_filename = context.trace_filename;
+            config_.skip_non_user = context.skip_non_user;
+            imem_mapvec_->init(context.isa, context.iem);
+        }
+
+        void onInst(const stf::STFInst& inst) final {
+            if(STF_EXPECT_TRUE(!done_)) {
+                done_ = !imem_mapvec_->processInst(config_, inst);
+            }
+        }
+
+        void end() final {
+            imem_mapvec_->print(config_);
+        }
+};
+
+/**
+ * Registers every built-in analysis
+ */
+inline void registerAnalyses(AnalysisRegistry& registry) {
+    registry.add<AddressMapAnalysis>("address_map",
+                                     "stf_address_map. Options: o=<file>, a=<alignment>, m=<min accesses>, i, I");
+    registry.add<BranchClassifyAnalysis>("branch_classify",
+                                         "stf_branch_classify. Options: v, t, d");
+    registry.add<CountAnalysis>("count",
+                                "stf_count. Options: v, S, c, C, i=<interval>");
+    registry.add<FunctionHistogramAnalysis>("function_histogram",
+                                            "stf_function_histogram. Options: E=<elf>");
+    registry.add<IMemAnalysis>("imem",
+                               "stf_imem. Options: o=<file>, s=<n>, w=<n>, r=<n>, t=<tid>, g=<pid>, c=<hwtid>, p, A, P, S, l, j");
+    registry.add<IMixAnalysis>("imix",
+                               "stf_imix. Options: o=<file>, s, m, e");
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stf_enums.hpp"
+#include "stf_inst.hpp"
+#include "stf_record_types.hpp"
+
+#include "command_line_parser.hpp"
+#include "tools_util.hpp"
+
+/**
+ * \class AnalysisBranch
+ * \brief Branch information that the driver derives from an instruction
+ *
+ * Provides the same accessors as stf::STFBranch, so code written against the branch reader can also be
+ * used from an Analysis.
+ */
+class AnalysisBranch {
+    private:
+        uint64_t pc_ = 0;
+        uint64_t target_ = 0;
+        bool taken_ = false;
+        bool conditional_ = false;
+        bool indirect_ = false;
+        bool call_ = false;
+        bool return_ = false;
+
+    public:
+        AnalysisBranch() = default;
+
+        /**
+         * Constructs an AnalysisBranch
+         * \param pc Branch PC
+         * \param target Target PC. For a not-taken branch this is the target it would have jumped to.
+         * \param taken If true, the branch was taken
+         * \param conditional If true, the branch is conditional
+         * \param indirect If true, the branch is indirect
+         * \param call If true, the branch is a call
+         * \param ret If true, the branch is a return
+         */
+        AnalysisBranch(const uint64_t pc,
+                       const uint64_t target,
+                       const bool taken,
+                       const bool conditional,
+                       const bool indirect,
+                       const bool call,
+                       const bool ret) :
+            pc_(pc),
+            target_(target),
+            taken_(taken),
+            conditional_(conditional),
+            indirect_(indirect),
+            call_(call),
+            return_(ret)
+        {
+        }
+
+        inline uint64_t getPC() const {
+            return pc_;
+        }
+
+        inline uint64_t getTargetPC() const {
+            return target_;
+        }
+
+        inline bool isTaken() const {
+            return taken_;
+        }
+
+        inline bool isConditional() const {
+            return conditional_;
+        }
+
+        inline bool isIndirect() const {
+            return indirect_;
+        }
+
+        inline bool isCall() const {
+            return call_;
+        }
+
+        inline bool isReturn() const {
+            return return_;
+        }
+
+        inline bool isBackwards() const {
+            return target_ < pc_;
+        }
+};
+
+/**
+ * \struct AnalysisContext
+ * \brief Trace-wide information passed to Analysis::begin()
+ */
+struct AnalysisContext {
+    std::string trace_filename;                                     /**< Trace being analyzed */
+    stf::ISA isa = stf::ISA::RESERVED;                              /**< Instruction set of the trace */
+    stf::INST_IEM iem = stf::INST_IEM::STF_INST_IEM_INVALID;        /**< Initial instruction encoding mode */
+    bool skip_non_user = false;                                     /**< If true, non-user mode instructions are skipped */
+};
+
+/**
+ * \class AnalysisOptions
+ * \brief Options for a single analysis
+ *
+ * Given on the command line as name[:option[,option...]], where each option is either a flag or key=value.
+ * Option names match the flags of the standalone tool the analysis comes from wherever possible.
+ */
+class AnalysisOptions {
+    private:
+        const trace_tools::CommandLineParser& parser_;
+        std::string name_;
+        std::map<std::string, std::string, std::less<>> options_;
+        mutable std::set<std::string, std::less<>> used_;
+
+    public:
+        /**
+         * Parses an analysis specification
+         * \param parser Parser used to report invalid options
+         * \param spec Specification in name[:option[,option...]] form
+         */
+        AnalysisOptions(const trace_tools::CommandLineParser& parser, const std::string_view spec) :
+            parser_(parser)
+        {
+            const auto colon = spec.find(':');
+            name_ = spec.substr(0, colon);
+            parser_.assertCondition(!name_.empty(), "Invalid analysis specification: ", spec);
+
+            if(colon == std::string_view::npos) {
+                return;
+            }
+
+            auto remaining = spec.substr(colon + 1);
+            while(!remaining.empty()) {
+                const auto comma = remaining.find(',');
+                const auto option = remaining.substr(0, comma);
+                const auto equals = option.find('=');
+                std::string key(option.substr(0, equals));
+                std::string value(equals == std::string_view::npos ? std::string_view() : option.substr(equals + 1));
+                parser_.assertCondition(!key.empty(), "Invalid option for analysis ", name_, ": ", option);
+                parser_.assertCondition(options_.emplace(std::move(key), std::move(value)).second,
+                                        "Option specified more than once for analysis ",
+                                        name_,
+                                        ": ",
+                                        option);
+                remaining = comma == std::string_view::npos ? std::string_view() : remaining.substr(comma + 1);
+            }
+        }
+
+        inline const std::string& getName() const {
+            return name_;
+        }
+
+        /**
+         * Checks whether an option was given
+         */
+        inline bool hasOption(const std::string_view key) const {
+            const auto it = options_.find(key);
+            if(it == options_.end()) {
+                return false;
+            }
+            used_.emplace(it->first);
+            return true;
+        }
+
+        /**
+         * Gets the value of a string option
+         * \returns true if the option was given
+         */
+        inline bool getValue(const std::string_view key, std::string& value) const {
+            if(!hasOption(key)) {
+                return false;
+            }
+            value = options_.find(key)->second;
+            parser_.assertCondition(!value.empty(), "Option ", key, " for analysis ", name_, " requires a value");
+            return true;
+        }
+
+        /**
+         * Gets the value of an integer option
+         * \returns true if the option was given
+         */
+        template<typename T>
+        inline bool getValue(const std::string_view key, T& value) const {
+            std::string str;
+            if(!getValue(key, str)) {
+                return false;
+            }
+            try {
+                value = parseInt<T>(str);
+            }
+            catch(const std::logic_error&) {
+                parser_.raiseErrorWithHelp("Invalid value for option " + std::string(key) + " of analysis " + name_ + ": " + str);
+            }
+            return true;
+        }
+
+        /**
+         * Reports an error if any option was not used by the analysis
+         */
+        void checkAllUsed() const {
+            for(const auto& p: options_) {
+                parser_.assertCondition(used_.count(p.first), "Unknown option for analysis ", name_, ": ", p.first);
+            }
+        }
+
+        /**
+         * Reports an error if a condition does not hold
+         */
+        template<typename ... MsgArgs>
+        inline void assertCondition(const bool cond, MsgArgs&&... msg_args) const {
+            parser_.assertCondition(cond, name_, ": ", std::forward<MsgArgs>(msg_args)...);
+        }
+};
+
+/**
+ * \class Analysis
+ * \brief Base class for an analysis run by stf_analyze
+ *
+ * The driver reads and decodes the trace once and calls the hooks of every enabled analysis. An analysis
+ * only receives the hooks it asks for in its constructor. Every hook of a single analysis is always called
+ * from the same thread, but different analyses may run on different threads, so analyses must not share
+ * mutable state. begin() and end() are always called from the main thread, one analysis at a time.
+ */
+class Analysis {
+    public:
+        static constexpr uint32_t ON_INST = 1 << 0;         /**< Call onInst() for every instruction */
+        static constexpr uint32_t ON_BRANCH = 1 << 1;       /**< Call onBranch() for every non-faulting branch */
+        static constexpr uint32_t ON_MEM_ACCESS = 1 << 2;   /**< Call onMemAccess() for every memory access */
+
+    private:
+        const uint32_t hooks_;
+
+    public:
+        /**
+         * Constructs an Analysis
+         * \param hooks Bitmask of the hooks the analysis needs
+         */
+        explicit Analysis(const uint32_t hooks) :
+            hooks_(hooks)
+        {
+        }
+
+        virtual ~Analysis() = default;
+
+        inline bool hasHook(const uint32_t hook) const {
+            return hooks_ & hook;
+        }
+
+        /**
+         * Called once before the first instruction
+         */
+        virtual void begin(const AnalysisContext&) {}
+
+        /**
+         * Called for every instruction, including faulting instructions
+         */
+        virtual void onInst(const stf::STFInst&) {}
+
+        /**
+         * Called for every non-faulting branch, after onInst()
+         */
+        virtual void onBranch(const stf::STFInst&, const AnalysisBranch&) {}
+
+        /**
+         * Called for every memory access, after onInst()
+         */
+        virtual void onMemAccess(const stf::STFInst&, const stf::InstMemAccessRecord&) {}
+
+        /**
+         * Called once after the last instruction. Reports the results of the analysis.
+         */
+        virtual void end() {}
+};
+
+/**
+ * \class AnalysisRegistry
+ * \brief Maps analysis names to factories
+ */
+class AnalysisRegistry {
+    public:
+        using Factory = std::function<std::unique_ptr<Analysis>(const AnalysisOptions&)>;
+
+    private:
+        struct Entry_ {
+            std::string description;
+            Factory factory;
+        };
+
+        std::map<std::string, Entry_, std::less<>> entries_;
+
+    public:
+        /**
+         * Registers an analysis
+         * \param name Name used to enable the analysis on the command line
+         * \param description Description of the analysis and its options
+         * \param factory Creates the analysis from its options
+         */
+        void add(const std::string& name, const std::string& description, Factory factory) {
+            stf_assert(entries_.emplace(name, Entry_{description, std::move(factory)}).second,
+                       "Analysis " << name << " was registered more than once");
+        }
+
+        /**
+         * Registers an analysis that is constructed directly from its options
+         * \param name Name used to enable the analysis on the command line
+         * \param description Description of the analysis and its options
+         */
+        template<typename AnalysisType>
+        void add(const std::string& name, const std::string& description) {
+            add(name, description, [](const AnalysisOptions& options) { return std::make_unique<AnalysisType>(options); });
+        }
+
+        /**
+         * Creates an analysis
+         * \param options Parsed analysis specification
+         * \returns The analysis, or nullptr if no analysis with that name is registered
+         */
+        std::unique_ptr<Analysis> create(const AnalysisOptions& options) const {
+            const auto it = entries_.find(options.getName());
+            if(it == entries_.end()) {
+                return nullptr;
+            }
+            auto analysis = it->second.factory(options);
+            options.checkAllUsed();
+            return analysis;
+        }
+
+        /**
+         * Formats the name and description of every registered analysis
+         */
+        void describe(std::ostream& os) const {
+            for(const auto& p: entries_) {
+                os << "    " << p.first << ": " << p.second.description << std::endl;
+            }
+        }
+};
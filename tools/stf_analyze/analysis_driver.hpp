@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stf_inst_reader.hpp"
+
+#include "analysis.hpp"
+#include "batch_buffer.hpp"
+#include "pc_table.hpp"
+#include "stf_decoder.hpp"
+
+/**
+ * \class StaticBranchCache
+ * \brief Classifies branches by PC, decoding each static instruction only once
+ */
+class StaticBranchCache {
+    private:
+        struct Entry_ {
+            uint32_t opcode = 0;
+            bool decoded = false;
+            bool is_branch = false;
+            bool conditional = false;
+            bool indirect = false;
+            bool call = false;
+            bool ret = false;
+            int64_t offset = 0;
+        };
+
+        stf::STFDecoder decoder_;
+        PCTable<Entry_> entries_;
+
+        inline bool writesLinkRegister_() const {
+            return decoder_.hasDestRegister(stf::Registers::STF_REG::STF_REG_X1) ||
+                   decoder_.hasDestRegister(stf::Registers::STF_REG::STF_REG_X5);
+        }
+
+        inline bool readsLinkRegister_() const {
+            return decoder_.hasSourceRegister(stf::Registers::STF_REG::STF_REG_X1) ||
+                   decoder_.hasSourceRegister(stf::Registers::STF_REG::STF_REG_X5);
+        }
+
+        void decode_(Entry_& entry, const uint32_t opcode) {
+            entry = Entry_();
+            entry.opcode = opcode;
+            entry.decoded = true;
+
+            decoder_.decode(opcode);
+            entry.is_branch = decoder_.isBranch();
+            if(!entry.is_branch) {
+                return;
+            }
+
+            // Follows the RISC-V calling convention: calls link through x1 or x5, returns jump through
+            // either of them without linking
+            entry.conditional = decoder_.isConditional();
+            entry.indirect = decoder_.isJalr();
+            entry.call = writesLinkRegister_();
+            entry.ret = entry.indirect && !entry.call && readsLinkRegister_();
+            if(!entry.indirect) {
+                entry.offset = decoder_.getSignedImmediate();
+            }
+        }
+
+    public:
+        /**
+         * Constructs a StaticBranchCache
+         * \param iem Instruction encoding mode used to decode instructions
+         */
+        explicit StaticBranchCache(const stf::INST_IEM iem) :
+            decoder_(iem)
+        {
+        }
+
+        /**
+         * Classifies an instruction
+         * \param inst Instruction to classify
+         * \param branch Filled in if the instruction is a branch
+         * \returns true if the instruction is a branch
+         */
+        inline bool lookup(const stf::STFInst& inst, AnalysisBranch& branch) {
+            auto& entry = entries_[inst.pc()];
+            // Re-decode if the code at this PC changed
+            if(STF_EXPECT_FALSE(!entry.decoded || entry.opcode != inst.opcode())) {
+                decode_(entry, inst.opcode());
+            }
+
+            if(STF_EXPECT_TRUE(!entry.is_branch)) {
+                return false;
+            }
+
+            const bool taken = inst.isTakenBranch();
+            uint64_t target = 0;
+            if(taken) {
+                target = inst.branchTarget();
+            }
+            else if(!entry.indirect) {
+                target = inst.pc() + static_cast<uint64_t>(entry.offset);
+            }
+
+            branch = AnalysisBranch(inst.pc(), target, taken, entry.conditional, entry.indirect, entry.call, entry.ret);
+            return true;
+        }
+};
+
+/**
+ * \class AnalysisDispatcher
+ * \brief Calls the hooks of a set of analyses for each instruction
+ */
+class AnalysisDispatcher {
+    private:
+        std::vector<Analysis*> inst_analyses_;
+        std::vector<Analysis*> branch_analyses_;
+        std::vector<Analysis*> mem_access_analyses_;
+
+    public:
+        /**
+         * Adds an analysis. Only the hooks the analysis asked for are called.
+         */
+        void add(Analysis& analysis) {
+            if(analysis.hasHook(Analysis::ON_INST)) {
+                inst_analyses_.emplace_back(&analysis);
+            }
+            if(analysis.hasHook(Analysis::ON_BRANCH)) {
+                branch_analyses_.emplace_back(&analysis);
+            }
+            if(analysis.hasHook(Analysis::ON_MEM_ACCESS)) {
+                mem_access_analyses_.emplace_back(&analysis);
+            }
+        }
+
+        /**
+         * Dispatches an instruction
+         * \param inst Instruction
+         * \param branch Branch information, or nullptr if the instruction is not a non-faulting branch
+         */
+        inline void dispatch(const stf::STFInst& inst, const AnalysisBranch* branch) {
+            for(auto* analysis: inst_analyses_) {
+                analysis->onInst(inst);
+            }
+
+            if(branch) {
+                for(auto* analysis: branch_analyses_) {
+                    analysis->onBranch(inst, *branch);
+                }
+            }
+
+            if(!mem_access_analyses_.empty()) {
+                for(const auto& access: inst.getMemoryAccesses()) {
+                    const auto& access_rec = access.getAccessRecord();
+                    for(auto* analysis: mem_access_analyses_) {
+                        analysis->onMemAccess(inst, access_rec);
+                    }
+                }
+            }
+        }
+};
+
+/**
+ * \class AnalysisDriver
+ * \brief Reads a trace once and runs every enabled analysis over it
+ *
+ * In serial mode every hook is called from the reading thread. In threaded mode each analysis runs on its own
+ * thread. The reading thread copies each instruction, along with its branch classification, into a shared
+ * batch that every analysis thread reads but none modify, so the trace is still only read and decoded once.
+ */
+class AnalysisDriver {
+    public:
+        /**
+         * \struct Config
+         * \brief Driver options
+         */
+        struct Config {
+            std::string trace_filename;     /**< Trace to analyze */
+            bool skip_non_user = false;     /**< If true, skip non-user mode instructions */
+            uint64_t skip_count = 0;        /**< Skip this many instructions before analyzing */
+            uint64_t max_insts = 0;         /**< Analyze at most this many instructions (0 = unlimited) */
+            bool threaded = false;          /**< If true, run each analysis on its own thread */
+            size_t batch_size = 4096;       /**< Number of instructions per batch in threaded mode */
+        };
+
+    private:
+        static constexpr size_t NUM_BATCH_SLOTS_ = 8;
+
+        /**
+         * \struct DecodedInst_
+         * \brief Instruction shared with the analysis threads
+         */
+        struct DecodedInst_ {
+            stf::STFInst inst;
+            bool is_branch = false;
+            AnalysisBranch branch;
+        };
+
+        using InstBatchBuffer = BatchBuffer<DecodedInst_>;
+
+        std::vector<std::unique_ptr<Analysis>> analyses_;
+        uint64_t num_insts_ = 0;
+
+        bool needsBranches_() const {
+            for(const auto& analysis: analyses_) {
+                if(analysis->hasHook(Analysis::ON_BRANCH)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Calls callback(inst, branch) on every instruction in the configured range
+         */
+        template<typename Callback>
+        void readTrace_(stf::STFInstReader& reader, const Config& config, Callback&& callback) {
+            const bool needs_branches = needsBranches_();
+            StaticBranchCache branch_cache(reader.getInitialIEM());
+            AnalysisBranch branch;
+
+            for(auto it = reader.begin(config.skip_count);
+                it != reader.end() && (!config.max_insts || num_insts_ < config.max_insts);
+                ++it, ++num_insts_) {
+                const auto& inst = *it;
+                const bool is_branch = needs_branches && !inst.isFault() && branch_cache.lookup(inst, branch);
+                callback(inst, is_branch ? &branch : nullptr);
+            }
+        }
+
+        void runSerial_(stf::STFInstReader& reader, const Config& config) {
+            AnalysisDispatcher dispatcher;
+            for(auto& analysis: analyses_) {
+                dispatcher.add(*analysis);
+            }
+
+            readTrace_(reader,
+                       config,
+                       [&dispatcher](const stf::STFInst& inst, const AnalysisBranch* branch) {
+                           dispatcher.dispatch(inst, branch);
+                       });
+        }
+
+        void runThreaded_(stf::STFInstReader& reader, const Config& config) {
+            InstBatchBuffer buffer(analyses_.size(), NUM_BATCH_SLOTS_, config.batch_size);
+            std::vector<std::exception_ptr> analysis_exceptions(analyses_.size());
+            std::vector<std::thread> threads;
+            threads.reserve(analyses_.size());
+
+            for(size_t i = 0; i < analyses_.size(); ++i) {
+                threads.emplace_back([this, i, &buffer, &analysis_exceptions]() {
+                    AnalysisDispatcher dispatcher;
+                    dispatcher.add(*analyses_[i]);
+                    auto& analysis_exception = analysis_exceptions[i];
+
+                    buffer.consumeAll([&dispatcher, &analysis_exception](const InstBatchBuffer::Batch& batch) {
+                        // Keep draining the buffer after a failure so that the reading thread can finish
+                        if(STF_EXPECT_FALSE(analysis_exception)) {
+                            return;
+                        }
+
+                        try {
+                            for(const auto& decoded: batch) {
+                                dispatcher.dispatch(decoded.inst, decoded.is_branch ? &decoded.branch : nullptr);
+                            }
+                        }
+                        catch(...) {
+                            analysis_exception = std::current_exception();
+                        }
+                    });
+                });
+            }
+
+            std::exception_ptr read_exception;
+            try {
+                auto* batch = &buffer.acquire();
+                readTrace_(reader,
+                           config,
+                           [&buffer, &batch, &config](const stf::STFInst& inst, const AnalysisBranch* branch) {
+                               auto& decoded = batch->emplace_back();
+                               decoded.inst = inst;
+                               decoded.is_branch = branch != nullptr;
+                               if(branch) {
+                                   decoded.branch = *branch;
+                               }
+
+                               if(STF_EXPECT_FALSE(batch->size() == config.batch_size)) {
+                                   buffer.publish();
+                                   batch = &buffer.acquire();
+                               }
+                           });
+
+                if(!batch->empty()) {
+                    buffer.publish();
+                }
+            }
+            catch(...) {
+                read_exception = std::current_exception();
+            }
+
+            // Let the analysis threads drain whatever was published so that they can be joined
+            buffer.finish();
+            for(auto& thread: threads) {
+                thread.join();
+            }
+            // The copied instructions have to be destroyed on the thread that read them
+            buffer.recycleAll();
+
+            if(read_exception) {
+                std::rethrow_exception(read_exception);
+            }
+            for(const auto& analysis_exception: analysis_exceptions) {
+                if(analysis_exception) {
+                    std::rethrow_exception(analysis_exception);
+                }
+            }
+        }
+
+    public:
+        /**
+         * Adds an analysis. Analyses report their results in the order they were added.
+         */
+        void add(std::unique_ptr<Analysis> analysis) {
+            analyses_.emplace_back(std::move(analysis));
+        }
+
+        /**
+         * Runs every analysis over a trace
+         * \param config Driver options
+         */
+        void run(const Config& config) {
+            stf_assert(!analyses_.empty(), "No analyses were enabled");
+            stf_assert(config.batch_size > 0, "Batch size must be greater than 0");
+
+            stf::STFInstReader reader(config.trace_filename, config.skip_non_user);
+
+            AnalysisContext context;
+            context.trace_filename = config.trace_filename;
+            context.isa = reader.getISA();
+            context.iem = reader.getInitialIEM();
+            context.skip_non_user = config.skip_non_user;
+
+            for(auto& analysis: analyses_) {
+                analysis->begin(context);
+            }
+
+            // A single analysis gains nothing from a separate thread
+            if(config.threaded && analyses_.size() > 1) {
+                runThreaded_(reader, config);
+            }
+            else {
+                runSerial_(reader, config);
+            }
+
+            for(auto& analysis: analyses_) {
+                analysis->end();
+            }
+        }
+
+        /**
+         * Gets the number of instructions that were analyzed
+         */
+        inline uint64_t getNumInsts() const {
+            return num_insts_;
+        }
+};
@@ -0,0 +1,89 @@
+// <STF_analyze> -*- C++ -*-
+
+/**
+ * \brief  Runs several trace analyses in a single pass over a trace
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "analyses.hpp"
+#include "analysis.hpp"
+#include "analysis_driver.hpp"
+#include "command_line_parser.hpp"
+
+/**
+ * Parses command line options and creates the enabled analyses
+ * \param argc argc from main
+ * \param argv argv from main
+ * \param registry Registry used to look up analyses
+ * \param config Driver options
+ * \param driver Driver that the enabled analyses are added to
+ */
+void parseCommandLine(int argc,
+                      char** argv,
+                      const AnalysisRegistry& registry,
+                      AnalysisDriver::Config& config,
+                      AnalysisDriver& driver) {
+    trace_tools::CommandLineParser parser("stf_analyze");
+    parser.addMultiFlag('a', "name[:options]", "enable an analysis. Can be specified multiple times.");
+    parser.addFlag('u', "only analyze user-mode instructions");
+    parser.addFlag('s', "N", "skip the first N instructions");
+    parser.addFlag('l', "N", "analyze at most N instructions");
+    parser.addFlag('j', "run each analysis on its own thread");
+    parser.addFlag('b', "N", "number of instructions per batch when running with -j (default 4096)");
+    parser.addPositionalArgument("trace", "trace in STF format");
+    parser.setDependentArgument('b', 'j');
+
+    std::ostringstream ss;
+    ss << "Analyses:" << std::endl;
+    registry.describe(ss);
+    parser.appendHelpText(ss.str());
+    parser.appendHelpText("Analysis options are separated by commas and have the same meaning as the flags of the standalone tool.");
+    parser.appendHelpText("Instruction ranges and user-mode filtering apply to every analysis.");
+    parser.appendHelpText("Example:");
+    parser.appendHelpText("    stf_analyze -a count -a imix:s,o=trace.imix -a branch_classify:d trace.zstf");
+
+    parser.parseArguments(argc, argv);
+
+    config.skip_non_user = parser.hasArgument('u');
+    parser.getArgumentValue('s', config.skip_count);
+    parser.getArgumentValue('l', config.max_insts);
+    config.threaded = parser.hasArgument('j');
+    parser.getArgumentValue('b', config.batch_size);
+    parser.getPositionalArgument(0, config.trace_filename);
+
+    parser.assertCondition(config.batch_size > 0, "-b parameter must be nonzero");
+
+    const auto& specs = parser.getMultipleValueArgument('a');
+    parser.assertCondition(!specs.empty(), "At least one analysis must be enabled with -a");
+
+    for(const auto& spec: specs) {
+        const AnalysisOptions options(parser, spec);
+        auto analysis = registry.create(options);
+        parser.assertCondition(analysis != nullptr, "Unknown analysis: ", options.getName());
+        driver.add(std::move(analysis));
+    }
+}
+
+int main(int argc, char** argv) {
+    AnalysisRegistry registry;
+    registerAnalyses(registry);
+
+    AnalysisDriver::Config config;
+    AnalysisDriver driver;
+
+    try {
+        parseCommandLine(argc, argv, registry, config, driver);
+    }
+    catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
+        std::cerr << e.what() << std::endl;
+        return e.getCode();
+    }
+
+    driver.run(config);
+
+    return 0;
+}
@@ -0,0 +1,387 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/prettywriter.h>
+
+#include "format_utils.hpp"
+#include "stf_exception.hpp"
+
+#include "perf_counters.hpp"
+
+/**
+ * \struct Statistics
+ * \brief Summary statistics over a set of samples
+ */
+struct Statistics {
+    double median = 0;      /**< Median */
+    double mean = 0;        /**< Arithmetic mean */
+    double variance = 0;    /**< Sample variance */
+    double min = 0;         /**< Minimum */
+    double max = 0;         /**< Maximum */
+
+    Statistics() = default;
+
+    /**
+     * Computes statistics
+     * \param samples Samples to summarize
+     */
+    explicit Statistics(std::vector<double> samples) {
+        if(samples.empty()) {
+            return;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        const size_t n = samples.size();
+        const size_t mid = n / 2;
+        median = (n % 2) ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2;
+        mean = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(n);
+        min = samples.front();
+        max = samples.back();
+
+        if(n > 1) {
+            double sum_sq = 0;
+            for(const auto sample: samples) {
+                sum_sq += (sample - mean) * (sample - mean);
+            }
+            variance = sum_sq / static_cast<double>(n - 1);
+        }
+    }
+
+    inline double stddev() const {
+        return std::sqrt(variance);
+    }
+
+    /**
+     * Adds the statistics to a JSON object
+     */
+    template<typename Allocator>
+    void toJSON(rapidjson::Value& object, Allocator& alloc) const {
+        object.AddMember("median", median, alloc);
+        object.AddMember("mean", mean, alloc);
+        object.AddMember("variance", variance, alloc);
+        object.AddMember("stddev", stddev(), alloc);
+        object.AddMember("min", min, alloc);
+        object.AddMember("max", max, alloc);
+    }
+};
+
+/**
+ * \class BenchmarkResult
+ * \brief Times and hardware counter values from every trial of a benchmark
+ */
+class BenchmarkResult {
+    private:
+        std::string name_;
+        std::string unit_;
+        uint64_t num_items_ = 0;
+        std::vector<double> times_;
+        std::vector<PerfCounters::Values> counters_;
+
+    public:
+        /**
+         * Constructs a BenchmarkResult
+         * \param name Benchmark name
+         * \param unit Name of the items the benchmark processes
+         */
+        BenchmarkResult(std::string name, std::string unit) :
+            name_(std::move(name)),
+            unit_(std::move(unit))
+        {
+        }
+
+        /**
+         * Records a trial
+         * \param num_items Number of items processed
+         * \param seconds Elapsed time
+         * \param counters Hardware counter values, or nullptr if they are unavailable
+         */
+        void addTrial(const uint64_t num_items, const double seconds, const PerfCounters::Values* counters) {
+            num_items_ = num_items;
+            times_.emplace_back(seconds);
+            if(counters) {
+                counters_.emplace_back(*counters);
+            }
+        }
+
+        inline const std::string& getName() const {
+            return name_;
+        }
+
+        inline uint64_t getNumItems() const {
+            return num_items_;
+        }
+
+        inline Statistics getTimeStatistics() const {
+            return Statistics(times_);
+        }
+
+        /**
+         * Gets the statistics of a hardware counter, normalized to the number of items
+         * \param idx Index of the counter in PerfCounters::NAMES
+         */
+        Statistics getCounterStatistics(const size_t idx) const {
+            std::vector<double> samples;
+            samples.reserve(counters_.size());
+            for(const auto& values: counters_) {
+                samples.emplace_back(static_cast<double>(values[idx]) / static_cast<double>(std::max(num_items_, uint64_t(1))));
+            }
+            return Statistics(std::move(samples));
+        }
+
+        /**
+         * Prints a one-line summary
+         */
+        void print(std::ostream& os) const {
+            static constexpr int NAME_WIDTH = 28;
+            const auto stats = getTimeStatistics();
+
+            stf::format_utils::formatLeft(os, name_, NAME_WIDTH);
+            os << num_items_ << ' ' << unit_
+               << " in " << stats.median << " s (median, stddev " << stats.stddev() << " s), "
+               << (stats.median > 0 ? static_cast<double>(num_items_) / stats.median : 0) << ' ' << unit_ << "/s";
+
+            if(!counters_.empty()) {
+                const double cycles = getCounterStatistics(0).median;
+                const double insts = getCounterStatistics(1).median;
+                os << ", " << cycles << " cycles/" << unit_ << ", IPC " << (cycles > 0 ? insts / cycles : 0);
+            }
+
+            os << std::endl;
+        }
+
+        /**
+         * Converts the result to a JSON object
+         */
+        template<typename Allocator>
+        rapidjson::Value toJSON(Allocator& alloc) const {
+            rapidjson::Value object(rapidjson::kObjectType);
+            object.AddMember("name", rapidjson::Value(name_.c_str(), alloc).Move(), alloc);
+            object.AddMember("unit", rapidjson::Value(unit_.c_str(), alloc).Move(), alloc);
+            object.AddMember("items", num_items_, alloc);
+
+            const auto stats = getTimeStatistics();
+            rapidjson::Value seconds(rapidjson::kObjectType);
+            stats.toJSON(seconds, alloc);
+            rapidjson::Value samples(rapidjson::kArrayType);
+            for(const auto time: times_) {
+                samples.PushBack(time, alloc);
+            }
+            seconds.AddMember("samples", samples, alloc);
+            object.AddMember("seconds", seconds, alloc);
+            object.AddMember("items_per_second",
+                             stats.median > 0 ? static_cast<double>(num_items_) / stats.median : 0.0,
+                             alloc);
+
+            if(!counters_.empty()) {
+                rapidjson::Value counters(rapidjson::kObjectType);
+                for(size_t i = 0; i < PerfCounters::NUM_COUNTERS; ++i) {
+                    rapidjson::Value counter(rapidjson::kObjectType);
+                    getCounterStatistics(i).toJSON(counter, alloc);
+                    const std::string name(PerfCounters::NAMES[i]);
+                    counters.AddMember(rapidjson::Value(name.c_str(), alloc).Move(), counter, alloc);
+                }
+                // Counter values are per item
+                object.AddMember("counters_per_item", counters, alloc);
+            }
+
+            return object;
+        }
+};
+
+/**
+ * \class BenchmarkSuite
+ * \brief Runs benchmarks with warmup and repeated trials, and collects their results
+ */
+class BenchmarkSuite {
+    private:
+        const size_t num_warmup_;
+        const size_t num_trials_;
+        const std::set<std::string> enabled_;
+        PerfCounters counters_;
+        std::vector<BenchmarkResult> results_;
+
+    public:
+        /**
+         * Constructs a BenchmarkSuite
+         * \param num_warmup Number of untimed runs before the trials
+         * \param num_trials Number of timed trials
+         * \param enabled Names of the benchmarks to run. If empty, every benchmark runs.
+         */
+        BenchmarkSuite(const size_t num_warmup, const size_t num_trials, std::set<std::string> enabled) :
+            num_warmup_(num_warmup),
+            num_trials_(num_trials),
+            enabled_(std::move(enabled))
+        {
+            stf_assert(num_trials_ > 0, "Number of trials must be greater than 0");
+            if(!counters_.available()) {
+                std::cerr << "Hardware performance counters are unavailable. Only times will be reported." << std::endl;
+            }
+        }
+
+        /**
+         * Returns whether a benchmark will run
+         */
+        inline bool enabled(const std::string& name) const {
+            return enabled_.empty() || enabled_.count(name);
+        }
+
+        /**
+         * Runs a benchmark
+         * \param name Benchmark name
+         * \param unit Name of the items the benchmark processes
+         * \param func Runs a single trial and returns the number of items it processed
+         */
+        template<typename Func>
+        void run(const std::string& name, const std::string& unit, Func&& func) {
+            if(!enabled(name)) {
+                return;
+            }
+
+            for(size_t i = 0; i < num_warmup_; ++i) {
+                func();
+            }
+
+            BenchmarkResult result(name, unit);
+            for(size_t i = 0; i < num_trials_; ++i) {
+                counters_.start();
+                const auto start = std::chrono::steady_clock::now();
+                const uint64_t num_items = func();
+                const auto end = std::chrono::steady_clock::now();
+                const auto values = counters_.stop();
+                result.addTrial(num_items,
+                                std::chrono::duration<double>(end - start).count(),
+                                counters_.available() ? &values : nullptr);
+            }
+
+            result.print(std::cout);
+            results_.emplace_back(std::move(result));
+        }
+
+        /**
+         * Writes every result as JSON
+         * \param os Stream to write to
+         * \param trace Trace the benchmarks were run on
+         */
+        void writeJSON(std::ostream& os, const std::string& trace) const {
+            rapidjson::Document d(rapidjson::kObjectType);
+            auto& d_alloc = d.GetAllocator();
+
+            d.AddMember("trace", rapidjson::Value(trace.c_str(), d_alloc).Move(), d_alloc);
+            d.AddMember("warmup", static_cast<uint64_t>(num_warmup_), d_alloc);
+            d.AddMember("trials", static_cast<uint64_t>(num_trials_), d_alloc);
+            d.AddMember("hardware_counters", counters_.available(), d_alloc);
+
+            rapidjson::Value benchmarks(rapidjson::kArrayType);
+            for(const auto& result: results_) {
+                benchmarks.PushBack(result.toJSON(d_alloc), d_alloc);
+            }
+            d.AddMember("benchmarks", benchmarks, d_alloc);
+
+            rapidjson::OStreamWrapper osw(os);
+            rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(osw);
+            d.Accept(writer);
+            os << std::endl;
+        }
+};
+
+/**
+ * Loads the median time per item of every benchmark in a JSON result file
+ */
+inline std::map<std::string, double> loadBenchmarkResults(const std::string& filename) {
+    std::ifstream json_stream(filename);
+    stf_assert(json_stream, "Failed to open " << filename);
+
+    rapidjson::IStreamWrapper isw(json_stream);
+    rapidjson::Document d;
+    d.ParseStream(isw);
+    stf_assert(!d.HasParseError() && d.IsObject() && d.HasMember("benchmarks") && d["benchmarks"].IsArray(),
+               filename << " is not a valid stf_bench result file");
+
+    std::map<std::string, double> results;
+    size_t idx = 0;
+    for(const auto& benchmark: d["benchmarks"].GetArray()) {
+        // Check every member first, since rapidjson asserts instead of throwing on a missing or mistyped value
+        stf_assert(benchmark.IsObject() &&
+                   benchmark.HasMember("name") && benchmark["name"].IsString() &&
+                   benchmark.HasMember("items") && benchmark["items"].IsNumber() &&
+                   benchmark.HasMember("seconds") && benchmark["seconds"].IsObject() &&
+                   benchmark["seconds"].HasMember("median") && benchmark["seconds"]["median"].IsNumber(),
+                   filename << ": benchmark " << idx << " must have a name, items and seconds.median");
+        const double items = std::max(benchmark["items"].GetDouble(), 1.0);
+        results.emplace(benchmark["name"].GetString(), benchmark["seconds"]["median"].GetDouble() / items);
+        ++idx;
+    }
+
+    return results;
+}
+
+/**
+ * Compares two JSON result files and flags benchmarks that got slower
+ * \param baseline_filename Baseline results
+ * \param current_filename Results to compare against the baseline
+ * \param threshold Percent increase in median time per item that counts as a regression
+ * \returns The number of regressions
+ */
+inline size_t compareBenchmarkResults(const std::string& baseline_filename,
+                                      const std::string& current_filename,
+                                      const double threshold) {
+    static constexpr int NAME_WIDTH = 28;
+    static constexpr int COLUMN_WIDTH = 16;
+
+    const auto baseline = loadBenchmarkResults(baseline_filename);
+    const auto current = loadBenchmarkResults(current_filename);
+
+    stf::format_utils::formatLeft(std::cout, "Benchmark", NAME_WIDTH);
+    stf::format_utils::formatLeft(std::cout, "Baseline ns", COLUMN_WIDTH);
+    stf::format_utils::formatLeft(std::cout, "Current ns", COLUMN_WIDTH);
+    stf::format_utils::formatLeft(std::cout, "Change", COLUMN_WIDTH);
+    std::cout << std::endl;
+
+    size_t num_regressions = 0;
+    for(const auto& [name, current_time]: current) {
+        const auto it = baseline.find(name);
+        if(it == baseline.end()) {
+            continue;
+        }
+
+        const double baseline_time = it->second;
+        const double change = baseline_time > 0 ? (current_time - baseline_time) * 100 / baseline_time : 0;
+        const bool regressed = change > threshold;
+        num_regressions += regressed;
+
+        stf::format_utils::formatLeft(std::cout, name, NAME_WIDTH);
+        stf::format_utils::formatLeft(std::cout, std::to_string(baseline_time * 1e9), COLUMN_WIDTH);
+        stf::format_utils::formatLeft(std::cout, std::to_string(current_time * 1e9), COLUMN_WIDTH);
+        stf::format_utils::formatLeft(std::cout, std::to_string(change) + '%', COLUMN_WIDTH);
+        if(regressed) {
+            std::cout << "REGRESSION";
+        }
+        std::cout << std::endl;
+    }
+
+    for(const auto& p: baseline) {
+        if(!current.count(p.first)) {
+            std::cout << p.first << " is missing from " << current_filename << std::endl;
+        }
+    }
+
+    std::cout << num_regressions << " regression" << (num_regressions == 1 ? "" : "s")
+              << " (threshold " << threshold << "%)" << std::endl;
+
+    return num_regressions;
+}
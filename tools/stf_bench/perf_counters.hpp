@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * \class PerfCounters
+ * \brief Counts hardware events with perf_event_open
+ *
+ * Each counter also counts threads created after it was opened, so benchmarks that start their own threads
+ * (e.g. PipelinedReader) are measured in full. If the kernel does not allow access to the counters (e.g. a high
+ * perf_event_paranoid setting or a VM without a PMU), available() returns false and start()/stop() do nothing.
+ */
+class PerfCounters {
+    public:
+        static constexpr size_t NUM_COUNTERS = 4;
+        using Values = std::array<uint64_t, NUM_COUNTERS>;
+
+        static constexpr std::array<std::string_view, NUM_COUNTERS> NAMES {
+            "cycles",
+            "instructions",
+            "cache_misses",
+            "branch_misses"
+        };
+
+    private:
+        std::array<int, NUM_COUNTERS> fds_;
+        bool available_ = false;
+
+#ifdef __linux__
+        static int open_(const uint64_t config) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = config;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+
+        void close_() {
+#ifdef __linux__
+            for(auto& fd: fds_) {
+                if(fd >= 0) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+#endif
+            available_ = false;
+        }
+
+    public:
+        PerfCounters() {
+            fds_.fill(-1);
+
+#ifdef __linux__
+            static constexpr std::array<uint64_t, NUM_COUNTERS> CONFIGS {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_MISSES
+            };
+
+            available_ = true;
+            for(size_t i = 0; i < NUM_COUNTERS; ++i) {
+                fds_[i] = open_(CONFIGS[i]);
+                if(fds_[i] < 0) {
+                    close_();
+                    break;
+                }
+            }
+#endif
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        ~PerfCounters() {
+            close_();
+        }
+
+        /**
+         * Returns whether the hardware counters could be opened
+         */
+        inline bool available() const {
+            return available_;
+        }
+
+        /**
+         * Resets and starts the counters
+         */
+        inline void start() {
+#ifdef __linux__
+            if(!available_) {
+                return;
+            }
+
+            for(const auto fd: fds_) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            }
+            for(const auto fd: fds_) {
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+        }
+
+        /**
+         * Stops the counters
+         * \returns The number of events counted since start()
+         */
+        inline Values stop() {
+            Values values {};
+
+#ifdef __linux__
+            if(!available_) {
+                return values;
+            }
+
+            for(const auto fd: fds_) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+            for(size_t i = 0; i < NUM_COUNTERS; ++i) {
+                uint64_t value = 0;
+                if(read(fds_[i], &value, sizeof(value)) == static_cast<ssize_t>(sizeof(value))) {
+                    values[i] = value;
+                }
+            }
+#endif
+
+            return values;
+        }
+};
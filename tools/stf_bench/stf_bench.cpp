@@ -1,14 +1,33 @@
+#include <array>
 #include <chrono>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include <boost/core/demangle.hpp>
 
 #include "command_line_parser.hpp"
+#include "disassembler.hpp"
+#include "filesystem.hpp"
+#include "pc_table.hpp"
+#include "pipelined_reader.hpp"
 #include "stf_branch_reader.hpp"
+#include "stf_decoder.hpp"
 #include "stf_inst_reader.hpp"
+#include "stf_page_table.hpp"
+#include "stf_symbol_table.hpp"
+#include "stf_transaction_reader.hpp"
+#include "stf_writer.hpp"
+#include "tools_util.hpp"
+
+#include "benchmark_suite.hpp"
 
 template<typename Reader>
 inline std::chrono::duration<double> readAllRecords(Reader& reader) {
@@ -36,7 +55,7 @@ inline std::chrono::duration<double> readAllRecords(stf::STFReader& reader) {
 }
 
 template<typename Reader, typename ... Args>
-void readerBench(const std::string& filename, Args&&... args) {
+std::chrono::duration<double> readerBench(const std::string& filename, Args&&... args) {
     Reader reader(filename, args...);
 
     auto time = readAllRecords<Reader>(reader);
@@ -54,6 +73,362 @@ void readerBench(const std::string& filename, Args&&... args) {
               << " instructions ("
               << (static_cast<double>(reader.numInstsRead()) / time.count())
               << " insts/s)" << std::endl;
+
+    return time;
+}
+
+/**
+ * Runs readerBench on a reader and on a PipelinedReader wrapping it, then reports the speedup
+ */
+template<typename Reader, typename ... Args>
+void pipelinedReaderBench(const std::string& filename, Args&&... args) {
+    const auto time = readerBench<Reader>(filename, args...);
+    const auto pipelined_time = readerBench<PipelinedReader<Reader>>(filename, args...);
+    std::cout << "Pipelined speedup: " << (time.count() / pipelined_time.count()) << 'x' << std::endl;
+}
+
+/**
+ * Benchmarks a reader, optionally comparing it against a PipelinedReader
+ */
+template<typename Reader, typename ... Args>
+void iterableReaderBench(const bool pipelined, const std::string& filename, Args&&... args) {
+    if(pipelined) {
+        pipelinedReaderBench<Reader>(filename, args...);
+    }
+    else {
+        readerBench<Reader>(filename, args...);
+    }
+}
+
+struct BranchCounts {
+    uint64_t taken = 0;
+    uint64_t not_taken = 0;
+};
+
+template<typename MapType>
+inline std::chrono::duration<double> aggregateBranches(const std::vector<std::pair<uint64_t, bool>>& branches,
+                                                       MapType& branch_counts) {
+    auto start = std::chrono::system_clock::now();
+    for(const auto& [pc, taken]: branches) {
+        auto& counts = branch_counts[pc];
+        if(taken) {
+            ++counts.taken;
+        }
+        else {
+            ++counts.not_taken;
+        }
+    }
+    auto end = std::chrono::system_clock::now();
+    return end - start;
+}
+
+void printAggregationResult(const std::string_view name,
+                            const std::chrono::duration<double>& time,
+                            const size_t num_branches,
+                            const size_t num_pcs) {
+    std::cout << name
+              << std::endl
+              << "Aggregated "
+              << num_branches
+              << " branches ("
+              << num_pcs
+              << " static) in "
+              << time.count()
+              << " seconds ("
+              << (time.count() * 1e9 / static_cast<double>(num_branches))
+              << " ns/branch)" << std::endl;
+}
+
+/**
+ * Compares the cost of per-PC branch aggregation with std::map and PCTable. The branches are read into memory
+ * first so that only the aggregation is timed.
+ */
+void aggregationBench(const std::string& filename, const bool skip_non_user) {
+    std::vector<std::pair<uint64_t, bool>> branches;
+    stf::STFBranchReader reader(filename, skip_non_user);
+    for(const auto& branch: reader) {
+        branches.emplace_back(branch.getPC(), branch.isTaken());
+    }
+
+    if(branches.empty()) {
+        std::cout << "No branches found" << std::endl;
+        return;
+    }
+
+    std::map<uint64_t, BranchCounts> map_counts;
+    const auto map_time = aggregateBranches(branches, map_counts);
+    printAggregationResult("std::map", map_time, branches.size(), map_counts.size());
+
+    PCTable<BranchCounts> table_counts;
+    const auto table_time = aggregateBranches(branches, table_counts);
+    printAggregationResult("PCTable", table_time, branches.size(), table_counts.size());
+
+    std::cout << "Speedup: " << (map_time.count() / table_time.count()) << 'x' << std::endl;
+}
+
+/**
+ * \struct SuiteConfig
+ * \brief Options for the benchmark suite
+ */
+struct SuiteConfig {
+    std::string trace;                  /**< Trace to benchmark with */
+    std::string transaction_trace;      /**< Transaction trace to benchmark with. Transaction benchmarks are skipped if empty. */
+    std::string elf;                    /**< ELF used for symbol lookup and binutils disassembly */
+    std::string output_filename;        /**< JSON output file. No JSON is written if empty. */
+    std::set<std::string> enabled;      /**< Benchmarks to run. Every benchmark runs if empty. */
+    bool skip_non_user = false;         /**< If true, skip non-user mode instructions */
+    size_t num_warmup = 1;              /**< Number of untimed runs before the trials */
+    size_t num_trials = 5;              /**< Number of timed trials */
+    uint64_t max_items = 1000000;       /**< Number of instructions or records loaded into memory for the in-memory benchmarks */
+};
+
+/**
+ * Iterates over every item in a trace
+ * \returns The number of items
+ */
+template<typename Reader, typename ... Args>
+inline uint64_t countItems(const std::string& filename, Args&&... args) {
+    Reader reader(filename, args...);
+    uint64_t num_items = 0;
+    for(const auto& item: reader) {
+        (void)item;
+        ++num_items;
+    }
+    return num_items;
+}
+
+/**
+ * \struct CachedDecode
+ * \brief Decoded instruction properties cached by PC
+ */
+struct CachedDecode {
+    uint32_t opcode = 0;
+    bool valid = false;
+    bool is_branch = false;
+    bool is_load = false;
+    bool is_store = false;
+};
+
+/**
+ * \struct PTELookup
+ * \brief Address translated by the pte_lookup benchmark
+ */
+struct PTELookup {
+    uint32_t pid = 0;
+    uint64_t va = 0;
+    uint64_t index = 0;
+    uint32_t size = 0;
+};
+
+/**
+ * Times page table lookups. The page table walks embedded in the first config.max_items instructions are loaded
+ * into an STF_PTE, then every instruction fetch and memory access address is looked up with
+ * CheckAndDumpNewPTESingle, the same way stf_extract does. Usage is reset before each trial, so only the first
+ * lookup of each page writes its walk to the (scratch) output trace.
+ */
+void pteLookupBench(BenchmarkSuite& suite, const SuiteConfig& config) {
+    stf::STFInstReader reader(config.trace, config.skip_non_user, true);
+    stf::STF_PTE page_table(nullptr, nullptr, true);
+    std::vector<stf::STFRecord::UniqueHandle> pte_records;
+    std::vector<PTELookup> lookups;
+
+    uint64_t inst_count = 0;
+    for(auto it = reader.begin(); it != reader.end() && inst_count < config.max_items; ++it) {
+        ++inst_count;
+        for(const auto& p: it->getEmbeddedPTEs()) {
+            pte_records.emplace_back(p->clone());
+            const auto& pte_rec = pte_records.back()->as<stf::PageTableWalkRecord>();
+            const_cast<stf::PageTableWalkRecord&>(pte_rec).setIndex(inst_count);
+            page_table.UpdatePTE(it->pid(), &pte_rec);
+        }
+
+        lookups.emplace_back(PTELookup{it->pid(), it->pc(), inst_count, 4});
+        for(const auto& mem_access: it->getMemoryAccesses()) {
+            lookups.emplace_back(PTELookup{it->pid(),
+                                           mem_access.getAddress(),
+                                           inst_count,
+                                           static_cast<uint32_t>(mem_access.getSize())});
+        }
+    }
+
+    if(pte_records.empty()) {
+        std::cerr << config.trace << " has no page table walks, skipping pte_lookup" << std::endl;
+        return;
+    }
+
+    const auto output_filename = (fs::temp_directory_path() / "stf_bench_pte.zstf").string();
+    {
+        stf::STFWriter writer(output_filename, 1, stf::STFWriter::DEFAULT_CHUNK_SIZE);
+        reader.copyHeader(writer);
+        writer.finalizeHeader();
+
+        suite.run("pte_lookup", "lookups", [&page_table, &lookups, &writer]() {
+            page_table.ResetUsage();
+            for(const auto& lookup: lookups) {
+                page_table.CheckAndDumpNewPTESingle(writer, lookup.pid, lookup.va, lookup.index, lookup.size);
+            }
+            return static_cast<uint64_t>(lookups.size());
+        });
+
+        writer.close();
+    }
+    fs::remove(output_filename);
+}
+
+/**
+ * Runs the benchmark suite. Reader benchmarks read the whole trace. Decode, disassembly, symbol lookup and writer
+ * benchmarks run over the first config.max_items instructions or records, which are loaded into memory first so
+ * that only the operation itself is timed.
+ */
+void suiteBench(const SuiteConfig& config) {
+    static constexpr std::array<int, 4> COMPRESSION_LEVELS {1, 3, 9, 19};
+
+    BenchmarkSuite suite(config.num_warmup, config.num_trials, config.enabled);
+
+    suite.run("record_read", "records", [&config]() {
+        stf::STFReader reader(config.trace);
+        readAllRecords(reader);
+        return static_cast<uint64_t>(reader.numRecordsRead());
+    });
+    suite.run("inst_read", "insts", [&config]() {
+        return countItems<stf::STFInstReader>(config.trace, config.skip_non_user, false);
+    });
+    suite.run("inst_read_track_pte", "insts", [&config]() {
+        return countItems<stf::STFInstReader>(config.trace, config.skip_non_user, true);
+    });
+    suite.run("inst_read_pipelined", "insts", [&config]() {
+        return countItems<PipelinedReader<stf::STFInstReader>>(config.trace, config.skip_non_user, false);
+    });
+    suite.run("branch_read", "branches", [&config]() {
+        return countItems<stf::STFBranchReader>(config.trace, config.skip_non_user);
+    });
+
+    if(!config.transaction_trace.empty()) {
+        suite.run("transaction_read", "transactions", [&config]() {
+            return countItems<stf::STFTransactionReader>(config.transaction_trace);
+        });
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> insts;
+    stf::ISA isa = stf::ISA::RESERVED;
+    stf::INST_IEM iem = stf::INST_IEM::STF_INST_IEM_INVALID;
+    {
+        stf::STFInstReader reader(config.trace, config.skip_non_user);
+        isa = reader.getISA();
+        iem = reader.getInitialIEM();
+        for(auto it = reader.begin(); it != reader.end() && insts.size() < config.max_items; ++it) {
+            insts.emplace_back(it->pc(), it->opcode());
+        }
+    }
+
+    if(insts.empty()) {
+        std::cerr << "No instructions found, skipping in-memory benchmarks" << std::endl;
+    }
+    else {
+        stf::STFDecoder decoder(iem);
+        suite.run("decode", "insts", [&insts, &decoder]() {
+            for(const auto& p: insts) {
+                decoder.decode(p.second);
+                (void)decoder.isBranch();
+                (void)decoder.isLoad();
+                (void)decoder.isStore();
+            }
+            return static_cast<uint64_t>(insts.size());
+        });
+        suite.run("decode_cached", "insts", [&insts, &decoder]() {
+            PCTable<CachedDecode> cache;
+            for(const auto& [pc, opcode]: insts) {
+                auto& entry = cache[pc];
+                if(STF_EXPECT_FALSE(!entry.valid || entry.opcode != opcode)) {
+                    decoder.decode(opcode);
+                    entry.opcode = opcode;
+                    entry.valid = true;
+                    entry.is_branch = decoder.isBranch();
+                    entry.is_load = decoder.isLoad();
+                    entry.is_store = decoder.isStore();
+                }
+            }
+            return static_cast<uint64_t>(insts.size());
+        });
+
+        std::ostringstream disasm_os;
+        const auto disasm_bench = [&insts, &disasm_os](const stf::disassemblers::BaseDisassembler& dis) {
+            for(const auto& [pc, opcode]: insts) {
+                disasm_os.seekp(0);
+                dis.printDisassembly(disasm_os, pc, opcode);
+            }
+            return static_cast<uint64_t>(insts.size());
+        };
+
+        if(suite.enabled("disasm_mavis")) {
+            const stf::disassemblers::MavisDisassembler dis(isa, iem, false);
+            suite.run("disasm_mavis", "insts", [&disasm_bench, &dis]() { return disasm_bench(dis); });
+        }
+#ifdef ENABLE_BINUTILS_DISASM
+        if(suite.enabled("disasm_binutils")) {
+            const stf::disassemblers::BinutilsDisassembler dis(config.elf, isa, iem, false);
+            suite.run("disasm_binutils", "insts", [&disasm_bench, &dis]() { return disasm_bench(dis); });
+        }
+#endif
+
+        if(suite.enabled("symbol_lookup")) {
+            if(fs::exists(config.elf)) {
+                const STFSymbolTable symbol_table(config.elf);
+                suite.run("symbol_lookup", "insts", [&insts, &symbol_table]() {
+                    for(const auto& p: insts) {
+                        (void)symbol_table.findFunction(p.first);
+                    }
+                    return static_cast<uint64_t>(insts.size());
+                });
+            }
+            else {
+                std::cerr << config.elf << " does not exist, skipping symbol_lookup" << std::endl;
+            }
+        }
+    }
+
+    if(suite.enabled("pte_lookup")) {
+        pteLookupBench(suite, config);
+    }
+
+    bool any_writer_enabled = false;
+    for(const auto level: COMPRESSION_LEVELS) {
+        any_writer_enabled |= suite.enabled("write_zstd_" + std::to_string(level));
+    }
+
+    if(any_writer_enabled) {
+        stf::STFReader reader(config.trace);
+        std::vector<stf::STFRecord::UniqueHandle> records;
+        try {
+            stf::STFRecord::UniqueHandle rec;
+            while(records.size() < config.max_items && reader >> rec) {
+                records.emplace_back(std::move(rec));
+            }
+        }
+        catch(const stf::EOFException&) {
+        }
+
+        const auto output_filename = (fs::temp_directory_path() / "stf_bench_write.zstf").string();
+        for(const auto level: COMPRESSION_LEVELS) {
+            suite.run("write_zstd_" + std::to_string(level), "records", [&reader, &records, &output_filename, level]() {
+                stf::STFWriter writer(output_filename, level, stf::STFWriter::DEFAULT_CHUNK_SIZE);
+                reader.copyHeader(writer);
+                writer.finalizeHeader();
+                for(const auto& rec: records) {
+                    writer << *rec;
+                }
+                writer.close();
+                return static_cast<uint64_t>(records.size());
+            });
+        }
+        fs::remove(output_filename);
+    }
+
+    if(!config.output_filename.empty()) {
+        std::ofstream json_file(config.output_filename);
+        stf_assert(json_file, "Failed to open " << config.output_filename);
+        suite.writeJSON(json_file, config.trace);
+    }
 }
 
 int main(int argc, char* argv[]) {
@@ -61,31 +436,83 @@ int main(int argc, char* argv[]) {
         int reader = 0;
 
         trace_tools::CommandLineParser parser("stf_bench");
-        parser.addFlag('r', "reader", "Reader to test (0 = all, 1 = STFReader, 2 = STFInstReader, 3 = STFBranchReader)");
+        parser.addFlag('r', "reader", "Reader to test (0 = all, 1 = STFReader, 2 = STFInstReader, 3 = STFBranchReader, 4 = per-PC branch aggregation)");
         parser.addFlag('u', "Skip non-user instructions (will not apply to STFReader)");
         parser.addFlag('p', "Enable page table tracking");
-        parser.addPositionalArgument("trace", "STF to test with");
+        parser.addFlag('P', "Also test STFInstReader and STFBranchReader wrapped in a PipelinedReader and report the speedup");
+        parser.addFlag('S', "Run the benchmark suite");
+        parser.addMultiFlag('B', "name", "Only run the named suite benchmark. Can be specified multiple times.");
+        parser.addFlag('w', "N", "Number of warmup runs per suite benchmark (default 1)");
+        parser.addFlag('n', "N", "Number of timed trials per suite benchmark (default 5)");
+        parser.addFlag('N', "N", "Number of instructions/records loaded into memory for the in-memory suite benchmarks (default 1000000)");
+        parser.addFlag('E', "elf", "ELF used by the symbol lookup and binutils disassembly suite benchmarks (default: trace name with .elf extension)");
+        parser.addFlag('x', "trace", "Transaction trace used by the transaction_read suite benchmark");
+        parser.addFlag('o', "json", "Write suite results to a JSON file");
+        parser.addFlag('C', "baseline", "Compare suite results in the trace argument against a baseline JSON file and report regressions");
+        parser.addFlag('t', "percent", "Increase in median time per item that counts as a regression with -C (default 5)");
+        parser.addPositionalArgument("trace", "STF to test with, or the JSON results to compare with -C");
+        for(const char suite_arg: {'B', 'w', 'n', 'N', 'E', 'x', 'o'}) {
+            parser.setDependentArgument(suite_arg, 'S');
+        }
+        parser.setDependentArgument('t', 'C');
+        parser.setMutuallyExclusive('S', 'C');
+        parser.setMutuallyExclusive('S', 'r');
+        parser.appendHelpText("Suite benchmarks: record_read, inst_read, inst_read_track_pte, inst_read_pipelined, branch_read, "
+                              "transaction_read, decode, decode_cached, disasm_mavis, disasm_binutils, symbol_lookup, "
+                              "pte_lookup, write_zstd_1, write_zstd_3, write_zstd_9, write_zstd_19");
         parser.parseArguments(argc, argv);
 
         const bool skip_non_user = parser.hasArgument('u');
         const bool track_page_table_entries = parser.hasArgument('p');
+        const bool pipelined = parser.hasArgument('P');
         parser.getArgumentValue('r', reader);
         const auto trace = parser.getPositionalArgument<std::string>(0);
 
+        if(parser.hasArgument('C')) {
+            std::string baseline;
+            double threshold = 5;
+            parser.getArgumentValue('C', baseline);
+            parser.getArgumentValue('t', threshold);
+            return compareBenchmarkResults(baseline, trace, threshold) ? 1 : 0;
+        }
+
+        if(parser.hasArgument('S')) {
+            SuiteConfig config;
+            config.trace = trace;
+            config.skip_non_user = skip_non_user;
+            config.elf = findElfFromTrace(trace);
+            parser.getArgumentValue('E', config.elf);
+            parser.getArgumentValue('x', config.transaction_trace);
+            parser.getArgumentValue('o', config.output_filename);
+            parser.getArgumentValue('w', config.num_warmup);
+            parser.getArgumentValue('n', config.num_trials);
+            parser.getArgumentValue('N', config.max_items);
+            for(const auto& name: parser.getMultipleValueArgument('B')) {
+                config.enabled.emplace(name);
+            }
+            parser.assertCondition(config.num_trials > 0, "-n parameter must be nonzero");
+            parser.assertCondition(config.max_items > 0, "-N parameter must be nonzero");
+            suiteBench(config);
+            return 0;
+        }
+
         switch(reader) {
             case 0:
                 readerBench<stf::STFReader>(trace);
-                readerBench<stf::STFInstReader>(trace, skip_non_user, track_page_table_entries);
-                readerBench<stf::STFBranchReader>(trace, skip_non_user);
+                iterableReaderBench<stf::STFInstReader>(pipelined, trace, skip_non_user, track_page_table_entries);
+                iterableReaderBench<stf::STFBranchReader>(pipelined, trace, skip_non_user);
                 break;
             case 1:
                 readerBench<stf::STFReader>(trace);
                 break;
             case 2:
-                readerBench<stf::STFInstReader>(trace, skip_non_user, track_page_table_entries);
+                iterableReaderBench<stf::STFInstReader>(pipelined, trace, skip_non_user, track_page_table_entries);
                 break;
             case 3:
-                readerBench<stf::STFBranchReader>(trace, skip_non_user);
+                iterableReaderBench<stf::STFBranchReader>(pipelined, trace, skip_non_user);
+                break;
+            case 4:
+                aggregationBench(trace, skip_non_user);
                 break;
         };
     }
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+
+#include "print_utils.hpp"
+#include "stf_exception.hpp"
+
+enum class Direction : uint8_t {
+    INVALID,
+    FORWARD,
+    BACKWARD,
+    CALL,
+    RETURN,
+    MULTIPLE
+};
+
+struct BranchInfo {
+    uint64_t taken = 0;
+    uint64_t not_taken = 0;
+    std::map<uint64_t, uint64_t> targets;
+    bool indirect = false;
+    Direction direction = Direction::INVALID;
+};
+
+/**
+ * \class BranchClassifier
+ * \brief Classifies every static branch by its direction and taken/not-taken behavior
+ */
+class BranchClassifier {
+    private:
+        std::map<uint64_t, BranchInfo> branch_counts_;
+
+    public:
+        /**
+         * Counts a dynamic branch
+         * \param branch Branch to count. Must provide the same accessors as stf::STFBranch.
+         */
+        template<typename BranchType>
+        inline void count(const BranchType& branch) {
+            auto& branch_info = branch_counts_[branch.getPC()];
+
+            const bool is_taken = branch.isTaken();
+            branch_info.taken += is_taken;
+            branch_info.not_taken += !is_taken;
+            branch_info.targets[branch.getTargetPC()] += is_taken;
+            branch_info.indirect = branch.isIndirect();
+
+            Direction new_dir = Direction::FORWARD;
+            if(branch.isCall()) {
+                new_dir = Direction::CALL;
+            }
+            else if(branch.isReturn()) {
+                new_dir = Direction::RETURN;
+            }
+            else if(branch.isBackwards()) {
+                new_dir = Direction::BACKWARD;
+            }
+            if(branch_info.direction == Direction::INVALID) {
+                branch_info.direction = new_dir;
+            }
+            else if(branch_info.direction != new_dir) {
+                stf_assert(branch_info.indirect, "Only indirect branches can have multiple directions");
+                branch_info.direction = Direction::MULTIPLE;
+            }
+        }
+
+        /**
+         * Prints the classified branches
+         * \param verbose If true, print the targets of each branch
+         * \param only_taken If true, only print branches that are taken at least once
+         * \param only_dynamic If true, only print branches that are neither always-taken nor never-taken
+         */
+        void print(const bool verbose, const bool only_taken, const bool only_dynamic) const {
+            static constexpr int COLUMN_WIDTH = 20;
+            stf::print_utils::printLeft("Instruction PC", COLUMN_WIDTH);
+            stf::print_utils::printLeft("Total Instances", COLUMN_WIDTH);
+            stf::print_utils::printLeft("Behavior", COLUMN_WIDTH);
+            stf::print_utils::printLeft("Direction", COLUMN_WIDTH);
+            stf::print_utils::printLeft("Indirect", COLUMN_WIDTH);
+            stf::print_utils::printLeft("# Targets", COLUMN_WIDTH);
+            stf::print_utils::printLeft("Taken Count", COLUMN_WIDTH);
+            stf::print_utils::printLeft("Not Taken Count", COLUMN_WIDTH);
+            if(verbose) {
+                stf::print_utils::printLeft("Target", COLUMN_WIDTH);
+                stf::print_utils::printLeft("Traversals", COLUMN_WIDTH);
+            }
+            std::cout << std::endl;
+            for(const auto& branch: branch_counts_) {
+                const auto& branch_info = branch.second;
+                const auto taken = branch_info.taken;
+                const auto not_taken = branch_info.not_taken;
+
+                if(only_dynamic && !(taken && not_taken)) {
+                    continue;
+                }
+
+                if(only_taken && !taken) {
+                    continue;
+                }
+
+                const auto pc = branch.first;
+                const auto total = taken + not_taken;
+                stf_assert(total, "Invalid branch behavior for pc " << std::hex << pc);
+
+                stf::print_utils::printHex(pc);
+                stf::print_utils::printSpaces(4);
+                stf::print_utils::printDecLeft(total, COLUMN_WIDTH);
+
+                if(taken && !not_taken) {
+                    stf::print_utils::printLeft("AT", COLUMN_WIDTH);
+                }
+                else if(!taken && not_taken) {
+                    stf::print_utils::printLeft("NT", COLUMN_WIDTH);
+                }
+                else if(taken && not_taken) {
+                    stf::print_utils::printLeft("DYN", COLUMN_WIDTH);
+                }
+
+                switch(branch_info.direction) {
+                    case Direction::FORWARD:
+                        stf::print_utils::printLeft("FORWARD", COLUMN_WIDTH);
+                        break;
+                    case Direction::BACKWARD:
+                        stf::print_utils::printLeft("BACKWARD", COLUMN_WIDTH);
+                        break;
+                    case Direction::CALL:
+                        stf::print_utils::printLeft("CALL", COLUMN_WIDTH);
+                        break;
+                    case Direction::RETURN:
+                        stf::print_utils::printLeft("RETURN", COLUMN_WIDTH);
+                        break;
+                    case Direction::MULTIPLE:
+                        stf::print_utils::printLeft("MULTIPLE", COLUMN_WIDTH);
+                        break;
+                    case Direction::INVALID:
+                        stf_throw("Invalid branch direction for pc " << std::hex << pc);
+                };
+
+                if(branch_info.indirect) {
+                    stf::print_utils::printLeft('Y', COLUMN_WIDTH);
+                }
+                else {
+                    stf::print_utils::printLeft('N', COLUMN_WIDTH);
+                }
+
+                stf::print_utils::printDecLeft(branch_info.targets.size(), COLUMN_WIDTH);
+
+                stf::print_utils::printDecLeft(taken, COLUMN_WIDTH);
+                stf::print_utils::printDecLeft(not_taken, COLUMN_WIDTH);
+
+                if(verbose) {
+                    bool first_line = true;
+                    for(const auto& target_pair: branch_info.targets) {
+                        if(STF_EXPECT_FALSE(first_line)) {
+                            first_line = false;
+                        }
+                        else {
+                            stf::print_utils::printSpaces(8*COLUMN_WIDTH);
+                        }
+                        stf::print_utils::printHex(target_pair.first);
+                        stf::print_utils::printSpaces(4);
+                        stf::print_utils::printDecLeft(target_pair.second);
+                        std::cout << std::endl;
+                    }
+                }
+
+                std::cout << std::endl;
+            }
+        }
+};
@@ -5,8 +5,10 @@
 #include <string>
 
 #include "print_utils.hpp"
+#include "profiling.hpp"
 #include "stf_branch_reader.hpp"
 #include "command_line_parser.hpp"
+#include "text_writer.hpp"
 
 void processCommandLine(int argc,
                         char** argv,
@@ -34,9 +36,13 @@ int main(int argc, char** argv) {
     }
 
     stf::STFBranchReader reader(trace, skip_non_user);
+    TextWriter out;
+    auto& os = out.stream();
 
-    for(const auto& branch: reader) {
-        std::cout << branch << std::endl;
+    for(const auto& branch: TRACE_TOOLS_PROFILE_RANGE("reader.branch", reader)) {
+        TRACE_TOOLS_PROFILE_SCOPE("output.format");
+        os << branch;
+        out.newline();
     }
 
     return 0;
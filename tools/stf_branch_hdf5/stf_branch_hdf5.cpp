@@ -12,6 +12,7 @@
 #include "stf_branch_reader.hpp"
 #include "stf_decoder.hpp"
 #include "command_line_parser.hpp"
+#include "npy_columnar.hpp"
 
 enum class HDF5Field {
     INDEX,
@@ -152,6 +153,7 @@ void processCommandLine(int argc,
                         bool& decode_target_opcodes,
                         bool& byte_chunks,
                         bool& exclude_loop_branches,
+                        bool& npy_output,
                         size_t& local_history_length,
                         std::unordered_set<HDF5Field>& excluded_fields,
                         size_t& limit_top_branches,
@@ -167,14 +169,16 @@ void processCommandLine(int argc,
     parser.addFlag('L', "L", "Keep a local history of length L (maximum length is 64). If -1 is specified, this field is broken up into single bit fields.");
     parser.addFlag('X', "exclude loop branches");
     parser.addMultiFlag('x', "exclude_field", "exclude specified field. Can be specified multiple times.");
+    parser.addFlag('N', "write NumPy columnar output instead of HDF5. The output will be a directory containing one uncompressed .npy file per field that can be memory-mapped with numpy.load(mmap_mode='r').");
     parser.addPositionalArgument("trace", "trace in STF format");
-    parser.addPositionalArgument("output", "output HDF5");
+    parser.addPositionalArgument("output", "output HDF5 file (or output directory if -N is specified)");
     parser.parseArguments(argc, argv);
     skip_non_user = parser.hasArgument('u');
     use_unsigned_bool = parser.hasArgument('U');
     always_fill_in_target_opcode = parser.hasArgument('O');
     decode_target_opcodes = parser.hasArgument('D');
     exclude_loop_branches = parser.hasArgument('X');
+    npy_output = parser.hasArgument('N');
 
     if(!decode_target_opcodes) {
         excluded_fields.insert(HDF5Field::TARGET_FUNC1);
@@ -716,25 +720,21 @@ const HDF5BranchBase<false>::BoolType HDF5BranchBase<false>::False = -1;
 template<>
 const HDF5BranchBase<false>::BoolType HDF5BranchBase<false>::True = 1;
 
-template<size_t CHUNK_SIZE, typename BranchType>
-class HDF5BranchWriter {
-    private:
-        static constexpr int RANK_ = 1;
-        static constexpr hsize_t MAX_DIMS_[1] = {H5S_UNLIMITED};
-        static constexpr hsize_t CHUNK_DIM_[1] ={CHUNK_SIZE};
-        static constexpr int ZLIB_COMPRESSION_LEVEL = 7;
-        static inline const H5std_string DATASET_NAME_{"branch_info"};
-
+/**
+ * \class BranchWriterBase
+ * \brief Buffers encoded branches and hands them off to the output backend one chunk at a time
+ *
+ * WriterType must implement writeChunk_(num_items), which writes the first num_items entries of branch_buffer_
+ */
+template<typename WriterType, size_t CHUNK_SIZE, typename BranchType>
+class BranchWriterBase {
+    protected:
         using BufferT = std::array<BranchType, CHUNK_SIZE>;
         BufferT branch_buffer_{};
         typename BufferT::iterator it_ = branch_buffer_.begin();
 
-        const H5::H5File hdf5_file_;
-        const H5::DataSpace chunk_mspace_;
         const H5::CompType branch_type_;
-        const H5::DataSet dataset_;
 
-        hsize_t cur_slab_dim_[1] = {0};
         OpcodeMap opcode_map_;
         const int32_t wkld_id_ = -1;
         const size_t local_history_length_ = 0;
@@ -743,6 +743,69 @@ class HDF5BranchWriter {
 
         typename BranchType::BoolType last_taken_ = BranchType::False;
 
+        BranchWriterBase(const bool return_random_for_unknown_target_opcode, const std::unordered_set<HDF5Field>& excluded_fields, const int32_t wkld_id, const size_t local_history_length, const stf::INST_IEM iem, const bool decode_target_opcodes) :
+            branch_type_(BranchType::initBranchType(excluded_fields, local_history_length, decode_target_opcodes)),
+            opcode_map_(return_random_for_unknown_target_opcode, iem),
+            wkld_id_(wkld_id),
+            local_history_length_(local_history_length),
+            decode_target_opcodes_(decode_target_opcodes)
+        {
+        }
+
+        /**
+         * Writes out any partially filled chunk. Must be called from the derived class destructor.
+         */
+        inline void flush_() {
+            if(it_ != branch_buffer_.begin()) {
+                static_cast<WriterType*>(this)->writeChunk_(static_cast<size_t>(std::distance(branch_buffer_.begin(), it_)));
+                it_ = branch_buffer_.begin();
+            }
+        }
+
+    public:
+        inline void append(const stf::STFBranch& branch) {
+            opcode_map_.updateOpcode(branch.getTargetPC(), branch.getTargetOpcode());
+            const auto pc = branch.getPC();
+            if(local_history_length_) {
+                auto& cur_local_history = local_history_.try_emplace(pc, local_history_length_).first->second;
+                *it_ = BranchType(branch, opcode_map_, wkld_id_, decode_target_opcodes_, cur_local_history);
+                cur_local_history <<= 1;
+                cur_local_history.set(0, it_->taken);
+            }
+            else {
+                *it_ = BranchType(branch, opcode_map_, wkld_id_, decode_target_opcodes_);
+            }
+
+            it_->last_taken = last_taken_;
+            last_taken_ = BranchType::encodeBool(it_->taken);
+            ++it_;
+            if(it_ == branch_buffer_.end()) {
+                static_cast<WriterType*>(this)->writeChunk_(CHUNK_SIZE);
+                it_ = branch_buffer_.begin();
+            }
+        }
+};
+
+template<size_t CHUNK_SIZE, typename BranchType>
+class HDF5BranchWriter : public BranchWriterBase<HDF5BranchWriter<CHUNK_SIZE, BranchType>, CHUNK_SIZE, BranchType> {
+    private:
+        using Base = BranchWriterBase<HDF5BranchWriter<CHUNK_SIZE, BranchType>, CHUNK_SIZE, BranchType>;
+        friend Base;
+        using Base::branch_buffer_;
+        using Base::branch_type_;
+
+        static constexpr int RANK_ = 1;
+        static constexpr hsize_t MAX_DIMS_[1] = {H5S_UNLIMITED};
+        static constexpr hsize_t CHUNK_DIM_[1] ={CHUNK_SIZE};
+        static constexpr int ZLIB_COMPRESSION_LEVEL = 7;
+        static inline const H5std_string DATASET_NAME_{"branch_info"};
+
+        const H5::H5File hdf5_file_;
+        const H5::DataSpace chunk_mspace_;
+        const H5::DataSet dataset_;
+
+        hsize_t cur_slab_dim_[1] = {0};
+
         inline void writeChunk_(const size_t num_items, const hsize_t chunk_dim[], const H5::DataSpace& mspace) {
             const hsize_t hyperslab_offset = cur_slab_dim_[0];
             cur_slab_dim_[0] += num_items;
@@ -752,8 +815,15 @@ class HDF5BranchWriter {
             dataset_.write(branch_buffer_.data(), branch_type_, mspace, fspace);
         }
 
-        inline void writeChunk_() {
-            writeChunk_(CHUNK_SIZE, CHUNK_DIM_, chunk_mspace_);
+        inline void writeChunk_(const size_t num_items) {
+            if(STF_EXPECT_TRUE(num_items == CHUNK_SIZE)) {
+                writeChunk_(CHUNK_SIZE, CHUNK_DIM_, chunk_mspace_);
+            }
+            else {
+                const hsize_t dim[1] = {num_items};
+                H5::DataSpace mspace(RANK_, dim, MAX_DIMS_);
+                writeChunk_(num_items, dim, mspace);
+            }
         }
 
         static H5::DSetCreatPropList getDataSetProps_() {
@@ -766,47 +836,62 @@ class HDF5BranchWriter {
 
     public:
         explicit HDF5BranchWriter(const std::string& filename, const bool return_random_for_unknown_target_opcode, const std::unordered_set<HDF5Field>& excluded_fields, const int32_t wkld_id, const size_t local_history_length, const stf::INST_IEM iem, const bool decode_target_opcodes) :
+            Base(return_random_for_unknown_target_opcode, excluded_fields, wkld_id, local_history_length, iem, decode_target_opcodes),
             hdf5_file_(filename.c_str(), H5F_ACC_TRUNC),
             chunk_mspace_(RANK_, CHUNK_DIM_, MAX_DIMS_),
-            branch_type_(BranchType::initBranchType(excluded_fields, local_history_length, decode_target_opcodes)),
-            dataset_(hdf5_file_.createDataSet(DATASET_NAME_, branch_type_, chunk_mspace_, getDataSetProps_())),
-            opcode_map_(return_random_for_unknown_target_opcode, iem),
-            wkld_id_(wkld_id),
-            local_history_length_(local_history_length),
-            decode_target_opcodes_(decode_target_opcodes)
+            dataset_(hdf5_file_.createDataSet(DATASET_NAME_, branch_type_, chunk_mspace_, getDataSetProps_()))
         {
         }
 
         ~HDF5BranchWriter() {
-            if(it_ != branch_buffer_.begin()) {
-                const auto num_items = static_cast<size_t>(std::distance(branch_buffer_.begin(), it_));
-                const hsize_t dim[1] = {num_items};
-                H5::DataSpace mspace(RANK_, dim, MAX_DIMS_);
-                writeChunk_(num_items, dim, mspace);
-            }
+            Base::flush_();
         }
+};
 
-        inline void append(const stf::STFBranch& branch) {
-            opcode_map_.updateOpcode(branch.getTargetPC(), branch.getTargetOpcode());
-            const auto pc = branch.getPC();
-            if(local_history_length_) {
-                auto& cur_local_history = local_history_.try_emplace(pc, local_history_length_).first->second;
-                *it_ = BranchType(branch, opcode_map_, wkld_id_, decode_target_opcodes_, cur_local_history);
-                cur_local_history <<= 1;
-                cur_local_history.set(0, it_->taken);
-            }
-            else {
-                *it_ = BranchType(branch, opcode_map_, wkld_id_, decode_target_opcodes_);
+/**
+ * \class NPYBranchWriter
+ * \brief Writes branches to a directory containing one uncompressed .npy file per field
+ *
+ * The column set, names, and widths are taken from the same HDF5 compound type used by HDF5BranchWriter,
+ * so both backends always produce the same fields.
+ */
+template<size_t CHUNK_SIZE, typename BranchType>
+class NPYBranchWriter : public BranchWriterBase<NPYBranchWriter<CHUNK_SIZE, BranchType>, CHUNK_SIZE, BranchType> {
+    private:
+        using Base = BranchWriterBase<NPYBranchWriter<CHUNK_SIZE, BranchType>, CHUNK_SIZE, BranchType>;
+        friend Base;
+        using Base::branch_buffer_;
+        using Base::branch_type_;
+
+        npy_columnar::DatasetWriter dataset_;
+        std::vector<size_t> column_offsets_;
+
+        inline void writeChunk_(const size_t num_items) {
+            const auto* const base = reinterpret_cast<const uint8_t*>(branch_buffer_.data());
+            for(size_t i = 0; i < column_offsets_.size(); ++i) {
+                dataset_.getColumn(i).appendStrided(base + column_offsets_[i], sizeof(BranchType), num_items);
             }
+        }
 
-            it_->last_taken = last_taken_;
-            last_taken_ = BranchType::encodeBool(it_->taken);
-            ++it_;
-            if(it_ == branch_buffer_.end()) {
-                writeChunk_();
-                it_ = branch_buffer_.begin();
+    public:
+        explicit NPYBranchWriter(const std::string& directory, const bool return_random_for_unknown_target_opcode, const std::unordered_set<HDF5Field>& excluded_fields, const int32_t wkld_id, const size_t local_history_length, const stf::INST_IEM iem, const bool decode_target_opcodes) :
+            Base(return_random_for_unknown_target_opcode, excluded_fields, wkld_id, local_history_length, iem, decode_target_opcodes),
+            dataset_(directory)
+        {
+            const auto num_members = static_cast<unsigned>(branch_type_.getNmembers());
+            for(unsigned i = 0; i < num_members; ++i) {
+                const auto member_type = branch_type_.getMemberIntType(i);
+                const auto member_size = member_type.getSize();
+                dataset_.addColumn(branch_type_.getMemberName(i),
+                                   npy_columnar::makeIntDescr(member_size, member_type.getSign() != H5T_SGN_NONE),
+                                   member_size);
+                column_offsets_.emplace_back(branch_type_.getMemberOffset(i));
             }
         }
+
+        ~NPYBranchWriter() {
+            Base::flush_();
+        }
 };
 
 template<bool byte_chunks, bool use_unsigned_bool>
@@ -826,6 +911,27 @@ inline bool isLoopBranch(const stf::STFBranch& branch) {
     return branch.isConditional() && (branch.getTargetPC() <= branch.getPC());
 }
 
+template<typename WriterType>
+void writeBranches(stf::STFBranchReader& reader,
+                   WriterType& writer,
+                   const std::set<uint64_t>& top_branches,
+                   const bool exclude_loop_branches) {
+    if(top_branches.empty()) {
+        for(const auto& branch: reader) {
+            if(!exclude_loop_branches || !isLoopBranch(branch)) {
+                writer.append(branch);
+            }
+        }
+    }
+    else {
+        for(const auto& branch: reader) {
+            if(top_branches.count(branch.getPC()) && (!exclude_loop_branches || !isLoopBranch(branch))) {
+                writer.append(branch);
+            }
+        }
+    }
+}
+
 template<bool use_unsigned_bool, bool byte_chunks>
 void processTrace(const std::string& trace,
                   const std::string& output,
@@ -836,25 +942,20 @@ void processTrace(const std::string& trace,
                   const int32_t wkld_id,
                   const size_t local_history_length,
                   const bool decode_target_opcodes,
-                  const bool exclude_loop_branches) {
+                  const bool exclude_loop_branches,
+                  const bool npy_output) {
     static constexpr size_t CHUNK_SIZE = 1000;
+    using BranchType = typename BranchTypeChooser<byte_chunks, use_unsigned_bool>::type;
 
     stf::STFBranchReader reader(trace, skip_non_user);
-    HDF5BranchWriter<CHUNK_SIZE, typename BranchTypeChooser<byte_chunks, use_unsigned_bool>::type> writer(output, always_fill_in_target_opcode, excluded_fields, wkld_id, local_history_length, reader.getInitialIEM(), decode_target_opcodes);
 
-    if(top_branches.empty()) {
-        for(const auto& branch: reader) {
-            if(!exclude_loop_branches || !isLoopBranch(branch)) {
-                writer.append(branch);
-            }
-        }
+    if(npy_output) {
+        NPYBranchWriter<CHUNK_SIZE, BranchType> writer(output, always_fill_in_target_opcode, excluded_fields, wkld_id, local_history_length, reader.getInitialIEM(), decode_target_opcodes);
+        writeBranches(reader, writer, top_branches, exclude_loop_branches);
     }
     else {
-        for(const auto& branch: reader) {
-            if(top_branches.count(branch.getPC()) && (!exclude_loop_branches || !isLoopBranch(branch))) {
-                writer.append(branch);
-            }
-        }
+        HDF5BranchWriter<CHUNK_SIZE, BranchType> writer(output, always_fill_in_target_opcode, excluded_fields, wkld_id, local_history_length, reader.getInitialIEM(), decode_target_opcodes);
+        writeBranches(reader, writer, top_branches, exclude_loop_branches);
     }
 }
 
@@ -894,6 +995,7 @@ int main(int argc, char** argv) {
     bool decode_target_opcodes = false;
     bool byte_chunks = false;
     bool exclude_loop_branches = false;
+    bool npy_output = false;
     std::unordered_set<HDF5Field> excluded_fields;
     size_t limit_top_branches = 0;
     int32_t wkld_id = -1;
@@ -910,6 +1012,7 @@ int main(int argc, char** argv) {
                            decode_target_opcodes,
                            byte_chunks,
                            exclude_loop_branches,
+                           npy_output,
                            local_history_length,
                            excluded_fields,
                            limit_top_branches,
@@ -924,18 +1027,18 @@ int main(int argc, char** argv) {
 
     if(use_unsigned_bool) {
         if(byte_chunks) {
-            processTrace<true, true>(trace, output, skip_non_user, always_fill_in_target_opcode, top_branches, excluded_fields, wkld_id, local_history_length, decode_target_opcodes, exclude_loop_branches);
+            processTrace<true, true>(trace, output, skip_non_user, always_fill_in_target_opcode, top_branches, excluded_fields, wkld_id, local_history_length, decode_target_opcodes, exclude_loop_branches, npy_output);
         }
         else {
-            processTrace<true, false>(trace, output, skip_non_user, always_fill_in_target_opcode, top_branches, excluded_fields, wkld_id, local_history_length, decode_target_opcodes, exclude_loop_branches);
+            processTrace<true, false>(trace, output, skip_non_user, always_fill_in_target_opcode, top_branches, excluded_fields, wkld_id, local_history_length, decode_target_opcodes, exclude_loop_branches, npy_output);
         }
     }
     else {
         if(byte_chunks) {
-            processTrace<false, true>(trace, output, skip_non_user, always_fill_in_target_opcode, top_branches, excluded_fields, wkld_id, local_history_length, decode_target_opcodes, exclude_loop_branches);
+            processTrace<false, true>(trace, output, skip_non_user, always_fill_in_target_opcode, top_branches, excluded_fields, wkld_id, local_history_length, decode_target_opcodes, exclude_loop_branches, npy_output);
         }
         else {
-            processTrace<false, false>(trace, output, skip_non_user, always_fill_in_target_opcode, top_branches, excluded_fields, wkld_id, local_history_length, decode_target_opcodes, exclude_loop_branches);
+            processTrace<false, false>(trace, output, skip_non_user, always_fill_in_target_opcode, top_branches, excluded_fields, wkld_id, local_history_length, decode_target_opcodes, exclude_loop_branches, npy_output);
         }
     }
 
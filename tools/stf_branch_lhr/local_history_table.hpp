@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stf_exception.hpp"
+
+/**
+ * \class LocalHistoryTable
+ * \brief Per-PC local branch history stored as fixed-length bit rings in a flat open-addressed table
+ *
+ * Every static branch owns a ring of 64-bit words plus a head index, so recording an outcome touches a
+ * single word regardless of the history length. All history words live in one contiguous vector indexed by
+ * table slot, so there is no per-branch allocation.
+ */
+class LocalHistoryTable {
+    public:
+        /**
+         * \struct Entry
+         * \brief Per-branch bookkeeping. The history bits are stored separately in the word table.
+         */
+        struct Entry {
+            uint64_t pc = 0;    /**< Branch PC */
+            uint64_t count = 0; /**< Number of times the branch executed. 0 marks an empty slot. */
+            uint32_t head = 0;  /**< Bit position the next outcome will be written to. Moves downward. */
+        };
+
+    private:
+        static constexpr size_t BITS_PER_WORD_ = 64;
+        static constexpr size_t INITIAL_CAPACITY_ = 1024;
+
+        const size_t history_length_;
+        const size_t words_per_entry_;
+        const uint32_t ring_bits_;
+
+        std::vector<Entry> entries_;
+        std::vector<uint64_t> words_;
+        size_t mask_ = 0;
+        size_t size_ = 0;
+
+        static inline size_t hash_(const uint64_t pc) {
+            // Fibonacci hashing spreads the (mostly aligned) PCs across the table
+            static constexpr uint64_t HASH_MULT = 0x9e3779b97f4a7c15ULL;
+            return static_cast<size_t>((pc >> 1) * HASH_MULT >> 32);
+        }
+
+        inline uint64_t* getWords_(const size_t slot) {
+            return words_.data() + slot * words_per_entry_;
+        }
+
+        inline const uint64_t* getWords_(const size_t slot) const {
+            return words_.data() + slot * words_per_entry_;
+        }
+
+        inline size_t findSlot_(const uint64_t pc) const {
+            size_t slot = hash_(pc) & mask_;
+            while(entries_[slot].count && entries_[slot].pc != pc) {
+                slot = (slot + 1) & mask_;
+            }
+            return slot;
+        }
+
+        void resize_(const size_t capacity) {
+            std::vector<Entry> old_entries(capacity);
+            std::vector<uint64_t> old_words(capacity * words_per_entry_, 0);
+            old_entries.swap(entries_);
+            old_words.swap(words_);
+            mask_ = capacity - 1;
+
+            for(size_t old_slot = 0; old_slot < old_entries.size(); ++old_slot) {
+                const auto& entry = old_entries[old_slot];
+                if(!entry.count) {
+                    continue;
+                }
+                const size_t slot = findSlot_(entry.pc);
+                entries_[slot] = entry;
+                std::copy_n(old_words.data() + old_slot * words_per_entry_, words_per_entry_, getWords_(slot));
+            }
+        }
+
+    public:
+        /**
+         * Constructs a LocalHistoryTable
+         * \param history_length Number of outcomes remembered for each branch
+         */
+        explicit LocalHistoryTable(const size_t history_length) :
+            history_length_(history_length),
+            words_per_entry_((history_length + BITS_PER_WORD_ - 1) / BITS_PER_WORD_),
+            ring_bits_(static_cast<uint32_t>(words_per_entry_ * BITS_PER_WORD_))
+        {
+            stf_assert(history_length_ > 0, "Local history length must be greater than 0");
+            resize_(INITIAL_CAPACITY_);
+        }
+
+        /**
+         * Records an outcome for a branch
+         * \param pc Branch PC
+         * \param taken Branch direction
+         */
+        inline void update(const uint64_t pc, const bool taken) {
+            size_t slot = findSlot_(pc);
+            auto* entry = &entries_[slot];
+
+            if(STF_EXPECT_FALSE(!entry->count)) {
+                // Keep the load factor at or below 1/2 so probe sequences stay short
+                if((size_ + 1) * 2 > entries_.size()) {
+                    resize_(entries_.size() * 2);
+                    slot = findSlot_(pc);
+                    entry = &entries_[slot];
+                }
+                entry->pc = pc;
+                ++size_;
+            }
+
+            const uint32_t head = entry->head;
+            uint64_t& word = getWords_(slot)[head / BITS_PER_WORD_];
+            const uint64_t bit = 1ULL << (head % BITS_PER_WORD_);
+            word = taken ? (word | bit) : (word & ~bit);
+
+            ++entry->count;
+            entry->head = head == 0 ? ring_bits_ - 1 : head - 1;
+        }
+
+        /**
+         * Gets a window of up to 64 outcomes without modifying the history
+         * \param entry Entry to read
+         * \param start_age Age of the youngest outcome in the window (0 = most recent)
+         * \param length Number of outcomes to read
+         * \returns Outcomes packed with the youngest in bit 0. Outcomes older than the branch itself read as 0.
+         */
+        inline uint64_t getPattern(const Entry& entry, const size_t start_age, const size_t length) const {
+            stf_assert(length <= BITS_PER_WORD_, "Pattern length cannot exceed " << BITS_PER_WORD_);
+            stf_assert(start_age + length <= history_length_, "Pattern extends past the end of the history");
+
+            if(length == 0) {
+                return 0;
+            }
+
+            // Outcomes are written at descending bit positions, so reading upwards from the most recent outcome
+            // yields the youngest outcome in bit 0. Slots that have never been written are still 0.
+            const size_t start = (entry.head + 1 + start_age) % ring_bits_;
+            const uint64_t* words = getWords_(static_cast<size_t>(&entry - entries_.data()));
+            const size_t word_idx = start / BITS_PER_WORD_;
+            const size_t bit_idx = start % BITS_PER_WORD_;
+
+            // The window spans at most two (ring-adjacent) words
+            uint64_t pattern = words[word_idx] >> bit_idx;
+            if(bit_idx + length > BITS_PER_WORD_) {
+                pattern |= words[(word_idx + 1) % words_per_entry_] << (BITS_PER_WORD_ - bit_idx);
+            }
+            if(length < BITS_PER_WORD_) {
+                pattern &= (1ULL << length) - 1;
+            }
+
+            return pattern;
+        }
+
+        /**
+         * Formats the full history of a branch, oldest outcome first
+         * \param entry Entry to format
+         */
+        std::string toString(const Entry& entry) const {
+            std::string str(history_length_, '0');
+            size_t age = 0;
+            while(age < history_length_) {
+                const size_t length = std::min(BITS_PER_WORD_, history_length_ - age);
+                const uint64_t pattern = getPattern(entry, age, length);
+                for(size_t i = 0; i < length; ++i) {
+                    if((pattern >> i) & 1) {
+                        str[history_length_ - 1 - age - i] = '1';
+                    }
+                }
+                age += length;
+            }
+            return str;
+        }
+
+        /**
+         * Gets pointers to every occupied entry, sorted by PC
+         */
+        std::vector<const Entry*> getSortedEntries() const {
+            std::vector<const Entry*> sorted;
+            sorted.reserve(size_);
+            for(const auto& entry: entries_) {
+                if(entry.count) {
+                    sorted.emplace_back(&entry);
+                }
+            }
+            std::sort(sorted.begin(), sorted.end(), [](const Entry* lhs, const Entry* rhs) { return lhs->pc < rhs->pc; });
+            return sorted;
+        }
+
+        /**
+         * Gets the number of static branches in the table
+         */
+        inline size_t size() const {
+            return size_;
+        }
+
+        /**
+         * Gets the history length
+         */
+        inline size_t getHistoryLength() const {
+            return history_length_;
+        }
+
+        /**
+         * Gets the number of bytes allocated for the table
+         */
+        inline size_t getMemoryUsage() const {
+            return entries_.capacity() * sizeof(Entry) + words_.capacity() * sizeof(uint64_t);
+        }
+};
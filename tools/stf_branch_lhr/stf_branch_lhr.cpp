@@ -1,49 +1,143 @@
+#include <bitset>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "stf_decoder.hpp"
 
 #include "print_utils.hpp"
 #include "stf_branch_reader.hpp"
 #include "command_line_parser.hpp"
-#include <boost/multiprecision/cpp_int.hpp>
+#include "local_history_table.hpp"
 
 void processCommandLine(int argc,
                         char** argv,
                         std::string& trace,
                         bool& verbose,
-                        bool& skip_non_user) {
+                        bool& skip_non_user,
+                        size_t& history_length,
+                        bool& benchmark) {
     trace_tools::CommandLineParser parser("stf_branch_lhr");
     parser.appendHelpText("Detect and output the local history of all static branches in the specified STF");
     parser.addFlag('v', "verbose mode (prints indirect branch targets)");
     parser.addFlag('u', "skip non user-mode instructions");
+    parser.addFlag('l', "length", "number of outcomes to keep for each branch (default 1000)");
+    parser.addFlag('b', "compare the performance of the ring buffer history table against the original bitset implementation instead of printing histories");
     parser.addPositionalArgument("trace", "trace in STF format");
     parser.parseArguments(argc, argv);
     verbose = parser.hasArgument('v');
     skip_non_user = parser.hasArgument('u');
+    parser.getArgumentValue('l', history_length);
+    benchmark = parser.hasArgument('b');
 
     parser.getPositionalArgument(0, trace);
+
+    parser.assertCondition(history_length > 0, "History length must be greater than 0");
 }
 
 
+/**
+ * Original std::map + std::bitset implementation, kept as the baseline for the -b benchmark
+ */
 struct BranchInfo {
     static constexpr uint32_t MAX_LHR = 1000;
     uint32_t count = 0;
     std::bitset<MAX_LHR> lhr;
 };
 
+using BranchOutcomes = std::vector<std::pair<uint64_t, bool>>;
+
+template<typename Func>
+inline double timeIt(Func&& func) {
+    const auto start = std::chrono::steady_clock::now();
+    func();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/**
+ * Replays the conditional branches in the trace through both history implementations and reports the time
+ * and memory each one needs. The histories are compared afterwards to make sure the implementations agree.
+ */
+int runBenchmark(stf::STFBranchReader& reader, const size_t history_length) {
+    BranchOutcomes outcomes;
+    for(const auto& branch: reader) {
+        if(branch.isConditional()) {
+            outcomes.emplace_back(branch.getPC(), branch.isTaken());
+        }
+    }
+
+    std::map<uint64_t, BranchInfo> legacy;
+    const double legacy_time = timeIt([&legacy, &outcomes]() {
+        for(const auto& [pc, taken]: outcomes) {
+            auto& branch_info = legacy[pc];
+            ++branch_info.count;
+            branch_info.lhr <<= 1;
+            if(taken) {
+                branch_info.lhr |= 0x1;
+            }
+        }
+    });
+
+    LocalHistoryTable table(history_length);
+    const double table_time = timeIt([&table, &outcomes]() {
+        for(const auto& [pc, taken]: outcomes) {
+            table.update(pc, taken);
+        }
+    });
+
+    // Compare the overlapping portion of the histories
+    const size_t compare_length = std::min<size_t>(history_length, BranchInfo::MAX_LHR);
+    size_t num_mismatches = 0;
+    for(const auto* entry: table.getSortedEntries()) {
+        const auto& branch_info = legacy.at(entry->pc);
+        const auto lhr = branch_info.lhr.to_string();
+        const auto ring = table.toString(*entry);
+        if(branch_info.count != entry->count ||
+           lhr.compare(lhr.size() - compare_length, compare_length, ring, ring.size() - compare_length, compare_length) != 0) {
+            ++num_mismatches;
+        }
+    }
+
+    // std::map nodes carry 3 pointers and a color field in addition to the key and value
+    static constexpr size_t MAP_NODE_OVERHEAD = 4 * sizeof(void*);
+    const size_t legacy_memory = legacy.size() * (sizeof(uint64_t) + sizeof(BranchInfo) + MAP_NODE_OVERHEAD);
+
+    const auto report = [&outcomes](const char* name, const double time, const size_t memory) {
+        std::cout << std::setw(24) << std::left << name
+                  << std::setw(14) << std::right << std::fixed << std::setprecision(6) << time << " s"
+                  << std::setw(16) << std::setprecision(2) << (static_cast<double>(outcomes.size()) / time / 1e6) << " M updates/s"
+                  << std::setw(16) << memory << " bytes" << std::endl;
+    };
+
+    std::cout << outcomes.size() << " conditional branches, " << table.size() << " static branches" << std::endl;
+    report("bitset (1000)", legacy_time, legacy_memory);
+    report(("ring (" + std::to_string(history_length) + ")").c_str(), table_time, table.getMemoryUsage());
+
+    if(num_mismatches) {
+        std::cerr << "ERROR: " << num_mismatches << " branch histories differ between implementations" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
 
 // This program detects and outputs local history of all static branches in the specified trace
 int main(int argc, char** argv) {
     std::string trace;
     bool verbose = false;
     bool skip_non_user = false;
+    size_t history_length = BranchInfo::MAX_LHR;
+    bool benchmark = false;
 
     try {
-        processCommandLine(argc, argv, trace, verbose, skip_non_user);
+        processCommandLine(argc, argv, trace, verbose, skip_non_user, history_length, benchmark);
     }
     catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
         std::cerr << e.what() << std::endl;
@@ -52,30 +146,25 @@ int main(int argc, char** argv) {
 
     stf::STFBranchReader reader(trace, skip_non_user);
 
-    std::map<uint64_t, BranchInfo> branches;
+    if(benchmark) {
+        return runBenchmark(reader, history_length);
+    }
+
+    LocalHistoryTable branches(history_length);
 
     // Determine the local history of all conditional branches in trace
     for(const auto& branch: reader) {
         if (branch.isConditional()) {
-            const auto pc = branch.getPC();
-            const bool is_taken = branch.isTaken();
-            auto& branch_info = branches[pc];
-            ++branch_info.count;
-            branch_info.lhr <<= 1;
-            if(is_taken) {
-                branch_info.lhr |= 0x1;
-            }
+            branches.update(branch.getPC(), branch.isTaken());
         }
     }
 
     std::cout << std::setw(10) << "PC  " << std::setw(7) << "br_count " << " LHR" << std::endl;
     std::cout << std::endl;
-    for(const auto& branch: branches) {
-        const auto& branch_info = branch.second;
-        const auto pc = branch.first;
-        std::cout << std::hex << std::setw(10) << pc
-                  << " " << std::dec << std::setw(7) << branch_info.count
-                  << " " << branch_info.lhr.to_string()
+    for(const auto* branch_info: branches.getSortedEntries()) {
+        std::cout << std::hex << std::setw(10) << branch_info->pc
+                  << " " << std::dec << std::setw(7) << branch_info->count
+                  << " " << branches.toString(*branch_info)
                   << std::endl;
     }
 
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "branch_batch_buffer.hpp"
+#include "branch_predictor.hpp"
+
+namespace branch_predictor {
+    /**
+     * \class PredictorStats
+     * \brief Accuracy statistics collected for a single predictor
+     */
+    class PredictorStats {
+        public:
+            struct Counts {
+                uint64_t branches = 0;
+                uint64_t mispredicts = 0;
+
+                inline void count(const bool mispredicted) {
+                    ++branches;
+                    mispredicts += mispredicted;
+                }
+
+                inline double accuracy() const {
+                    return branches ? 1.0 - static_cast<double>(mispredicts) / static_cast<double>(branches) : 1.0;
+                }
+            };
+
+        private:
+            const uint64_t interval_length_;
+            Counts total_;
+            std::unordered_map<uint64_t, Counts> per_pc_;
+            std::vector<Counts> intervals_;
+
+        public:
+            explicit PredictorStats(const uint64_t interval_length) :
+                interval_length_(interval_length)
+            {
+            }
+
+            inline void count(const BranchRecord& branch, const bool mispredicted) {
+                total_.count(mispredicted);
+                per_pc_[branch.pc].count(mispredicted);
+
+                if(interval_length_) {
+                    const auto interval = static_cast<size_t>(branch.index / interval_length_);
+                    if(STF_EXPECT_FALSE(interval >= intervals_.size())) {
+                        intervals_.resize(interval + 1);
+                    }
+                    intervals_[interval].count(mispredicted);
+                }
+            }
+
+            inline const Counts& getTotal() const {
+                return total_;
+            }
+
+            inline const auto& getPerPC() const {
+                return per_pc_;
+            }
+
+            inline const auto& getIntervals() const {
+                return intervals_;
+            }
+
+            inline uint64_t getIntervalLength() const {
+                return interval_length_;
+            }
+    };
+
+    /**
+     * \class PredictorWorker
+     * \brief Runs a single predictor on its own thread, consuming every batch from a BranchBatchBuffer
+     */
+    class PredictorWorker {
+        private:
+            BranchPredictor::Handle predictor_;
+            PredictorStats stats_;
+            std::exception_ptr exception_;
+            std::thread thread_;
+
+            void run_(BranchBatchBuffer& buffer) {
+                buffer.consumeAll([this, &buffer](const BranchBatchBuffer::Batch& batch) {
+                    // Once the predictor has failed, keep releasing batches so that the reader is never blocked
+                    if(STF_EXPECT_FALSE(exception_)) {
+                        return;
+                    }
+
+                    try {
+                        for(const auto& branch: batch) {
+                            if(STF_EXPECT_TRUE(branch.conditional)) {
+                                const bool predicted = predictor_->predict(branch);
+                                predictor_->update(branch, predicted);
+                                stats_.count(branch, predicted != branch.taken);
+                            }
+                            else {
+                                predictor_->trackUnconditional(branch);
+                            }
+                        }
+                    }
+                    catch(...) {
+                        exception_ = std::current_exception();
+                        buffer.stop();
+                    }
+                });
+            }
+
+        public:
+            PredictorWorker(BranchPredictor::Handle&& predictor, const uint64_t interval_length) :
+                predictor_(std::move(predictor)),
+                stats_(interval_length)
+            {
+            }
+
+            PredictorWorker(PredictorWorker&& rhs) :
+                predictor_(std::move(rhs.predictor_)),
+                stats_(std::move(rhs.stats_)),
+                exception_(std::move(rhs.exception_))
+            {
+                stf_assert(!rhs.thread_.joinable(), "Cannot move a running PredictorWorker");
+            }
+
+            ~PredictorWorker() {
+                if(thread_.joinable()) {
+                    thread_.join();
+                }
+            }
+
+            /**
+             * Starts the worker thread
+             */
+            inline void start(BranchBatchBuffer& buffer) {
+                thread_ = std::thread([this, &buffer]() { run_(buffer); });
+            }
+
+            /**
+             * Waits for the worker thread to consume every batch. Rethrows the exception if the predictor failed.
+             */
+            inline void join() {
+                if(thread_.joinable()) {
+                    thread_.join();
+                }
+                if(STF_EXPECT_FALSE(exception_)) {
+                    std::rethrow_exception(std::exchange(exception_, nullptr));
+                }
+            }
+
+            inline std::string getName() const {
+                return predictor_->getName();
+            }
+
+            inline const PredictorStats& getStats() const {
+                return stats_;
+            }
+    };
+} // end namespace branch_predictor
@@ -0,0 +1,612 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "branch_history.hpp"
+#include "branch_predictor.hpp"
+
+namespace branch_predictor {
+    /**
+     * \class BimodalPredictor
+     * \brief PC-indexed table of 2-bit counters
+     *
+     * Parameters: log_entries (default 14)
+     */
+    class BimodalPredictor : public BranchPredictor {
+        private:
+            const size_t log_entries_;
+            const uint64_t mask_;
+            std::vector<SaturatingCounter<int8_t, 2>> table_;
+
+            inline auto& getEntry_(const uint64_t pc) {
+                return table_[pcHash(pc) & mask_];
+            }
+
+        public:
+            explicit BimodalPredictor(const PredictorParams& params) :
+                log_entries_(params.getLog2("log_entries", 14)),
+                mask_((1ULL << log_entries_) - 1),
+                table_(1ULL << log_entries_)
+            {
+            }
+
+            std::string getName() const final {
+                return "bimodal(log_entries=" + std::to_string(log_entries_) + ")";
+            }
+
+            bool predict(const BranchRecord& branch) final {
+                return getEntry_(branch.pc).taken();
+            }
+
+            void update(const BranchRecord& branch, const bool) final {
+                getEntry_(branch.pc).update(branch.taken);
+            }
+    };
+
+    /**
+     * \class GSharePredictor
+     * \brief Table of 2-bit counters indexed by PC XOR global history
+     *
+     * Parameters: log_entries (default 16), history (default 16)
+     */
+    class GSharePredictor : public BranchPredictor {
+        private:
+            const size_t log_entries_;
+            const size_t history_length_;
+            const uint64_t mask_;
+            const uint64_t history_mask_;
+            uint64_t history_ = 0;
+            std::vector<SaturatingCounter<int8_t, 2>> table_;
+
+            inline auto& getEntry_(const uint64_t pc) {
+                return table_[(pcHash(pc) ^ history_) & mask_];
+            }
+
+        public:
+            explicit GSharePredictor(const PredictorParams& params) :
+                log_entries_(params.getLog2("log_entries", 16)),
+                history_length_(params.get<size_t>("history", 16)),
+                mask_((1ULL << log_entries_) - 1),
+                history_mask_(history_length_ >= 64 ? std::numeric_limits<uint64_t>::max() : (1ULL << history_length_) - 1),
+                table_(1ULL << log_entries_)
+            {
+            }
+
+            std::string getName() const final {
+                return "gshare(log_entries=" + std::to_string(log_entries_) +
+                       ",history=" + std::to_string(history_length_) + ")";
+            }
+
+            bool predict(const BranchRecord& branch) final {
+                return getEntry_(branch.pc).taken();
+            }
+
+            void update(const BranchRecord& branch, const bool) final {
+                getEntry_(branch.pc).update(branch.taken);
+                history_ = ((history_ << 1) | branch.taken) & history_mask_;
+            }
+    };
+
+    /**
+     * \class PerceptronPredictor
+     * \brief Global history perceptron predictor (Jimenez & Lin)
+     *
+     * Parameters: log_entries (default 10), history (default 32)
+     */
+    class PerceptronPredictor : public BranchPredictor {
+        private:
+            using Weight = int8_t;
+            static constexpr int WEIGHT_MAX_ = std::numeric_limits<Weight>::max();
+            static constexpr int WEIGHT_MIN_ = std::numeric_limits<Weight>::min();
+
+            const size_t log_entries_;
+            const size_t history_length_;
+            const uint64_t mask_;
+            const int threshold_;
+            std::vector<Weight> weights_;
+            std::vector<int8_t> history_;
+            int last_output_ = 0;
+
+            inline Weight* getWeights_(const uint64_t pc) {
+                return weights_.data() + (pcHash(pc) & mask_) * (history_length_ + 1);
+            }
+
+            static inline void train_(Weight& w, const bool increment) {
+                const int val = w + (increment ? 1 : -1);
+                w = static_cast<Weight>(std::clamp(val, WEIGHT_MIN_, WEIGHT_MAX_));
+            }
+
+        public:
+            explicit PerceptronPredictor(const PredictorParams& params) :
+                log_entries_(params.getLog2("log_entries", 10)),
+                history_length_(params.get<size_t>("history", 32)),
+                mask_((1ULL << log_entries_) - 1),
+                threshold_(static_cast<int>(1.93 * static_cast<double>(history_length_) + 14)),
+                weights_((1ULL << log_entries_) * (history_length_ + 1), 0),
+                history_(history_length_, -1)
+            {
+            }
+
+            std::string getName() const final {
+                return "perceptron(log_entries=" + std::to_string(log_entries_) +
+                       ",history=" + std::to_string(history_length_) + ")";
+            }
+
+            bool predict(const BranchRecord& branch) final {
+                const auto* const w = getWeights_(branch.pc);
+                int y = w[0];
+                for(size_t i = 0; i < history_length_; ++i) {
+                    y += w[i + 1] * history_[i];
+                }
+                last_output_ = y;
+                return y >= 0;
+            }
+
+            void update(const BranchRecord& branch, const bool predicted) final {
+                if(predicted != branch.taken || std::abs(last_output_) <= threshold_) {
+                    auto* const w = getWeights_(branch.pc);
+                    train_(w[0], branch.taken);
+                    for(size_t i = 0; i < history_length_; ++i) {
+                        train_(w[i + 1], branch.taken == (history_[i] > 0));
+                    }
+                }
+
+                if(history_length_) {
+                    std::move_backward(history_.begin(), history_.end() - 1, history_.end());
+                    history_[0] = static_cast<int8_t>(branch.taken ? 1 : -1);
+                }
+            }
+    };
+
+    /**
+     * \class TAGESCLPredictor
+     * \brief TAGE predictor with a statistical corrector and loop predictor (after Seznec's TAGE-SC-L)
+     *
+     * This is a compact model intended for relative comparisons rather than a cycle-accurate reproduction
+     * of the championship predictor.
+     *
+     * Parameters: tables (default 10), log_entries (default 10), log_base (default 13), min_history (default 4),
+     *             max_history (default 640), tag_bits (default 11), loop (default 1), sc (default 1)
+     */
+    class TAGESCLPredictor : public BranchPredictor {
+        private:
+            using Counter3 = SaturatingCounter<int8_t, 3>;
+            using Counter2 = SaturatingCounter<int8_t, 2>;
+
+            struct TaggedEntry {
+                Counter3 ctr;
+                uint16_t tag = 0;
+                uint8_t u = 0;
+            };
+
+            struct LoopEntry {
+                uint16_t tag = 0;
+                uint16_t past_iter = 0;
+                uint16_t current_iter = 0;
+                uint8_t confidence = 0;
+                uint8_t age = 0;
+                bool dir = false;
+            };
+
+            static constexpr uint8_t USEFUL_MAX_ = 3;
+            static constexpr uint64_t USEFUL_RESET_PERIOD_ = 1ULL << 18;
+            static constexpr size_t LOG_LOOP_ENTRIES_ = 8;
+            static constexpr uint8_t LOOP_CONFIDENCE_MAX_ = 3;
+            static constexpr uint8_t LOOP_AGE_MAX_ = 31;
+            static constexpr size_t LOG_SC_ENTRIES_ = 10;
+            static constexpr std::array<size_t, 4> SC_HISTORY_LENGTHS_{0, 6, 11, 21};
+            static constexpr int SC_THRESHOLD_MIN_ = 6;
+            static constexpr int SC_THRESHOLD_MAX_ = 127;
+
+            const size_t num_tables_;
+            const size_t log_entries_;
+            const size_t log_base_;
+            const size_t min_history_;
+            const size_t max_history_;
+            const size_t tag_bits_;
+            const bool use_loop_;
+            const bool use_sc_;
+
+            std::vector<size_t> history_lengths_;
+            GlobalHistory history_;
+            uint64_t path_history_ = 0;
+            std::vector<FoldedHistory> index_folds_;
+            std::vector<FoldedHistory> tag_folds0_;
+            std::vector<FoldedHistory> tag_folds1_;
+
+            std::vector<Counter2> base_;
+            std::vector<std::vector<TaggedEntry>> tables_;
+
+            std::vector<LoopEntry> loop_table_;
+            SaturatingCounter<int8_t, 7> use_loop_ctr_{-1};
+
+            std::vector<FoldedHistory> sc_folds_;
+            std::vector<std::vector<SaturatingCounter<int8_t, 6>>> sc_tables_;
+            int sc_threshold_ = 35;
+            SaturatingCounter<int8_t, 7> sc_threshold_ctr_;
+
+            SaturatingCounter<int8_t, 4> use_alt_on_na_;
+            uint64_t num_updates_ = 0;
+            uint64_t rng_ = 0x2545F4914F6CDD1DULL;
+
+            // Per-prediction state that is consumed by update()
+            std::vector<uint32_t> indices_;
+            std::vector<uint16_t> tags_;
+            int provider_ = -1;
+            int alt_provider_ = -1;
+            bool provider_pred_ = false;
+            bool alt_pred_ = false;
+            bool tage_pred_ = false;
+            bool loop_hit_ = false;
+            bool loop_valid_ = false;
+            bool loop_pred_ = false;
+            uint32_t loop_index_ = 0;
+            uint16_t loop_tag_ = 0;
+            bool sc_pred_ = false;
+            int sc_sum_ = 0;
+            std::array<uint32_t, SC_HISTORY_LENGTHS_.size()> sc_indices_{};
+
+            inline uint32_t nextRandom_() {
+                rng_ ^= rng_ << 13;
+                rng_ ^= rng_ >> 7;
+                rng_ ^= rng_ << 17;
+                return static_cast<uint32_t>(rng_);
+            }
+
+            inline uint32_t baseIndex_(const uint64_t pc) const {
+                return static_cast<uint32_t>(pcHash(pc) & ((1ULL << log_base_) - 1));
+            }
+
+            inline uint32_t taggedIndex_(const uint64_t pc, const size_t table) const {
+                const uint64_t hpc = pcHash(pc);
+                const uint64_t path = path_history_ & ((1ULL << std::min<size_t>(history_lengths_[table], 16)) - 1);
+                const uint64_t idx = hpc ^ (hpc >> (log_entries_ - table % log_entries_)) ^ index_folds_[table].get() ^ path;
+                return static_cast<uint32_t>(idx & ((1ULL << log_entries_) - 1));
+            }
+
+            inline uint16_t taggedTag_(const uint64_t pc, const size_t table) const {
+                const uint64_t tag = pcHash(pc) ^ tag_folds0_[table].get() ^ (static_cast<uint64_t>(tag_folds1_[table].get()) << 1);
+                return static_cast<uint16_t>(tag & ((1ULL << tag_bits_) - 1));
+            }
+
+            inline void predictLoop_(const uint64_t pc) {
+                const uint64_t hpc = pcHash(pc);
+                loop_index_ = static_cast<uint32_t>(hpc & ((1ULL << LOG_LOOP_ENTRIES_) - 1));
+                loop_tag_ = static_cast<uint16_t>((hpc >> LOG_LOOP_ENTRIES_) & 0x3FFF);
+                const auto& entry = loop_table_[loop_index_];
+                loop_hit_ = entry.age && entry.tag == loop_tag_;
+                loop_valid_ = loop_hit_ && entry.confidence == LOOP_CONFIDENCE_MAX_;
+                loop_pred_ = (entry.current_iter + 1 == entry.past_iter) ? !entry.dir : entry.dir;
+            }
+
+            inline void updateLoop_(const bool taken, const bool tage_mispredicted) {
+                auto& entry = loop_table_[loop_index_];
+                if(loop_hit_) {
+                    if(loop_valid_ && loop_pred_ != taken) {
+                        // The loop predictor was confident and wrong - give up on this entry
+                        entry = LoopEntry();
+                        return;
+                    }
+
+                    if(loop_valid_ && loop_pred_ != tage_pred_ && entry.age < LOOP_AGE_MAX_) {
+                        ++entry.age;
+                    }
+
+                    ++entry.current_iter;
+                    if(entry.current_iter == 0) {
+                        // Iteration count overflowed
+                        entry = LoopEntry();
+                        return;
+                    }
+
+                    if(taken != entry.dir) {
+                        if(entry.current_iter == entry.past_iter) {
+                            entry.confidence = static_cast<uint8_t>(std::min<int>(entry.confidence + 1, LOOP_CONFIDENCE_MAX_));
+                        }
+                        else if(entry.past_iter == 0) {
+                            entry.past_iter = entry.current_iter;
+                        }
+                        else {
+                            entry = LoopEntry();
+                            return;
+                        }
+                        entry.current_iter = 0;
+                    }
+                }
+                else if(tage_mispredicted) {
+                    // Only replace entries that have aged out, and age the current occupant occasionally
+                    if(entry.age == 0) {
+                        entry = LoopEntry();
+                        entry.tag = loop_tag_;
+                        entry.dir = !taken;
+                        entry.age = 7;
+                    }
+                    else if((nextRandom_() & 3) == 0) {
+                        --entry.age;
+                    }
+                }
+            }
+
+            inline void predictSC_(const uint64_t pc) {
+                const uint64_t hpc = pcHash(pc);
+                const uint32_t sc_mask = (1U << LOG_SC_ENTRIES_) - 1;
+                sc_sum_ = 0;
+                for(size_t i = 0; i < SC_HISTORY_LENGTHS_.size(); ++i) {
+                    // Table 0 is a bias table indexed by PC and the TAGE prediction
+                    const uint64_t hist = i == 0 ? tage_pred_ : sc_folds_[i].get();
+                    sc_indices_[i] = static_cast<uint32_t>((hpc ^ (hist << 1) ^ (hpc >> (LOG_SC_ENTRIES_ - i))) & sc_mask);
+                    sc_sum_ += sc_tables_[i][sc_indices_[i]].centered();
+                }
+
+                // Bias the sum toward the TAGE prediction based on its confidence
+                if(provider_ >= 0) {
+                    const auto& ctr = tables_[static_cast<size_t>(provider_)][indices_[static_cast<size_t>(provider_)]].ctr;
+                    sc_sum_ += (tage_pred_ ? 1 : -1) * (ctr.weak() ? 4 : 16);
+                }
+                else {
+                    sc_sum_ += tage_pred_ ? 8 : -8;
+                }
+
+                sc_pred_ = sc_sum_ >= 0;
+            }
+
+            inline void updateSC_(const bool taken) {
+                if(sc_pred_ != taken || std::abs(sc_sum_) < sc_threshold_) {
+                    for(size_t i = 0; i < SC_HISTORY_LENGTHS_.size(); ++i) {
+                        sc_tables_[i][sc_indices_[i]].update(taken);
+                    }
+                }
+
+                if(sc_pred_ != tage_pred_) {
+                    // Adapt the threshold: raise it if overriding TAGE hurt, lower it if it helped
+                    sc_threshold_ctr_.update(sc_pred_ != taken);
+                    if(sc_threshold_ctr_.get() == 63) {
+                        sc_threshold_ = std::min(sc_threshold_ + 1, SC_THRESHOLD_MAX_);
+                        sc_threshold_ctr_.set(0);
+                    }
+                    else if(sc_threshold_ctr_.get() == -64) {
+                        sc_threshold_ = std::max(sc_threshold_ - 1, SC_THRESHOLD_MIN_);
+                        sc_threshold_ctr_.set(0);
+                    }
+                }
+            }
+
+            inline void allocate_(const bool taken) {
+                const size_t start = static_cast<size_t>(provider_ + 1);
+                if(start >= num_tables_) {
+                    return;
+                }
+
+                // Randomly skip the first candidate to spread allocations across tables
+                size_t first = start;
+                if(first + 1 < num_tables_ && (nextRandom_() & 1)) {
+                    ++first;
+                }
+
+                bool allocated = false;
+                for(size_t i = first; i < num_tables_; ++i) {
+                    auto& entry = tables_[i][indices_[i]];
+                    if(entry.u == 0) {
+                        entry.tag = tags_[i];
+                        entry.ctr.set(taken ? 0 : -1);
+                        allocated = true;
+                        break;
+                    }
+                }
+
+                if(!allocated) {
+                    for(size_t i = start; i < num_tables_; ++i) {
+                        auto& u = tables_[i][indices_[i]].u;
+                        u = static_cast<uint8_t>(u - (u > 0));
+                    }
+                }
+            }
+
+            inline void updateHistories_(const bool taken, const uint64_t pc) {
+                history_.push(taken);
+                path_history_ = (path_history_ << 1) | (pcHash(pc) & 1);
+                for(size_t i = 0; i < num_tables_; ++i) {
+                    index_folds_[i].update(history_);
+                    tag_folds0_[i].update(history_);
+                    tag_folds1_[i].update(history_);
+                }
+                for(size_t i = 1; i < sc_folds_.size(); ++i) {
+                    sc_folds_[i].update(history_);
+                }
+            }
+
+        public:
+            explicit TAGESCLPredictor(const PredictorParams& params) :
+                num_tables_(params.get<size_t>("tables", 10)),
+                log_entries_(params.getLog2("log_entries", 10)),
+                log_base_(params.getLog2("log_base", 13)),
+                min_history_(params.get<size_t>("min_history", 4)),
+                max_history_(params.get<size_t>("max_history", 640)),
+                tag_bits_(params.get<size_t>("tag_bits", 11)),
+                use_loop_(params.get<int>("loop", 1)),
+                use_sc_(params.get<int>("sc", 1)),
+                history_(1),
+                base_(1ULL << log_base_),
+                tables_(num_tables_, std::vector<TaggedEntry>(1ULL << log_entries_)),
+                loop_table_(1ULL << LOG_LOOP_ENTRIES_),
+                sc_folds_(SC_HISTORY_LENGTHS_.size()),
+                sc_tables_(SC_HISTORY_LENGTHS_.size(), std::vector<SaturatingCounter<int8_t, 6>>(1ULL << LOG_SC_ENTRIES_)),
+                indices_(num_tables_),
+                tags_(num_tables_)
+            {
+                stf_assert(num_tables_ >= 2, "TAGE-SC-L requires at least 2 tagged tables");
+                stf_assert(min_history_ > 0 && max_history_ > min_history_, "TAGE-SC-L requires 0 < min_history < max_history");
+                stf_assert(tag_bits_ > 0 && tag_bits_ <= 16, "TAGE-SC-L tag_bits must be between 1 and 16");
+
+                // Geometric series of history lengths
+                const double ratio = std::pow(static_cast<double>(max_history_) / static_cast<double>(min_history_),
+                                              1.0 / static_cast<double>(num_tables_ - 1));
+                for(size_t i = 0; i < num_tables_; ++i) {
+                    const auto len = static_cast<size_t>(static_cast<double>(min_history_) * std::pow(ratio, static_cast<double>(i)) + 0.5);
+                    history_lengths_.emplace_back(i == 0 ? min_history_ : std::max(len, history_lengths_.back() + 1));
+                    index_folds_.emplace_back(history_lengths_[i], log_entries_);
+                    tag_folds0_.emplace_back(history_lengths_[i], tag_bits_);
+                    tag_folds1_.emplace_back(history_lengths_[i], tag_bits_ - 1 ? tag_bits_ - 1 : 1);
+                }
+
+                for(size_t i = 1; i < SC_HISTORY_LENGTHS_.size(); ++i) {
+                    sc_folds_[i] = FoldedHistory(SC_HISTORY_LENGTHS_[i], LOG_SC_ENTRIES_);
+                }
+
+                history_ = GlobalHistory(std::max(history_lengths_.back(), SC_HISTORY_LENGTHS_.back()));
+            }
+
+            std::string getName() const final {
+                std::ostringstream ss;
+                ss << "tage-sc-l(tables=" << num_tables_
+                   << ",log_entries=" << log_entries_
+                   << ",history=" << min_history_ << '-' << history_lengths_.back()
+                   << ",loop=" << use_loop_
+                   << ",sc=" << use_sc_ << ')';
+                return ss.str();
+            }
+
+            bool predict(const BranchRecord& branch) final {
+                const uint64_t pc = branch.pc;
+                provider_ = -1;
+                alt_provider_ = -1;
+
+                for(size_t i = 0; i < num_tables_; ++i) {
+                    indices_[i] = taggedIndex_(pc, i);
+                    tags_[i] = taggedTag_(pc, i);
+                }
+
+                for(int i = static_cast<int>(num_tables_) - 1; i >= 0; --i) {
+                    const auto ui = static_cast<size_t>(i);
+                    if(tables_[ui][indices_[ui]].tag == tags_[ui]) {
+                        if(provider_ < 0) {
+                            provider_ = i;
+                        }
+                        else {
+                            alt_provider_ = i;
+                            break;
+                        }
+                    }
+                }
+
+                const bool base_pred = base_[baseIndex_(pc)].taken();
+                alt_pred_ = alt_provider_ >= 0 ?
+                    tables_[static_cast<size_t>(alt_provider_)][indices_[static_cast<size_t>(alt_provider_)]].ctr.taken() :
+                    base_pred;
+
+                if(provider_ >= 0) {
+                    const auto& entry = tables_[static_cast<size_t>(provider_)][indices_[static_cast<size_t>(provider_)]];
+                    provider_pred_ = entry.ctr.taken();
+                    const bool newly_allocated = entry.ctr.weak() && entry.u == 0;
+                    tage_pred_ = (newly_allocated && use_alt_on_na_.taken()) ? alt_pred_ : provider_pred_;
+                }
+                else {
+                    provider_pred_ = base_pred;
+                    tage_pred_ = base_pred;
+                }
+
+                bool pred = tage_pred_;
+
+                if(use_sc_) {
+                    predictSC_(pc);
+                    pred = sc_pred_;
+                }
+
+                if(use_loop_) {
+                    predictLoop_(pc);
+                    if(loop_valid_ && use_loop_ctr_.taken()) {
+                        pred = loop_pred_;
+                    }
+                }
+
+                return pred;
+            }
+
+            void update(const BranchRecord& branch, const bool) final {
+                const bool taken = branch.taken;
+                const uint64_t pc = branch.pc;
+
+                if(use_loop_) {
+                    if(loop_valid_ && loop_pred_ != tage_pred_) {
+                        use_loop_ctr_.update(loop_pred_ == taken);
+                    }
+                    updateLoop_(taken, tage_pred_ != taken);
+                }
+
+                if(use_sc_) {
+                    updateSC_(taken);
+                }
+
+                if(tage_pred_ != taken) {
+                    allocate_(taken);
+                }
+
+                if(provider_ >= 0) {
+                    auto& entry = tables_[static_cast<size_t>(provider_)][indices_[static_cast<size_t>(provider_)]];
+                    if(entry.ctr.weak() && entry.u == 0 && provider_pred_ != alt_pred_) {
+                        use_alt_on_na_.update(alt_pred_ == taken);
+                    }
+
+                    entry.ctr.update(taken);
+                    if(alt_provider_ < 0) {
+                        base_[baseIndex_(pc)].update(taken);
+                    }
+
+                    if(provider_pred_ != alt_pred_) {
+                        if(provider_pred_ == taken) {
+                            entry.u = static_cast<uint8_t>(std::min<int>(entry.u + 1, USEFUL_MAX_));
+                        }
+                        else {
+                            entry.u = static_cast<uint8_t>(entry.u - (entry.u > 0));
+                        }
+                    }
+                }
+                else {
+                    base_[baseIndex_(pc)].update(taken);
+                }
+
+                if(++num_updates_ % USEFUL_RESET_PERIOD_ == 0) {
+                    for(auto& table: tables_) {
+                        for(auto& entry: table) {
+                            entry.u >>= 1;
+                        }
+                    }
+                }
+
+                updateHistories_(taken, pc);
+            }
+
+            void trackUnconditional(const BranchRecord& branch) final {
+                updateHistories_(true, branch.pc);
+            }
+    };
+
+    /**
+     * Constructs one of the built-in predictors
+     * \param name Predictor name
+     * \param params Predictor parameters
+     * \returns nullptr if name does not match a built-in predictor
+     */
+    inline BranchPredictor::Handle makeBuiltinPredictor(const std::string_view name, const PredictorParams& params) {
+        if(name == "bimodal") {
+            return std::make_unique<BimodalPredictor>(params);
+        }
+        if(name == "gshare") {
+            return std::make_unique<GSharePredictor>(params);
+        }
+        if(name == "perceptron") {
+            return std::make_unique<PerceptronPredictor>(params);
+        }
+        if(name == "tage-sc-l") {
+            return std::make_unique<TAGESCLPredictor>(params);
+        }
+        return nullptr;
+    }
+} // end namespace branch_predictor
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include "format_utils.hpp"
+#include "stf_branch_reader.hpp"
+
+#include "command_line_parser.hpp"
+#include "file_utils.hpp"
+#include "predictors.hpp"
+#include "predictor_sim.hpp"
+
+/**
+ * \class PluginPredictor
+ * \brief Wraps a BranchPredictor loaded from a shared library
+ */
+class PluginPredictor : public branch_predictor::BranchPredictor {
+    private:
+        struct HandleCloser {
+            void operator()(void* handle) const {
+                dlclose(handle);
+            }
+        };
+
+        // Declared first so that the library is unloaded after the predictor is destroyed, including when the
+        // constructor throws
+        std::unique_ptr<void, HandleCloser> handle_;
+        std::unique_ptr<branch_predictor::BranchPredictor, branch_predictor::PluginDestroyFunc> predictor_{nullptr, nullptr};
+
+        template<typename FuncType>
+        FuncType getSymbol_(const std::string& path, const char* name) {
+            auto func = reinterpret_cast<FuncType>(dlsym(handle_.get(), name));
+            stf_assert(func, "Plugin " << path << " does not export " << name);
+            return func;
+        }
+
+    public:
+        /**
+         * Loads a predictor plugin
+         * \param path Path to the shared library
+         * \param params Parameter string passed to the plugin factory
+         */
+        PluginPredictor(const std::string& path, const std::string& params) :
+            handle_(dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL))
+        {
+            stf_assert(handle_, "Failed to load predictor plugin " << path << ": " << dlerror());
+            const auto create = getSymbol_<branch_predictor::PluginCreateFunc>(path, branch_predictor::PLUGIN_CREATE_FUNC);
+            const auto destroy = getSymbol_<branch_predictor::PluginDestroyFunc>(path, branch_predictor::PLUGIN_DESTROY_FUNC);
+            predictor_ = decltype(predictor_)(create(params.c_str()), destroy);
+            stf_assert(predictor_, "Plugin " << path << " failed to create a predictor");
+        }
+
+        std::string getName() const final {
+            return predictor_->getName();
+        }
+
+        bool predict(const branch_predictor::BranchRecord& branch) final {
+            return predictor_->predict(branch);
+        }
+
+        void update(const branch_predictor::BranchRecord& branch, const bool predicted) final {
+            predictor_->update(branch, predicted);
+        }
+
+        void trackUnconditional(const branch_predictor::BranchRecord& branch) final {
+            predictor_->trackUnconditional(branch);
+        }
+};
+
+/**
+ * Constructs a predictor from a command line specification of the form name[:key=value[,key=value...]]
+ * \param spec Predictor specification
+ */
+branch_predictor::BranchPredictor::Handle makePredictor(const std::string& spec) {
+    const auto colon = spec.find(':');
+    const std::string name = spec.substr(0, colon);
+    const branch_predictor::PredictorParams params(colon == std::string::npos ? std::string_view() : std::string_view(spec).substr(colon + 1));
+
+    if(name == "plugin") {
+        const auto path = params.getString("path", "");
+        stf_assert(!path.empty(), "Plugin predictors must specify a path parameter");
+        return std::make_unique<PluginPredictor>(path, params.str());
+    }
+
+    auto predictor = branch_predictor::makeBuiltinPredictor(name, params);
+    stf_assert(predictor, "Unknown predictor: " << name);
+    return predictor;
+}
+
+void processCommandLine(int argc,
+                        char** argv,
+                        std::string& trace,
+                        std::string& output_filename,
+                        std::vector<std::string>& predictor_specs,
+                        bool& skip_non_user,
+                        uint64_t& interval_length,
+                        size_t& num_top_branches,
+                        size_t& batch_size) {
+    trace_tools::CommandLineParser parser("stf_branch_predictor_sim");
+    parser.addMultiFlag('p',
+                        "predictor",
+                        "predictor to simulate, specified as name[:key=value[,key=value...]]. "
+                        "Can be specified multiple times. "
+                        "Built-in predictors are bimodal, gshare, perceptron, and tage-sc-l. "
+                        "Plugins can be loaded with plugin:path=<library>[,key=value...]. "
+                        "Defaults to all built-in predictors with default parameters.");
+    parser.addFlag('u', "skip non user-mode instructions");
+    parser.addFlag('i', "interval", "report accuracy for every interval of this many instructions");
+    parser.addFlag('n', "N", "report the N branches with the most mispredicts for each predictor (default 10)");
+    parser.addFlag('b', "batch_size", "number of branches handed to the predictor threads at a time (default 4096)");
+    parser.addFlag('o', "output", "output file (defaults to stdout)");
+    parser.addPositionalArgument("trace", "trace in STF format");
+    parser.appendHelpText("Example:");
+    parser.appendHelpText("    Compare two gshare configurations against TAGE-SC-L, reporting accuracy every 10M instructions");
+    parser.appendHelpText("    stf_branch_predictor_sim -p gshare:history=12 -p gshare:history=24 -p tage-sc-l -i 10000000 trace.zstf");
+    parser.parseArguments(argc, argv);
+
+    predictor_specs = parser.getMultipleValueArgument('p');
+    skip_non_user = parser.hasArgument('u');
+    parser.getArgumentValue('i', interval_length);
+    parser.getArgumentValue('n', num_top_branches);
+    parser.getArgumentValue('b', batch_size);
+    parser.getArgumentValue('o', output_filename);
+    parser.getPositionalArgument(0, trace);
+
+    parser.assertCondition(batch_size > 0, "Batch size must be greater than 0");
+
+    if(predictor_specs.empty()) {
+        predictor_specs = {"bimodal", "gshare", "perceptron", "tage-sc-l"};
+    }
+}
+
+/**
+ * Reads every branch in the trace and publishes it to the predictor threads
+ * \returns Number of instructions read
+ */
+uint64_t readBranches(const std::string& trace,
+                      const bool skip_non_user,
+                      const size_t batch_size,
+                      branch_predictor::BranchBatchBuffer& buffer) {
+    stf::STFBranchReader reader(trace, skip_non_user);
+    buffer.publishAll(reader, batch_size);
+    return reader.numInstsRead();
+}
+
+void printReport(OutputFileStream& os,
+                 const branch_predictor::PredictorWorker& worker,
+                 const uint64_t num_insts,
+                 const size_t num_top_branches) {
+    static constexpr int COLUMN_WIDTH = 16;
+    static constexpr int NUM_DECIMAL_PLACES = 2;
+    static constexpr int MPKI_DECIMAL_PLACES = 3;
+
+    const auto& stats = worker.getStats();
+    const auto& total = stats.getTotal();
+    const double mpki = num_insts ? 1000.0 * static_cast<double>(total.mispredicts) / static_cast<double>(num_insts) : 0.0;
+
+    os << worker.getName() << std::endl;
+    stf::format_utils::formatLeft(os, "  Conditional branches:", COLUMN_WIDTH * 2);
+    os << total.branches << std::endl;
+    stf::format_utils::formatLeft(os, "  Mispredicts:", COLUMN_WIDTH * 2);
+    os << total.mispredicts << std::endl;
+    stf::format_utils::formatLeft(os, "  Accuracy:", COLUMN_WIDTH * 2);
+    stf::format_utils::formatPercent(os, total.accuracy(), 0, NUM_DECIMAL_PLACES);
+    os << std::endl;
+    stf::format_utils::formatLeft(os, "  MPKI:", COLUMN_WIDTH * 2);
+    os.saveFlags();
+    os << std::fixed << std::setprecision(MPKI_DECIMAL_PLACES) << mpki << std::endl;
+    os.restoreFlags();
+
+    if(num_top_branches) {
+        using PCCounts = std::pair<uint64_t, branch_predictor::PredictorStats::Counts>;
+        std::vector<PCCounts> sorted(stats.getPerPC().begin(), stats.getPerPC().end());
+        const auto num_to_print = std::min(num_top_branches, sorted.size());
+        std::partial_sort(sorted.begin(),
+                          sorted.begin() + static_cast<std::ptrdiff_t>(num_to_print),
+                          sorted.end(),
+                          [](const PCCounts& lhs, const PCCounts& rhs) {
+                              return lhs.second.mispredicts > rhs.second.mispredicts ||
+                                     (lhs.second.mispredicts == rhs.second.mispredicts && lhs.first < rhs.first);
+                          });
+
+        os << "  Top mispredicting branches:" << std::endl;
+        stf::format_utils::formatSpaces(os, 4);
+        stf::format_utils::formatLeft(os, "PC", COLUMN_WIDTH + 4);
+        stf::format_utils::formatLeft(os, "Branches", COLUMN_WIDTH);
+        stf::format_utils::formatLeft(os, "Mispredicts", COLUMN_WIDTH);
+        os << "Accuracy" << std::endl;
+        for(size_t i = 0; i < num_to_print; ++i) {
+            stf::format_utils::formatSpaces(os, 4);
+            stf::format_utils::formatHex(os, sorted[i].first);
+            stf::format_utils::formatSpaces(os, 4);
+            stf::format_utils::formatDecLeft(os, sorted[i].second.branches, COLUMN_WIDTH);
+            stf::format_utils::formatDecLeft(os, sorted[i].second.mispredicts, COLUMN_WIDTH);
+            stf::format_utils::formatPercent(os, sorted[i].second.accuracy(), 0, NUM_DECIMAL_PLACES);
+            os << std::endl;
+        }
+    }
+
+    if(const auto interval_length = stats.getIntervalLength(); interval_length) {
+        os << "  Interval accuracy (" << interval_length << " instructions per interval):" << std::endl;
+        stf::format_utils::formatSpaces(os, 4);
+        stf::format_utils::formatLeft(os, "Interval", COLUMN_WIDTH);
+        stf::format_utils::formatLeft(os, "Branches", COLUMN_WIDTH);
+        stf::format_utils::formatLeft(os, "Mispredicts", COLUMN_WIDTH);
+        os << "Accuracy" << std::endl;
+        const auto& intervals = stats.getIntervals();
+        for(size_t i = 0; i < intervals.size(); ++i) {
+            stf::format_utils::formatSpaces(os, 4);
+            stf::format_utils::formatDecLeft(os, i, COLUMN_WIDTH);
+            stf::format_utils::formatDecLeft(os, intervals[i].branches, COLUMN_WIDTH);
+            stf::format_utils::formatDecLeft(os, intervals[i].mispredicts, COLUMN_WIDTH);
+            stf::format_utils::formatPercent(os, intervals[i].accuracy(), 0, NUM_DECIMAL_PLACES);
+            os << std::endl;
+        }
+    }
+
+    os << std::endl;
+}
+
+int main(int argc, char** argv) {
+    static constexpr size_t NUM_BATCH_SLOTS = 8;
+
+    std::string trace;
+    std::string output_filename = "-";
+    std::vector<std::string> predictor_specs;
+    bool skip_non_user = false;
+    uint64_t interval_length = 0;
+    size_t num_top_branches = 10;
+    size_t batch_size = 4096;
+
+    try {
+        processCommandLine(argc,
+                           argv,
+                           trace,
+                           output_filename,
+                           predictor_specs,
+                           skip_non_user,
+                           interval_length,
+                           num_top_branches,
+                           batch_size);
+    }
+    catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
+        std::cerr << e.what() << std::endl;
+        return e.getCode();
+    }
+
+    // Constructed before the workers so that it outlives their threads
+    branch_predictor::BranchBatchBuffer buffer(predictor_specs.size(), NUM_BATCH_SLOTS, batch_size);
+
+    std::vector<branch_predictor::PredictorWorker> workers;
+    workers.reserve(predictor_specs.size());
+    for(const auto& spec: predictor_specs) {
+        workers.emplace_back(makePredictor(spec), interval_length);
+    }
+
+    OutputFileStream output_file(output_filename);
+
+    for(auto& worker: workers) {
+        worker.start(buffer);
+    }
+
+    uint64_t num_insts = 0;
+    try {
+        num_insts = readBranches(trace, skip_non_user, batch_size, buffer);
+    }
+    catch(...) {
+        // Let the workers drain whatever was published so that their destructors can join them
+        buffer.finish();
+        throw;
+    }
+
+    for(auto& worker: workers) {
+        worker.join();
+    }
+
+    output_file << "Instructions: " << num_insts << std::endl << std::endl;
+    for(const auto& worker: workers) {
+        printReport(output_file, worker, num_insts, num_top_branches);
+    }
+
+    return 0;
+}
@@ -26,6 +26,10 @@
 
 */
 
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
 #include <string>
 #include <sstream>
 #include <cstring>
@@ -55,7 +59,13 @@ static STFCheckConfig parse_command_line (int argc, char **argv) {
     parser.addFlag('v', "always print error counts at the end");
     parser.addFlag('e', "M", "end checking at M-th instruction");
     parser.addMultiFlag('i', "err", "ignore the specified error type");
+    parser.addFlag('j', "N", "check the trace in chunks on N threads");
+    parser.addFlag('C', "N", "number of instructions per chunk (-j only, default 10000000)");
+    parser.addFlag('W', "N", "number of instructions read before each chunk to rebuild per-thread state (-j only, default 100000). "
+                             "Checks against the previous instruction are skipped for a thread's first instruction in a chunk if the thread does not appear in the window.");
     parser.addPositionalArgument("trace", "trace in STF format");
+    parser.setDependentArgument('C', 'j');
+    parser.setDependentArgument('W', 'j');
 
     parser.parseArguments(argc, argv);
     config.skip_non_user = parser.hasArgument('u');
@@ -69,6 +79,13 @@ static STFCheckConfig parse_command_line (int argc, char **argv) {
         config.ignored_errors.insert(parseErrorCode(err));
     }
 
+    parser.getArgumentValue('j', config.num_threads);
+    parser.getArgumentValue('C', config.chunk_size);
+    parser.getArgumentValue('W', config.resync_window);
+    parser.assertCondition(config.num_threads > 0, "-j parameter must be greater than 0");
+    parser.assertCondition(config.chunk_size > 0, "-C parameter must be greater than 0");
+    parser.assertCondition(config.resync_window > 0, "-W parameter must be greater than 0");
+
     parser.getPositionalArgument(0, config.trace_filename);
 
     return config;
@@ -121,83 +138,85 @@ inline bool isVectorMemAccessMasked(const stf::STFInst& inst) {
     return false;
 }
 
-int main (int argc, char **argv) {
-    try {
-        uint64_t inst_count = 0;
-        uint64_t hdr_pte_count = 0;         // Number of pte entries found in trace header.
-        uint64_t embed_pte_count = 0;       // Number of embedded pte entries found in trace.
-        uint64_t pa_count = 0;              // Number of mem PA records found in trace.
-        uint64_t phys_pc_count = 0;         // Number of inst_phys_pc values in trace.
-
-        const STFCheckConfig config = parse_command_line (argc, argv);
-        ErrorTracker ecount(config.ignored_errors);
-        ecount.setContinueOnError(config.continue_on_error);
-
-        // Keep track of thread_info;
-        uint32_t hw_tid = 0;
-        uint32_t pid = 0;
-        uint32_t tid = 0;
-        uint32_t hw_tid_prev = std::numeric_limits<uint32_t>::max();
-        uint32_t pid_prev = std::numeric_limits<uint32_t>::max();
-        uint32_t tid_prev = std::numeric_limits<uint32_t>::max();
-        bool thread_switch = false;
-        ThreadMap thread_pc_prev;
-        ThreadMapKey thread_id;
-
-        // Open stf trace reader
-        stf::STFInstReader stf_reader(config.trace_filename, config.skip_non_user, config.check_phys_addr);
-        stf::STFDecoder decoder(stf_reader.getInitialIEM());
-        /* FIXME Because we have not kept up with STF versioning, this is currently broken and must be loosened.
-        if (!stf_reader.checkVersion()) {
-            exit(1);
+/**
+ * \class TraceChecker
+ * \brief Runs the per-instruction checks over a contiguous range of instructions
+ *
+ * Checks that span instructions (PC continuity, branch targets, mode changes) look at the previous
+ * instruction from the same thread, which prime() records without checking anything. The parallel mode uses
+ * this to rebuild that state from a short window of instructions before each chunk.
+ */
+class TraceChecker {
+    private:
+        const STFCheckConfig& config_;
+        ErrorTracker& ecount_;
+        const bool has_phys_addr_feature_;
+        stf::STFDecoder decoder_;
+
+        uint32_t hw_tid_prev_ = std::numeric_limits<uint32_t>::max();
+        uint32_t pid_prev_ = std::numeric_limits<uint32_t>::max();
+        uint32_t tid_prev_ = std::numeric_limits<uint32_t>::max();
+        ThreadMap thread_pc_prev_;
+        bool partial_history_ = false;
+
+        uint64_t inst_count_ = 0;
+        uint64_t embed_pte_count_ = 0;       // Number of embedded pte entries found in trace.
+        uint64_t pa_count_ = 0;              // Number of mem PA records found in trace.
+        uint64_t phys_pc_count_ = 0;         // Number of inst_phys_pc values in trace.
+
+    public:
+        /**
+         * Constructs a TraceChecker
+         * \param config stf_check configuration
+         * \param ecount ErrorTracker to report errors to
+         * \param iem Initial instruction encoding mode of the trace
+         * \param has_phys_addr_feature Whether the trace has the STF_CONTAIN_PHYSICAL_ADDRESS feature
+         * \param inst_count Number of instructions that precede the first checked instruction
+         */
+        TraceChecker(const STFCheckConfig& config,
+                     ErrorTracker& ecount,
+                     const stf::INST_IEM iem,
+                     const bool has_phys_addr_feature,
+                     const uint64_t inst_count = 0) :
+            config_(config),
+            ecount_(ecount),
+            has_phys_addr_feature_(has_phys_addr_feature),
+            decoder_(iem),
+            inst_count_(inst_count)
+        {
         }
-        */
 
-        const auto it = stf_reader.begin();
-        // Get initial trace thread info
-        if(it != stf_reader.end()) {
-            const auto& inst = *it;
-            hw_tid_prev = inst.hwtid();
-            pid_prev = inst.pid();
-            tid_prev = inst.tid();
-            thread_id = std::make_tuple(hw_tid_prev, pid_prev, tid_prev);
-            thread_pc_prev[thread_id] = inst;
+        /**
+         * Records an instruction as the previous instruction of its thread without checking it
+         * \param inst Instruction to record
+         */
+        inline void prime(const stf::STFInst& inst) {
+            hw_tid_prev_ = inst.hwtid();
+            pid_prev_ = inst.pid();
+            tid_prev_ = inst.tid();
+            thread_pc_prev_[std::make_tuple(hw_tid_prev_, pid_prev_, tid_prev_)] = inst;
         }
 
-        const auto& trace_features = stf_reader.getTraceFeatures();
-        const bool has_rv64_inst = stf_reader.getInitialIEM() == stf::INST_IEM::STF_INST_IEM_RV64;
-        bool ignore_rv64_error = false;
-
-        for(const auto& info: stf_reader.getTraceInfo()) {
-            if (info->getGenerator() != stf::STF_GEN::STF_GEN_RESERVED) {      // Check for a valid header.
-                try {
-                    std::cout << "Trace generator: " << info->getGenerator() << std::endl;
-                }
-                catch(const stf::STFException& e) {
-                    ecount.countError(ErrorCode::HEADER);
-                    ecount.reportError(ErrorCode::HEADER) << e.what() << std::endl;
-                }
-                std::cout << "Trace generator version: " << info->getVersionString() << std::endl;
-                std::cout << "Comment: " << info->getComment() << std::endl;
-                std::cout << "Features: ";
-                stf::print_utils::printHex(trace_features->getFeatures());
-                if(info->getGenerator() == stf::STF_GEN::STF_GEN_SPIKE) {
-                    ignore_rv64_error = true;
-                }
-                std::cout << std::endl;
-            }
-            else {
-                ecount.countError(ErrorCode::HEADER);
-                ecount.reportError(ErrorCode::HEADER) << "Invalid trace info record found" << std::endl;
-            }
+        /**
+         * Indicates that the checker was primed with only part of the preceding trace. The checks that compare an
+         * instruction against the previous instruction of its thread are skipped for the first instruction of any
+         * thread that was not primed, since its real predecessor is unknown.
+         * \param partial_history Whether the checker has partial history
+         */
+        inline void setPartialHistory(const bool partial_history) {
+            partial_history_ = partial_history;
         }
 
-        // Iterate through all of the records, checking for known issues.
-        for (const auto& inst: stf_reader) {
-            inst_count++;
+        /**
+         * Checks an instruction
+         * \param inst Instruction to check
+         * \returns false if the end instruction has been reached
+         */
+        bool check(const stf::STFInst& inst) {
+            ++inst_count_;
             if (!inst.valid()) {
-                ecount.countError(ErrorCode::INVALID_INST);
-                auto& msg = ecount.reportError(ErrorCode::INVALID_INST);
+                ecount_.countError(ErrorCode::INVALID_INST);
+                auto& msg = ecount_.reportError(ErrorCode::INVALID_INST);
                 msg << inst.index() << " invalid instruction ";
                 stf::format_utils::formatHex(msg, inst.opcode());
                 msg << " PC ";
@@ -205,21 +224,22 @@ int main (int argc, char **argv) {
                 msg << std::endl;
             }
 
-            hw_tid = inst.hwtid();
-            pid = inst.pid();
-            tid = inst.tid();
-            thread_id = std::make_tuple(hw_tid, pid, tid);
-            thread_switch = (tid != tid_prev || pid != pid_prev || hw_tid != hw_tid_prev);
-            hw_tid_prev = hw_tid;
-            pid_prev = pid;
-            tid_prev = tid;
-            const auto& inst_prev = thread_pc_prev[thread_id];
-            decoder.decode(inst_prev.opcode());
+            const uint32_t hw_tid = inst.hwtid();
+            const uint32_t pid = inst.pid();
+            const uint32_t tid = inst.tid();
+            const ThreadMapKey thread_id = std::make_tuple(hw_tid, pid, tid);
+            const bool thread_switch = (tid != tid_prev_ || pid != pid_prev_ || hw_tid != hw_tid_prev_);
+            hw_tid_prev_ = hw_tid;
+            pid_prev_ = pid;
+            tid_prev_ = tid;
+            const bool has_prev = !partial_history_ || thread_pc_prev_.count(thread_id) != 0;
+            auto& inst_prev = thread_pc_prev_[thread_id];
+            decoder_.decode(inst_prev.opcode());
 
             //check if trace has physical address translations
-            if (config.check_phys_addr && !trace_features->hasFeature(stf::TRACE_FEATURES::STF_CONTAIN_PHYSICAL_ADDRESS)) {
-                ecount.countError(ErrorCode::PHYS_ADDR);
-                auto& msg = ecount.reportError(ErrorCode::PHYS_ADDR);
+            if (config_.check_phys_addr && !has_phys_addr_feature_) {
+                ecount_.countError(ErrorCode::PHYS_ADDR);
+                auto& msg = ecount_.reportError(ErrorCode::PHYS_ADDR);
                 stf::format_utils::formatDecLeft(msg, inst.index(), MAX_COUNT_LENGTH);
                 msg << "STF_CONTAIN_PHYSICAL_ADDRESS not set, but is required as part of the default tracing configuration" << std::endl;
             }
@@ -227,16 +247,17 @@ int main (int argc, char **argv) {
             const auto& prev_events = inst_prev.getEvents();
 
             // Check for decoder failures on non-faulting instructions
-            if(STF_EXPECT_FALSE(decoder.decodeFailed() && prev_events.empty())) {
-                ecount.countError(ErrorCode::DECODER_FAILURE);
-                auto& msg = ecount.reportError(ErrorCode::DECODER_FAILURE);
+            if(STF_EXPECT_FALSE(has_prev && decoder_.decodeFailed() && prev_events.empty())) {
+                ecount_.countError(ErrorCode::DECODER_FAILURE);
+                auto& msg = ecount_.reportError(ErrorCode::DECODER_FAILURE);
                 stf::format_utils::formatDecLeft(msg, inst.index(), MAX_COUNT_LENGTH);
                 msg << " Failed to decode instruction." << std::endl;
             }
 
             //check if inst is_load or is_store and doesn't have memory accesses when it should
             if (STF_EXPECT_FALSE(
-                    decoder.isLoad() && // it decodes as a load
+                    has_prev &&
+                    decoder_.isLoad() && // it decodes as a load
                     (!inst_prev.isLoad() || inst_prev.getMemoryReads().empty()) && // but it isn't doing any loads
                     prev_events.empty())) { // and there are no events stopping it from doing a load
                 bool found = false;
@@ -254,18 +275,19 @@ int main (int argc, char **argv) {
                 found = isVectorMemAccessMasked(inst_prev);
 
                 if(STF_EXPECT_FALSE(!found)) {
-                    ecount.countError(ErrorCode::MISS_MEM);
-                    ecount.countError(ErrorCode::MISS_MEM_LOAD);
-                    auto& msg = ecount.reportError(ErrorCode::MISS_MEM_LOAD);
+                    ecount_.countError(ErrorCode::MISS_MEM);
+                    ecount_.countError(ErrorCode::MISS_MEM_LOAD);
+                    auto& msg = ecount_.reportError(ErrorCode::MISS_MEM_LOAD);
                     stf::format_utils::formatDecLeft(msg, inst.index(), MAX_COUNT_LENGTH);
                     msg << " Load instruction missing memory access record in stf." << std::endl;
                 }
             }
             if (STF_EXPECT_FALSE(
-                    decoder.isStore() && // it decodes as a store
+                    has_prev &&
+                    decoder_.isStore() && // it decodes as a store
                     (!inst_prev.isStore() || inst_prev.getMemoryWrites().empty()) && // but it isn't doing any stores
                     prev_events.empty() && // and there are no events stopping it from doing a store
-                    !decoder.isAtomic())) { // and this isn't an atomic inst (store-conditional)
+                    !decoder_.isAtomic())) { // and this isn't an atomic inst (store-conditional)
                 bool found = false;
                 // Commenting this out for now since RISC-V doesn't have software prefetches
                 /*
@@ -281,22 +303,22 @@ int main (int argc, char **argv) {
                 found = isVectorMemAccessMasked(inst_prev);
 
                 if (!found) {
-                    ecount.countError(ErrorCode::MISS_MEM);
-                    ecount.countError(ErrorCode::MISS_MEM_STR);
-                    auto& msg = ecount.reportError(ErrorCode::MISS_MEM_STR);
+                    ecount_.countError(ErrorCode::MISS_MEM);
+                    ecount_.countError(ErrorCode::MISS_MEM_STR);
+                    auto& msg = ecount_.reportError(ErrorCode::MISS_MEM_STR);
                     stf::format_utils::formatDecLeft(msg, inst.index(), MAX_COUNT_LENGTH);
                     msg << " Store instruction missing memory access record in stf." << std::endl;
                 }
             }
 
-            if (STF_EXPECT_FALSE(config.end_inst && (inst.index() > config.end_inst))) {
-                break;
+            if (STF_EXPECT_FALSE(config_.end_inst && (inst.index() > config_.end_inst))) {
+                return false;
             }
 
             if(STF_EXPECT_FALSE((inst.pc() & 1) != 0)) {
                 if(inst.isOpcode16()) {
-                    ecount.countError(ErrorCode::INVALID_PC_16);
-                    auto& msg = ecount.reportError(ErrorCode::INVALID_PC_16);
+                    ecount_.countError(ErrorCode::INVALID_PC_16);
+                    auto& msg = ecount_.reportError(ErrorCode::INVALID_PC_16);
                     msg << "Invalid pc value found in mode at instruction #";
                     stf::format_utils::formatDec(msg, inst.index());
                     msg << " pc value: ";
@@ -304,8 +326,8 @@ int main (int argc, char **argv) {
                     msg << std::endl;
                 }
                 else {
-                    ecount.countError(ErrorCode::INVALID_PC_32);
-                    auto& msg = ecount.reportError(ErrorCode::INVALID_PC_32);
+                    ecount_.countError(ErrorCode::INVALID_PC_32);
+                    auto& msg = ecount_.reportError(ErrorCode::INVALID_PC_32);
                     msg << "Invalid pc value found in mode at instruction #";
                     stf::format_utils::formatDec(msg, inst.index());
                     msg << " pc value: ";
@@ -314,7 +336,7 @@ int main (int argc, char **argv) {
                 }
             }
 
-            if(STF_EXPECT_FALSE(inst_count > 1 && inst.pc() != (inst_prev.pc() + inst_prev.opcodeSize()))) {
+            if(STF_EXPECT_FALSE(has_prev && inst_count_ > 1 && inst.pc() != (inst_prev.pc() + inst_prev.opcodeSize()))) {
                 bool valid_jump = false;
                 if(STF_EXPECT_FALSE(inst_prev.isTakenBranch() && inst_prev.branchTarget() == inst.pc())) {
                     valid_jump = true;
@@ -328,8 +350,8 @@ int main (int argc, char **argv) {
                 }
 
                 if(STF_EXPECT_FALSE(!valid_jump)) {
-                    ecount.countError(ErrorCode::PC_DISCONTINUITY);
-                    auto& msg = ecount.reportError(ErrorCode::PC_DISCONTINUITY);
+                    ecount_.countError(ErrorCode::PC_DISCONTINUITY);
+                    auto& msg = ecount_.reportError(ErrorCode::PC_DISCONTINUITY);
                     msg << "PC discontinuity found between instruction #";
                     stf::format_utils::formatDec(msg, inst_prev.index());
                     msg << " and ";
@@ -347,9 +369,9 @@ int main (int argc, char **argv) {
             for(const auto& mem_access: mem_accesses) {
                 // Check if accesses address zero
                 if (STF_EXPECT_FALSE(mem_access.getAddress() == 0)) {
-                    ecount.countError(ErrorCode::MEM_POINT_TO_ZERO);
-                    if (config.print_memory_zero_warnings) {
-                        auto& msg = ecount.reportError(ErrorCode::MEM_POINT_TO_ZERO);
+                    ecount_.countError(ErrorCode::MEM_POINT_TO_ZERO);
+                    if (config_.print_memory_zero_warnings) {
+                        auto& msg = ecount_.reportError(ErrorCode::MEM_POINT_TO_ZERO);
                         msg << "Instruction memory record points to vaddr 0 at instruction #";
                         stf::format_utils::formatDec(msg, inst.index());
                         msg << " pc value: ";
@@ -360,15 +382,15 @@ int main (int argc, char **argv) {
 
                 // Commenting this check out for now because the attribute field isn't really used for anything yet
                 //if (STF_EXPECT_FALSE(mem_access.getAttr() == 0)) {
-                //    ecount.countError(ErrorCode::MEM_ATTR);
-                //    auto& msg = ecount.reportError(ErrorCode::MEM_ATTR);
+                //    ecount_.countError(ErrorCode::MEM_ATTR);
+                //    auto& msg = ecount_.reportError(ErrorCode::MEM_ATTR);
                 //    msg << "The Instruction accesses memory. But there is no memory access attribute record at instruction index " << inst.index() << std::endl;
                 //}
 
                 // Check to see if paddr is valid.
 
                 if (mem_access.addressTranslationEnabled()) {
-                    pa_count++;
+                    ++pa_count_;
                     const uint64_t phys_addr = mem_access.getPhysAddress();
 
                     if(phys_addr == 0) {
@@ -389,14 +411,14 @@ int main (int argc, char **argv) {
                             }
                         }
                         if(!is_ls_fault) {
-                            ecount.countError(ErrorCode::PA_EQ_0);
-                            auto& msg = ecount.reportError(ErrorCode::PA_EQ_0);
+                            ecount_.countError(ErrorCode::PA_EQ_0);
+                            auto& msg = ecount_.reportError(ErrorCode::PA_EQ_0);
                             msg << "PA == 0 at instruction index " << std::dec << inst.index() << std::endl;
                         }
                     }
                     else if ((phys_addr & 0xfff) != (mem_access.getAddress() & 0xfff)) {
-                        ecount.countError(ErrorCode::PA_NE_VA);
-                        auto& msg = ecount.reportError(ErrorCode::PA_NE_VA);
+                        ecount_.countError(ErrorCode::PA_NE_VA);
+                        auto& msg = ecount_.reportError(ErrorCode::PA_NE_VA);
                         msg << "PA & 0xfff != VA & 0xfff at instruction index " << std::dec << inst.index() << std::endl;
                     }
                 }
@@ -421,26 +443,26 @@ int main (int argc, char **argv) {
                         }
                     }
                     if(!is_inst_fault) {
-                        ecount.countError(ErrorCode::INVALID_PHYS);
-                        auto& msg = ecount.reportError(ErrorCode::INVALID_PHYS);
+                        ecount_.countError(ErrorCode::INVALID_PHYS);
+                        auto& msg = ecount_.reportError(ErrorCode::INVALID_PHYS);
                         msg << "Invalid phys PC value at index " << std::dec << inst.index() << std::endl;
                     }
                 }
                 else {
-                    phys_pc_count++;
+                    ++phys_pc_count_;
                 }
             }
 
             // Check for embedded PTEs
-            embed_pte_count += inst.getEmbeddedPTEs().size();
+            embed_pte_count_ += inst.getEmbeddedPTEs().size();
 
             // check if unconditional branch contains PC_TARGET
             // If last instruction is an unconditional branch, it will not have PC TARGET.
-            if (STF_EXPECT_TRUE(!thread_switch)) {
-                if (STF_EXPECT_FALSE(decoder.isBranch() && !decoder.isConditional())) {
+            if (STF_EXPECT_TRUE(has_prev && !thread_switch)) {
+                if (STF_EXPECT_FALSE(decoder_.isBranch() && !decoder_.isConditional())) {
                     if (STF_EXPECT_FALSE(prev_events.empty() && (!inst_prev.isTakenBranch()))) {
-                        ecount.countError(ErrorCode::UNCOND_BR);
-                        auto& msg = ecount.reportError(ErrorCode::UNCOND_BR);
+                        ecount_.countError(ErrorCode::UNCOND_BR);
+                        auto& msg = ecount_.reportError(ErrorCode::UNCOND_BR);
                         stf::format_utils::formatDecLeft(msg, inst_prev.index(), MAX_COUNT_LENGTH);
                         msg << " 0x";
                         stf::format_utils::formatVA(msg, inst_prev.pc());
@@ -451,9 +473,9 @@ int main (int argc, char **argv) {
                 // if switch to user mode; check if previous instruction is sret or mret;
                 const bool is_mode_change_to_user = inst_prev.isChangeToUserMode();
 
-                if (STF_EXPECT_FALSE(is_mode_change_to_user && !decoder.isExceptionReturn())) {
-                    ecount.countError(ErrorCode::SWITCH_USR);
-                    auto& msg = ecount.reportError(ErrorCode::SWITCH_USR);
+                if (STF_EXPECT_FALSE(is_mode_change_to_user && !decoder_.isExceptionReturn())) {
+                    ecount_.countError(ErrorCode::SWITCH_USR);
+                    auto& msg = ecount_.reportError(ErrorCode::SWITCH_USR);
                     stf::format_utils::formatDecLeft(msg, inst_prev.index(), MAX_COUNT_LENGTH);
                     msg << " 0x";
                     stf::format_utils::formatVA(msg, inst_prev.pc());
@@ -465,11 +487,224 @@ int main (int argc, char **argv) {
                 }
             }
 
-            thread_pc_prev[thread_id] = inst;
+            inst_prev = inst;
+            return true;
+        }
+
+        /**
+         * Gets the number of instructions checked so far, including those preceding the first checked instruction
+         */
+        inline uint64_t getInstCount() const {
+            return inst_count_;
+        }
+
+        /**
+         * Gets the number of embedded PTEs found
+         */
+        inline uint64_t getEmbeddedPTECount() const {
+            return embed_pte_count_;
+        }
+
+        /**
+         * Gets the number of physical data addresses found
+         */
+        inline uint64_t getPACount() const {
+            return pa_count_;
+        }
+
+        /**
+         * Gets the number of physical instruction addresses found
+         */
+        inline uint64_t getPhysPCCount() const {
+            return phys_pc_count_;
+        }
+};
+
+/**
+ * \struct CheckedChunk
+ * \brief Results from checking a single chunk in parallel mode
+ */
+struct CheckedChunk {
+    ErrorTracker ecount; /**< Deferred errors found in the chunk */
+    TraceChecker checker; /**< Checker state, including the counts for the chunk */
+    bool last = false; /**< Set if no later chunk needs to be checked */
+
+    CheckedChunk(const STFCheckConfig& config,
+                 const stf::INST_IEM iem,
+                 const bool has_phys_addr_feature,
+                 const uint64_t inst_count) :
+        ecount(config.ignored_errors, true),
+        checker(config, ecount, iem, has_phys_addr_feature, inst_count)
+    {
+    }
+};
+
+/**
+ * Checks a single chunk of the trace with its own reader
+ * \param config stf_check configuration
+ * \param chunk_idx Index of the chunk to check
+ * \param iem Initial instruction encoding mode of the trace
+ * \param has_phys_addr_feature Whether the trace has the STF_CONTAIN_PHYSICAL_ADDRESS feature
+ * \param stop Set by the main thread when the results of this chunk will not be used
+ */
+static std::unique_ptr<CheckedChunk> checkChunk(const STFCheckConfig& config,
+                                                const uint64_t chunk_idx,
+                                                const stf::INST_IEM iem,
+                                                const bool has_phys_addr_feature,
+                                                const std::atomic<bool>& stop) {
+    const uint64_t start = chunk_idx * config.chunk_size + 1;
+    const uint64_t end = start + config.chunk_size;
+    const uint64_t resync_start = start > config.resync_window ? start - config.resync_window : 1;
+
+    auto chunk = std::make_unique<CheckedChunk>(config, iem, has_phys_addr_feature, start - 1);
+    auto& checker = chunk->checker;
+    // Threads that were last seen before the resync window have no known predecessor
+    checker.setPartialHistory(resync_start > 1);
+
+    stf::STFInstReader stf_reader(config.trace_filename, config.skip_non_user, config.check_phys_addr);
+    auto it = resync_start > 1 ? stf_reader.seekFromBeginning(resync_start - 1) : stf_reader.begin();
+
+    // The serial check treats the first instruction as its own predecessor
+    if(start == 1 && it != stf_reader.end()) {
+        checker.prime(*it);
+    }
+
+    uint64_t idx = resync_start;
+    for(; it != stf_reader.end() && idx < start; ++it, ++idx) {
+        checker.prime(*it);
+    }
+
+    for(; it != stf_reader.end() && idx < end; ++it, ++idx) {
+        if(STF_EXPECT_FALSE(stop)) {
+            return chunk;
+        }
+
+        // Everything after the first error is discarded unless we are continuing on errors
+        if(STF_EXPECT_FALSE(!checker.check(*it) || (!config.continue_on_error && chunk->ecount.hasDeferredErrors()))) {
+            chunk->last = true;
+            return chunk;
+        }
+    }
+
+    chunk->last = it == stf_reader.end();
+
+    return chunk;
+}
+
+int main (int argc, char **argv) {
+    try {
+        uint64_t inst_count = 0;
+        uint64_t hdr_pte_count = 0;         // Number of pte entries found in trace header.
+        uint64_t embed_pte_count = 0;       // Number of embedded pte entries found in trace.
+        uint64_t pa_count = 0;              // Number of mem PA records found in trace.
+        uint64_t phys_pc_count = 0;         // Number of inst_phys_pc values in trace.
+
+        const STFCheckConfig config = parse_command_line (argc, argv);
+        ErrorTracker ecount(config.ignored_errors);
+        ecount.setContinueOnError(config.continue_on_error);
+
+        // Open stf trace reader
+        stf::STFInstReader stf_reader(config.trace_filename, config.skip_non_user, config.check_phys_addr);
+        /* FIXME Because we have not kept up with STF versioning, this is currently broken and must be loosened.
+        if (!stf_reader.checkVersion()) {
+            exit(1);
+        }
+        */
+
+        const auto& trace_features = stf_reader.getTraceFeatures();
+        const bool has_rv64_inst = stf_reader.getInitialIEM() == stf::INST_IEM::STF_INST_IEM_RV64;
+        bool ignore_rv64_error = false;
+
+        for(const auto& info: stf_reader.getTraceInfo()) {
+            if (info->getGenerator() != stf::STF_GEN::STF_GEN_RESERVED) {      // Check for a valid header.
+                try {
+                    std::cout << "Trace generator: " << info->getGenerator() << std::endl;
+                }
+                catch(const stf::STFException& e) {
+                    ecount.countError(ErrorCode::HEADER);
+                    ecount.reportError(ErrorCode::HEADER) << e.what() << std::endl;
+                }
+                std::cout << "Trace generator version: " << info->getVersionString() << std::endl;
+                std::cout << "Comment: " << info->getComment() << std::endl;
+                std::cout << "Features: ";
+                stf::print_utils::printHex(trace_features->getFeatures());
+                if(info->getGenerator() == stf::STF_GEN::STF_GEN_SPIKE) {
+                    ignore_rv64_error = true;
+                }
+                std::cout << std::endl;
+            }
+            else {
+                ecount.countError(ErrorCode::HEADER);
+                ecount.reportError(ErrorCode::HEADER) << "Invalid trace info record found" << std::endl;
+            }
+        }
+
+        const bool has_phys_addr_feature = trace_features->hasFeature(stf::TRACE_FEATURES::STF_CONTAIN_PHYSICAL_ADDRESS);
+
+        if(config.num_threads > 1) {
+            // Check chunks concurrently, then merge their errors in trace order so that the report and exit code
+            // match the serial check
+            std::atomic<bool> stop = false;
+            std::deque<std::future<std::unique_ptr<CheckedChunk>>> pending;
+            uint64_t next_chunk = 0;
+
+            while(true) {
+                while(pending.size() < config.num_threads) {
+                    pending.emplace_back(std::async(std::launch::async,
+                                                    checkChunk,
+                                                    std::cref(config),
+                                                    next_chunk++,
+                                                    stf_reader.getInitialIEM(),
+                                                    has_phys_addr_feature,
+                                                    std::cref(stop)));
+                }
+
+                const auto chunk = pending.front().get();
+                pending.pop_front();
+
+                // Merging can exit the program, so make sure no other chunks are still running first
+                if(chunk->last || (!ecount.continueOnError() && chunk->ecount.hasDeferredErrors())) {
+                    stop = true;
+                    for(auto& f: pending) {
+                        f.wait();
+                    }
+                }
+
+                ecount.merge(chunk->ecount);
+                inst_count = chunk->checker.getInstCount();
+                embed_pte_count += chunk->checker.getEmbeddedPTECount();
+                pa_count += chunk->checker.getPACount();
+                phys_pc_count += chunk->checker.getPhysPCCount();
+
+                if(chunk->last) {
+                    break;
+                }
+            }
+        }
+        else {
+            TraceChecker checker(config, ecount, stf_reader.getInitialIEM(), has_phys_addr_feature);
+
+            const auto it = stf_reader.begin();
+            // Get initial trace thread info
+            if(it != stf_reader.end()) {
+                checker.prime(*it);
+            }
+
+            // Iterate through all of the records, checking for known issues.
+            for (const auto& inst: stf_reader) {
+                if(!checker.check(inst)) {
+                    break;
+                }
+            }
+
+            inst_count = checker.getInstCount();
+            embed_pte_count = checker.getEmbeddedPTECount();
+            pa_count = checker.getPACount();
+            phys_pc_count = checker.getPhysPCCount();
         }
 
         // Check to see if the STF_CONTAINS_PHYSICAL_ADDRESS flag is set properly.
-        if (trace_features->hasFeature(stf::TRACE_FEATURES::STF_CONTAIN_PHYSICAL_ADDRESS)) {
+        if (has_phys_addr_feature) {
             if (pa_count == 0) {
                 ecount.countError(ErrorCode::PHYS_ADDR);
                 ecount.reportError(ErrorCode::PHYS_ADDR) << "STF_CONTAIN_PHYSICAL_ADDRESS set, but no PAs found" << std::endl;
@@ -3,8 +3,11 @@
 #include <cinttypes>
 #include <iostream>
 #include <map>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <boost/container_hash/hash.hpp>
 
@@ -166,6 +169,16 @@ inline ErrorCode parseErrorCode(const std::string_view err_code_str) {
  * Counts and classifies errors found in an STF
  */
 class ErrorTracker {
+    public:
+        /**
+         * \struct DeferredError
+         * An error message that was buffered instead of printed
+         */
+        struct DeferredError {
+            ErrorCode code; /**< Error type */
+            std::string msg; /**< Formatted error message */
+        };
+
     private:
         static constexpr int COUNT_COLUMN_WIDTH_ = MAX_COUNT_LENGTH + 4; /**< Width of the error count column */
         static_assert(COUNT_COLUMN_WIDTH_ >= MAX_COUNT_LENGTH, "COUNT_COLUMN_WIDTH_ must be >= MAX_COUNT_LENGTH");
@@ -192,6 +205,9 @@ class ErrorTracker {
                         bool multiple_errors_ = false; /**< If true, we have detected multiple errors */
                         ErrorCode return_code_ = ErrorCode::RESERVED_NO_ERROR; /**< Used as the exit code when exiting due to an error */
                         bool ignore_next_error_ = false;
+                        const bool defer_errors_ = false; /**< If true, buffer errors in deferred_errors_ instead of printing them */
+                        ErrorCode pending_code_ = ErrorCode::RESERVED_NO_ERROR; /**< Error type of the message currently being formatted */
+                        std::vector<DeferredError> deferred_errors_; /**< Buffered errors, in the order they were reported */
 
                         /**
                          * Gets the exit code as an int so we can pass it to exit()
@@ -211,6 +227,15 @@ class ErrorTracker {
                         void putOutput_() {
                             // Called by destructor.
                             // destructor can not call virtual methods.
+                            if(defer_errors_) {
+                                if(STF_EXPECT_TRUE(!ignore_next_error_)) {
+                                    deferred_errors_.emplace_back(DeferredError{pending_code_, str()});
+                                }
+                                str("");
+                                ignore_next_error_ = false;
+                                return;
+                            }
+
                             if(STF_EXPECT_TRUE(!ignore_next_error_)) {
                                 os_ << str();
                             }
@@ -229,10 +254,12 @@ class ErrorTracker {
                          * Constructs an ErrorOstreamBuf
                          * \param os Underlying std::ostream
                          * \param continue_on_error if false, exit after the first error
+                         * \param defer_errors If true, buffer errors instead of printing them. Never exits.
                          */
-                        explicit ErrorOstreamBuf(std::ostream& os, bool continue_on_error = false) :
+                        explicit ErrorOstreamBuf(std::ostream& os, bool continue_on_error = false, bool defer_errors = false) :
                             os_(os),
-                            continue_on_error_(continue_on_error)
+                            continue_on_error_(continue_on_error),
+                            defer_errors_(defer_errors)
                         {
                         }
 
@@ -277,6 +304,7 @@ class ErrorTracker {
                          * \param error_code Exit code to set
                          */
                         void setErrorCode(ErrorCode error_code) {
+                            pending_code_ = error_code;
                             if (return_code_ == ErrorCode::RESERVED_NO_ERROR) { // This is the first reported error.
                                 return_code_ = error_code;
                             }
@@ -296,6 +324,13 @@ class ErrorTracker {
                         void ignoreNextError() {
                             ignore_next_error_ = true;
                         }
+
+                        /**
+                         * Gets the buffered errors
+                         */
+                        const std::vector<DeferredError>& getDeferredErrors() const {
+                            return deferred_errors_;
+                        }
                 };
 
                 ErrorOstreamBuf os_; /**< Underlying streambuf used to process output */
@@ -305,10 +340,11 @@ class ErrorTracker {
                  * Constructs an ErrorOstream
                  * \param os Underlying std::ostream
                  * \param continue_on_error If false, the program will exit on the first error
+                 * \param defer_errors If true, buffer errors instead of printing them
                  */
-                explicit ErrorOstream(std::ostream& os, bool continue_on_error = false) :
+                explicit ErrorOstream(std::ostream& os, bool continue_on_error = false, bool defer_errors = false) :
                     std::ostream(&os_),
-                    os_(os, continue_on_error)
+                    os_(os, continue_on_error, defer_errors)
                 {
                 }
 
@@ -353,6 +389,13 @@ class ErrorTracker {
                 void ignoreNextError() {
                     os_.ignoreNextError();
                 }
+
+                /**
+                 * Gets the buffered errors
+                 */
+                const std::vector<DeferredError>& getDeferredErrors() const {
+                    return os_.getDeferredErrors();
+                }
         };
 
         static const std::map<ErrorCode, const char*> error_code_msgs_; /**< Maps error codes to specific error messages */
@@ -387,9 +430,14 @@ class ErrorTracker {
         }
 
     public:
-        explicit ErrorTracker(const std::unordered_set<ErrorCode>& ignored_errors) :
+        /**
+         * Constructs an ErrorTracker
+         * \param ignored_errors Error types that should not be reported
+         * \param defer_errors If true, buffer reported errors so they can be merged into another ErrorTracker later
+         */
+        explicit ErrorTracker(const std::unordered_set<ErrorCode>& ignored_errors, const bool defer_errors = false) :
             ignored_errors_(ignored_errors),
-            err_(std::cerr)
+            err_(std::cerr, defer_errors, defer_errors)
         {
         }
 
@@ -459,6 +507,29 @@ class ErrorTracker {
             err_.setReturnCode(return_code);
         }
 
+        /**
+         * Checks whether any errors have been buffered
+         */
+        bool hasDeferredErrors() const {
+            return !err_.getDeferredErrors().empty();
+        }
+
+        /**
+         * Merges the counts from a deferred ErrorTracker and reports its buffered errors in order, as if they
+         * had been reported to this tracker directly. Exits on the first error unless continue on error is set.
+         * \param other ErrorTracker to merge
+         */
+        void merge(const ErrorTracker& other) {
+            for(size_t i = 0; i < errors_.size(); ++i) {
+                errors_[i] += other.errors_[i];
+            }
+
+            for(const auto& error: other.err_.getDeferredErrors()) {
+                err_.setErrorCode(error.code);
+                err_ << error.msg << std::flush;
+            }
+        }
+
         /**
          * Print the counts for every error type
          */
@@ -511,6 +582,9 @@ struct STFCheckConfig {
     bool always_print_error_counts = false; /**< Whether we should always print error counts at the end */
     uint64_t end_inst = 0; /**< If > 0, stop checking after this many instructions */
     std::unordered_set<ErrorCode> ignored_errors; /*< Contains error codes that should be ignored */
+    size_t num_threads = 1; /**< Number of threads used to check chunks in parallel. 1 checks the trace serially. */
+    uint64_t chunk_size = 10000000; /**< Number of instructions checked by each parallel worker */
+    uint64_t resync_window = 100000; /**< Number of instructions read before each chunk to rebuild per-thread state */
 };
 
 /**
@@ -1,12 +1,12 @@
 #include <iostream>
-#include <map>
 #include <memory>
-#include <set>
 #include <string>
+#include <utility>
 
 #include "stf_elf.hpp"
 #include "stf_decoder.hpp"
 #include "disassembler.hpp"
+#include "pc_table.hpp"
 
 #include "print_utils.hpp"
 #include "stf_inst_reader.hpp"
@@ -56,9 +56,9 @@ void processCommandLine(int argc,
 }
 
 struct CMovInfo {
-    uint32_t branch_opcode;
-    uint64_t mov_pc;
-    uint32_t mov_opcode;
+    uint32_t branch_opcode = 0;
+    uint64_t mov_pc = 0;
+    uint32_t mov_opcode = 0;
 };
 
 template<int COLUMN_WIDTH, int COLUMN_INDEX>
@@ -111,9 +111,8 @@ int main(int argc, char** argv) {
     uint64_t last_branch_pc = 0;
     uint32_t last_branch_opcode = 0;
     stf::STFDecoder decoder(reader.getInitialIEM());
-    std::map<uint64_t, std::pair<uint64_t, uint64_t>> branch_counts;
-    std::set<uint64_t> cmov_branches;
-    std::map<uint64_t, CMovInfo> cmov_info;
+    PCTable<std::pair<uint64_t, uint64_t>> branch_counts;
+    PCTable<CMovInfo> cmov_info;
 
     // First find all instances of a not-taken conditional branch followed by a move
     for(const auto& inst: reader) {
@@ -149,9 +148,8 @@ int main(int argc, char** argv) {
                         decoder.decode(opcode);
                         if(decoder.isInstType(mavis::InstMetaData::InstructionTypes::MOVE) &&
                            !decoder.isInstType(mavis::InstMetaData::InstructionTypes::FLOAT)) {
-                            cmov_branches.insert(inst.pc());
-                            if(show_disasm) {
-                                cmov_info.emplace(inst.pc(), CMovInfo{inst.opcode(), next_pc, opcode});
+                            if(auto [cmov, new_cmov] = cmov_info.tryEmplace(inst.pc()); new_cmov) {
+                                cmov = CMovInfo{inst.opcode(), next_pc, opcode};
                             }
                         }
                     }
@@ -184,9 +182,8 @@ int main(int argc, char** argv) {
                             !decoder.isInstType(mavis::InstMetaData::InstructionTypes::FLOAT))) {
             const auto next_pc = inst.pc() + inst.opcodeSize();
             if(last_branch_target == next_pc) {
-                cmov_branches.insert(last_branch_pc);
-                if(show_disasm) {
-                    cmov_info.emplace(last_branch_pc, CMovInfo{last_branch_opcode, inst.pc(), inst.opcode()});
+                if(auto [cmov, new_cmov] = cmov_info.tryEmplace(last_branch_pc); new_cmov) {
+                    cmov = CMovInfo{last_branch_opcode, inst.pc(), inst.opcode()};
                 }
             }
         }
@@ -204,7 +201,7 @@ int main(int argc, char** argv) {
         stf::print_utils::printLeft("Disassembly", COLUMN_WIDTH);
     }
     std::cout << std::endl;
-    for(const auto pc: cmov_branches) {
+    for(const auto& [pc, cmov]: cmov_info.getSortedEntries()) {
         const auto& counts = branch_counts[pc];
         const auto taken = counts.first;
         const auto not_taken = counts.second;
@@ -219,10 +216,8 @@ int main(int argc, char** argv) {
         stf::print_utils::printDecLeft(not_taken, COLUMN_WIDTH);
         std::cout << std::endl;
         if(show_disasm) {
-            const auto& cmov = cmov_info[pc];
-
-            printDisasmLine<COLUMN_WIDTH, 4>(dis, pc, cmov.branch_opcode);
-            printDisasmLine<COLUMN_WIDTH, 4>(dis, cmov.mov_pc, cmov.mov_opcode);
+            printDisasmLine<COLUMN_WIDTH, 4>(dis, pc, cmov->branch_opcode);
+            printDisasmLine<COLUMN_WIDTH, 4>(dis, cmov->mov_pc, cmov->mov_opcode);
         }
     }
 
@@ -7,10 +7,10 @@
 #include "formatters.hpp"
 
 /**
- * \class STFCountFilter
- * Filter class used for counting STF records
+ * \class STFRecordCounter
+ * Counts STF records, instructions and memory accesses and reports the totals
  */
-class STFCountFilter : public stf::STFFilter<STFCountFilter> {
+class STFRecordCounter {
     private:
         const bool verbose_ = false;                     /**< If false, outputs all counts on a single line */
         const bool short_mode_ = false;                  /**< If true, only outputs instruction count */
@@ -32,8 +32,6 @@ class STFCountFilter : public stf::STFFilter<STFCountFilter> {
         mutable uint64_t fault_count_ = 0;               /**< Count faults */
         mutable uint64_t next_csv_dump_ = 0;             /**< Last time CSV was dumped */
 
-        friend class stf::STFFilter<STFCountFilter>;
-
         inline uint64_t getUserCount_() const {
             return inst_count_ - non_user_count_;
         }
@@ -90,18 +88,18 @@ class STFCountFilter : public stf::STFFilter<STFCountFilter> {
 
     public:
         /**
-         * Constructs an STFCountFilter
-         * \param inst_reader Instruction reader object
+         * Constructs an STFRecordCounter
          * \param verbose If false, all output will be on a single line
+         * \param short_mode If true, only the instruction count will be output
+         * \param csv_output If true, output results in CSV format
+         * \param cumulative_csv If true, CSV results will be cumulative
+         * \param csv_interval CSV dump interval. If 0, CSV will only be dumped at the end
          */
-        explicit STFCountFilter(stf::STFInstReader& inst_reader,
-                                const bool verbose,
-                                const bool short_mode,
-                                const bool user_mode_only,
-                                const bool csv_output,
-                                const bool cumulative_csv,
-                                const uint64_t csv_interval) :
-            stf::STFFilter<STFCountFilter>(inst_reader, user_mode_only),
+        STFRecordCounter(const bool verbose,
+                         const bool short_mode,
+                         const bool csv_output,
+                         const bool cumulative_csv,
+                         const uint64_t csv_interval) :
             verbose_(verbose),
             short_mode_(short_mode),
             csv_output_(csv_output),
@@ -111,18 +109,23 @@ class STFCountFilter : public stf::STFFilter<STFCountFilter> {
         {
         }
 
-    protected:
-        inline const std::vector<stf::STFInst>& filter(const stf::STFInst& inst) {
-            if(STF_EXPECT_TRUE(!is_fault_)) {
+        /**
+         * Counts the records belonging to an instruction
+         * \param inst Instruction to count
+         * \param is_fault If true, the instruction faulted
+         * \param in_user_code If true, the instruction is user code
+         */
+        inline void count(const stf::STFInst& inst, const bool is_fault, const bool in_user_code) {
+            if(STF_EXPECT_TRUE(!is_fault)) {
                 inst_count_++;
             }
 
             if(!short_mode_) {
-                if(STF_EXPECT_FALSE(!is_fault_ && !in_user_code_)) {
+                if(STF_EXPECT_FALSE(!is_fault && !in_user_code)) {
                     non_user_count_++;
                 }
 
-                fault_count_ += is_fault_;
+                fault_count_ += is_fault;
 
                 const auto& orig_records = inst.getOrigRecords();
                 record_count_ += orig_records.size();
@@ -142,10 +145,11 @@ class STFCountFilter : public stf::STFFilter<STFCountFilter> {
                     next_csv_dump_ += csv_interval_;
                 }
             }
-
-            return EMPTY_INST_LIST_;
         }
 
+        /**
+         * Outputs the final counts
+         */
         void finished() const {
             if(short_mode_) {
                 std::cout << inst_count_ << std::endl;
@@ -178,3 +182,42 @@ class STFCountFilter : public stf::STFFilter<STFCountFilter> {
             }
         }
 };
+
+/**
+ * \class STFCountFilter
+ * Filter class used for counting STF records
+ */
+class STFCountFilter : public stf::STFFilter<STFCountFilter> {
+    private:
+        STFRecordCounter counter_;                       /**< Counts the filtered records */
+
+        friend class stf::STFFilter<STFCountFilter>;
+
+    public:
+        /**
+         * Constructs an STFCountFilter
+         * \param inst_reader Instruction reader object
+         * \param verbose If false, all output will be on a single line
+         */
+        explicit STFCountFilter(stf::STFInstReader& inst_reader,
+                                const bool verbose,
+                                const bool short_mode,
+                                const bool user_mode_only,
+                                const bool csv_output,
+                                const bool cumulative_csv,
+                                const uint64_t csv_interval) :
+            stf::STFFilter<STFCountFilter>(inst_reader, user_mode_only),
+            counter_(verbose, short_mode, csv_output, cumulative_csv, csv_interval)
+        {
+        }
+
+    protected:
+        inline const std::vector<stf::STFInst>& filter(const stf::STFInst& inst) {
+            counter_.count(inst, is_fault_, in_user_code_);
+            return EMPTY_INST_LIST_;
+        }
+
+        void finished() const {
+            counter_.finished();
+        }
+};
@@ -1,12 +1,15 @@
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <memory>
-#include <set>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include "stf_elf.hpp"
 #include "stf_decoder.hpp"
 #include "disassembler.hpp"
+#include "pc_table.hpp"
 
 #include "print_utils.hpp"
 #include "stf_inst_reader.hpp"
@@ -49,33 +52,35 @@ void processCommandLine(int argc,
 }
 
 struct CStarInfo {
-    CStarInfo(const uint32_t _branch_opcode,
-              const uint64_t _next_inst_pc,
-              const uint32_t _next_inst_opcode) :
-        next_inst_pc(_next_inst_pc),
-        next_inst_opcode(_next_inst_opcode),
-        branch_opcode(_branch_opcode)
-    {
-    }
-
-    uint64_t next_inst_pc;
-    uint32_t next_inst_opcode;
-    uint32_t branch_opcode;
+    uint64_t next_inst_pc = 0;
+    uint32_t next_inst_opcode = 0;
+    uint32_t branch_opcode = 0;
 };
 
 struct BranchInfo {
-    uint64_t taken;
-    uint64_t not_taken;
-    uint64_t num_toggle;
-    bool last_taken;
+    uint64_t taken = 0;
+    uint64_t not_taken = 0;
+    uint64_t num_toggle = 0;
+    bool last_taken = false;
 };
 
-using BranchMap = std::map<uint64_t, BranchInfo>;
+using BranchMap = PCTable<BranchInfo>;
+using CStarMap = PCTable<CStarInfo>;
+
+inline void addCStarInfo(CStarMap& cstar_info,
+                         const uint64_t branch_pc,
+                         const uint32_t branch_opcode,
+                         const uint64_t next_inst_pc,
+                         const uint32_t next_inst_opcode) {
+    auto [cstar, new_cstar] = cstar_info.tryEmplace(branch_pc);
+    if(new_cstar) {
+        cstar = CStarInfo{next_inst_pc, next_inst_opcode, branch_opcode};
+    }
+}
 
 template<bool taken>
 inline void updateBranchInfo(BranchMap& branch_counts, const uint64_t pc) {
-    auto[it, new_branch] = branch_counts.try_emplace(pc);
-    auto& branch_info = it->second;
+    auto [branch_info, new_branch] = branch_counts.tryEmplace(pc);
 
     bool toggle = new_branch;
 
@@ -130,7 +135,7 @@ int main(int argc, char** argv) {
     uint32_t last_branch_opcode = 0;
     stf::STFDecoder decoder(reader.getInitialIEM());
     BranchMap branch_counts;
-    std::map<uint64_t, CStarInfo> cstar_info;
+    CStarMap cstar_info;
 
     // First find all instances of a not-taken conditional branch followed by another instruction
     for(const auto& inst: reader) {
@@ -169,8 +174,7 @@ int main(int argc, char** argv) {
                     if(next_opcode) {
                         decoder.decode(next_opcode);
                         if(STF_EXPECT_TRUE(!decoder.isBranch())) {
-                            cstar_info.try_emplace(inst_pc,
-                                                   inst_opcode, next_pc, next_opcode);
+                            addCStarInfo(cstar_info, inst_pc, inst_opcode, next_pc, next_opcode);
                         }
                     }
                 }
@@ -193,33 +197,44 @@ int main(int argc, char** argv) {
 
         if(STF_EXPECT_FALSE(last_was_nt_branch && !decoder.isBranch())) {
             if(last_branch_target == next_pc) {
-                cstar_info.try_emplace(last_branch_pc,
-                                       last_branch_opcode, inst_pc, inst_opcode);
+                addCStarInfo(cstar_info, last_branch_pc, last_branch_opcode, inst_pc, inst_opcode);
             }
         }
 
         last_was_nt_branch = false;
     }
 
-    std::map<std::string, std::map<std::string, std::tuple<uint64_t, uint64_t, uint64_t>>> mnemonic_counts;
+    // Aggregate by mnemonic ID, then sort by the mnemonic strings once
+    MnemonicTable<stf::STFDecoder> mnemonics(decoder);
+    std::map<std::pair<uint32_t, uint32_t>, std::tuple<uint64_t, uint64_t, uint64_t>> mnemonic_counts;
 
-    for(const auto& p: cstar_info) {
-        const auto& [branch_pc, cstar] = p;
-        auto& [taken, not_taken, toggle] = mnemonic_counts[decoder.decode(cstar.branch_opcode).getMnemonic()][decoder.decode(cstar.next_inst_opcode).getMnemonic()];
+    for(const auto& [branch_pc, cstar]: cstar_info.getSortedEntries()) {
+        const auto key = std::make_pair(mnemonics.getId(cstar->branch_opcode), mnemonics.getId(cstar->next_inst_opcode));
+        auto& [taken, not_taken, toggle] = mnemonic_counts[key];
         const auto& branch_info = branch_counts[branch_pc];
         taken += branch_info.taken;
         not_taken += branch_info.not_taken;
         toggle += branch_info.num_toggle;
     }
 
+    std::vector<decltype(mnemonic_counts)::const_iterator> sorted_counts;
+    sorted_counts.reserve(mnemonic_counts.size());
+    for(auto it = mnemonic_counts.cbegin(); it != mnemonic_counts.cend(); ++it) {
+        sorted_counts.emplace_back(it);
+    }
+
+    const auto get_mnemonics = [&mnemonics](const auto& it) {
+        return std::tie(mnemonics.getMnemonic(it->first.first), mnemonics.getMnemonic(it->first.second));
+    };
+    std::sort(sorted_counts.begin(),
+              sorted_counts.end(),
+              [&get_mnemonics](const auto& lhs, const auto& rhs) { return get_mnemonics(lhs) < get_mnemonics(rhs); });
+
     std::cout << "Branch Mnemonic,Next Inst Mnemonic,Taken Count,Not Taken Count,Toggle Count" << std::endl;
-    for(const auto& p: mnemonic_counts) {
-        const auto& [branch_mnemonic, next_inst_info] = p;
-        for(const auto& q: next_inst_info) {
-            const auto& next_inst_mnemonic = q.first;
-            const auto& [taken, not_taken, toggle] = q.second;
-            std::cout << branch_mnemonic << ',' << next_inst_mnemonic << ',' << taken << ',' << not_taken << ',' << toggle << std::endl;
-        }
+    for(const auto& it: sorted_counts) {
+        const auto& [branch_mnemonic, next_inst_mnemonic] = get_mnemonics(it);
+        const auto& [taken, not_taken, toggle] = it->second;
+        std::cout << branch_mnemonic << ',' << next_inst_mnemonic << ',' << taken << ',' << not_taken << ',' << toggle << std::endl;
     }
 
     return 0;
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include "dtl/dtl.hpp"
+#pragma GCC diagnostic pop
+
+#include "stf_exception.hpp"
+
+/**
+ * \class AnchoredDiff
+ * \brief Windowed diff engine that can resynchronize after insertions and deletions without buffering
+ * entire traces
+ *
+ * Instructions are compared in lockstep until they diverge. The engine then reads ahead in both streams,
+ * fingerprinting every run of anchor_length instructions with a rolling hash, until it finds a run that
+ * appears in both streams (an anchor). Only the instructions before the anchor are handed to dtl, after
+ * which lockstep comparison resumes at the anchor. Memory use is bounded by max_window instructions per
+ * trace. If no anchor is found within the window, the whole window is diffed and the engine carries on
+ * from the end of it.
+ *
+ * SourceType must provide std::optional<InstType> next(), returning std::nullopt at the end of the stream, and
+ * void recycle(), which is called whenever no instruction returned by next() is alive any more.
+ * InstType must provide operator==, operator<< and a uint64_t hash() that is consistent with operator==.
+ */
+template<typename InstType>
+class AnchoredDiff {
+    private:
+        struct Entry {
+            InstType inst;
+            uint64_t hash;
+
+            explicit Entry(InstType&& i) :
+                inst(std::move(i)),
+                hash(inst.hash())
+            {
+            }
+        };
+
+        using Window = std::deque<Entry>;
+        using InstVec = std::vector<InstType>;
+
+        static constexpr uint64_t FINGERPRINT_BASE_ = 0x100000001b3ULL;
+
+        const size_t anchor_length_;
+        const size_t max_window_;
+        const uint64_t max_diffs_;
+        const bool only_count_;
+        std::ostream& os_;
+        std::vector<std::streampos>* const diff_ends_;
+
+        // FINGERPRINT_BASE_ ^ (anchor_length_ - 1), used to remove the oldest instruction from a fingerprint
+        uint64_t base_pow_ = 1;
+
+        uint64_t num_diffs_ = 0;
+        uint64_t num_matched_ = 0;
+        uint64_t num_windows_ = 0;
+
+        template<typename SourceType>
+        class Stream {
+            private:
+                SourceType& source_;
+                bool ended_ = false;
+
+            public:
+                Window window;
+
+                explicit Stream(SourceType& source) :
+                    source_(source)
+                {
+                }
+
+                /**
+                 * Reads instructions until the window holds at least n of them or the source ends
+                 * \returns true if the window holds at least n instructions
+                 */
+                inline bool fill(const size_t n) {
+                    while(window.size() < n && !ended_) {
+                        if(auto inst = source_.next(); inst) {
+                            window.emplace_back(std::move(*inst));
+                        }
+                        else {
+                            ended_ = true;
+                        }
+                    }
+                    return window.size() >= n;
+                }
+
+                inline bool empty() {
+                    return !fill(1);
+                }
+
+                /**
+                 * Discards the oldest instruction. Once the window is empty no instruction from the source is
+                 * alive any more, so the source is allowed to reuse its storage.
+                 */
+                inline void pop() {
+                    window.pop_front();
+                    if(window.empty()) {
+                        source_.recycle();
+                    }
+                }
+
+                inline InstVec take(const size_t n) {
+                    InstVec insts;
+                    insts.reserve(n);
+                    for(size_t i = 0; i < n; ++i) {
+                        insts.emplace_back(std::move(window.front().inst));
+                        window.pop_front();
+                    }
+                    return insts;
+                }
+        };
+
+        static inline bool equal_(const Entry& lhs, const Entry& rhs) {
+            return lhs.hash == rhs.hash && lhs.inst == rhs.inst;
+        }
+
+        inline bool limitReached_() const {
+            return max_diffs_ && num_diffs_ >= max_diffs_;
+        }
+
+        inline void emit_(const char* prefix, const InstType& inst) {
+            // A window can contain more edits than the remaining limit allows
+            if(limitReached_()) {
+                return;
+            }
+            ++num_diffs_;
+            if(!only_count_) {
+                os_ << prefix << inst << std::endl;
+                if(diff_ends_) {
+                    diff_ends_->emplace_back(os_.tellp());
+                }
+            }
+        }
+
+        inline void emitDeleted_(const InstType& inst) {
+            emit_("- ", inst);
+        }
+
+        inline void emitAdded_(const InstType& inst) {
+            emit_("+ ", inst);
+        }
+
+        /**
+         * Incrementally fingerprints the runs of anchor_length_ instructions starting at each window offset
+         */
+        class FingerprintScanner {
+            private:
+                const AnchoredDiff& parent_;
+                uint64_t fingerprint_ = 0;
+                size_t next_ = 0; // Offset of the next run to fingerprint
+
+            public:
+                std::unordered_map<uint64_t, size_t> first_offset;
+
+                explicit FingerprintScanner(const AnchoredDiff& parent) :
+                    parent_(parent)
+                {
+                }
+
+                /**
+                 * Fingerprints the run starting at the next offset
+                 * \returns The fingerprint, or std::nullopt if the window does not contain a full run at that offset
+                 */
+                inline std::optional<std::pair<uint64_t, size_t>> advance(const Window& window) {
+                    const size_t k = parent_.anchor_length_;
+                    if(next_ + k > window.size()) {
+                        return std::nullopt;
+                    }
+
+                    if(next_ == 0) {
+                        for(size_t i = 0; i < k; ++i) {
+                            fingerprint_ = fingerprint_ * FINGERPRINT_BASE_ + window[i].hash;
+                        }
+                    }
+                    else {
+                        fingerprint_ = (fingerprint_ - window[next_ - 1].hash * parent_.base_pow_) * FINGERPRINT_BASE_ +
+                                       window[next_ + k - 1].hash;
+                    }
+
+                    const size_t offset = next_++;
+                    first_offset.emplace(fingerprint_, offset);
+                    return std::make_pair(fingerprint_, offset);
+                }
+        };
+
+        inline bool isAnchor_(const Window& w1, const size_t off1, const Window& w2, const size_t off2) const {
+            for(size_t i = 0; i < anchor_length_; ++i) {
+                if(!equal_(w1[off1 + i], w2[off2 + i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Reads ahead in both streams looking for the closest anchor
+         * \returns Window offsets of the anchor in each stream. If no anchor is found, returns the number of
+         * instructions to diff from each stream instead.
+         */
+        template<typename SourceType1, typename SourceType2>
+        std::pair<size_t, size_t> findAnchor_(Stream<SourceType1>& s1, Stream<SourceType2>& s2) {
+            FingerprintScanner scan1(*this);
+            FingerprintScanner scan2(*this);
+
+            for(size_t n = 0; n < max_window_; ++n) {
+                const bool has1 = s1.fill(n + anchor_length_);
+                const bool has2 = s2.fill(n + anchor_length_);
+                if(!has1 && !has2) {
+                    break;
+                }
+
+                // Check each new run against every run seen so far in the other stream, including the run at
+                // the same offset
+                const auto fp1 = scan1.advance(s1.window);
+                const auto fp2 = scan2.advance(s2.window);
+
+                if(fp1) {
+                    if(const auto it = scan2.first_offset.find(fp1->first);
+                       it != scan2.first_offset.end() && isAnchor_(s1.window, fp1->second, s2.window, it->second)) {
+                        return std::make_pair(fp1->second, it->second);
+                    }
+                }
+                if(fp2) {
+                    if(const auto it = scan1.first_offset.find(fp2->first);
+                       it != scan1.first_offset.end() && isAnchor_(s1.window, it->second, s2.window, fp2->second)) {
+                        return std::make_pair(it->second, fp2->second);
+                    }
+                }
+            }
+
+            // No anchor: diff everything read so far, up to the window limit
+            return std::make_pair(std::min(s1.window.size(), max_window_), std::min(s2.window.size(), max_window_));
+        }
+
+        /**
+         * Diffs a bounded divergent window with dtl and emits the edits
+         */
+        void diffWindow_(const InstVec& insts1, const InstVec& insts2) {
+            ++num_windows_;
+
+            if(insts1.empty() || insts2.empty()) {
+                for(const auto& inst: insts1) {
+                    emitDeleted_(inst);
+                }
+                for(const auto& inst: insts2) {
+                    emitAdded_(inst);
+                }
+                return;
+            }
+
+            dtl::Diff<InstType, InstVec> d(insts1, insts2);
+            d.onHuge();
+            d.compose();
+
+            for(const auto& edit: d.getSes().getSequence()) {
+                switch(edit.second.type) {
+                    case dtl::SES_DELETE:
+                        emitDeleted_(edit.first);
+                        break;
+                    case dtl::SES_ADD:
+                        emitAdded_(edit.first);
+                        break;
+                    case dtl::SES_COMMON:
+                        ++num_matched_;
+                        break;
+                }
+            }
+        }
+
+    public:
+        /**
+         * Constructs an AnchoredDiff
+         * \param anchor_length Number of consecutive matching instructions required to resynchronize
+         * \param max_window Maximum number of instructions buffered from each stream while searching for an anchor
+         * \param max_diffs Stop after this many differing instructions (0 = unlimited)
+         * \param only_count If true, only count differences instead of printing them
+         * \param os Stream to print differences to
+         * \param diff_ends If not null, the position of os after each printed difference is appended to it
+         */
+        AnchoredDiff(const size_t anchor_length,
+                     const size_t max_window,
+                     const uint64_t max_diffs,
+                     const bool only_count,
+                     std::ostream& os,
+                     std::vector<std::streampos>* diff_ends = nullptr) :
+            anchor_length_(anchor_length),
+            max_window_(max_window),
+            max_diffs_(max_diffs),
+            only_count_(only_count),
+            os_(os),
+            diff_ends_(diff_ends)
+        {
+            stf_assert(anchor_length_ > 0, "Anchor length must be greater than 0");
+            stf_assert(max_window_ > 0, "Maximum window size must be greater than 0");
+
+            for(size_t i = 1; i < anchor_length_; ++i) {
+                base_pow_ *= FINGERPRINT_BASE_;
+            }
+        }
+
+        /**
+         * Diffs two instruction streams
+         * \param source1 First stream
+         * \param source2 Second stream
+         */
+        template<typename SourceType1, typename SourceType2>
+        void run(SourceType1& source1, SourceType2& source2) {
+            Stream<SourceType1> s1(source1);
+            Stream<SourceType2> s2(source2);
+
+            while(!limitReached_()) {
+                const bool empty1 = s1.empty();
+                const bool empty2 = s2.empty();
+
+                if(empty1 && empty2) {
+                    break;
+                }
+
+                // One of the streams ended, so everything left in the other one is a difference
+                if(empty1) {
+                    emitAdded_(s2.window.front().inst);
+                    s2.pop();
+                    continue;
+                }
+                if(empty2) {
+                    emitDeleted_(s1.window.front().inst);
+                    s1.pop();
+                    continue;
+                }
+
+                if(equal_(s1.window.front(), s2.window.front())) {
+                    ++num_matched_;
+                    s1.pop();
+                    s2.pop();
+                    continue;
+                }
+
+                const auto [len1, len2] = findAnchor_(s1, s2);
+                const auto insts1 = s1.take(len1);
+                const auto insts2 = s2.take(len2);
+                diffWindow_(insts1, insts2);
+            }
+        }
+
+        /**
+         * Gets the number of instructions that were only present in one of the streams
+         */
+        inline uint64_t getNumDiffs() const {
+            return num_diffs_;
+        }
+
+        /**
+         * Gets the number of instructions that matched
+         */
+        inline uint64_t getNumMatched() const {
+            return num_matched_;
+        }
+
+        /**
+         * Gets the number of divergent windows that were handed to dtl
+         */
+        inline uint64_t getNumWindows() const {
+            return num_windows_;
+        }
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "stf_exception.hpp"
+
+/**
+ * \struct DiffSegment
+ * \brief A pair of aligned instruction ranges, one from each trace
+ */
+struct DiffSegment {
+    uint64_t offset1 = 0; /**< Offset of the first instruction in trace 1, relative to the diff start */
+    uint64_t length1 = 0; /**< Number of instructions from trace 1 (0 = until the end of the trace) */
+    uint64_t offset2 = 0; /**< Offset of the first instruction in trace 2, relative to the diff start */
+    uint64_t length2 = 0; /**< Number of instructions from trace 2 (0 = until the end of the trace) */
+};
+
+/**
+ * \struct DiffSegmentResult
+ * \brief Buffered output from diffing a single segment
+ */
+struct DiffSegmentResult {
+    std::ostringstream output;                /**< Printed differences */
+    std::vector<std::streampos> diff_ends;    /**< Position in output after each printed difference */
+    uint64_t num_diffs = 0;                   /**< Number of differences found */
+    uint64_t num_insts = 0;                   /**< Number of instructions read from both traces */
+    bool past_end = false;                    /**< Set if the segment lies past the end of both traces */
+};
+
+/**
+ * \class SegmentedDiffRunner
+ * \brief Diffs segments concurrently on a pool of threads and emits their results in order
+ *
+ * Segments are numbered from 0. The plan function maps a segment number to a DiffSegment, returning
+ * std::nullopt once there are no more segments. A segment that reads no instructions from either trace is
+ * also treated as the end, which allows open-ended plans such as fixed-size segments. At most
+ * MAX_IN_FLIGHT_PER_THREAD segments per thread are buffered ahead of the one being emitted.
+ */
+class SegmentedDiffRunner {
+    private:
+        static constexpr size_t MAX_IN_FLIGHT_PER_THREAD = 2;
+
+        const size_t num_threads_;
+        const uint64_t max_diffs_;
+
+        std::mutex mutex_;
+        std::condition_variable result_ready_cv_;
+        std::condition_variable slot_free_cv_;
+        std::map<size_t, DiffSegmentResult> results_;
+        std::atomic<size_t> next_segment_ = 0;
+        size_t next_to_emit_ = 0;
+        bool stop_ = false;
+        std::exception_ptr exception_;
+
+        template<typename PlanFunc, typename DiffFunc>
+        void work_(const PlanFunc& plan, const DiffFunc& diff) {
+            while(true) {
+                const size_t idx = next_segment_++;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    slot_free_cv_.wait(lock, [this, idx]() {
+                        return stop_ || idx < next_to_emit_ + num_threads_ * MAX_IN_FLIGHT_PER_THREAD;
+                    });
+                    if(stop_) {
+                        return;
+                    }
+                }
+
+                DiffSegmentResult result;
+                try {
+                    if(const auto segment = plan(idx); segment) {
+                        diff(*segment, result);
+                    }
+                    result.past_end |= result.num_insts == 0;
+                }
+                catch(...) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if(!exception_) {
+                        exception_ = std::current_exception();
+                    }
+                    stop_ = true;
+                    result_ready_cv_.notify_all();
+                    slot_free_cv_.notify_all();
+                    return;
+                }
+
+                const bool past_end = result.past_end;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    results_.emplace(idx, std::move(result));
+                }
+                result_ready_cv_.notify_all();
+
+                // Every later segment is past the end as well
+                if(past_end) {
+                    return;
+                }
+            }
+        }
+
+    public:
+        /**
+         * Constructs a SegmentedDiffRunner
+         * \param num_threads Number of worker threads
+         * \param max_diffs Stop after this many differences (0 = unlimited)
+         */
+        SegmentedDiffRunner(const size_t num_threads, const uint64_t max_diffs) :
+            num_threads_(num_threads),
+            max_diffs_(max_diffs)
+        {
+            stf_assert(num_threads_ > 0, "Number of threads must be greater than 0");
+        }
+
+        /**
+         * Diffs every segment and prints the results in segment order
+         * \param plan Callable mapping a segment number to std::optional<DiffSegment>. Must be thread-safe.
+         * \param diff Callable that diffs a DiffSegment into a DiffSegmentResult. Must be thread-safe.
+         * \param os Stream to print the results to
+         * \returns Total number of differences, truncated to max_diffs
+         */
+        template<typename PlanFunc, typename DiffFunc>
+        uint64_t run(const PlanFunc& plan, const DiffFunc& diff, std::ostream& os) {
+            std::vector<std::thread> workers;
+            workers.reserve(num_threads_);
+            for(size_t i = 0; i < num_threads_; ++i) {
+                workers.emplace_back([this, &plan, &diff]() { work_(plan, diff); });
+            }
+
+            uint64_t num_diffs = 0;
+            while(true) {
+                DiffSegmentResult result;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    result_ready_cv_.wait(lock, [this]() { return stop_ || results_.count(next_to_emit_); });
+                    if(stop_) {
+                        break;
+                    }
+                    auto it = results_.find(next_to_emit_);
+                    result = std::move(it->second);
+                    results_.erase(it);
+                    ++next_to_emit_;
+                }
+                slot_free_cv_.notify_all();
+
+                if(result.past_end) {
+                    break;
+                }
+
+                const uint64_t remaining = max_diffs_ ? max_diffs_ - num_diffs : result.num_diffs;
+                const uint64_t num_to_emit = std::min(remaining, result.num_diffs);
+                if(num_to_emit == result.num_diffs) {
+                    os << result.output.str();
+                }
+                else if(num_to_emit && !result.diff_ends.empty()) {
+                    os << result.output.str().substr(0, static_cast<size_t>(result.diff_ends[num_to_emit - 1]));
+                }
+                num_diffs += num_to_emit;
+
+                if(max_diffs_ && num_diffs >= max_diffs_) {
+                    break;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            slot_free_cv_.notify_all();
+            result_ready_cv_.notify_all();
+
+            for(auto& worker: workers) {
+                worker.join();
+            }
+
+            if(exception_) {
+                std::rethrow_exception(exception_);
+            }
+
+            return num_diffs;
+        }
+};
@@ -10,6 +10,11 @@
 #include "dtl/dtl.hpp"
 #pragma GCC diagnostic pop
 
+#include <limits>
+#include <thread>
+
+#include "anchored_diff.hpp"
+#include "segmented_diff.hpp"
 #include "stf_diff.hpp"
 
 #include "print_utils.hpp"
@@ -26,16 +31,16 @@ std::ostream& operator<<(std::ostream& os, const STFDiffInst& inst) {
                 inst.physPC_);
     */
 
-    stf::format_utils::formatDec(os, inst.index_);
+    stf::format_utils::formatDec(os, inst.getIndex());
     os << ":\t";
-    stf::format_utils::formatHex(os, inst.pc_);
+    stf::format_utils::formatHex(os, inst.getPC());
     os << " : ";
-    stf::format_utils::formatHex(os, inst.opcode_);
+    stf::format_utils::formatHex(os, inst.getOpcode());
     os << ' ';
 
-    inst.dis_->printDisassembly(os, inst.pc_, inst.opcode_);
+    inst.getDisassembler()->printDisassembly(os, inst.getPC(), inst.getOpcode());
 
-    if (!inst.mem_accesses_.empty()) {
+    if (inst.hasMemAccesses()) {
         /*if (inst.mem_accesses[0].paddr == INVALID_PHYS_ADDR)
             snprintf(buf, 100, " MEM %#016lx: [",
                     inst.mem_accesses[0].addr);
@@ -43,19 +48,22 @@ std::ostream& operator<<(std::ostream& os, const STFDiffInst& inst) {
             snprintf(buf, 100, " MEM %#016lx:%#010lx: [",
                     inst.mem_accesses[0].addr,
                     inst.mem_accesses[0].paddr);*/
-        os << " MEM ";
-        stf::format_utils::formatHex(os, inst.mem_accesses_.front().getAddress());
-        os << ": [";
-
-        for (const auto &mit : inst.mem_accesses_) {
+        bool first = true;
+        inst.forEachMemAccess([&os, &first](const STFDiffInst::MemAccess& mit) {
+            if (first) {
+                os << " MEM ";
+                stf::format_utils::formatHex(os, mit.getAddress());
+                os << ": [";
+                first = false;
+            }
             os << ' ';
             stf::format_utils::formatHex(os, mit.getData());
-        }
+        });
 
         os << " ]";
     }
 
-    for (const auto &rit : inst.operands_) {
+    inst.forEachOperand([&os](const STFDiffInst::Operand& rit) {
         // If there are state records, there should (generally) be a record for every single register in the machine.
         // Space them out to make the output more readable.
         if(STF_EXPECT_FALSE(rit.getType() == stf::Registers::STF_REG_OPERAND_TYPE::REG_STATE)) {
@@ -73,7 +81,7 @@ std::ostream& operator<<(std::ostream& os, const STFDiffInst& inst) {
             os << "   " << rit.getLabel() << ": " << rit.getReg() << " : ";
             stf::format_utils::formatHex(os, rit.getScalarData());
         }
-    }
+    });
 
     return os;
 }
@@ -128,7 +136,7 @@ inline void advanceToCompletedSC(stf::STFDecoder& decoder,
 }
 
 // Given two traces (and some config info), report the first n differences
-// between the two. n == config.diff_count.
+// between the two. n == config.diff_count, or every difference if it is 0.
 int streamingDiff(const STFDiffConfig &config,
                   const std::string &trace1,
                   const std::string &trace2) {
@@ -151,14 +159,20 @@ int streamingDiff(const STFDiffConfig &config,
     stf::STFDecoder decoder(iem);
     stf::Disassembler dis1(findElfFromTrace(config.trace1), inst_set, iem, config.use_aliases);
     stf::Disassembler dis2(findElfFromTrace(config.trace2), inst_set, iem, config.use_aliases);
+    DiffInstArena arena1(&dis1);
+    DiffInstArena arena2(&dis2);
 
     const bool spike_lr_sc_workaround = config.workarounds.at("spike_lr_sc");
 
     while ((!config.length) || (count < config.length)) {
-        if (diff_count >= config.diff_count) {
+        if (config.diff_count && diff_count >= config.diff_count) {
             break;
         }
 
+        // Instructions never outlive an iteration, so the arenas can be reused
+        arena1.clear();
+        arena2.clear();
+
         if (spike_lr_sc_workaround && reader1 != rdr1.end() && reader2 != rdr2.end()) {
             const bool inst1_was_failed_sc = isFailedSC(decoder, *reader1);
             const bool inst2_was_failed_sc = isFailedSC(decoder, *reader2);
@@ -185,7 +199,7 @@ int streamingDiff(const STFDiffConfig &config,
                 std::cout << "+ "
                           << STFDiffInst(inst2,
                                          config,
-                                         &dis2)
+                                         arena2)
                           << std::endl;
             }
             reader2++;
@@ -201,7 +215,7 @@ int streamingDiff(const STFDiffConfig &config,
                 std::cout << "- "
                           << STFDiffInst(inst1,
                                          config,
-                                         &dis1)
+                                         arena1)
                           << std::endl;
             }
             reader1++;
@@ -214,10 +228,10 @@ int streamingDiff(const STFDiffConfig &config,
 
         STFDiffInst diff1(inst1,
                           config,
-                          &dis1);
+                          arena1);
         STFDiffInst diff2(inst2,
                           config,
-                          &dis2);
+                          arena2);
 
         if (diff1 != diff2) {
             diff_count++;
@@ -239,30 +253,274 @@ int streamingDiff(const STFDiffConfig &config,
     return !!diff_count;
 }
 
-void extractInstructions(const std::string &trace,
-                         DiffInstVec &vec,
-                         const uint64_t start,
-                         const STFDiffConfig &config) {
-    // Open stf trace reader
-    stf::STFInstReader rdr(trace, config.ignore_kernel);
-    stf::Disassembler dis(findElfFromTrace(trace), rdr.getISA(), rdr.getInitialIEM(), config.use_aliases);
-    auto reader = getBeginIterator(start, config.diff_markpointed_region, config.diff_tracepointed_region, rdr);
+/**
+ * \class DiffInstSource
+ * \brief Produces STFDiffInsts from a trace one at a time for AnchoredDiff and the parallel diff
+ */
+class DiffInstSource {
+    public:
+        static constexpr uint64_t UNLIMITED = std::numeric_limits<uint64_t>::max();
+
+    private:
+        const STFDiffConfig& config_;
+        stf::STFInstReader rdr_;
+        stf::Disassembler dis_;
+        DiffInstArena arena_;
+        stf::STFInstReader::iterator it_;
+        const uint64_t max_insts_;
+        uint64_t count_ = 0;
+
+    public:
+        DiffInstSource(const std::string& trace, const uint64_t start, const STFDiffConfig& config) :
+            config_(config),
+            rdr_(trace, config.ignore_kernel),
+            dis_(findElfFromTrace(trace), rdr_.getISA(), rdr_.getInitialIEM(), config.use_aliases),
+            arena_(&dis_),
+            it_(getBeginIterator(start, config.diff_markpointed_region, config.diff_tracepointed_region, rdr_)),
+            // length of 0 means to keep going till we hit the end
+            max_insts_(config.length ? config.length : UNLIMITED)
+        {
+        }
 
-    uint64_t count = 0;
-    while (reader != rdr.end()) {
-        const auto& inst = *reader;
+        /**
+         * Constructs a DiffInstSource that reads a range of instructions, seeking directly to the first one
+         * \param trace Trace to read
+         * \param first_inst Index of the first instruction to read
+         * \param max_insts Maximum number of instructions to read (UNLIMITED = until the end of the trace)
+         * \param config Diff configuration
+         */
+        DiffInstSource(const std::string& trace,
+                       const uint64_t first_inst,
+                       const uint64_t max_insts,
+                       const STFDiffConfig& config) :
+            config_(config),
+            rdr_(trace, config.ignore_kernel),
+            dis_(findElfFromTrace(trace), rdr_.getISA(), rdr_.getInitialIEM(), config.use_aliases),
+            arena_(&dis_),
+            it_(first_inst > 1 ? rdr_.seekFromBeginning(first_inst - 1) : rdr_.begin()),
+            max_insts_(max_insts)
+        {
+        }
+
+        inline std::optional<STFDiffInst> next() {
+            if(count_ >= max_insts_ || it_ == rdr_.end()) {
+                return std::nullopt;
+            }
 
-        vec.emplace_back(inst,
-                         config,
-                         &dis);
+            std::optional<STFDiffInst> inst(std::in_place, *it_, config_, arena_);
+            ++it_;
+            ++count_;
+            return inst;
+        }
 
-        reader++;
-        count++;
+        /**
+         * Releases the storage used by every instruction returned so far. None of them may be used afterwards.
+         */
+        inline void recycle() {
+            arena_.clear();
+        }
+
+        inline const stf::STFInstReader& getReader() const {
+            return rdr_;
+        }
+
+        inline uint64_t getNumRead() const {
+            return count_;
+        }
+};
+
+// Reports the first n differences between two traces like streamingDiff, but resynchronizes after
+// insertions and deletions by searching for anchor points where both traces realign
+int windowedDiff(const STFDiffConfig& config) {
+    DiffInstSource src1(config.trace1, config.start1, config);
+    DiffInstSource src2(config.trace2, config.start2, config);
+
+    stf_assert(src1.getReader().getISA() == src2.getReader().getISA(),
+               "Traces must have the same instruction set in order to be compared!");
+    stf_assert(src1.getReader().getInitialIEM() == src2.getReader().getInitialIEM(),
+               "Traces must have the same instruction encoding in order to be compared!");
+
+    AnchoredDiff<STFDiffInst> diff(config.anchor_length, config.max_window, config.diff_count, config.only_count, std::cout);
+    diff.run(src1, src2);
+
+    if (config.only_count) {
+        std::cout << diff.getNumDiffs() << " different instructions" << std::endl;
+    }
+
+    return !!diff.getNumDiffs();
+}
+
+// Compares two segments instruction by instruction, like streamingDiff
+void lockstepDiff(DiffInstSource& src1,
+                  DiffInstSource& src2,
+                  const STFDiffConfig& config,
+                  DiffSegmentResult& result) {
+    while (!config.diff_count || result.num_diffs < config.diff_count) {
+        src1.recycle();
+        src2.recycle();
+
+        auto diff1 = src1.next();
+        auto diff2 = src2.next();
+
+        if (!diff1 && !diff2) {
+            break;
+        }
+
+        if (diff1 && diff2 && *diff1 == *diff2) {
+            continue;
+        }
+
+        result.num_diffs++;
+        if (!config.only_count) {
+            if (diff1) {
+                result.output << "- " << *diff1 << std::endl;
+            }
+            if (diff2) {
+                result.output << "+ " << *diff2 << std::endl;
+            }
+            result.diff_ends.emplace_back(result.output.tellp());
+        }
+    }
+}
 
-        // length of 0 means to keep going till we hit the end
-        if (config.length && (count >= config.length)) {
+// Finds the offset (relative to the diff start) of the instruction following each markpoint in a trace
+std::vector<uint64_t> findMarkpoints(const std::string& trace, const uint64_t start, const STFDiffConfig& config) {
+    stf::STFInstReader rdr(trace, config.ignore_kernel);
+    stf::STFDecoder decoder(rdr.getInitialIEM());
+    std::vector<uint64_t> markpoints;
+
+    uint64_t offset = 0;
+    for(auto it = std::next(rdr.begin(), static_cast<ssize_t>(start) - 1); it != rdr.end(); ++it) {
+        ++offset;
+        if (config.length && offset > config.length) {
             break;
         }
+
+        decoder.decode(it->opcode());
+        if(decoder.isMarkpoint()) {
+            markpoints.emplace_back(offset);
+        }
+    }
+
+    return markpoints;
+}
+
+// Builds the list of segments from markpoints or user-specified cut points
+std::vector<DiffSegment> planSegments(const STFDiffConfig& config) {
+    std::vector<std::pair<uint64_t, uint64_t>> cut_points = config.cut_points;
+
+    if(config.segment_at_markpoints) {
+        std::vector<uint64_t> markpoints1;
+        std::vector<uint64_t> markpoints2;
+        std::thread scan_thread([&markpoints1, &config]() { markpoints1 = findMarkpoints(config.trace1, config.start1, config); });
+        markpoints2 = findMarkpoints(config.trace2, config.start2, config);
+        scan_thread.join();
+
+        if(markpoints1.size() != markpoints2.size()) {
+            std::cerr << "WARNING: trace1 has " << markpoints1.size() << " markpoints and trace2 has "
+                      << markpoints2.size() << ". Only the first "
+                      << std::min(markpoints1.size(), markpoints2.size()) << " will be used to align the traces."
+                      << std::endl;
+        }
+
+        const size_t num_markpoints = std::min(markpoints1.size(), markpoints2.size());
+        for(size_t i = 0; i < num_markpoints; ++i) {
+            cut_points.emplace_back(markpoints1[i], markpoints2[i]);
+        }
+    }
+
+    std::vector<DiffSegment> segments;
+    uint64_t prev1 = 0;
+    uint64_t prev2 = 0;
+    for(const auto& [cut1, cut2]: cut_points) {
+        segments.push_back(DiffSegment{prev1, cut1 - prev1, prev2, cut2 - prev2});
+        prev1 = cut1;
+        prev2 = cut2;
+    }
+    // The last segment runs until the end of both traces
+    segments.push_back(DiffSegment{prev1, 0, prev2, 0});
+
+    return segments;
+}
+
+// Converts a segment length into a DiffInstSource instruction limit, clamping it to the -l limit
+inline uint64_t getSegmentLimit(const uint64_t offset, const uint64_t length, const uint64_t limit) {
+    const uint64_t segment_limit = length ? length : DiffInstSource::UNLIMITED;
+    if(!limit) {
+        return segment_limit;
+    }
+    if(offset >= limit) {
+        return 0;
+    }
+    return std::min(segment_limit, limit - offset);
+}
+
+// Splits both traces into aligned segments and diffs them concurrently. Results are printed in segment order,
+// and every instruction is printed with its index in the original trace.
+int parallelDiff(const STFDiffConfig& config) {
+    {
+        stf::STFInstReader rdr1(config.trace1, config.ignore_kernel);
+        stf::STFInstReader rdr2(config.trace2, config.ignore_kernel);
+        stf_assert(rdr1.getISA() == rdr2.getISA(), "Traces must have the same instruction set in order to be compared!");
+        stf_assert(rdr1.getInitialIEM() == rdr2.getInitialIEM(), "Traces must have the same instruction encoding in order to be compared!");
+    }
+
+    const bool fixed_size_segments = !config.segment_at_markpoints && config.cut_points.empty();
+    const auto segments = fixed_size_segments ? std::vector<DiffSegment>() : planSegments(config);
+
+    const auto plan = [&config, &segments, fixed_size_segments](const size_t idx) -> std::optional<DiffSegment> {
+        if(fixed_size_segments) {
+            const uint64_t offset = idx * config.segment_size;
+            return DiffSegment{offset, config.segment_size, offset, config.segment_size};
+        }
+        if(idx < segments.size()) {
+            return segments[idx];
+        }
+        return std::nullopt;
+    };
+
+    const auto diff = [&config](const DiffSegment& segment, DiffSegmentResult& result) {
+        const uint64_t limit1 = getSegmentLimit(segment.offset1, segment.length1, config.length);
+        const uint64_t limit2 = getSegmentLimit(segment.offset2, segment.length2, config.length);
+        if(!limit1 && !limit2) {
+            return;
+        }
+
+        DiffInstSource src1(config.trace1, config.start1 + segment.offset1, limit1, config);
+        DiffInstSource src2(config.trace2, config.start2 + segment.offset2, limit2, config);
+
+        if(config.windowed_diff) {
+            AnchoredDiff<STFDiffInst> anchored_diff(config.anchor_length,
+                                                    config.max_window,
+                                                    config.diff_count,
+                                                    config.only_count,
+                                                    result.output,
+                                                    &result.diff_ends);
+            anchored_diff.run(src1, src2);
+            result.num_diffs = anchored_diff.getNumDiffs();
+        }
+        else {
+            lockstepDiff(src1, src2, config, result);
+        }
+
+        result.num_insts = src1.getNumRead() + src2.getNumRead();
+    };
+
+    SegmentedDiffRunner runner(config.num_threads, config.diff_count);
+    const uint64_t diff_count = runner.run(plan, diff, std::cout);
+
+    if (config.only_count) {
+        std::cout << diff_count << " different instructions" << std::endl;
+    }
+
+    return !!diff_count;
+}
+
+// Buffers every instruction from a source. The source owns the storage for the instructions,
+// so it must outlive the vector.
+void extractInstructions(DiffInstSource& src, DiffInstVec &vec) {
+    while (auto inst = src.next()) {
+        vec.emplace_back(*inst);
     }
 }
 
@@ -275,14 +533,11 @@ int main (int argc, char **argv) {
             DiffInstVec instVec1;
             DiffInstVec instVec2;
 
-            extractInstructions(config.trace1,
-                                instVec1,
-                                config.start1,
-                                config);
-            extractInstructions(config.trace2,
-                                instVec2,
-                                config.start2,
-                                config);
+            DiffInstSource src1(config.trace1, config.start1, config);
+            DiffInstSource src2(config.trace2, config.start2, config);
+
+            extractInstructions(src1, instVec1);
+            extractInstructions(src2, instVec2);
 
             std::cerr << "Now diffing " << instVec1.size() << '(' << instVec2.size() << ") instructions" << std::endl;
 
@@ -296,6 +551,12 @@ int main (int argc, char **argv) {
 
             d.printUnifiedFormat();
         }
+        else if (config.num_threads) {
+            ret = parallelDiff(config);
+        }
+        else if (config.windowed_diff) {
+            ret = windowedDiff(config);
+        }
         else {
             ret = streamingDiff(config, config.trace1, config.trace2);
         }
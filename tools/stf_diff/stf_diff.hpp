@@ -1,13 +1,20 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "disassembler.hpp"
 #include "command_line_parser.hpp"
 #include "stf_inst.hpp"
 #include "stf_vlen.hpp"
+#include "tools_util.hpp"
 #include "util.hpp"
 
 class STFDiffConfig {
@@ -27,6 +34,13 @@ class STFDiffConfig {
         bool diff_dest_registers = false;
         bool diff_state_registers = false;
         bool unified_diff = false;
+        bool windowed_diff = false;
+        size_t anchor_length = 16;
+        size_t max_window = 4096;
+        size_t num_threads = 0;
+        uint64_t segment_size = 1000000;
+        bool segment_at_markpoints = false;
+        std::vector<std::pair<uint64_t, uint64_t>> cut_points;
         bool only_count = false;
         bool use_aliases = false;
         bool diff_markpointed_region = false;
@@ -35,6 +49,11 @@ class STFDiffConfig {
             {"spike_lr_sc", false}
         };
 
+        /**
+         * Constructs a default configuration. Used by tools that share STFDiffInst but have their own command line.
+         */
+        STFDiffConfig() = default;
+
         STFDiffConfig(int argc, char **argv) {
             trace_tools::CommandLineParser parser("stf_diff");
             parser.addFlag('1', "N", "start diff on Nth instruction of trace1");
@@ -48,12 +67,19 @@ class STFDiffConfig {
             parser.addFlag('R', "compare register records");
             parser.addFlag('D', "compare destination register records");
             parser.addFlag('S', "compare register state records");
-            parser.addFlag('c', "N", "Exit after the Nth difference");
+            parser.addFlag('c', "N", "Exit after the Nth difference (default 1). 0 reports every difference.");
             parser.addFlag('C', "Just report the number of differences");
             parser.addFlag('u', "run unified diff");
+            parser.addFlag('w', "run windowed diff (reports insertions and deletions like -u, but only buffers the divergent regions of the traces)");
+            parser.addFlag('K', "N", "number of consecutive matching instructions needed to resynchronize in windowed mode (default 16)");
+            parser.addFlag('X', "N", "maximum number of instructions to read ahead in each trace while resynchronizing in windowed mode (default 4096)");
             parser.addFlag('a', "use register aliases in disassembly");
             parser.addFlag('m', "begin diff after first markpoint");
             parser.addFlag('t', "begin diff after first tracepoint");
+            parser.addFlag('j', "N", "diff segments of the traces in parallel on N threads");
+            parser.addFlag('g', "in parallel mode, split the traces at every markpoint. The Nth markpoint in trace1 is aligned with the Nth markpoint in trace2.");
+            parser.addMultiFlag('s', "N[:M]", "in parallel mode, split the traces after N instructions of trace1 and M instructions of trace2 (M defaults to N). Can be specified multiple times.");
+            parser.addFlag('Z', "N", "in parallel mode, split both traces every N instructions if neither -g nor -s is given (default 1000000)");
             parser.addMultiFlag('W', "workaround", "enable specified workaround");
             parser.addPositionalArgument("trace1", "first STF trace to compare");
             parser.addPositionalArgument("trace2", "second STF trace to compare");
@@ -64,6 +90,18 @@ class STFDiffConfig {
             parser.setMutuallyExclusive('A', 'P');
             parser.setMutuallyExclusive('m', 't');
             parser.setMutuallyExclusive('R', 'D');
+            parser.setMutuallyExclusive('u', 'w');
+            parser.setDependentArgument('K', 'w');
+            parser.setDependentArgument('X', 'w');
+            parser.setMutuallyExclusive('j', 'u');
+            parser.setMutuallyExclusive('j', 'm');
+            parser.setMutuallyExclusive('j', 't');
+            parser.setMutuallyExclusive('g', 's');
+            parser.setMutuallyExclusive('g', 'Z');
+            parser.setMutuallyExclusive('s', 'Z');
+            parser.setDependentArgument('g', 'j');
+            parser.setDependentArgument('s', 'j');
+            parser.setDependentArgument('Z', 'j');
 
             parser.parseArguments(argc, argv);
 
@@ -80,6 +118,20 @@ class STFDiffConfig {
             diff_dest_registers = parser.hasArgument('D');
             diff_state_registers = parser.hasArgument('D');
             unified_diff = parser.hasArgument('u');
+            windowed_diff = parser.hasArgument('w');
+            parser.getArgumentValue('K', anchor_length);
+            parser.getArgumentValue('X', max_window);
+            parser.getArgumentValue('j', num_threads);
+            parser.getArgumentValue('Z', segment_size);
+            segment_at_markpoints = parser.hasArgument('g');
+
+            for(const auto& cut_point: parser.getMultipleValueArgument('s')) {
+                const auto colon = cut_point.find(':');
+                const auto cut1 = parseInt<uint64_t>(std::string_view(cut_point).substr(0, colon));
+                const auto cut2 = colon == std::string::npos ? cut1 : parseInt<uint64_t>(std::string_view(cut_point).substr(colon + 1));
+                cut_points.emplace_back(cut1, cut2);
+            }
+            std::sort(cut_points.begin(), cut_points.end());
             only_count = parser.hasArgument('C');
             use_aliases = parser.hasArgument('a');
             diff_markpointed_region = parser.hasArgument('m');
@@ -99,239 +151,397 @@ class STFDiffConfig {
 
             parser.assertCondition(start1, "-1 parameter must be nonzero");
             parser.assertCondition(start2, "-2 parameter must be nonzero");
+            parser.assertCondition(anchor_length, "-K parameter must be nonzero");
+            parser.assertCondition(max_window, "-X parameter must be nonzero");
+            parser.assertCondition(segment_size, "-Z parameter must be nonzero");
+            parser.assertCondition(!parser.hasArgument('j') || num_threads, "-j parameter must be nonzero");
+            parser.assertCondition(cut_points.empty() || (cut_points.front().first && cut_points.front().second),
+                                   "-s cut points must be nonzero");
+            parser.assertCondition(std::adjacent_find(cut_points.begin(),
+                                                      cut_points.end(),
+                                                      [](const auto& lhs, const auto& rhs) { return rhs.second <= lhs.second || rhs.first == lhs.first; }) == cut_points.end(),
+                                   "-s cut points must be strictly increasing in both traces");
+            parser.assertCondition(!num_threads || !workarounds.at("spike_lr_sc"), "The spike_lr_sc workaround is not supported in parallel mode");
         }
 };
 
+/**
+ * \class DiffInstArena
+ * \brief Shared storage for the memory accesses and operands of STFDiffInsts read from a single trace
+ *
+ * Every STFDiffInst stores an offset into the arena instead of owning its own containers. Clearing the
+ * arena invalidates every STFDiffInst that refers to it, so it should only be cleared once all of them
+ * have been discarded.
+ */
+class DiffInstArena {
+    private:
+        const stf::Disassembler* dis_;
+        std::vector<uint64_t> words_;
+        std::vector<std::string_view> labels_;
+
+    public:
+        explicit DiffInstArena(const stf::Disassembler* dis) :
+            dis_(dis)
+        {
+        }
+
+        DiffInstArena(const DiffInstArena&) = delete;
+        DiffInstArena& operator=(const DiffInstArena&) = delete;
+
+        inline const stf::Disassembler* getDisassembler() const {
+            return dis_;
+        }
+
+        inline size_t size() const {
+            return words_.size();
+        }
+
+        inline void push(const uint64_t word) {
+            words_.emplace_back(word);
+        }
+
+        inline const uint64_t* at(const size_t offset) const {
+            return words_.data() + offset;
+        }
+
+        /**
+         * Operand labels are static strings shared by every operand of the same kind, so they are stored once
+         * and referred to by index
+         */
+        inline uint8_t getLabelIndex(const std::string_view label) {
+            const auto it = std::find(labels_.begin(), labels_.end(), label);
+            if(it != labels_.end()) {
+                return static_cast<uint8_t>(std::distance(labels_.begin(), it));
+            }
+            stf_assert(labels_.size() <= std::numeric_limits<uint8_t>::max(), "Too many distinct operand labels");
+            labels_.emplace_back(label);
+            return static_cast<uint8_t>(labels_.size() - 1);
+        }
+
+        inline std::string_view getLabel(const uint8_t idx) const {
+            return labels_[idx];
+        }
+
+        /**
+         * Discards every stored instruction while keeping the allocated memory
+         */
+        inline void clear() {
+            words_.clear();
+        }
+
+        /**
+         * Gets the number of bytes currently allocated
+         */
+        inline size_t getMemoryUsage() const {
+            return words_.capacity() * sizeof(uint64_t);
+        }
+};
+
+/**
+ * \class STFDiffInst
+ * \brief Compact instruction representation used for diffing
+ *
+ * Only a fixed-size header is stored in the object itself. Memory accesses and operands are packed into a
+ * DiffInstArena:
+ *     - 2 words (address, data) per memory access
+ *     - 2 header words (register; type | label index << 8 | vlen << 16 | data word count << 48) followed by
+ *       the operand data for each operand
+ * A hash of every compared field is computed on construction so that most mismatches are detected without
+ * touching the arena.
+ */
 class STFDiffInst {
     private:
+        static constexpr size_t MEM_ACCESS_WORDS_ = 2;
+        static constexpr size_t OPERAND_HEADER_WORDS_ = 2;
+        static constexpr uint64_t LABEL_SHIFT_ = 8;
+        static constexpr uint64_t VLEN_SHIFT_ = 16;
+        static constexpr uint64_t NUM_WORDS_SHIFT_ = 48;
+        static constexpr uint64_t FIELD_MASK_8_ = 0xff;
+        static constexpr uint64_t FIELD_MASK_16_ = 0xffff;
+        static constexpr uint64_t FIELD_MASK_32_ = 0xffffffff;
+
+    public:
+        /**
+         * \class MemAccess
+         * \brief View of a memory access stored in a DiffInstArena
+         */
         class MemAccess {
             private:
-                const uint64_t addr_;
-                const uint64_t data_;
+                const uint64_t* words_;
 
             public:
-                MemAccess(const stf::MemAccess& mem_access, bool ignore_addresses) :
-                    addr_(ignore_addresses ? stf::page_utils::INVALID_PHYS_ADDR : mem_access.getAddress()),
-                    data_(mem_access.getData())
+                explicit MemAccess(const uint64_t* words) :
+                    words_(words)
                 {
                 }
 
                 uint64_t getAddress() const {
-                    return addr_;
+                    return words_[0];
                 }
 
                 uint64_t getData() const {
-                    return data_;
-                }
-
-                bool operator==(const MemAccess& rhs) const {
-                    //return (addr_ == rhs.addr_) && (paddr_ == rhs.paddr_) && (data_ == rhs.data_);
-                    return (addr_ == rhs.addr_) && (data_ == rhs.data_);
-                }
-
-                bool operator!=(const MemAccess& rhs) const {
-                    return !(*this == rhs);
+                    return words_[1];
                 }
         };
 
+        /**
+         * \class Operand
+         * \brief View of an operand stored in a DiffInstArena
+         */
         class Operand {
             private:
-                const stf::Registers::STF_REG reg_;
-                const stf::Registers::STF_REG_OPERAND_TYPE type_;
-                const stf::InstRegRecord::VectorType data_;
-                const std::string_view label_;
-                const stf::vlen_t vlen_;
+                const uint64_t* words_;
+                const DiffInstArena* arena_;
+
+                inline uint64_t getFlags_() const {
+                    return words_[1];
+                }
 
             public:
-                explicit Operand(const stf::Operand& op) :
-                    reg_(op.getReg()),
-                    type_(op.getType()),
-                    data_(op.isVector() ? op.getVectorValue() : stf::InstRegRecord::VectorType(1, op.getScalarValue())),
-                    label_(op.getLabel()),
-                    vlen_(op.getVLen())
+                Operand(const uint64_t* words, const DiffInstArena* arena) :
+                    words_(words),
+                    arena_(arena)
                 {
                 }
 
                 stf::Registers::STF_REG getReg() const {
-                    return reg_;
+                    return static_cast<stf::Registers::STF_REG>(words_[0]);
                 }
 
                 stf::Registers::STF_REG_OPERAND_TYPE getType() const {
-                    return type_;
+                    return static_cast<stf::Registers::STF_REG_OPERAND_TYPE>(getFlags_() & FIELD_MASK_8_);
+                }
+
+                std::string_view getLabel() const {
+                    return arena_->getLabel(static_cast<uint8_t>((getFlags_() >> LABEL_SHIFT_) & FIELD_MASK_8_));
+                }
+
+                stf::vlen_t getVLen() const {
+                    return static_cast<stf::vlen_t>((getFlags_() >> VLEN_SHIFT_) & FIELD_MASK_32_);
+                }
+
+                size_t getNumWords() const {
+                    return static_cast<size_t>(getFlags_() >> NUM_WORDS_SHIFT_);
                 }
 
-                const stf::InstRegRecord::VectorType& getVectorData() const {
+                const uint64_t* getData() const {
+                    return words_ + OPERAND_HEADER_WORDS_;
+                }
+
+                stf::InstRegRecord::VectorType getVectorData() const {
                     stf_assert(isVector(), "Attempted to get vector data from a scalar operand");
-                    return data_;
+                    return stf::InstRegRecord::VectorType(getData(), getData() + getNumWords());
                 }
 
                 uint64_t getScalarData() const {
                     stf_assert(!isVector(), "Attempted to get scalar data from a vector operand");
-                    return data_.front();
+                    return getData()[0];
                 }
 
-                const std::string_view& getLabel() const {
-                    return label_;
+                bool isVector() const {
+                    return getNumWords() > 1;
                 }
 
                 bool operator==(const Operand& rhs) const {
-                    return (type_ == rhs.type_) && (reg_ == rhs.reg_) && (data_ == rhs.data_);
+                    return (getType() == rhs.getType()) &&
+                           (getReg() == rhs.getReg()) &&
+                           (getNumWords() == rhs.getNumWords()) &&
+                           std::equal(getData(), getData() + getNumWords(), rhs.getData());
                 }
 
                 bool operator!=(const Operand& rhs) const {
                     return !(*this == rhs);
                 }
 
-                bool isVector() const {
-                    return data_.size() > 1;
-                }
-
-                stf::vlen_t getVLen() const {
-                    return vlen_;
+                /**
+                 * Gets the number of arena words used by this operand
+                 */
+                size_t size() const {
+                    return OPERAND_HEADER_WORDS_ + getNumWords();
                 }
         };
 
+    private:
         uint64_t pc_;
-        //uint64_t physPC_;
-        uint32_t opcode_;
         uint64_t index_;
-        std::vector<MemAccess> mem_accesses_;
-        std::vector<Operand> operands_;
-        const stf::Disassembler* dis_ = nullptr;
+        uint64_t hash_;
+        uint64_t offset_;
+        const DiffInstArena* arena_;
+        uint32_t opcode_;
+        uint16_t num_mem_accesses_ = 0;
+        uint16_t num_operands_ = 0;
+
+        static inline uint64_t hashCombine_(const uint64_t seed, const uint64_t value) {
+            return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+        }
 
         template<typename OperandVectorType>
-        inline void addOperands_(const OperandVectorType& operands) {
-            operands_.reserve(operands.size());
+        inline void addOperands_(DiffInstArena& arena, const OperandVectorType& operands) {
             for(const auto& op: operands) {
-                operands_.emplace_back(op);
+                const auto reg = static_cast<uint64_t>(op.getReg());
+                const auto type = static_cast<uint64_t>(op.getType());
+                const auto vlen = static_cast<uint64_t>(op.getVLen());
+                const size_t num_words = op.isVector() ? op.getVectorValue().size() : 1;
+
+                stf_assert(type <= FIELD_MASK_8_, "Invalid operand type");
+                stf_assert(num_words <= FIELD_MASK_16_, "Operand is too large to diff");
+                stf_assert(vlen <= FIELD_MASK_32_, "Operand vlen is too large to diff");
+                stf_assert(num_operands_ < FIELD_MASK_16_, "Instruction has too many operands to diff");
+
+                arena.push(reg);
+                arena.push(type |
+                           (static_cast<uint64_t>(arena.getLabelIndex(op.getLabel())) << LABEL_SHIFT_) |
+                           (vlen << VLEN_SHIFT_) |
+                           (static_cast<uint64_t>(num_words) << NUM_WORDS_SHIFT_));
+                hash_ = hashCombine_(hashCombine_(hash_, reg), type);
+
+                if(op.isVector()) {
+                    for(const auto v: op.getVectorValue()) {
+                        arena.push(v);
+                        hash_ = hashCombine_(hash_, v);
+                    }
+                }
+                else {
+                    const uint64_t v = op.getScalarValue();
+                    arena.push(v);
+                    hash_ = hashCombine_(hash_, v);
+                }
+
+                ++num_operands_;
             }
         }
 
+        inline const uint64_t* getOperandWords_() const {
+            return arena_->at(offset_ + num_mem_accesses_ * MEM_ACCESS_WORDS_);
+        }
+
     public:
         STFDiffInst(const stf::STFInst& inst,
                     const STFDiffConfig& config,
-                    const stf::Disassembler* dis) :
+                    DiffInstArena& arena) :
             pc_(config.ignore_addresses ? stf::page_utils::INVALID_PHYS_ADDR : inst.pc()),
-            opcode_(inst.opcode()),
             index_(inst.index()),
-            dis_(dis)
+            hash_(0),
+            offset_(arena.size()),
+            arena_(&arena),
+            opcode_(inst.opcode())
         {
-            //physPC_ = pPC ? inst->physPc() : INVALID_PHYS_ADDR;
+            hash_ = hashCombine_(pc_, opcode_);
+
             // Ignore data on syscalls
             if (config.diff_memory && !inst.isSyscall()) {
                 for(const auto& mit: inst.getMemoryAccesses()) {
-                    mem_accesses_.emplace_back(mit, config.ignore_addresses);
+                    stf_assert(num_mem_accesses_ < FIELD_MASK_16_, "Instruction has too many memory accesses to diff");
+                    const uint64_t addr = config.ignore_addresses ? stf::page_utils::INVALID_PHYS_ADDR : mit.getAddress();
+                    const uint64_t data = mit.getData();
+                    arena.push(addr);
+                    arena.push(data);
+                    hash_ = hashCombine_(hashCombine_(hash_, addr), data);
+                    ++num_mem_accesses_;
                 }
             }
 
             // If registers are on, check those
             if (config.diff_registers) {
-                addOperands_(inst.getOperands());
+                addOperands_(arena, inst.getOperands());
             }
             else if(config.diff_dest_registers) {
-                addOperands_(inst.getDestOperands());
+                addOperands_(arena, inst.getDestOperands());
             }
 
             if(config.diff_state_registers) {
-                addOperands_(inst.getRegisterStates());
-            }
-        }
-
-        STFDiffInst(const STFDiffInst& rhs) = default;
-        STFDiffInst(STFDiffInst&& rhs) = default;
-
-        STFDiffInst& operator=(STFDiffInst&& rhs) noexcept {
-            if(this == &rhs) {
-                return *this;
+                addOperands_(arena, inst.getRegisterStates());
             }
 
-            pc_ = std::move(rhs.pc_);
-            opcode_ = std::move(rhs.opcode_);
-            index_ = std::move(rhs.index_);
-            mem_accesses_ = std::move(rhs.mem_accesses_);
-            operands_ = std::move(rhs.operands_);
-            dis_ = std::move(rhs.dis_);
-
-            return *this;
-        }
-
-        STFDiffInst& operator=(const STFDiffInst& rhs) {
-            if(this == &rhs) {
-                return *this;
-            }
-
-            pc_ = rhs.pc_;
-            opcode_ = rhs.opcode_;
-            index_ = rhs.index_;
-            mem_accesses_.clear();
-            std::copy(rhs.mem_accesses_.begin(), rhs.mem_accesses_.end(), std::back_inserter(mem_accesses_));
-            operands_.clear();
-            std::copy(rhs.operands_.begin(), rhs.operands_.end(), std::back_inserter(operands_));
-            dis_ = rhs.dis_;
-
-            return *this;
+            hash_ = hashCombine_(hashCombine_(hash_, num_mem_accesses_), num_operands_);
         }
 
         bool operator==(const STFDiffInst &other) const {
-            //if ((pc != other.pc) || (physPC_ != other.physPC_) || (opcode != other.opcode)) {
-            if ((pc_ != other.pc_) || (opcode_ != other.opcode_)) {
+            // The hash covers every compared field, so the remaining checks only guard against collisions
+            if ((hash_ != other.hash_) ||
+                (pc_ != other.pc_) ||
+                (opcode_ != other.opcode_) ||
+                (num_mem_accesses_ != other.num_mem_accesses_) ||
+                (num_operands_ != other.num_operands_)) {
                 return false;
             }
 
-            if (mem_accesses_.size() != other.mem_accesses_.size()) {
+            const uint64_t* m1 = arena_->at(offset_);
+            const uint64_t* m2 = other.arena_->at(other.offset_);
+            if (!std::equal(m1, m1 + num_mem_accesses_ * MEM_ACCESS_WORDS_, m2)) {
                 return false;
             }
 
-            if (!mem_accesses_.empty()) {
-                auto m2 = other.mem_accesses_.cbegin();
-                for (const auto &m1 : mem_accesses_) {
-                    if (m2 == other.mem_accesses_.end()) {
-                        return false;
-                    }
-
-                    if (m1 != *m2) {
-                        return false;
-                    }
-
-                    m2++;
-                }
-
-                if (m2 != other.mem_accesses_.end()) {
+            const uint64_t* r1 = getOperandWords_();
+            const uint64_t* r2 = other.getOperandWords_();
+            for (uint16_t i = 0; i < num_operands_; ++i) {
+                const Operand op1(r1, arena_);
+                const Operand op2(r2, other.arena_);
+                if (op1 != op2) {
                     return false;
                 }
+                r1 += op1.size();
+                r2 += op2.size();
             }
 
-            if (operands_.size() != other.operands_.size()) {
-                return false;
-            }
+            return true;
+        }
 
-            if (!operands_.empty()) {
-                auto r2 = other.operands_.cbegin();
-                for (const auto &r1 : operands_) {
-                    if (r2 == other.operands_.end()) {
-                        return false;
-                    }
+        bool operator!=(const STFDiffInst &other) const {
+            return !(*this == other);
+        }
 
-                    if (r1 != *r2) {
-                        return false;
-                    }
+        /**
+         * Gets the hash of every field that participates in operator==
+         */
+        inline uint64_t hash() const {
+            return hash_;
+        }
 
-                    r2++;
-                }
+        inline uint64_t getPC() const {
+            return pc_;
+        }
 
-                if (r2 != other.operands_.end()) {
-                    return false;
-                }
-            }
+        inline uint32_t getOpcode() const {
+            return opcode_;
+        }
 
-            return true;
+        inline uint64_t getIndex() const {
+            return index_;
         }
 
-        bool operator!=(STFDiffInst &other) {
-            return !(*this == other);
+        inline const stf::Disassembler* getDisassembler() const {
+            return arena_->getDisassembler();
         }
 
-        friend std::ostream& operator<<(std::ostream& os, const STFDiffInst& inst);
+        inline bool hasMemAccesses() const {
+            return num_mem_accesses_;
+        }
+
+        /**
+         * Calls func on every memory access
+         */
+        template<typename Func>
+        inline void forEachMemAccess(Func&& func) const {
+            const uint64_t* words = arena_->at(offset_);
+            for (uint16_t i = 0; i < num_mem_accesses_; ++i) {
+                func(MemAccess(words));
+                words += MEM_ACCESS_WORDS_;
+            }
+        }
+
+        /**
+         * Calls func on every operand
+         */
+        template<typename Func>
+        inline void forEachOperand(Func&& func) const {
+            const uint64_t* words = getOperandWords_();
+            for (uint16_t i = 0; i < num_operands_; ++i) {
+                const Operand op(words, arena_);
+                func(op);
+                words += op.size();
+            }
+        }
 };
 
 using DiffInstVec = std::vector<STFDiffInst>;
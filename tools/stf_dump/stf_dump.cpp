@@ -11,14 +11,19 @@
 #include <cstdint>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 #include "command_line_parser.hpp"
 #include "disassembler.hpp"
 #include "print_utils.hpp"
+#include "profiling.hpp"
 #include "stf_dump.hpp"
+#include "ordered_renderer.hpp"
 #include "stf_inst_reader.hpp"
 #include "stf_page_table.hpp"
+#include "stf_symbol_table.hpp"
+#include "text_writer.hpp"
 #include "tools_util.hpp"
 //#include "STFSymTab.hpp"
 
@@ -37,6 +42,12 @@ static STFDumpConfig parseCommandLine (int argc, char **argv) {
     parser.addFlag('e', "M", "end dumping at M-th instruction");
     parser.addFlag('y', "*_symTab.yaml", "YAML symbol table file to show annotation");
     parser.addFlag('H', "omit the header information");
+    parser.addFlag('f', "fast mode - drop alignment padding. Output is no longer column-aligned.");
+    parser.addFlag('F', "annotate disassembly with function names from the ELF symbol table (<trace>.elf)");
+    parser.addFlag('j', "N", "render output with N worker threads. Output is identical to the default single-threaded mode. "
+                            "The binutils disassembler is not thread-safe, so its calls are serialized and uncached "
+                            "instructions do not scale with N; use STF_DISASM=MAVIS for the best -j speedup.");
+    parser.addFlag('b', "N", "number of instructions per batch when rendering with -j (default " + std::to_string(config.batch_size) + ")");
     parser.addPositionalArgument("trace", "trace in STF format");
 
     parser.parseArguments(argc, argv);
@@ -53,8 +64,14 @@ static STFDumpConfig parseCommandLine (int argc, char **argv) {
     parser.getArgumentValue('y', config.symbol_filename);
     config.show_annotation = !config.symbol_filename.empty();
     config.omit_header = parser.hasArgument('H');
+    config.no_padding = parser.hasArgument('f');
+    config.show_functions = parser.hasArgument('F');
+    parser.getArgumentValue('j', config.num_threads);
+    parser.getArgumentValue('b', config.batch_size);
     parser.getPositionalArgument(0, config.trace_filename);
 
+    parser.assertCondition(config.batch_size > 0, "-b parameter must be nonzero");
+
     stf_assert(!config.end_inst || (config.end_inst >= config.start_inst),
                "End inst (" << config.end_inst << ") must be greater than or equal to start inst (" << config.start_inst << ')');
 
@@ -63,20 +80,32 @@ static STFDumpConfig parseCommandLine (int argc, char **argv) {
 
 /**
  * Prints an opcode along with its disassembly
+ * \param out TextWriter to write to
+ * \param dis Disassembler
+ * \param symbol_table If not nullptr, used to annotate the disassembly with the function containing pc
  * \param opcode instruction opcode
  * \param pc instruction PC
- * \param os The ostream to write the assembly to
  */
-static inline void printOpcodeWithDisassembly(const stf::Disassembler& dis,
+static inline void printOpcodeWithDisassembly(TextWriter& out,
+                                              const stf::Disassembler& dis,
+                                              const STFSymbolTable* symbol_table,
                                               const uint32_t opcode,
                                               const uint64_t pc) {
     static constexpr int OPCODE_PADDING = stf::format_utils::OPCODE_FIELD_WIDTH - stf::format_utils::OPCODE_WIDTH - 1;
 
-    dis.printOpcode(std::cout, opcode);
+    dis.printOpcode(out.stream(), opcode);
+
+    out.spaces(OPCODE_PADDING); // pad out the rest of the opcode field with spaces
 
-    stf::print_utils::printSpaces(OPCODE_PADDING); // pad out the rest of the opcode field with spaces
+    dis.printDisassembly(out.stream(), pc, opcode);
 
-    dis.printDisassembly(std::cout, pc, opcode);
+    if(symbol_table) {
+        if(const auto symbol = symbol_table->findFunction(pc).first) {
+            out.write(" <");
+            out.write(symbol->name());
+            out.put('>');
+        }
+    }
     // if (show_annotation)
     // {
     //     // Retrieve symbol information from symbol table hash map
@@ -91,9 +120,139 @@ static inline void printOpcodeWithDisassembly(const stf::Disassembler& dis,
     //     else
     //         std::cout << " | " << " [ " << symInfo.libName << ", " << symInfo.symName << " ] ";
     // }
-    std::cout << std::endl;
+    out.newline();
 }
 
+/**
+ * Prints an instruction and everything attached to it. Only writes to out, so it can be called from any thread as
+ * long as each thread has its own TextWriter and Disassembler.
+ * \param out TextWriter to write to
+ * \param dis Disassembler
+ * \param symbol_table If not nullptr, used to annotate the disassembly with function names
+ * \param config Dump configuration
+ * \param inst Instruction to print
+ * \param print_pid If true, the PID line is printed before the instruction
+ */
+static void printInst(TextWriter& out,
+                      const stf::Disassembler& dis,
+                      const STFSymbolTable* symbol_table,
+                      const STFDumpConfig& config,
+                      const stf::STFInst& inst,
+                      const bool print_pid) {
+    auto& os = out.stream();
+
+    if (STF_EXPECT_FALSE(print_pid)) {
+        stf::format_utils::formatLabel(os, "PID");
+        stf::format_utils::formatTID(os, inst.hwtid());
+        os << ':';
+        stf::format_utils::formatTID(os, inst.pid());
+        os << ':';
+        stf::format_utils::formatTID(os, inst.tid());
+        out.newline();
+    }
+
+    // Opcode width string (INST32/INST16) and index should each take up half of the label column
+    out.left(inst.getOpcodeWidthStr(), stf::format_utils::LABEL_WIDTH / 2);
+
+    out.decLeft(inst.index(), stf::format_utils::LABEL_WIDTH / 2);
+
+    out.va(inst.pc());
+
+    if (stf::format_utils::showPhys()) {
+        // Make sure we zero-fill as needed, so that the address remains "virt:phys" and not "virt:  phys"
+        out.put(':');
+        out.pa(inst.physPc());
+    }
+    out.put(' ');
+
+    if (STF_EXPECT_FALSE(inst.isTakenBranch())) {
+        out.write("PC ");
+        out.va(inst.branchTarget());
+        if (stf::format_utils::showPhys()) {
+            out.put(':');
+            out.pa(inst.physBranchTarget());
+        }
+        out.put(' ');
+    }
+    else if(STF_EXPECT_FALSE(config.concise_mode && (inst.isFault() || inst.isInterrupt()))) {
+        const std::string_view fault_msg = inst.isFault() ? "FAULT" : "INTERRUPT";
+        out.left(fault_msg, stf::format_utils::VA_WIDTH + 4);
+        if (stf::format_utils::showPhys()) {
+            out.spaces(stf::format_utils::PA_WIDTH + 1);
+        }
+    }
+    else {
+        out.spaces(stf::format_utils::VA_WIDTH + 4);
+        if (stf::format_utils::showPhys()) {
+            out.spaces(stf::format_utils::PA_WIDTH + 1);
+        }
+    }
+
+    out.spaces(9); // Additional padding so that opcode lines up with operand values
+    printOpcodeWithDisassembly(out, dis, symbol_table, inst.opcode(), inst.pc());
+
+    if(!config.concise_mode) {
+        for(const auto& m: inst.getMemoryAccesses()) {
+            os << m;
+            out.newline();
+        }
+
+        if (config.show_pte) {
+            for(const auto& pte: inst.getEmbeddedPTEs()) {
+                os << pte->as<stf::PageTableWalkRecord>();
+            }
+        }
+
+        for(const auto& reg: inst.getRegisterStates()) {
+            os << reg;
+            out.newline();
+        }
+
+        for(const auto& reg: inst.getOperands()) {
+            os << reg;
+            out.newline();
+        }
+
+        for(const auto& evt: inst.getEvents()) {
+            os << evt;
+            out.newline();
+        }
+
+        for(const auto& cmt: inst.getComments()) {
+            os << cmt->as<stf::CommentRecord>();
+            out.newline();
+        }
+
+        for(const auto& uop: inst.getMicroOps()) {
+            const auto& microop = uop->as<stf::InstMicroOpRecord>();
+            stf::format_utils::formatOperandLabel(os, microop.getSize() == 2 ? "UOp16 " : "UOp32 ");
+            out.spaces(stf::format_utils::REGISTER_NAME_WIDTH + stf::format_utils::DATA_WIDTH);
+            printOpcodeWithDisassembly(out, dis, nullptr, microop.getMicroOp(), inst.pc());
+        }
+
+        for(const auto& reg: inst.getReadyRegs()) {
+            stf::format_utils::formatOperandLabel(os, "ReadyReg ");
+            os << std::dec << reg->as<stf::InstReadyRegRecord>().getReg();
+            out.newline();
+        }
+    }
+}
+
+/**
+ * \struct DumpItem
+ * An instruction queued for rendering in parallel mode
+ */
+struct DumpItem {
+    stf::STFInst inst; /**< Instruction to print */
+    bool print_pid; /**< If true, print the PID line before the instruction */
+
+    DumpItem(const stf::STFInst& inst, const bool print_pid) :
+        inst(inst),
+        print_pid(print_pid)
+    {
+    }
+};
+
 int main (int argc, char **argv)
 {
     // Get arguments
@@ -104,10 +263,22 @@ int main (int argc, char **argv)
         stf::STFInstReader stf_reader(config.trace_filename, config.user_mode_only, stf::format_utils::showPhys());
         stf_reader.checkVersion();
 
-        // Create disassembler
-        stf::Disassembler dis(findElfFromTrace(config.trace_filename), stf_reader.getISA(), stf_reader.getInitialIEM(), config.use_aliases);
+        const std::string elf = findElfFromTrace(config.trace_filename);
+
+        std::unique_ptr<STFSymbolTable> symbol_table;
+        if(config.show_functions) {
+            symbol_table = std::make_unique<STFSymbolTable>(elf);
+        }
+
+        TextWriter out;
+        out.setPadding(!config.no_padding);
+        // Everything else printed to std::cout (e.g. by print_utils or the record formatters) goes into the same
+        // buffer, so it stays in order with the fields written directly to the TextWriter
+        const TextWriter::Redirect cout_redirect(out, std::cout);
 
         if(!config.omit_header) {
+            TRACE_TOOLS_PROFILE_SCOPE("output.header");
+
             // Print Version info
             stf::print_utils::printLabel("VERSION");
             std::cout << stf_reader.major() << '.' << stf_reader.minor() << std::endl;
@@ -137,11 +308,9 @@ int main (int argc, char **argv)
         uint32_t pid_prev = std::numeric_limits<uint32_t>::max();
         uint32_t tid_prev = std::numeric_limits<uint32_t>::max();
 
-        const auto start_inst = config.start_inst ? config.start_inst - 1 : 0;
-
-        for (auto it = stf_reader.begin(start_inst); it != stf_reader.end(); ++it) {
-            const auto& inst = *it;
-
+        // Tracks the state that carries over from one instruction to the next, which has to be done in trace order.
+        // Returns true if the PID line should be printed before the instruction.
+        const auto update_pid = [&config, &hw_tid_prev, &pid_prev, &tid_prev](const stf::STFInst& inst) {
             if (STF_EXPECT_FALSE(!inst.valid())) {
                 std::cerr << "ERROR: " << inst.index() << " invalid instruction " << std::hex << inst.opcode() << " PC " << inst.pc() << std::endl;
             }
@@ -149,102 +318,73 @@ int main (int argc, char **argv)
             const uint32_t hw_tid = inst.hwtid();
             const uint32_t pid = inst.pid();
             const uint32_t tid = inst.tid();
-            if (STF_EXPECT_FALSE(!config.concise_mode && (tid != tid_prev || pid != pid_prev || hw_tid != hw_tid_prev))) {
-                stf::print_utils::printLabel("PID");
-                stf::print_utils::printTID(hw_tid);
-                std::cout << ':';
-                stf::print_utils::printTID(pid);
-                std::cout << ':';
-                stf::print_utils::printTID(tid);
-                std::cout << std::endl;
-            }
+            const bool print_pid = !config.concise_mode && (tid != tid_prev || pid != pid_prev || hw_tid != hw_tid_prev);
             hw_tid_prev = hw_tid;
             pid_prev = pid;
             tid_prev = tid;
+            return print_pid;
+        };
 
-            // Opcode width string (INST32/INST16) and index should each take up half of the label column
-            stf::print_utils::printLeft(inst.getOpcodeWidthStr(), stf::format_utils::LABEL_WIDTH / 2);
-
-            stf::print_utils::printDecLeft(inst.index(), stf::format_utils::LABEL_WIDTH / 2);
-
-            stf::print_utils::printVA(inst.pc());
-
-            if (stf::format_utils::showPhys()) {
-                // Make sure we zero-fill as needed, so that the address remains "virt:phys" and not "virt:  phys"
-                std::cout << ':';
-                stf::print_utils::printPA(inst.physPc());
-            }
-            stf::print_utils::printSpaces(1);
-
-            if (STF_EXPECT_FALSE(inst.isTakenBranch())) {
-                std::cout << "PC ";
-                stf::print_utils::printVA(inst.branchTarget());
-                if (stf::format_utils::showPhys()) {
-                    std::cout << ':';
-                    stf::print_utils::printPA(inst.physBranchTarget());
-                }
-                stf::print_utils::printSpaces(1);
-            }
-            else if(STF_EXPECT_FALSE(config.concise_mode && (inst.isFault() || inst.isInterrupt()))) {
-                const std::string_view fault_msg = inst.isFault() ? "FAULT" : "INTERRUPT";
-                stf::print_utils::printLeft(fault_msg, stf::format_utils::VA_WIDTH + 4);
-                if (stf::format_utils::showPhys()) {
-                    stf::print_utils::printSpaces(stf::format_utils::PA_WIDTH + 1);
-                }
-            }
-            else {
-                stf::print_utils::printSpaces(stf::format_utils::VA_WIDTH + 4);
-                if (stf::format_utils::showPhys()) {
-                    stf::print_utils::printSpaces(stf::format_utils::PA_WIDTH + 1);
-                }
-            }
-
-            stf::print_utils::printSpaces(9); // Additional padding so that opcode lines up with operand values
-            printOpcodeWithDisassembly(dis, inst.opcode(), inst.pc());
-
-            if(!config.concise_mode) {
-                for(const auto& m: inst.getMemoryAccesses()) {
-                    std::cout << m << std::endl;
-                }
-
-                if (config.show_pte) {
-                    for(const auto& pte: inst.getEmbeddedPTEs()) {
-                        std::cout << pte->as<stf::PageTableWalkRecord>();
-                    }
-                }
+        const auto start_inst = config.start_inst ? config.start_inst - 1 : 0;
 
-                for(const auto& reg: inst.getRegisterStates()) {
-                    std::cout << reg << std::endl;
+        if(config.num_threads) {
+            const auto isa = stf_reader.getISA();
+            const auto iem = stf_reader.getInitialIEM();
+            const STFSymbolTable* const symbol_table_ptr = symbol_table.get();
+
+            // Each worker gets its own disassembler
+            OrderedRenderer<DumpItem> renderer(
+                out,
+                config.num_threads,
+                [&config, &elf, isa, iem, symbol_table_ptr]() {
+                    return [&config,
+                            symbol_table_ptr,
+                            dis = std::make_unique<stf::Disassembler>(elf, isa, iem, config.use_aliases)]
+                           (TextWriter& writer, const DumpItem& item) {
+                        printInst(writer, *dis, symbol_table_ptr, config, item.inst, item.print_pid);
+                    };
+                },
+                config.batch_size
+            );
+
+            auto* batch = &renderer.acquire();
+            for (auto it = TRACE_TOOLS_PROFILE_EXPR("reader.inst", stf_reader.begin(start_inst));
+                 it != stf_reader.end();
+                 TRACE_TOOLS_PROFILE_EXPR("reader.inst", ++it)) {
+                const auto& inst = *it;
+                batch->emplace_back(inst, update_pid(inst));
+
+                if (STF_EXPECT_FALSE(config.end_inst && (inst.index() >= config.end_inst))) {
+                    break;
                 }
 
-                for(const auto& reg: inst.getOperands()) {
-                    std::cout << reg << std::endl;
+                if(STF_EXPECT_FALSE(batch->size() == config.batch_size)) {
+                    renderer.publish();
+                    batch = &renderer.acquire();
                 }
+            }
 
-                for(const auto& evt: inst.getEvents()) {
-                    std::cout << evt << std::endl;
-                }
+            if(!batch->empty()) {
+                renderer.publish();
+            }
+            renderer.finish();
+        }
+        else {
+            // Create disassembler
+            const stf::Disassembler dis(elf, stf_reader.getISA(), stf_reader.getInitialIEM(), config.use_aliases);
 
-                for(const auto& cmt: inst.getComments()) {
-                    std::cout << cmt->as<stf::CommentRecord>() << std::endl;
-                }
+            for (auto it = TRACE_TOOLS_PROFILE_EXPR("reader.inst", stf_reader.begin(start_inst));
+                 it != stf_reader.end();
+                 TRACE_TOOLS_PROFILE_EXPR("reader.inst", ++it)) {
+                TRACE_TOOLS_PROFILE_SCOPE("output.format");
+                const auto& inst = *it;
 
-                for(const auto& uop: inst.getMicroOps()) {
-                    const auto& microop = uop->as<stf::InstMicroOpRecord>();
-                    stf::print_utils::printOperandLabel(microop.getSize() == 2 ? "UOp16 " : "UOp32 ");
-                    stf::print_utils::printSpaces(stf::format_utils::REGISTER_NAME_WIDTH + stf::format_utils::DATA_WIDTH);
-                    printOpcodeWithDisassembly(dis, microop.getMicroOp(), inst.pc());
-                }
+                printInst(out, dis, symbol_table.get(), config, inst, update_pid(inst));
 
-                for(const auto& reg: inst.getReadyRegs()) {
-                    stf::print_utils::printOperandLabel("ReadyReg ");
-                    std::cout << std::dec << reg->as<stf::InstReadyRegRecord>().getReg() << std::endl;
+                if (STF_EXPECT_FALSE(config.end_inst && (inst.index() >= config.end_inst))) {
+                    break;
                 }
             }
-
-            if (STF_EXPECT_FALSE(config.end_inst && (inst.index() >= config.end_inst))) {
-                break;
-            }
         }
     }
     catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
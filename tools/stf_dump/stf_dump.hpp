@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -19,4 +20,8 @@ struct STFDumpConfig {
     bool use_aliases = false; /**< Use aliases when disassembling */
     bool show_pte = false; /**< Show PTE records */
     bool omit_header = false; /**< If true, do not dump the header information */
+    bool no_padding = false; /**< If true, drop alignment padding from the output */
+    bool show_functions = false; /**< If true, annotate disassembly with function names from the ELF */
+    size_t num_threads = 0; /**< Number of rendering threads. 0 renders on the reading thread. */
+    size_t batch_size = 1024; /**< Number of instructions per rendering batch */
 };
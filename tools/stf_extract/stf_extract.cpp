@@ -32,6 +32,7 @@ static STFExtractConfig parse_command_line (int argc, char **argv)
     parser.addFlag('f', "off", "offset by which to shift inst_pc");
     parser.addFlag('l', "filter out kernel code while extracting");
     parser.addFlag('d', "for slicing (-s/-k/-t) output PTE records on demand");
+    parser.addFlag('j', "n", "write up to n split trace files concurrently (-t only)");
     parser.addFlag('u', "only count user-mode instructions for -s/-k/-t parameters. Non-user instructions will still be included in the extracted trace unless -l is specified.");
     parser.addPositionalArgument("trace", "trace in STF format");
     parser.appendHelpText("common usages:");
@@ -42,6 +43,7 @@ static STFExtractConfig parse_command_line (int argc, char **argv)
     parser.appendHelpText("    -t <m> -o <output> <input> -- write every <m> instructions to <output.xxxxx.zstf>");
 
     parser.setMutuallyExclusive('k', 't');
+    parser.setDependentArgument('j', 't');
 
     parser.parseArguments(argc, argv);
 
@@ -49,6 +51,8 @@ static STFExtractConfig parse_command_line (int argc, char **argv)
     parser.getArgumentValue('k', config.head_count);
     parser.getArgumentValue('t', config.split_count);
     parser.getArgumentValue('o', config.output_filename);
+    parser.getArgumentValue('j', config.num_threads);
+    parser.assertCondition(config.num_threads > 0, "-j parameter must be greater than 0");
     const bool has_f = parser.getArgumentValue('f', config.inst_offset);
     if(has_f && (config.inst_offset % 4)) {
         throw trace_tools::CommandLineParser::EarlyExitException(1, "Instruction PC offset must be a multiple of 4.");
@@ -68,7 +72,7 @@ int main(int argc, char **argv)
     try {
         const STFExtractConfig config = parse_command_line (argc, argv);
         STFExtractor extractor(config);
-        extractor.run(config.head_count, config.skip_count, config.split_count, config.output_filename);
+        extractor.run(config.head_count, config.skip_count, config.split_count, config.output_filename, config.num_threads);
     }
     catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
         std::cerr << e.what() << std::endl;
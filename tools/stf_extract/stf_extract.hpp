@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdint>
+#include <deque>
+#include <future>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -28,6 +30,7 @@ struct STFExtractConfig {
     bool filter_kernel_code = false; /**< If true, filter out kernel code */
     bool dump_ptes_on_demand = false; /**< If true, dump PTEs in line with instructions that need the translation */
     bool user_mode_counts = false; /**< If true, only count user-mode instructions when slicing, but still output non-user instructions */
+    size_t num_threads = 1; /**< Number of split traces to write concurrently */
 };
 
 /**
@@ -44,12 +47,37 @@ class STFExtractor {
         stf::PCTracker pc_tracker_; /**< Tracks PC state */
         stf::RecordMap record_map_;
 
+        const std::string trace_filename_; /**< Trace being extracted from */
         const bool dump_ptes_on_demand_; /**< If true, dump PTEs in line with instructions that need the translation */
         const bool user_mode_counts_; /**< If true, only count user-mode instructions when slicing, but still output non-user instructions */
         const bool filter_kernel_code_; /**< If true, filter out all non-user code */
 
         bool in_user_code_ = false; /**< If true, we are currently in user-mode code */
         std::vector<std::string> comments_; /**< Tracks comment records */
+        uint64_t num_insts_read_ = 0; /**< Number of instructions the reader has advanced past */
+
+        /**
+         * Constructs an extractor that writes a single split trace. It starts from a copy of the parent's
+         * state and reads the trace with its own reader, so it can run on its own thread while the parent
+         * carries on to the next split.
+         *
+         * \param parent Extractor positioned at the first instruction of the split
+         */
+        explicit STFExtractor(const STFExtractor& parent) :
+            stf_reader_(parent.trace_filename_, parent.filter_kernel_code_),
+            inst_it_(stf_reader_.end()),
+            page_table_(parent.page_table_),
+            regstate_(parent.regstate_),
+            pc_tracker_(parent.pc_tracker_),
+            trace_filename_(parent.trace_filename_),
+            dump_ptes_on_demand_(parent.dump_ptes_on_demand_),
+            user_mode_counts_(parent.user_mode_counts_),
+            filter_kernel_code_(parent.filter_kernel_code_),
+            in_user_code_(parent.in_user_code_),
+            comments_(parent.comments_),
+            num_insts_read_(parent.num_insts_read_)
+        {
+        }
 
         /**
          * \brief Helper function to parse the Escape record for thread id information;
@@ -100,6 +128,7 @@ class STFExtractor {
             while ((inst_it_ != stf_reader_.end()) && (skipped < skipcount)) {
                 processInst_(*inst_it_, skipped);
                 ++inst_it_;
+                ++num_insts_read_;
             }
 
             return skipped;
@@ -185,12 +214,67 @@ class STFExtractor {
                 }
                 inst_it_->write(stf_writer_);
                 ++inst_it_;
+                ++num_insts_read_;
             }
 
             std::cerr << "Output " << count << " instructions" << std::endl;
             return count;
         }
 
+        /**
+         * \brief Seeks to the first instruction of this extractor's split and writes the split trace
+         */
+        void writeSplit_(const std::string& filename, const uint64_t split_count, const bool modify_header) {
+            inst_it_ = num_insts_read_ ? stf_reader_.seekFromBeginning(num_insts_read_) : stf_reader_.begin();
+
+            stf_writer_.open(filename);
+            stf_assert(stf_writer_, "Error: Failed to open output " << filename);
+            extractInstr_(split_count, modify_header);
+            stf_writer_.close();
+        }
+
+        /**
+         * \brief Splits the rest of the trace, writing up to num_threads split traces at once.
+         * This extractor only tracks the state needed for each split's header; every split is read, written
+         * and compressed by its own thread.
+         */
+        void splitConcurrently_(const uint64_t split_count,
+                                const std::string& output_filename,
+                                const size_t num_threads,
+                                const uint64_t overall_instcnt) {
+            std::deque<std::future<void>> writers;
+            uint32_t file_count = 0;
+            bool modify_header = overall_instcnt;
+
+            while(true) {
+                if(writers.size() == num_threads) {
+                    writers.front().get();
+                    writers.pop_front();
+                }
+
+                const std::string cur_output_file = output_filename + '.' + std::to_string(file_count++) + ".zstf";
+                std::cerr << overall_instcnt << " Creating split trace file " << cur_output_file << std::endl;
+
+                // The split extractor is destroyed on its own thread so that the records it
+                // allocated are freed on the thread that allocated them
+                std::unique_ptr<STFExtractor> split(new STFExtractor(*this));
+                writers.emplace_back(std::async(std::launch::async,
+                                                [split = std::move(split), cur_output_file, split_count, modify_header]() mutable {
+                                                    split->writeSplit_(cur_output_file, split_count, modify_header);
+                                                    split.reset();
+                                                }));
+                modify_header = true;
+
+                if(extractSkip_(split_count) < split_count) {
+                    break;
+                }
+            }
+
+            for(auto& writer: writers) {
+                writer.get();
+            }
+        }
+
 
     public:
         /**
@@ -199,14 +283,22 @@ class STFExtractor {
          * \param skip_count Number of instructions to skip
          * \param split_count If > 0, split trace into split_count length segments
          * \param output_filename Output filename to write
+         * \param num_threads Number of split traces to write concurrently
          */
-        void run(uint64_t head_count, const uint64_t skip_count, const uint64_t split_count, const std::string& output_filename) {
+        void run(uint64_t head_count,
+                 const uint64_t skip_count,
+                 const uint64_t split_count,
+                 const std::string& output_filename,
+                 const size_t num_threads = 1) {
             uint64_t overall_instcnt = extractSkip_(skip_count);
 
             stf_assert(overall_instcnt == skip_count,
                        "Specified skip count (" << skip_count << ") was greater than the trace length (" << overall_instcnt << ").");
 
-            if (split_count > 0) {
+            if (split_count > 0 && num_threads > 1) {
+                splitConcurrently_(split_count, output_filename, num_threads, overall_instcnt);
+            }
+            else if (split_count > 0) {
                 uint32_t file_count = 0;
                 bool modify_header = overall_instcnt;
 
@@ -250,6 +342,7 @@ class STFExtractor {
             page_table_(nullptr, nullptr, true),
             regstate_(stf_reader_.getISA(), stf_reader_.getInitialIEM()),
             pc_tracker_(stf_reader_.getInitialPC(), config.inst_offset),
+            trace_filename_(config.trace_filename),
             dump_ptes_on_demand_(config.dump_ptes_on_demand || stf_reader_.getTraceFeatures()->hasFeature(stf::TRACE_FEATURES::STF_CONTAIN_PTE)),
             user_mode_counts_(config.user_mode_counts),
             filter_kernel_code_(config.filter_kernel_code),
@@ -85,7 +85,7 @@ int main (int argc, char **argv)
                                 TRACE_TOOLS_VERSION_MINOR_MINOR,
                                 "Merge trace generated by stf_filter_evt");
         stf_writer.finalizeHeader();
-        stf::STFRegState regState(stf_reader.getISA(), stf_reader.getInitialIEM());
+        CowRegState regState(stf_reader.getISA(), stf_reader.getInitialIEM());
 
         bool instFiltered = false;
         bool evtFiltered = false;
@@ -101,14 +101,10 @@ int main (int argc, char **argv)
                 std::cerr << std::endl;
             }
             // if there is register state dump; update them;
-            for(const auto& state: inst.getRegisterStates()) {
-                regState.regStateUpdate(state.getRecord());
-            }
+            regState.update(inst.getRegisterStates());
 
             if (inst.index() < config.startInst) {
-                for(const auto& op: inst.getDestOperands()) {
-                    regState.regStateUpdate(op.getRecord());
-                }
+                regState.update(inst.getDestOperands());
                 filter.appendFilteredPTE(inst);
                 continue;
             }
@@ -208,9 +204,7 @@ int main (int argc, char **argv)
 
             if (instFiltered) {
                 // the instruction is filtered; update register state;
-                for(const auto& op: inst.getDestOperands()) {
-                    regState.regStateUpdate(op.getRecord());
-                }
+                regState.update(inst.getDestOperands());
                 // the instruction is filtered; PTE;
                 filter.appendFilteredPTE(inst);
 
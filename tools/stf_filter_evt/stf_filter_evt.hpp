@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -7,13 +8,71 @@
 #include "stf_inst.hpp"
 #include "stf_reg_state.hpp"
 
+/**
+ * \class CowRegState
+ * \brief Copy-on-write wrapper around STFRegState
+ *
+ * Snapshots share the underlying state, so taking one is O(1). The state is only copied if it is modified
+ * while a snapshot is still alive.
+ */
+class CowRegState {
+    private:
+        std::shared_ptr<stf::STFRegState> state_;
+
+        inline stf::STFRegState& getMutable_() {
+            if(STF_EXPECT_FALSE(state_.use_count() > 1)) {
+                state_ = std::make_shared<stf::STFRegState>(*state_);
+            }
+            return *state_;
+        }
+
+    public:
+        CowRegState(const stf::ISA isa, const stf::INST_IEM iem) :
+            state_(std::make_shared<stf::STFRegState>(isa, iem))
+        {
+        }
+
+        /**
+         * Applies a single register record
+         */
+        inline void update(const stf::InstRegRecord& record) {
+            getMutable_().regStateUpdate(record);
+        }
+
+        /**
+         * Applies every register record in a range of operands (e.g. STFInst::getDestOperands())
+         */
+        template<typename OperandRange>
+        inline void update(const OperandRange& operands) {
+            if(operands.empty()) {
+                return;
+            }
+
+            auto& state = getMutable_();
+            for(const auto& op: operands) {
+                state.regStateUpdate(op.getRecord());
+            }
+        }
+
+        /**
+         * Gets a read-only snapshot of the current state
+         */
+        inline std::shared_ptr<const stf::STFRegState> snapshot() const {
+            return state_;
+        }
+
+        inline void writeRegState(stf::STFWriter& stf_writer) const {
+            state_->writeRegState(stf_writer);
+        }
+};
+
 class FilteredSTFInst : public stf::STFInst {
     private:
         bool branch_target_overridden_ = false;
         bool branch_target_invalidated_ = false;
         bool keep_events_ = true;
         bool reg_state_overridden_ = false;
-        stf::STFRegState reg_state_;
+        std::shared_ptr<const stf::STFRegState> reg_state_;
 
         static inline bool isEventDescriptor_(const stf::descriptors::internal::Descriptor desc) {
             return desc == stf::descriptors::internal::Descriptor::STF_EVENT ||
@@ -26,11 +85,6 @@ class FilteredSTFInst : public stf::STFInst {
         }
 
     public:
-        FilteredSTFInst(const stf::STFInstReader& reader) :
-            reg_state_(reader.getISA(), reader.getInitialIEM())
-        {
-        }
-
         /**
          * \brief Write all records in this instruction to STFWriter
          */
@@ -60,7 +114,7 @@ class FilteredSTFInst : public stf::STFInst {
                 }
                 if(STF_EXPECT_FALSE(reg_state_overridden_ && !reg_state_written)) {
                     if(STF_EXPECT_FALSE(descriptorHasBeenSkipped_(vec_pair.first, stf::descriptors::internal::Descriptor::STF_INST_REG))) {
-                        reg_state_.writeRegState(stf_writer);
+                        reg_state_->writeRegState(stf_writer);
                         reg_state_written = true;
                         if(vec_pair.first == stf::descriptors::internal::Descriptor::STF_INST_REG) {
                             for(const auto& record: vec_pair.second) {
@@ -89,9 +143,9 @@ class FilteredSTFInst : public stf::STFInst {
             branch_target_ = new_target;
         }
 
-        void overrideRegState(const stf::STFRegState& reg_state) {
+        void overrideRegState(std::shared_ptr<const stf::STFRegState> reg_state) {
             reg_state_overridden_ = true;
-            reg_state_ = reg_state;
+            reg_state_ = std::move(reg_state);
         }
 
         void keepEvents(const bool keep_events) {
@@ -101,7 +155,8 @@ class FilteredSTFInst : public stf::STFInst {
         void reset() {
             branch_target_invalidated_ = false;
             branch_target_overridden_ = false;
-            reg_state_overridden_ = true;
+            reg_state_overridden_ = false;
+            reg_state_.reset();
 
             stf::STFInst::reset_();
         }
@@ -111,7 +166,8 @@ class FilteredSTFInst : public stf::STFInst {
 
             branch_target_invalidated_ = false;
             branch_target_overridden_ = false;
-            reg_state_overridden_ = true;
+            reg_state_overridden_ = false;
+            reg_state_.reset();
 
             return *this;
         }
@@ -143,7 +199,6 @@ class STFEventFilter {
 
     public:
         STFEventFilter(const stf::STFInstReader& reader) :
-            prev_inst_(reader),
             decoder_(reader.getInitialIEM())
         {
         }
@@ -157,9 +212,10 @@ class STFEventFilter {
         bool writeInst(stf::STFWriter& stf_writer,
                        const stf::STFInst& inst,
                        const bool keep_event,
-                       stf::STFRegState& reg_state,
+                       CowRegState& reg_state,
                        const bool verbose) {
             static bool first_inst = true;
+            const bool update_reg_state = !first_inst;
             // before write current inst, complete the previous branch target(if necessary) and inst opcode;
             bool bBranch = false;
             if (STF_EXPECT_TRUE(!first_inst)) {
@@ -195,12 +251,10 @@ class STFEventFilter {
                 }
 
                 // if current instruction has register state dump; write them into trace;
+                // The snapshot is released when prev_inst_ is replaced, before the destination operands are
+                // applied, so the register state is never copied
                 if (!inst.getRegisterStates().empty()) {
-                    prev_inst_.overrideRegState(reg_state);
-                }
-
-                for(const auto& op: inst.getDestOperands()) {
-                    reg_state.regStateUpdate(op.getRecord());
+                    prev_inst_.overrideRegState(reg_state.snapshot());
                 }
 
                 // write previous instruction
@@ -227,6 +281,11 @@ class STFEventFilter {
             // wait for next instruction ready, to check branch target before writing opcode;
             prev_inst_ = inst;
             prev_inst_.keepEvents(keep_event);
+
+            if (update_reg_state) {
+                reg_state.update(inst.getDestOperands());
+            }
+
             return true;
         }
 
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "stf_exception.hpp"
+
+/**
+ * \class FingerprintTree
+ * \brief Hierarchical hash tree over fixed-size instruction blocks
+ *
+ * Level 0 holds one hash per block of block_size instructions. Each higher level holds one hash per
+ * fanout nodes of the level below, up to a single root. Two trees built with the same parameters can be
+ * compared by descending from the root, visiting only the first differing child at each level, to find the
+ * first block where the traces diverge.
+ *
+ * Sidecar layout (all integers little-endian uint64_t):
+ *     magic, version, block_size, fanout, start_inst, num_insts, options, trace name length,
+ *     trace name bytes (padded to 8 bytes), num_levels, then for each level: num_nodes, node hashes
+ */
+class FingerprintTree {
+    public:
+        static constexpr uint64_t MAGIC = 0x3150465f465453ULL; // "STF_FP1\0"
+        static constexpr uint64_t VERSION = 1;
+
+        /**
+         * \struct Params
+         * \brief Parameters that must match for two trees to be comparable
+         */
+        struct Params {
+            uint64_t block_size = 0;    /**< Number of instructions per leaf */
+            uint64_t fanout = 0;        /**< Number of children per interior node */
+            uint64_t options = 0;       /**< Bitmask of the comparison options used to hash instructions */
+
+            bool operator==(const Params& rhs) const {
+                return block_size == rhs.block_size && fanout == rhs.fanout && options == rhs.options;
+            }
+
+            bool operator!=(const Params& rhs) const {
+                return !(*this == rhs);
+            }
+        };
+
+    private:
+        static constexpr uint64_t BLOCK_HASH_MULT_ = 0x100000001b3ULL;
+
+        Params params_;
+        uint64_t start_inst_ = 1;
+        uint64_t num_insts_ = 0;
+        std::string trace_;
+        std::vector<std::vector<uint64_t>> levels_;
+
+        uint64_t block_hash_ = 0;
+        uint64_t block_count_ = 0;
+
+        // splitmix64 finalizer, so that similar blocks do not produce similar hashes
+        static inline uint64_t mix_(uint64_t x) {
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebULL;
+            x ^= x >> 31;
+            return x;
+        }
+
+        inline void finishBlock_() {
+            levels_.front().emplace_back(mix_(block_hash_ ^ block_count_));
+            block_hash_ = 0;
+            block_count_ = 0;
+        }
+
+        // Sidecars are little-endian regardless of the host byte order, so they can be shared between machines
+        static inline void encodeWord_(char* bytes, const uint64_t word) {
+            for(size_t i = 0; i < sizeof(word); ++i) {
+                bytes[i] = static_cast<char>((word >> (8 * i)) & 0xff);
+            }
+        }
+
+        static inline uint64_t decodeWord_(const char* bytes) {
+            uint64_t word = 0;
+            for(size_t i = 0; i < sizeof(word); ++i) {
+                word |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+            }
+            return word;
+        }
+
+        static inline void writeWord_(std::ofstream& os, const uint64_t word) {
+            char bytes[sizeof(word)];
+            encodeWord_(bytes, word);
+            os.write(bytes, sizeof(bytes));
+        }
+
+        static inline uint64_t readWord_(std::ifstream& is, const std::string& filename) {
+            char bytes[sizeof(uint64_t)];
+            is.read(bytes, sizeof(bytes));
+            stf_assert(is, "Unexpected end of fingerprint file " << filename);
+            return decodeWord_(bytes);
+        }
+
+    public:
+        FingerprintTree() = default;
+
+        /**
+         * Constructs an empty tree that instructions can be added to
+         * \param params Tree parameters
+         * \param start_inst Index of the first fingerprinted instruction
+         * \param trace Name of the fingerprinted trace
+         */
+        FingerprintTree(const Params& params, const uint64_t start_inst, const std::string& trace) :
+            params_(params),
+            start_inst_(start_inst),
+            trace_(trace),
+            levels_(1)
+        {
+            stf_assert(params_.block_size > 0, "Block size must be greater than 0");
+            stf_assert(params_.fanout > 1, "Fanout must be greater than 1");
+        }
+
+        /**
+         * Adds an instruction hash to the current block
+         */
+        inline void add(const uint64_t inst_hash) {
+            block_hash_ = block_hash_ * BLOCK_HASH_MULT_ + inst_hash;
+            ++num_insts_;
+            if(++block_count_ == params_.block_size) {
+                finishBlock_();
+            }
+        }
+
+        /**
+         * Hashes the final partial block and builds the interior levels
+         */
+        void finalize() {
+            if(block_count_) {
+                finishBlock_();
+            }
+
+            while(levels_.back().size() > 1) {
+                const auto& children = levels_.back();
+                std::vector<uint64_t> parents;
+                parents.reserve((children.size() + params_.fanout - 1) / params_.fanout);
+                for(size_t i = 0; i < children.size(); i += params_.fanout) {
+                    const size_t end = std::min(children.size(), i + static_cast<size_t>(params_.fanout));
+                    uint64_t h = end - i;
+                    for(size_t j = i; j < end; ++j) {
+                        h = mix_(h * BLOCK_HASH_MULT_ + children[j]);
+                    }
+                    parents.emplace_back(h);
+                }
+                levels_.emplace_back(std::move(parents));
+            }
+        }
+
+        /**
+         * Writes the tree to a sidecar file
+         */
+        void write(const std::string& filename) const {
+            std::ofstream os(filename, std::ios::binary);
+            stf_assert(os, "Failed to open " << filename << " for writing");
+
+            writeWord_(os, MAGIC);
+            writeWord_(os, VERSION);
+            writeWord_(os, params_.block_size);
+            writeWord_(os, params_.fanout);
+            writeWord_(os, start_inst_);
+            writeWord_(os, num_insts_);
+            writeWord_(os, params_.options);
+
+            writeWord_(os, trace_.size());
+            std::string padded_trace = trace_;
+            padded_trace.resize((trace_.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t), '\0');
+            os.write(padded_trace.data(), static_cast<std::streamsize>(padded_trace.size()));
+
+            writeWord_(os, levels_.size());
+            std::vector<char> bytes;
+            for(const auto& level: levels_) {
+                writeWord_(os, level.size());
+                bytes.resize(level.size() * sizeof(uint64_t));
+                for(size_t i = 0; i < level.size(); ++i) {
+                    encodeWord_(bytes.data() + i * sizeof(uint64_t), level[i]);
+                }
+                os.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            }
+
+            stf_assert(os, "Failed to write fingerprint file " << filename);
+        }
+
+        /**
+         * Checks whether a file is a fingerprint sidecar
+         */
+        static bool isFingerprintFile(const std::string& filename) {
+            std::ifstream is(filename, std::ios::binary);
+            char bytes[sizeof(uint64_t)];
+            is.read(bytes, sizeof(bytes));
+            return is && decodeWord_(bytes) == MAGIC;
+        }
+
+        /**
+         * Reads a tree from a sidecar file
+         */
+        static FingerprintTree read(const std::string& filename) {
+            std::ifstream is(filename, std::ios::binary);
+            stf_assert(is, "Failed to open " << filename);
+
+            stf_assert(readWord_(is, filename) == MAGIC, filename << " is not a fingerprint file");
+            const auto version = readWord_(is, filename);
+            stf_assert(version == VERSION, filename << " has unsupported fingerprint version " << version);
+
+            FingerprintTree tree;
+            tree.params_.block_size = readWord_(is, filename);
+            tree.params_.fanout = readWord_(is, filename);
+            tree.start_inst_ = readWord_(is, filename);
+            tree.num_insts_ = readWord_(is, filename);
+            tree.params_.options = readWord_(is, filename);
+
+            const auto trace_len = readWord_(is, filename);
+            std::string padded_trace((trace_len + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t), '\0');
+            is.read(padded_trace.data(), static_cast<std::streamsize>(padded_trace.size()));
+            tree.trace_ = padded_trace.substr(0, trace_len);
+
+            tree.levels_.resize(readWord_(is, filename));
+            std::vector<char> bytes;
+            for(auto& level: tree.levels_) {
+                level.resize(readWord_(is, filename));
+                bytes.resize(level.size() * sizeof(uint64_t));
+                is.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+                stf_assert(is, "Unexpected end of fingerprint file " << filename);
+                for(size_t i = 0; i < level.size(); ++i) {
+                    level[i] = decodeWord_(bytes.data() + i * sizeof(uint64_t));
+                }
+            }
+
+            return tree;
+        }
+
+        /**
+         * Finds the first block that differs between two trees
+         * \returns Index of the first differing block, or std::nullopt if the trees are identical
+         */
+        static std::optional<uint64_t> findFirstDivergence(const FingerprintTree& lhs, const FingerprintTree& rhs) {
+            stf_assert(lhs.params_ == rhs.params_,
+                       "Fingerprints must be built with the same block size, fanout and comparison options to be compared");
+
+            if(lhs.num_insts_ == rhs.num_insts_ && lhs.levels_.back() == rhs.levels_.back()) {
+                return std::nullopt;
+            }
+
+            // The trees can have different heights if the traces have different lengths. Start at the level
+            // below the shorter tree's root so that both trees have nodes at every level visited.
+            const size_t num_levels = std::min(lhs.levels_.size(), rhs.levels_.size());
+            uint64_t node = 0;
+            uint64_t num_candidates = std::max(lhs.levels_[num_levels - 1].size(), rhs.levels_[num_levels - 1].size());
+            for(size_t level = num_levels; level-- > 0;) {
+                const auto& l = lhs.levels_[level];
+                const auto& r = rhs.levels_[level];
+
+                const uint64_t first = node;
+                const uint64_t end = std::min(first + num_candidates, static_cast<uint64_t>(std::max(l.size(), r.size())));
+                uint64_t child = end;
+                for(uint64_t i = first; i < end; ++i) {
+                    if(i >= l.size() || i >= r.size() || l[i] != r[i]) {
+                        child = i;
+                        break;
+                    }
+                }
+
+                // Every child matched, so the difference is in the length of the final block
+                if(child == end) {
+                    child = end - 1;
+                }
+
+                node = child * lhs.params_.fanout;
+                num_candidates = lhs.params_.fanout;
+                if(level == 0) {
+                    return child;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        inline const Params& getParams() const {
+            return params_;
+        }
+
+        inline uint64_t getStartInst() const {
+            return start_inst_;
+        }
+
+        inline uint64_t getNumInsts() const {
+            return num_insts_;
+        }
+
+        inline uint64_t getNumBlocks() const {
+            return levels_.empty() ? 0 : levels_.front().size();
+        }
+
+        inline size_t getNumLevels() const {
+            return levels_.size();
+        }
+
+        inline const std::string& getTrace() const {
+            return trace_;
+        }
+};
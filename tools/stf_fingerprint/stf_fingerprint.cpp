@@ -0,0 +1,212 @@
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "stf_inst_reader.hpp"
+
+#include "command_line_parser.hpp"
+#include "fingerprint_tree.hpp"
+#include "stf_diff.hpp"
+
+/**
+ * \struct FingerprintConfig
+ * \brief Command line options for stf_fingerprint
+ */
+struct FingerprintConfig {
+    std::vector<std::string> files;
+    std::string output_filename;
+    uint64_t start_inst = 1;
+    uint64_t length = 0;
+    FingerprintTree::Params params;
+    STFDiffConfig diff_config;
+
+    // Bits in FingerprintTree::Params::options
+    static constexpr uint64_t IGNORE_KERNEL = 1 << 0;
+    static constexpr uint64_t IGNORE_ADDRESSES = 1 << 1;
+    static constexpr uint64_t DIFF_MEMORY = 1 << 2;
+    static constexpr uint64_t DIFF_REGISTERS = 1 << 3;
+    static constexpr uint64_t DIFF_DEST_REGISTERS = 1 << 4;
+    static constexpr uint64_t DIFF_STATE_REGISTERS = 1 << 5;
+    static constexpr uint64_t DIFF_PHYSICAL_PC = 1 << 6;
+    static constexpr uint64_t DIFF_PHYSICAL_DATA = 1 << 7;
+
+    FingerprintConfig(int argc, char** argv) {
+        params.block_size = 1000000;
+        params.fanout = 16;
+
+        trace_tools::CommandLineParser parser("stf_fingerprint");
+        parser.addFlag('s', "N", "start fingerprinting at the Nth instruction");
+        parser.addFlag('l', "len", "fingerprint <len> instructions");
+        parser.addFlag('b', "N", "number of instructions per block (default 1000000)");
+        parser.addFlag('f', "N", "number of children per tree node (default 16)");
+        parser.addFlag('o', "output", "fingerprint file to write (defaults to <trace>.fp)");
+        parser.addFlag('k', "ignore kernel instructions");
+        parser.addFlag('A', "ignore addresses");
+        parser.addFlag('M', "include memory records");
+        parser.addFlag('p', "include all physical addresses");
+        parser.addFlag('P', "only include data physical addresses");
+        parser.addFlag('R', "include register records");
+        parser.addFlag('D', "include destination register records");
+        parser.addFlag('S', "include register state records");
+        parser.addPositionalArgument("files",
+                                     "a single trace to fingerprint, or two traces and/or fingerprint files to compare",
+                                     true);
+        parser.appendHelpText("With one trace, writes a fingerprint file. With two arguments, finds the first block where they diverge.");
+        parser.appendHelpText("Traces given for comparison are fingerprinted on the fly with the specified options.");
+        parser.appendHelpText("The comparison options (-k, -A, -M, -p, -P, -R, -D, -S) have the same meaning as in stf_diff.");
+        parser.appendHelpText("Example:");
+        parser.appendHelpText("    stf_fingerprint -R -b 100000 golden.zstf");
+        parser.appendHelpText("    stf_fingerprint -R -b 100000 golden.zstf.fp candidate.zstf");
+
+        parser.setMutuallyExclusive('A', 'p');
+        parser.setMutuallyExclusive('A', 'P');
+        parser.setMutuallyExclusive('R', 'D');
+
+        parser.parseArguments(argc, argv);
+
+        parser.getArgumentValue('s', start_inst);
+        parser.getArgumentValue('l', length);
+        parser.getArgumentValue('b', params.block_size);
+        parser.getArgumentValue('f', params.fanout);
+        parser.getArgumentValue('o', output_filename);
+
+        diff_config.ignore_kernel = parser.hasArgument('k');
+        diff_config.ignore_addresses = parser.hasArgument('A');
+        diff_config.diff_memory = parser.hasArgument('M');
+        diff_config.diff_physical_pc = parser.hasArgument('p');
+        diff_config.diff_physical_data = diff_config.diff_physical_pc || parser.hasArgument('P');
+        diff_config.diff_registers = parser.hasArgument('R');
+        diff_config.diff_dest_registers = parser.hasArgument('D');
+        diff_config.diff_state_registers = parser.hasArgument('S');
+
+        params.options = (diff_config.ignore_kernel ? IGNORE_KERNEL : 0) |
+                         (diff_config.ignore_addresses ? IGNORE_ADDRESSES : 0) |
+                         (diff_config.diff_memory ? DIFF_MEMORY : 0) |
+                         (diff_config.diff_registers ? DIFF_REGISTERS : 0) |
+                         (diff_config.diff_dest_registers ? DIFF_DEST_REGISTERS : 0) |
+                         (diff_config.diff_state_registers ? DIFF_STATE_REGISTERS : 0) |
+                         (diff_config.diff_physical_pc ? DIFF_PHYSICAL_PC : 0) |
+                         (diff_config.diff_physical_data ? DIFF_PHYSICAL_DATA : 0);
+
+        const auto& file_args = parser.getMultipleValuePositionalArgument(0);
+        files.assign(file_args.begin(), file_args.end());
+
+        parser.assertCondition(files.size() == 1 || files.size() == 2, "Expected either one trace or two files to compare");
+        parser.assertCondition(start_inst, "-s parameter must be nonzero");
+        parser.assertCondition(params.block_size, "-b parameter must be nonzero");
+        parser.assertCondition(params.fanout > 1, "-f parameter must be greater than 1");
+        parser.assertCondition(files.size() == 1 || !parser.hasArgument('o'), "-o can only be used when fingerprinting a single trace");
+
+        if(files.size() == 1 && output_filename.empty()) {
+            output_filename = files.front() + ".fp";
+        }
+    }
+
+    /**
+     * Formats the stf_diff flags that correspond to the comparison options of a fingerprint
+     */
+    static std::string getDiffFlags(const uint64_t options) {
+        std::ostringstream ss;
+        static constexpr std::pair<uint64_t, const char*> FLAGS[] = {
+            {IGNORE_KERNEL, " -k"},
+            {IGNORE_ADDRESSES, " -A"},
+            {DIFF_MEMORY, " -M"},
+            {DIFF_PHYSICAL_PC, " -p"},
+            {DIFF_REGISTERS, " -R"},
+            {DIFF_DEST_REGISTERS, " -D"},
+            {DIFF_STATE_REGISTERS, " -S"}
+        };
+        for(const auto& [bit, flag]: FLAGS) {
+            if(options & bit) {
+                ss << flag;
+            }
+        }
+        // -p implies -P
+        if((options & DIFF_PHYSICAL_DATA) && !(options & DIFF_PHYSICAL_PC)) {
+            ss << " -P";
+        }
+        return ss.str();
+    }
+};
+
+/**
+ * Builds the fingerprint tree for a trace
+ */
+FingerprintTree fingerprintTrace(const std::string& trace, const FingerprintConfig& config) {
+    stf::STFInstReader reader(trace, config.diff_config.ignore_kernel);
+    // Instructions are never printed, so no disassembler is needed
+    DiffInstArena arena(nullptr);
+    FingerprintTree tree(config.params, config.start_inst, trace);
+
+    auto it = config.start_inst > 1 ? reader.seekFromBeginning(config.start_inst - 1) : reader.begin();
+    for(uint64_t count = 0; it != reader.end() && (!config.length || count < config.length); ++it, ++count) {
+        arena.clear();
+        tree.add(STFDiffInst(*it, config.diff_config, arena).hash());
+    }
+
+    tree.finalize();
+    return tree;
+}
+
+/**
+ * Loads a fingerprint file, or fingerprints a trace if the file is not a fingerprint
+ */
+FingerprintTree loadOrFingerprint(const std::string& filename, const FingerprintConfig& config) {
+    if(FingerprintTree::isFingerprintFile(filename)) {
+        return FingerprintTree::read(filename);
+    }
+    return fingerprintTrace(filename, config);
+}
+
+int compareFingerprints(const FingerprintConfig& config) {
+    // Fingerprinting a trace is read-bound, so do both at once
+    auto future1 = std::async(std::launch::async, [&config]() { return loadOrFingerprint(config.files[0], config); });
+    const FingerprintTree tree2 = loadOrFingerprint(config.files[1], config);
+    const FingerprintTree tree1 = future1.get();
+
+    const auto divergent_block = FingerprintTree::findFirstDivergence(tree1, tree2);
+    if(!divergent_block) {
+        std::cout << "Fingerprints match (" << tree1.getNumInsts() << " instructions)" << std::endl;
+        return 0;
+    }
+
+    const uint64_t block_size = tree1.getParams().block_size;
+    const uint64_t offset = *divergent_block * block_size;
+    const uint64_t start1 = tree1.getStartInst() + offset;
+    const uint64_t start2 = tree2.getStartInst() + offset;
+
+    std::cout << "First divergent block: " << *divergent_block << std::endl
+              << "    " << tree1.getTrace() << ": instructions " << start1 << '-' << (start1 + block_size - 1)
+              << " (" << tree1.getNumInsts() << " instructions fingerprinted)" << std::endl
+              << "    " << tree2.getTrace() << ": instructions " << start2 << '-' << (start2 + block_size - 1)
+              << " (" << tree2.getNumInsts() << " instructions fingerprinted)" << std::endl
+              << "To see the differences, run:" << std::endl
+              << "    stf_diff" << FingerprintConfig::getDiffFlags(tree1.getParams().options)
+              << " -1 " << start1 << " -2 " << start2 << " -l " << block_size
+              << ' ' << tree1.getTrace() << ' ' << tree2.getTrace() << std::endl;
+
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    try {
+        const FingerprintConfig config(argc, argv);
+
+        if(config.files.size() == 2) {
+            return compareFingerprints(config);
+        }
+
+        const auto tree = fingerprintTrace(config.files.front(), config);
+        tree.write(config.output_filename);
+        std::cout << "Fingerprinted " << tree.getNumInsts() << " instructions in " << tree.getNumBlocks()
+                  << " blocks (" << tree.getNumLevels() << " levels) to " << config.output_filename << std::endl;
+    }
+    catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
+        std::cerr << e.what() << std::endl;
+        return e.getCode();
+    }
+
+    return 0;
+}
@@ -0,0 +1,657 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "branch_batch_buffer.hpp"
+#include "branch_history.hpp"
+#include "branch_predictor.hpp"
+
+namespace frontend_model {
+    using branch_predictor::BranchRecord;
+    using branch_predictor::PredictorParams;
+
+    /**
+     * Gets the size of a RISC-V instruction from its opcode
+     */
+    inline uint64_t getInstSize(const uint32_t opcode) {
+        return (opcode & 3) == 3 ? 4 : 2;
+    }
+
+    /**
+     * \class BTB
+     * \brief Set-associative branch target buffer with LRU replacement and optionally partial tags
+     */
+    class BTB {
+        private:
+            struct Entry {
+                bool valid = false;
+                uint64_t tag = 0;
+                uint64_t target = 0;
+                uint64_t lru = 0;
+            };
+
+            const size_t num_entries_;
+            const size_t num_ways_;
+            const size_t tag_bits_;
+            const size_t num_sets_;
+            const size_t log_sets_;
+            const uint64_t tag_mask_;
+            std::vector<Entry> entries_;
+            uint64_t access_count_ = 0;
+
+            inline Entry* getSet_(const uint64_t pc) {
+                return entries_.data() + (branch_predictor::pcHash(pc) & (num_sets_ - 1)) * num_ways_;
+            }
+
+            inline uint64_t getTag_(const uint64_t pc) const {
+                return (branch_predictor::pcHash(pc) >> log_sets_) & tag_mask_;
+            }
+
+        public:
+            /**
+             * Constructs a BTB
+             * \param num_entries Total number of entries
+             * \param num_ways Associativity
+             * \param tag_bits Number of tag bits to keep. 0 keeps the full tag.
+             */
+            BTB(const size_t num_entries, const size_t num_ways, const size_t tag_bits) :
+                num_entries_(num_entries),
+                num_ways_(num_ways),
+                tag_bits_(tag_bits),
+                num_sets_(num_ways ? num_entries / num_ways : 0),
+                log_sets_(num_sets_ ? log2(num_sets_) : 0),
+                tag_mask_(tag_bits == 0 || tag_bits >= 64 ? std::numeric_limits<uint64_t>::max() : (1ULL << tag_bits) - 1),
+                entries_(num_entries)
+            {
+                stf_assert(num_ways_ > 0 && num_entries_ % num_ways_ == 0,
+                           "BTB entries (" << num_entries_ << ") must be a multiple of BTB ways (" << num_ways_ << ")");
+                stf_assert(num_sets_ && (num_sets_ & (num_sets_ - 1)) == 0, "Number of BTB sets must be a power of 2");
+            }
+
+            /**
+             * Looks up a branch
+             * \returns The predicted target if the lookup hit
+             */
+            inline std::optional<uint64_t> lookup(const uint64_t pc) {
+                auto* const set = getSet_(pc);
+                const auto tag = getTag_(pc);
+                for(size_t i = 0; i < num_ways_; ++i) {
+                    if(set[i].valid && set[i].tag == tag) {
+                        set[i].lru = ++access_count_;
+                        return set[i].target;
+                    }
+                }
+                return std::nullopt;
+            }
+
+            /**
+             * Inserts or updates a branch
+             */
+            inline void update(const uint64_t pc, const uint64_t target) {
+                auto* const set = getSet_(pc);
+                const auto tag = getTag_(pc);
+                Entry* victim = set;
+                for(size_t i = 0; i < num_ways_; ++i) {
+                    auto& entry = set[i];
+                    if(entry.valid && entry.tag == tag) {
+                        victim = &entry;
+                        break;
+                    }
+                    if(!entry.valid || (victim->valid && entry.lru < victim->lru)) {
+                        victim = &entry;
+                    }
+                }
+
+                victim->valid = true;
+                victim->tag = tag;
+                victim->target = target;
+                victim->lru = ++access_count_;
+            }
+
+            std::string getName() const {
+                std::ostringstream ss;
+                ss << "btb(entries=" << num_entries_ << ",ways=" << num_ways_ << ",tag_bits=";
+                if(tag_bits_) {
+                    ss << tag_bits_;
+                }
+                else {
+                    ss << "full";
+                }
+                ss << ')';
+                return ss.str();
+            }
+    };
+
+    /**
+     * \class ReturnAddressStack
+     * \brief Circular return address stack that overwrites the oldest entry on overflow
+     */
+    class ReturnAddressStack {
+        private:
+            std::vector<uint64_t> stack_;
+            size_t top_ = 0;
+            size_t size_ = 0;
+            uint64_t overflows_ = 0;
+            uint64_t underflows_ = 0;
+
+        public:
+            explicit ReturnAddressStack(const size_t depth) :
+                stack_(depth)
+            {
+            }
+
+            inline void push(const uint64_t return_address) {
+                if(STF_EXPECT_FALSE(stack_.empty())) {
+                    ++overflows_;
+                    return;
+                }
+
+                top_ = (top_ + 1) % stack_.size();
+                stack_[top_] = return_address;
+                if(size_ == stack_.size()) {
+                    ++overflows_;
+                }
+                else {
+                    ++size_;
+                }
+            }
+
+            /**
+             * Pops the top of the stack
+             * \returns The predicted return address, or nullopt if the stack was empty
+             */
+            inline std::optional<uint64_t> pop() {
+                if(STF_EXPECT_FALSE(size_ == 0)) {
+                    ++underflows_;
+                    return std::nullopt;
+                }
+
+                const auto addr = stack_[top_];
+                top_ = (top_ + stack_.size() - 1) % stack_.size();
+                --size_;
+                return addr;
+            }
+
+            inline uint64_t getOverflows() const {
+                return overflows_;
+            }
+
+            inline uint64_t getUnderflows() const {
+                return underflows_;
+            }
+
+            inline size_t getDepth() const {
+                return stack_.size();
+            }
+    };
+
+    /**
+     * \class ITTAGE
+     * \brief Indirect target predictor modeled after Seznec's ITTAGE
+     *
+     * A PC-indexed base table backed by tagged tables indexed with geometrically increasing global
+     * history lengths. History is built from conditional branch directions and indirect target bits.
+     */
+    class ITTAGE {
+        private:
+            struct Entry {
+                uint16_t tag = 0;
+                uint64_t target = 0;
+                uint8_t confidence = 0;
+                bool useful = false;
+            };
+
+            struct BaseEntry {
+                uint64_t target = 0;
+                uint8_t confidence = 0;
+            };
+
+            static constexpr uint8_t CONFIDENCE_MAX_ = 3;
+            static constexpr uint64_t USEFUL_RESET_PERIOD_ = 1ULL << 16;
+
+            const size_t num_tables_;
+            const size_t log_entries_;
+            const size_t log_base_;
+            const size_t tag_bits_;
+
+            std::vector<size_t> history_lengths_;
+            branch_predictor::GlobalHistory history_;
+            std::vector<branch_predictor::FoldedHistory> index_folds_;
+            std::vector<branch_predictor::FoldedHistory> tag_folds_;
+
+            std::vector<BaseEntry> base_;
+            std::vector<std::vector<Entry>> tables_;
+
+            std::vector<uint32_t> indices_;
+            std::vector<uint16_t> tags_;
+            int provider_ = -1;
+            int alt_provider_ = -1;
+            uint64_t num_updates_ = 0;
+
+            inline uint32_t baseIndex_(const uint64_t pc) const {
+                return static_cast<uint32_t>(branch_predictor::pcHash(pc) & ((1ULL << log_base_) - 1));
+            }
+
+            inline void pushHistory_(const bool bit) {
+                history_.push(bit);
+                for(size_t i = 0; i < num_tables_; ++i) {
+                    index_folds_[i].update(history_);
+                    tag_folds_[i].update(history_);
+                }
+            }
+
+            inline Entry& getEntry_(const int table) {
+                const auto t = static_cast<size_t>(table);
+                return tables_[t][indices_[t]];
+            }
+
+        public:
+            /**
+             * Constructs an ITTAGE predictor
+             * \param num_tables Number of tagged tables
+             * \param log_entries log2 of the number of entries in each tagged table
+             * \param log_base log2 of the number of entries in the base table
+             * \param min_history Shortest history length
+             * \param max_history Longest history length
+             * \param tag_bits Tag width
+             */
+            ITTAGE(const size_t num_tables,
+                   const size_t log_entries,
+                   const size_t log_base,
+                   const size_t min_history,
+                   const size_t max_history,
+                   const size_t tag_bits) :
+                num_tables_(num_tables),
+                log_entries_(log_entries),
+                log_base_(log_base),
+                tag_bits_(tag_bits),
+                history_(1),
+                base_(1ULL << log_base),
+                tables_(num_tables, std::vector<Entry>(1ULL << log_entries)),
+                indices_(num_tables),
+                tags_(num_tables)
+            {
+                stf_assert(num_tables_ >= 1, "ITTAGE requires at least 1 tagged table");
+                stf_assert(min_history > 0 && max_history >= min_history, "ITTAGE requires 0 < min_history <= max_history");
+                stf_assert(tag_bits_ > 0 && tag_bits_ <= 16, "ITTAGE tag_bits must be between 1 and 16");
+
+                const double ratio = num_tables_ > 1 ?
+                    std::pow(static_cast<double>(max_history) / static_cast<double>(min_history),
+                             1.0 / static_cast<double>(num_tables_ - 1)) :
+                    1.0;
+                for(size_t i = 0; i < num_tables_; ++i) {
+                    const auto len = static_cast<size_t>(static_cast<double>(min_history) * std::pow(ratio, static_cast<double>(i)) + 0.5);
+                    history_lengths_.emplace_back(i == 0 ? min_history : std::max(len, history_lengths_.back() + 1));
+                    index_folds_.emplace_back(history_lengths_[i], log_entries_);
+                    tag_folds_.emplace_back(history_lengths_[i], tag_bits_);
+                }
+
+                history_ = branch_predictor::GlobalHistory(history_lengths_.back());
+            }
+
+            /**
+             * Predicts the target of an indirect branch. Must be followed by update() for the same branch.
+             * \returns nullopt if no table has a prediction for the branch
+             */
+            inline std::optional<uint64_t> predict(const uint64_t pc) {
+                const uint64_t hpc = branch_predictor::pcHash(pc);
+                provider_ = -1;
+                alt_provider_ = -1;
+
+                for(size_t i = 0; i < num_tables_; ++i) {
+                    indices_[i] = static_cast<uint32_t>((hpc ^ (hpc >> (i + 1)) ^ index_folds_[i].get()) & ((1ULL << log_entries_) - 1));
+                    tags_[i] = static_cast<uint16_t>((hpc ^ (tag_folds_[i].get() << 1)) & ((1ULL << tag_bits_) - 1));
+                }
+
+                for(int i = static_cast<int>(num_tables_) - 1; i >= 0; --i) {
+                    const auto ui = static_cast<size_t>(i);
+                    if(tables_[ui][indices_[ui]].tag == tags_[ui] && tables_[ui][indices_[ui]].target) {
+                        if(provider_ < 0) {
+                            provider_ = i;
+                        }
+                        else {
+                            alt_provider_ = i;
+                            break;
+                        }
+                    }
+                }
+
+                if(provider_ >= 0) {
+                    const auto& entry = getEntry_(provider_);
+                    // Low-confidence providers defer to the next matching table
+                    if(entry.confidence == 0 && alt_provider_ >= 0) {
+                        return getEntry_(alt_provider_).target;
+                    }
+                    return entry.target;
+                }
+
+                const auto& base_entry = base_[baseIndex_(pc)];
+                if(base_entry.target) {
+                    return base_entry.target;
+                }
+                return std::nullopt;
+            }
+
+            /**
+             * Trains the predictor with the resolved target
+             * \param pc Branch PC
+             * \param target Actual target
+             * \param predicted Target returned by predict()
+             */
+            inline void update(const uint64_t pc, const uint64_t target, const std::optional<uint64_t>& predicted) {
+                const bool correct = predicted && *predicted == target;
+
+                if(provider_ >= 0) {
+                    auto& entry = getEntry_(provider_);
+                    const bool alt_correct = alt_provider_ >= 0 && getEntry_(alt_provider_).target == target;
+                    if(entry.target == target) {
+                        entry.confidence = static_cast<uint8_t>(std::min<int>(entry.confidence + 1, CONFIDENCE_MAX_));
+                        entry.useful |= !alt_correct;
+                    }
+                    else if(entry.confidence > 0) {
+                        --entry.confidence;
+                    }
+                    else {
+                        entry.target = target;
+                        entry.useful = false;
+                    }
+                }
+
+                auto& base_entry = base_[baseIndex_(pc)];
+                if(base_entry.target == target) {
+                    base_entry.confidence = static_cast<uint8_t>(std::min<int>(base_entry.confidence + 1, CONFIDENCE_MAX_));
+                }
+                else if(base_entry.confidence > 0) {
+                    --base_entry.confidence;
+                }
+                else {
+                    base_entry.target = target;
+                }
+
+                if(!correct) {
+                    bool allocated = false;
+                    for(size_t i = static_cast<size_t>(provider_ + 1); i < num_tables_; ++i) {
+                        auto& entry = tables_[i][indices_[i]];
+                        if(!entry.useful) {
+                            entry.tag = tags_[i];
+                            entry.target = target;
+                            entry.confidence = 0;
+                            allocated = true;
+                            break;
+                        }
+                    }
+
+                    if(!allocated) {
+                        for(size_t i = static_cast<size_t>(provider_ + 1); i < num_tables_; ++i) {
+                            tables_[i][indices_[i]].useful = false;
+                        }
+                    }
+                }
+
+                if(++num_updates_ % USEFUL_RESET_PERIOD_ == 0) {
+                    for(auto& table: tables_) {
+                        for(auto& entry: table) {
+                            entry.useful = false;
+                        }
+                    }
+                }
+
+                // Fold a few target bits into the global history. The multiplicative hash keeps targets that
+                // only differ in their upper bits (e.g. aligned jump table entries) distinguishable.
+                static constexpr uint64_t TARGET_HASH_MULT = 0x9e3779b97f4a7c15ULL;
+                const uint64_t target_hash = (branch_predictor::pcHash(target) * TARGET_HASH_MULT) >> 62;
+                pushHistory_(target_hash & 1);
+                pushHistory_((target_hash >> 1) & 1);
+            }
+
+            /**
+             * Records the direction of a conditional branch in the global history
+             */
+            inline void trackConditional(const bool taken) {
+                pushHistory_(taken);
+            }
+
+            std::string getName() const {
+                std::ostringstream ss;
+                ss << "ittage(tables=" << num_tables_
+                   << ",log_entries=" << log_entries_
+                   << ",history=" << history_lengths_.front() << '-' << history_lengths_.back()
+                   << ",tag_bits=" << tag_bits_ << ')';
+                return ss.str();
+            }
+    };
+
+    /**
+     * \struct FrontEndStats
+     * \brief Event counts collected by a FrontEndModel
+     */
+    struct FrontEndStats {
+        uint64_t branches = 0;                  /**< All branches */
+        uint64_t taken_branches = 0;            /**< Taken branches */
+        uint64_t taken_bubble_cycles = 0;       /**< Bubbles caused by correctly predicted taken branches */
+        uint64_t btb_misses_direct = 0;         /**< Taken direct branches that missed in the BTB */
+        uint64_t btb_misses_indirect = 0;       /**< Taken indirect branches (excluding returns) that missed in the BTB */
+        uint64_t btb_misses_return = 0;         /**< Returns that missed in the BTB */
+        uint64_t btb_target_mismatches = 0;     /**< Direct branches whose BTB target was wrong (aliasing) */
+        uint64_t returns = 0;                   /**< Returns */
+        uint64_t ras_mispredicts = 0;           /**< Returns whose RAS target was wrong */
+        uint64_t ras_underflow_mispredicts = 0; /**< Returns that found the RAS empty */
+        uint64_t indirect_branches = 0;         /**< Indirect branches (excluding returns) */
+        uint64_t indirect_mispredicts = 0;      /**< Indirect branches whose predicted target was wrong */
+        uint64_t decode_redirects = 0;          /**< Redirects resolved at decode */
+        uint64_t execute_redirects = 0;         /**< Redirects resolved at execute */
+        uint64_t penalty_cycles = 0;            /**< Total cycles lost to redirects and taken branch bubbles */
+    };
+
+    /**
+     * \class FrontEndModel
+     * \brief Combines a BTB, RAS and ITTAGE into a simple front-end timing model
+     *
+     * Conditional branch directions are assumed to be predicted perfectly so that only target prediction
+     * effects are measured. Taken branches that miss in the BTB are redirected at decode if the target can be
+     * computed there (direct branches, or indirect/return branches whose RAS/ITTAGE prediction was correct),
+     * and at execute otherwise.
+     *
+     * Parameters: btb_entries (default 4096), btb_ways (default 4), btb_tag_bits (default 0 = full tags),
+     *             ras_depth (default 16), ittage_tables (default 6), ittage_log_entries (default 9),
+     *             ittage_log_base (default 10), ittage_min_history (default 4), ittage_max_history (default 128),
+     *             ittage_tag_bits (default 11), taken_bubble (default 1), decode_penalty (default 4),
+     *             execute_penalty (default 12)
+     */
+    class FrontEndModel {
+        private:
+            BTB btb_;
+            ReturnAddressStack ras_;
+            ITTAGE ittage_;
+            const uint64_t taken_bubble_;
+            const uint64_t decode_penalty_;
+            const uint64_t execute_penalty_;
+            FrontEndStats stats_;
+
+            inline void redirect_(const bool at_decode) {
+                if(at_decode) {
+                    ++stats_.decode_redirects;
+                    stats_.penalty_cycles += decode_penalty_;
+                }
+                else {
+                    ++stats_.execute_redirects;
+                    stats_.penalty_cycles += execute_penalty_;
+                }
+            }
+
+        public:
+            explicit FrontEndModel(const PredictorParams& params) :
+                btb_(params.get<size_t>("btb_entries", 4096),
+                     params.get<size_t>("btb_ways", 4),
+                     params.get<size_t>("btb_tag_bits", 0)),
+                ras_(params.get<size_t>("ras_depth", 16)),
+                ittage_(params.get<size_t>("ittage_tables", 6),
+                        params.getLog2("ittage_log_entries", 9),
+                        params.getLog2("ittage_log_base", 10),
+                        params.get<size_t>("ittage_min_history", 4),
+                        params.get<size_t>("ittage_max_history", 128),
+                        params.get<size_t>("ittage_tag_bits", 11)),
+                taken_bubble_(params.get<uint64_t>("taken_bubble", 1)),
+                decode_penalty_(params.get<uint64_t>("decode_penalty", 4)),
+                execute_penalty_(params.get<uint64_t>("execute_penalty", 12))
+            {
+            }
+
+            inline void process(const BranchRecord& branch) {
+                ++stats_.branches;
+
+                const auto btb_target = btb_.lookup(branch.pc);
+
+                if(branch.conditional) {
+                    ittage_.trackConditional(branch.taken);
+                }
+
+                std::optional<uint64_t> predicted_target;
+                bool is_return = false;
+                bool is_indirect = false;
+
+                if(branch.ret) {
+                    is_return = true;
+                    ++stats_.returns;
+                    predicted_target = ras_.pop();
+                }
+                else if(branch.indirect) {
+                    is_indirect = true;
+                    ++stats_.indirect_branches;
+                    predicted_target = ittage_.predict(branch.pc);
+                }
+
+                if(branch.call) {
+                    ras_.push(branch.pc + getInstSize(branch.opcode));
+                }
+
+                if(!branch.taken) {
+                    return;
+                }
+
+                ++stats_.taken_branches;
+
+                if(is_return || is_indirect) {
+                    const bool target_correct = predicted_target && *predicted_target == branch.target;
+                    if(!target_correct) {
+                        if(is_return) {
+                            if(predicted_target) {
+                                ++stats_.ras_mispredicts;
+                            }
+                            else {
+                                ++stats_.ras_underflow_mispredicts;
+                            }
+                        }
+                        else {
+                            ++stats_.indirect_mispredicts;
+                        }
+                        redirect_(false);
+                    }
+                    else if(!btb_target) {
+                        // The front end didn't know there was a branch here, but decode can use the
+                        // RAS/ITTAGE prediction
+                        redirect_(true);
+                    }
+                    else {
+                        stats_.taken_bubble_cycles += taken_bubble_;
+                        stats_.penalty_cycles += taken_bubble_;
+                    }
+
+                    if(!btb_target) {
+                        ++(is_return ? stats_.btb_misses_return : stats_.btb_misses_indirect);
+                    }
+                }
+                else if(!btb_target) {
+                    ++stats_.btb_misses_direct;
+                    redirect_(true);
+                }
+                else if(*btb_target != branch.target) {
+                    ++stats_.btb_target_mismatches;
+                    redirect_(true);
+                }
+                else {
+                    stats_.taken_bubble_cycles += taken_bubble_;
+                    stats_.penalty_cycles += taken_bubble_;
+                }
+
+                if(is_indirect) {
+                    ittage_.update(branch.pc, branch.target, predicted_target);
+                }
+
+                btb_.update(branch.pc, branch.target);
+            }
+
+            inline const FrontEndStats& getStats() const {
+                return stats_;
+            }
+
+            inline uint64_t getRASOverflows() const {
+                return ras_.getOverflows();
+            }
+
+            inline uint64_t getRASUnderflows() const {
+                return ras_.getUnderflows();
+            }
+
+            std::string getName() const {
+                std::ostringstream ss;
+                ss << btb_.getName()
+                   << " ras(depth=" << ras_.getDepth() << ") "
+                   << ittage_.getName()
+                   << " penalties(taken_bubble=" << taken_bubble_
+                   << ",decode=" << decode_penalty_
+                   << ",execute=" << execute_penalty_ << ')';
+                return ss.str();
+            }
+    };
+
+    /**
+     * \class FrontEndWorker
+     * \brief Runs a FrontEndModel on its own thread, consuming every batch from a BranchBatchBuffer
+     */
+    class FrontEndWorker {
+        private:
+            FrontEndModel model_;
+            std::thread thread_;
+
+        public:
+            explicit FrontEndWorker(const PredictorParams& params) :
+                model_(params)
+            {
+            }
+
+            FrontEndWorker(FrontEndWorker&& rhs) :
+                model_(std::move(rhs.model_))
+            {
+                stf_assert(!rhs.thread_.joinable(), "Cannot move a running FrontEndWorker");
+            }
+
+            inline void start(branch_predictor::BranchBatchBuffer& buffer) {
+                thread_ = std::thread([this, &buffer]() {
+                    buffer.consumeAll([this](const branch_predictor::BranchBatchBuffer::Batch& batch) {
+                        for(const auto& branch: batch) {
+                            model_.process(branch);
+                        }
+                    });
+                });
+            }
+
+            inline void join() {
+                if(thread_.joinable()) {
+                    thread_.join();
+                }
+            }
+
+            inline const FrontEndModel& getModel() const {
+                return model_;
+            }
+    };
+} // end namespace frontend_model
@@ -0,0 +1,150 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "format_utils.hpp"
+#include "stf_branch_reader.hpp"
+
+#include "command_line_parser.hpp"
+#include "file_utils.hpp"
+#include "frontend_model.hpp"
+
+void processCommandLine(int argc,
+                        char** argv,
+                        std::string& trace,
+                        std::string& output_filename,
+                        std::vector<std::string>& configs,
+                        bool& skip_non_user,
+                        size_t& batch_size) {
+    trace_tools::CommandLineParser parser("stf_frontend_sim");
+    parser.addMultiFlag('c',
+                        "config",
+                        "front-end configuration to simulate, specified as key=value[,key=value...]. "
+                        "Can be specified multiple times to simulate several configurations in one pass. "
+                        "Keys: btb_entries, btb_ways, btb_tag_bits (0 = full tags), ras_depth, "
+                        "ittage_tables, ittage_log_entries, ittage_log_base, ittage_min_history, ittage_max_history, ittage_tag_bits, "
+                        "taken_bubble, decode_penalty, execute_penalty.");
+    parser.addFlag('u', "skip non user-mode instructions");
+    parser.addFlag('b', "batch_size", "number of branches handed to the simulation threads at a time (default 4096)");
+    parser.addFlag('o', "output", "output file (defaults to stdout)");
+    parser.addPositionalArgument("trace", "trace in STF format");
+    parser.appendHelpText("Conditional branch directions are assumed to be predicted perfectly, so all reported costs come from target prediction.");
+    parser.appendHelpText("Example:");
+    parser.appendHelpText("    Compare a 2K-entry, 12-bit tag BTB against a 4K-entry full-tag BTB");
+    parser.appendHelpText("    stf_frontend_sim -c btb_entries=2048,btb_tag_bits=12 -c btb_entries=4096 trace.zstf");
+    parser.parseArguments(argc, argv);
+
+    configs = parser.getMultipleValueArgument('c');
+    skip_non_user = parser.hasArgument('u');
+    parser.getArgumentValue('b', batch_size);
+    parser.getArgumentValue('o', output_filename);
+    parser.getPositionalArgument(0, trace);
+
+    parser.assertCondition(batch_size > 0, "Batch size must be greater than 0");
+
+    if(configs.empty()) {
+        configs.emplace_back();
+    }
+}
+
+/**
+ * Formats a single statistic along with its per-kilo-instruction rate
+ */
+inline void formatStat(OutputFileStream& os, const std::string_view name, const uint64_t value, const uint64_t num_insts) {
+    static constexpr int NAME_WIDTH = 36;
+    static constexpr int VALUE_WIDTH = 16;
+    static constexpr int NUM_DECIMAL_PLACES = 3;
+
+    stf::format_utils::formatSpaces(os, 2);
+    stf::format_utils::formatLeft(os, name, NAME_WIDTH);
+    stf::format_utils::formatDecLeft(os, value, VALUE_WIDTH);
+    if(num_insts) {
+        os.saveFlags();
+        os << std::fixed << std::setprecision(NUM_DECIMAL_PLACES)
+           << (1000.0 * static_cast<double>(value) / static_cast<double>(num_insts)) << " PKI";
+        os.restoreFlags();
+    }
+    os << std::endl;
+}
+
+void printReport(OutputFileStream& os, const frontend_model::FrontEndModel& model, const uint64_t num_insts) {
+    const auto& stats = model.getStats();
+
+    os << model.getName() << std::endl;
+    formatStat(os, "Branches", stats.branches, num_insts);
+    formatStat(os, "Taken branches", stats.taken_branches, num_insts);
+    formatStat(os, "Taken branch bubble cycles", stats.taken_bubble_cycles, num_insts);
+    formatStat(os, "BTB misses (direct)", stats.btb_misses_direct, num_insts);
+    formatStat(os, "BTB misses (indirect)", stats.btb_misses_indirect, num_insts);
+    formatStat(os, "BTB misses (return)", stats.btb_misses_return, num_insts);
+    formatStat(os, "BTB target mismatches", stats.btb_target_mismatches, num_insts);
+    formatStat(os, "Returns", stats.returns, num_insts);
+    formatStat(os, "RAS mispredicts", stats.ras_mispredicts, num_insts);
+    formatStat(os, "RAS underflow mispredicts", stats.ras_underflow_mispredicts, num_insts);
+    formatStat(os, "RAS overflows", model.getRASOverflows(), num_insts);
+    formatStat(os, "RAS underflows", model.getRASUnderflows(), num_insts);
+    formatStat(os, "Indirect branches", stats.indirect_branches, num_insts);
+    formatStat(os, "Indirect target mispredicts", stats.indirect_mispredicts, num_insts);
+    formatStat(os, "Decode redirects", stats.decode_redirects, num_insts);
+    formatStat(os, "Execute redirects", stats.execute_redirects, num_insts);
+    formatStat(os, "Total front-end penalty cycles", stats.penalty_cycles, num_insts);
+    os << std::endl;
+}
+
+int main(int argc, char** argv) {
+    static constexpr size_t NUM_BATCH_SLOTS = 8;
+
+    std::string trace;
+    std::string output_filename = "-";
+    std::vector<std::string> configs;
+    bool skip_non_user = false;
+    size_t batch_size = 4096;
+
+    try {
+        processCommandLine(argc, argv, trace, output_filename, configs, skip_non_user, batch_size);
+    }
+    catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
+        std::cerr << e.what() << std::endl;
+        return e.getCode();
+    }
+
+    std::vector<frontend_model::FrontEndWorker> workers;
+    workers.reserve(configs.size());
+    for(const auto& config: configs) {
+        workers.emplace_back(branch_predictor::PredictorParams(config));
+    }
+
+    OutputFileStream output_file(output_filename);
+
+    branch_predictor::BranchBatchBuffer buffer(workers.size(), NUM_BATCH_SLOTS, batch_size);
+    for(auto& worker: workers) {
+        worker.start(buffer);
+    }
+
+    uint64_t num_insts = 0;
+    try {
+        stf::STFBranchReader reader(trace, skip_non_user);
+        buffer.publishAll(reader, batch_size);
+        num_insts = reader.numInstsRead();
+    }
+    catch(...) {
+        // Let the workers drain whatever was published so that they can be joined
+        buffer.finish();
+        for(auto& worker: workers) {
+            worker.join();
+        }
+        throw;
+    }
+
+    for(auto& worker: workers) {
+        worker.join();
+    }
+
+    output_file << "Instructions: " << num_insts << std::endl << std::endl;
+    for(const auto& worker: workers) {
+        printReport(output_file, worker.getModel(), num_insts);
+    }
+
+    return 0;
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pc_table.hpp"
+#include "stf_bin.hpp"
+#include "stf_decoder.hpp"
+
+/**
+ * \struct HammockInfo
+ * \brief Describes a conditional branch that skips over a hammock
+ */
+struct HammockInfo {
+    uint32_t branch_opcode = 0;                         /**< Opcode of the branch */
+    size_t num_blocks = 1;                              /**< Number of basic blocks in the skipped region */
+    std::string mnemonic;                               /**< Mnemonic of the first skipped instruction */
+    std::vector<std::pair<uint64_t, uint32_t>> insts;   /**< PC and opcode of every skipped instruction */
+
+    /**
+     * Gets the number of skipped instructions
+     */
+    inline size_t length() const {
+        return insts.size();
+    }
+};
+
+/**
+ * \class StaticHammockTable
+ * \brief Finds every hammock branch in a binary from its static control flow graph
+ *
+ * The executable ranges of the binary are decoded with a linear sweep. A conditional branch with a forward
+ * target T and fall-through F is a hammock branch if the region [F, T):
+ *     - contains at most max_length instructions in at most max_blocks basic blocks
+ *     - is only entered at F, i.e. no direct branch outside the region targets an instruction after F
+ *     - is only left at T, i.e. every branch or jump in the region is a direct forward jump to an address in
+ *       (F, T], and there are no indirect jumps, exception returns or system calls
+ */
+class StaticHammockTable {
+    private:
+        static constexpr uint8_t COND_BRANCH_ = 1 << 0;   // Direct conditional branch
+        static constexpr uint8_t JUMP_ = 1 << 1;          // Direct unconditional jump
+        static constexpr uint8_t BARRIER_ = 1 << 2;       // Instruction that can never be part of a hammock
+
+        /**
+         * \struct StaticInst_
+         * \brief Decoded instruction from the linear sweep
+         */
+        struct StaticInst_ {
+            uint64_t pc;
+            uint64_t target;
+            uint32_t opcode;
+            uint8_t flags;
+        };
+
+        PCTable<HammockInfo> hammocks_;
+
+        static inline uint64_t opcodeSize_(const uint32_t opcode) {
+            return stf::STFDecoder::isCompressed(opcode) ? 2 : 4;
+        }
+
+        /**
+         * Decodes every instruction in the executable ranges of the binary
+         */
+        static std::vector<StaticInst_> sweep_(const STFBinary& binary,
+                                               stf::STFDecoder& decoder,
+                                               std::unordered_map<uint64_t, uint32_t>& target_counts) {
+            std::vector<StaticInst_> insts;
+
+            auto ranges = binary.getExecutableRanges();
+            std::sort(ranges.begin(),
+                      ranges.end(),
+                      [](const STFAddressRange& lhs, const STFAddressRange& rhs) { return lhs.startsBefore(rhs); });
+
+            for(const auto& range: ranges) {
+                uint64_t pc = range.startAddress();
+                while(pc + 2 <= range.endAddress()) {
+                    uint32_t opcode = binary.read<uint16_t>(pc);
+                    if(!stf::STFDecoder::isCompressed(opcode)) {
+                        if(pc + 4 > range.endAddress()) {
+                            break;
+                        }
+                        opcode = binary.read<uint32_t>(pc);
+                    }
+
+                    StaticInst_ inst{pc, 0, opcode, 0};
+                    decoder.decode(opcode);
+                    if(decoder.decodeFailed() || decoder.isExceptionReturn() || decoder.isSyscall()) {
+                        inst.flags = BARRIER_;
+                    }
+                    else if(decoder.isBranch()) {
+                        if(decoder.isIndirect() || decoder.isJalr()) {
+                            inst.flags = BARRIER_;
+                        }
+                        else {
+                            inst.target = pc + static_cast<uint64_t>(decoder.getSignedImmediate());
+                            inst.flags = decoder.isConditional() ? COND_BRANCH_ : JUMP_;
+                            ++target_counts[inst.target];
+                        }
+                    }
+
+                    insts.emplace_back(inst);
+                    pc += opcodeSize_(opcode);
+                }
+            }
+
+            return insts;
+        }
+
+        /**
+         * Checks whether the branch at insts[branch_idx] is a hammock branch and adds it to the table if it is
+         */
+        void analyzeBranch_(const std::vector<StaticInst_>& insts,
+                            const size_t branch_idx,
+                            const std::unordered_map<uint64_t, uint32_t>& target_counts,
+                            stf::STFDecoder& decoder,
+                            const size_t max_length,
+                            const size_t max_blocks) {
+            const auto& branch = insts[branch_idx];
+            const uint64_t entry = branch.pc + opcodeSize_(branch.opcode);
+            const uint64_t exit = branch.target;
+
+            if(exit <= entry) {
+                return;
+            }
+
+            std::unordered_map<uint64_t, uint32_t> internal_targets;
+            std::vector<uint64_t> leaders(1, entry);
+
+            uint64_t next_pc = entry;
+            size_t end_idx = branch_idx + 1;
+            for(; end_idx < insts.size() && insts[end_idx].pc < exit; ++end_idx) {
+                const auto& inst = insts[end_idx];
+                // Stop at gaps between executable ranges and at regions that are too long
+                if(inst.pc != next_pc || end_idx - branch_idx > max_length || (inst.flags & BARRIER_)) {
+                    return;
+                }
+
+                next_pc = inst.pc + opcodeSize_(inst.opcode);
+
+                if(inst.flags & (COND_BRANCH_ | JUMP_)) {
+                    if(inst.target <= inst.pc || inst.target > exit) {
+                        return;
+                    }
+
+                    ++internal_targets[inst.target];
+                    if(inst.target < exit) {
+                        leaders.emplace_back(inst.target);
+                    }
+                    if(next_pc < exit) {
+                        leaders.emplace_back(next_pc);
+                    }
+                }
+            }
+
+            // The region must end exactly at the branch target
+            if(next_pc != exit) {
+                return;
+            }
+
+            std::sort(leaders.begin(), leaders.end());
+            const size_t num_blocks = static_cast<size_t>(std::distance(leaders.begin(), std::unique(leaders.begin(), leaders.end())));
+            if(num_blocks > max_blocks) {
+                return;
+            }
+
+            // Any branch into the region from outside of it makes it multiple-entry
+            for(size_t i = branch_idx + 2; i < end_idx; ++i) {
+                const auto it = target_counts.find(insts[i].pc);
+                if(it == target_counts.end()) {
+                    continue;
+                }
+                const auto internal_it = internal_targets.find(insts[i].pc);
+                if(internal_it == internal_targets.end() || internal_it->second != it->second) {
+                    return;
+                }
+            }
+
+            auto& hammock = hammocks_[branch.pc];
+            hammock.branch_opcode = branch.opcode;
+            hammock.num_blocks = num_blocks;
+            hammock.mnemonic = decoder.decode(insts[branch_idx + 1].opcode).getMnemonic();
+            hammock.insts.reserve(end_idx - branch_idx - 1);
+            for(size_t i = branch_idx + 1; i < end_idx; ++i) {
+                hammock.insts.emplace_back(insts[i].pc, insts[i].opcode);
+            }
+        }
+
+    public:
+        /**
+         * Builds the hammock table for a binary
+         * \param binary Binary to analyze
+         * \param iem Instruction encoding mode used to decode the binary
+         * \param max_length Maximum number of instructions skipped by a hammock branch
+         * \param max_blocks Maximum number of basic blocks skipped by a hammock branch
+         */
+        StaticHammockTable(const STFBinary& binary,
+                           const stf::INST_IEM iem,
+                           const size_t max_length,
+                           const size_t max_blocks) {
+            stf_assert(max_length > 0, "Maximum hammock length must be greater than 0");
+            stf_assert(max_blocks > 0, "Maximum number of hammock basic blocks must be greater than 0");
+
+            stf::STFDecoder decoder(iem);
+            std::unordered_map<uint64_t, uint32_t> target_counts;
+            const auto insts = sweep_(binary, decoder, target_counts);
+
+            for(size_t i = 0; i < insts.size(); ++i) {
+                if(insts[i].flags & COND_BRANCH_) {
+                    analyzeBranch_(insts, i, target_counts, decoder, max_length, max_blocks);
+                }
+            }
+        }
+
+        /**
+         * Looks up a branch
+         * \returns Pointer to the hammock info for the branch, or nullptr if it is not a hammock branch
+         */
+        inline const HammockInfo* find(const uint64_t pc) const {
+            return hammocks_.find(pc);
+        }
+
+        /**
+         * Gets the number of hammock branches in the binary
+         */
+        inline size_t size() const {
+            return hammocks_.size();
+        }
+};
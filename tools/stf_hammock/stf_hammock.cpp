@@ -1,7 +1,6 @@
 #include <iostream>
 #include <map>
 #include <memory>
-#include <set>
 #include <string>
 
 #include <rapidjson/document.h>
@@ -11,6 +10,8 @@
 #include "stf_elf.hpp"
 #include "stf_decoder.hpp"
 #include "disassembler.hpp"
+#include "hammock_table.hpp"
+#include "pc_table.hpp"
 
 #include "print_utils.hpp"
 #include "stf_inst_reader.hpp"
@@ -22,6 +23,7 @@ void processCommandLine(int argc,
                         std::string& binary_file,
                         uint64_t& binary_offset,
                         size_t& hammock_length,
+                        size_t& hammock_blocks,
                         bool& elf,
                         bool& bin,
                         bool& only_dynamic,
@@ -29,7 +31,8 @@ void processCommandLine(int argc,
                         bool& show_disasm,
                         bool& enable_json) {
     trace_tools::CommandLineParser parser("stf_hammock");
-    parser.addFlag('H', "hammock_length", "How many instructions can be skipped in the hammock. Defaults to 1.");
+    parser.addFlag('H', "hammock_length", "How many instructions can be skipped in the hammock. Defaults to 1. Lengths > 1 require -e or -b.");
+    parser.addFlag('B', "hammock_blocks", "How many basic blocks can be skipped in the hammock. Defaults to 1. Requires -e or -b.");
     parser.addFlag('e', "elf", "ELF file to search for always-skipped instructions");
     parser.addFlag('b', "bin", "Binary file to search for always-skipped instructions");
     parser.addFlag('o', "offset", "VA offset for raw binary files. Defaults to 0x80000000.");
@@ -47,6 +50,8 @@ void processCommandLine(int argc,
 
     hammock_length = 1;
     parser.getArgumentValue('H', hammock_length);
+    hammock_blocks = 1;
+    parser.getArgumentValue('B', hammock_blocks);
 
     skip_non_user = parser.hasArgument('u');
     elf = parser.hasArgument('e');
@@ -65,25 +70,14 @@ void processCommandLine(int argc,
     show_disasm = parser.hasArgument('D');
     enable_json = parser.hasArgument('j');
 
+    parser.assertCondition(hammock_length > 0, "-H parameter must be greater than 0");
+    parser.assertCondition(hammock_blocks > 0, "-B parameter must be greater than 0");
+    parser.assertCondition(elf || bin || (hammock_length == 1 && !parser.hasArgument('B')),
+                           "Hammocks longer than 1 instruction can only be found with -e or -b");
+
     parser.getPositionalArgument(0, trace);
 }
 
-struct HammockInfo {
-    const uint32_t branch_opcode;
-    const uint64_t inst_pc;
-    const uint32_t inst_opcode;
-    const std::string mnemonic;
-
-    HammockInfo(const uint32_t branch_opcode, const uint64_t inst_pc, const uint32_t inst_opcode, const std::string& mnemonic) :
-        branch_opcode(branch_opcode),
-        inst_pc(inst_pc),
-        inst_opcode(inst_opcode),
-        mnemonic(mnemonic)
-    {
-    }
-
-};
-
 template<int COLUMN_WIDTH, int COLUMN_INDEX>
 void formatDisasmLine(std::ostream& os, const stf::Disassembler& dis, const uint64_t pc, const uint32_t opcode) {
     static_assert(COLUMN_WIDTH >= 16, "Column width must be >= 16");
@@ -98,6 +92,7 @@ int main(int argc, char** argv) {
     std::string trace;
     std::string binary_file;
     size_t hammock_length;
+    size_t hammock_blocks;
     uint64_t binary_offset = 0;
     bool elf = false;
     bool bin = false;
@@ -107,11 +102,7 @@ int main(int argc, char** argv) {
     bool enable_json = false;
 
     try {
-        processCommandLine(argc, argv, trace, binary_file, binary_offset, hammock_length, elf, bin, only_dynamic, skip_non_user, show_disasm, enable_json);
-        if(hammock_length != 1) {
-            throw trace_tools::CommandLineParser::EarlyExitException(1,
-                                                                     "Only length-1 hammock branches are currently supported.");
-        }
+        processCommandLine(argc, argv, trace, binary_file, binary_offset, hammock_length, hammock_blocks, elf, bin, only_dynamic, skip_non_user, show_disasm, enable_json);
     }
     catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
         std::cerr << e.what() << std::endl;
@@ -135,86 +126,71 @@ int main(int argc, char** argv) {
 
     stf::Disassembler dis(findElfFromTrace(trace), reader.getISA(), reader.getInitialIEM(), false);
 
-    bool last_was_nt_branch = false;
-    uint64_t last_branch_target = 0;
-    uint64_t last_branch_pc = 0;
-    uint32_t last_branch_opcode = 0;
-    stf::STFDecoder decoder(reader.getInitialIEM());
-    std::map<uint64_t, std::pair<uint64_t, uint64_t>> branch_counts;
-    std::set<uint64_t> hammock_branches;
-    std::map<uint64_t, HammockInfo> hammock_info;
-
-    // First find all instances of a not-taken conditional branch
-    for(const auto& inst: reader) {
-        // If it's a taken branch, we won't be able to tell what the next sequential instruction is.
-        // So, we count it and check later if it was an actual hammock candidate
-        if(STF_EXPECT_FALSE(inst.isTakenBranch())) {
-            last_was_nt_branch = false;
-            ++branch_counts[inst.pc()].first;
-            if(binary) {
-                decoder.decode(inst.opcode());
-                if(!decoder.isInstType(mavis::InstMetaData::InstructionTypes::CONDITIONAL)) {
-                    continue;
-                }
+    PCTable<std::pair<uint64_t, uint64_t>> branch_counts;
+    PCTable<HammockInfo> hammock_info;
 
-                const auto next_pc = inst.pc() + inst.opcodeSize();
-                if(inst.branchTarget() > next_pc) {
-                    const auto branch_distance = (inst.branchTarget() - next_pc);
-
-                    uint32_t opcode = 0;
-                    if(branch_distance == 2) {
-                        opcode = binary->read<uint16_t>(next_pc);
-                    }
-                    else if(branch_distance == 4) {
-                        opcode = binary->read<uint32_t>(next_pc);
-                        // Make sure the next instruction isn't compressed
-                        // If it is, then this branch is skipping over more than 1 instruction
-                        if(stf::STFDecoder::isCompressed(opcode)) {
-                            continue;
-                        }
-                    }
+    if(binary) {
+        // Every hammock is found statically, so the trace pass only has to count the branches
+        const StaticHammockTable hammock_table(*binary, reader.getInitialIEM(), hammock_length, hammock_blocks);
+
+        for(const auto& inst: reader) {
+            if(const auto* hammock = hammock_table.find(inst.pc()); STF_EXPECT_FALSE(hammock != nullptr)) {
+                auto& counts = branch_counts[inst.pc()];
+                if(inst.isTakenBranch()) {
+                    ++counts.first;
+                }
+                else {
+                    ++counts.second;
+                }
 
-                    if(opcode) {
-                        decoder.decode(opcode);
-                        hammock_branches.insert(inst.pc());
-                        hammock_info.emplace(std::piecewise_construct,
-                                             std::forward_as_tuple(inst.pc()),
-                                             std::forward_as_tuple(inst.opcode(),
-                                                                   next_pc,
-                                                                   opcode,
-                                                                   decoder.getMnemonic()));
-                    }
+                if(auto [info, new_hammock] = hammock_info.tryEmplace(inst.pc()); STF_EXPECT_FALSE(new_hammock)) {
+                    info = *hammock;
                 }
             }
-            continue;
         }
+    }
+    else {
+        bool last_was_nt_branch = false;
+        uint64_t last_branch_target = 0;
+        uint64_t last_branch_pc = 0;
+        uint32_t last_branch_opcode = 0;
+        stf::STFDecoder decoder(reader.getInitialIEM());
+
+        // Without a binary, hammocks can only be found from not-taken instances of a conditional branch
+        for(const auto& inst: reader) {
+            // If it's a taken branch, we won't be able to tell what the next sequential instruction is.
+            // So, we count it and check later if it was an actual hammock candidate
+            if(STF_EXPECT_FALSE(inst.isTakenBranch())) {
+                last_was_nt_branch = false;
+                ++branch_counts[inst.pc()].first;
+                continue;
+            }
 
-        decoder.decode(inst.opcode());
+            decoder.decode(inst.opcode());
 
-        if(STF_EXPECT_FALSE(decoder.isBranch() && decoder.isConditional())) {
-            last_was_nt_branch = true;
-            // Compute the target
-            ++branch_counts[inst.pc()].second;
-            last_branch_target = inst.pc() + static_cast<uint64_t>(decoder.getSignedImmediate());
-            last_branch_pc = inst.pc();
-            last_branch_opcode = inst.opcode();
-            continue;
-        }
+            if(STF_EXPECT_FALSE(decoder.isBranch() && decoder.isConditional())) {
+                last_was_nt_branch = true;
+                // Compute the target
+                ++branch_counts[inst.pc()].second;
+                last_branch_target = inst.pc() + static_cast<uint64_t>(decoder.getSignedImmediate());
+                last_branch_pc = inst.pc();
+                last_branch_opcode = inst.opcode();
+                continue;
+            }
 
-        if(STF_EXPECT_FALSE(last_was_nt_branch)) {
-            const auto next_pc = inst.pc() + inst.opcodeSize();
-            if(last_branch_target == next_pc) {
-                hammock_branches.insert(last_branch_pc);
-                hammock_info.emplace(std::piecewise_construct,
-                                     std::forward_as_tuple(last_branch_pc),
-                                     std::forward_as_tuple(last_branch_opcode,
-                                                           inst.pc(),
-                                                           inst.opcode(),
-                                                           decoder.getMnemonic()));
+            if(STF_EXPECT_FALSE(last_was_nt_branch)) {
+                const auto next_pc = inst.pc() + inst.opcodeSize();
+                if(last_branch_target == next_pc) {
+                    if(auto [hammock, new_hammock] = hammock_info.tryEmplace(last_branch_pc); new_hammock) {
+                        hammock.branch_opcode = last_branch_opcode;
+                        hammock.mnemonic = decoder.getMnemonic();
+                        hammock.insts.emplace_back(inst.pc(), inst.opcode());
+                    }
+                }
             }
-        }
 
-        last_was_nt_branch = false;
+            last_was_nt_branch = false;
+        }
     }
 
     static constexpr int COLUMN_WIDTH = 20;
@@ -224,7 +200,7 @@ int main(int argc, char** argv) {
     auto& d_alloc = d.GetAllocator();
     rapidjson::Value pc_results(rapidjson::kObjectType);
 
-    for(const auto pc: hammock_branches) {
+    for(const auto& [pc, hammock_ptr]: hammock_info.getSortedEntries()) {
         const auto& counts = branch_counts[pc];
         const auto taken = counts.first;
         const auto not_taken = counts.second;
@@ -232,7 +208,7 @@ int main(int argc, char** argv) {
             continue;
         }
         const auto total = taken + not_taken;
-        const auto& hammock = hammock_info.at(pc);
+        const auto& hammock = *hammock_ptr;
         mnemonic_counts[hammock.mnemonic] += total;
 
         if(enable_json) {
@@ -241,6 +217,8 @@ int main(int argc, char** argv) {
             pc_result.AddMember("taken", (uint64_t)taken, d_alloc);
             pc_result.AddMember("not_taken", (uint64_t)not_taken, d_alloc);
             pc_result.AddMember("mnemonic", rapidjson::Value(hammock.mnemonic.c_str(), d_alloc).Move(), d_alloc);
+            pc_result.AddMember("length", (uint64_t)hammock.length(), d_alloc);
+            pc_result.AddMember("blocks", (uint64_t)hammock.num_blocks, d_alloc);
             os << std::hex << pc;
             pc_results.AddMember(rapidjson::Value(os.str().c_str(), d_alloc).Move(), pc_result, d_alloc);
             os.str("");
@@ -252,11 +230,15 @@ int main(int argc, char** argv) {
             stf::format_utils::formatDecLeft(os, taken, COLUMN_WIDTH);
             stf::format_utils::formatDecLeft(os, not_taken, COLUMN_WIDTH);
             stf::format_utils::formatLeft(os, hammock.mnemonic, COLUMN_WIDTH);
+            stf::format_utils::formatDecLeft(os, hammock.length(), COLUMN_WIDTH);
+            stf::format_utils::formatDecLeft(os, hammock.num_blocks, COLUMN_WIDTH);
             os << std::endl;
 
             if(show_disasm) {
                 formatDisasmLine<COLUMN_WIDTH, 4>(os, dis, pc, hammock.branch_opcode);
-                formatDisasmLine<COLUMN_WIDTH, 4>(os, dis, hammock.inst_pc, hammock.inst_opcode);
+                for(const auto& [inst_pc, inst_opcode]: hammock.insts) {
+                    formatDisasmLine<COLUMN_WIDTH, 4>(os, dis, inst_pc, inst_opcode);
+                }
             }
         }
     }
@@ -290,6 +272,8 @@ int main(int argc, char** argv) {
         stf::print_utils::printLeft("Taken Count", COLUMN_WIDTH);
         stf::print_utils::printLeft("Not Taken Count", COLUMN_WIDTH);
         stf::print_utils::printLeft("Inst Mnemonic", COLUMN_WIDTH);
+        stf::print_utils::printLeft("Length", COLUMN_WIDTH);
+        stf::print_utils::printLeft("Blocks", COLUMN_WIDTH);
         if(show_disasm) {
             stf::print_utils::printLeft("Instruction PC", COLUMN_WIDTH);
             stf::print_utils::printLeft("Disassembly", COLUMN_WIDTH);
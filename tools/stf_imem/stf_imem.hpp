@@ -488,6 +488,25 @@ class IMemMapVec {
 
         virtual ~IMemMapVec() = default;
 
+        /**
+         * Initializes the map from the trace header
+         * \param inst_set Instruction set of the trace
+         * \param iem Initial instruction encoding mode of the trace
+         */
+        void init(const stf::ISA inst_set, const stf::INST_IEM iem) {
+            inst_set_ = inst_set;
+            iem_ = iem;
+            is_rv64_ = iem_ == stf::INST_IEM::STF_INST_IEM_RV64;
+        }
+
+        /**
+         * Counts an instruction. init() must be called first.
+         * \param config Configuration
+         * \param inst Instruction to count
+         * \returns false once the configured number of instructions has been counted
+         */
+        virtual bool processInst(const STFImemConfig& config, const stf::STFInst& inst) = 0;
+
         /**
          * Processes a trace
          * \param config Configuration
@@ -653,6 +672,50 @@ class IMemMapVec {
 template<typename ImplType>
 class IMemMapVecIntf : public IMemMapVec {
     public:
+        /**
+         * Counts an instruction
+         * \param config Configuration
+         * \param inst Instruction to count
+         * \returns false once the configured number of instructions has been counted
+         */
+        bool processInst(const STFImemConfig& config, const stf::STFInst& inst) final {
+            if (STF_EXPECT_FALSE(inst_count_skipped_ < config.skip_count)) {
+                ++inst_count_skipped_;
+                return true;
+            }
+            if (STF_EXPECT_FALSE(inst_count_ >= config.keep_count)) {
+                return false;
+            }
+
+            if (STF_EXPECT_FALSE(!inst.valid())) {
+                std::cerr << "ERROR: " << inst.index() << " invalid instruction ";
+                stf::format_utils::formatHex(std::cerr, inst.opcode());
+                std::cerr << " PC ";
+                stf::format_utils::formatHex(std::cerr, inst.pc());
+                std::cerr << std::endl;
+            }
+
+            if (STF_EXPECT_FALSE(config.g_hw_tid != 0 && config.g_hw_tid != inst.hwtid())) {
+                return true;
+            }
+            if (STF_EXPECT_FALSE(config.g_pid != 0 && config.g_pid != inst.pid())) {
+                return true;
+            }
+            if (STF_EXPECT_FALSE(config.g_tid != 0 && config.g_tid != inst.tid())) {
+                return true;
+            }
+
+            // ignore faulting instructions since they will be replayed
+            if (STF_EXPECT_FALSE(inst.isFault())) {
+                return true;
+            }
+
+            static_cast<ImplType*>(this)->count_impl(config, inst);
+
+            ++inst_count_;
+            return true;
+        }
+
         /**
          * Processes a trace
          * \param config Configuration
@@ -660,46 +723,12 @@ class IMemMapVecIntf : public IMemMapVec {
         void processTrace(const STFImemConfig& config) final {
             stf::STFInstReader stf_reader(config.trace_filename, config.skip_non_user);
 
-            uint64_t inst_count_skipped = 0;
-            inst_set_ = stf_reader.getISA();
-            iem_ = stf_reader.getInitialIEM();
-            is_rv64_ = iem_ == stf::INST_IEM::STF_INST_IEM_RV64;
+            init(stf_reader.getISA(), stf_reader.getInitialIEM());
 
             for (const auto& inst: stf_reader) {
-                if (STF_EXPECT_FALSE(inst_count_skipped < config.skip_count)) {
-                    ++inst_count_skipped;
-                    continue;
-                }
-                if (STF_EXPECT_FALSE(inst_count_ >= config.keep_count)) {
+                if (STF_EXPECT_FALSE(!processInst(config, inst))) {
                     break;
                 }
-
-                if (STF_EXPECT_FALSE(!inst.valid())) {
-                    std::cerr << "ERROR: " << inst.index() << " invalid instruction ";
-                    stf::format_utils::formatHex(std::cerr, inst.opcode());
-                    std::cerr << " PC ";
-                    stf::format_utils::formatHex(std::cerr, inst.pc());
-                    std::cerr << std::endl;
-                }
-
-                if (STF_EXPECT_FALSE(config.g_hw_tid != 0 && config.g_hw_tid != inst.hwtid())) {
-                    continue;
-                }
-                if (STF_EXPECT_FALSE(config.g_pid != 0 && config.g_pid != inst.pid())) {
-                    continue;
-                }
-                if (STF_EXPECT_FALSE(config.g_tid != 0 && config.g_tid != inst.tid())) {
-                    continue;
-                }
-
-                // ignore faulting instructions since they will be replayed
-                if (STF_EXPECT_FALSE(inst.isFault())) {
-                    continue;
-                }
-
-                static_cast<ImplType*>(this)->count_impl(config, inst);
-
-                ++inst_count_;
             }
         }
 };
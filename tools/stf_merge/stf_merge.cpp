@@ -11,24 +11,30 @@
  */
 
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <map>
+#include <set>
+#include <tuple>
 #include <vector>
 
 #include "command_line_parser.hpp"
 #include "stf_merge.hpp"
 #include "tools_util.hpp"
 
+static constexpr size_t DEFAULT_MAX_CACHED_RECORDS = 10000000;
+
 /**
  * \brief Parse the command line options
  *
  */
-static std::pair<FileList, std::string> parseCommandLine (int argc, char **argv) {
+static std::tuple<FileList, std::string, size_t> parseCommandLine (int argc, char **argv) {
     // Parse options
     uint64_t bcount = 1;
     uint64_t ecount = std::numeric_limits<uint64_t>::max();
     uint64_t repeat = 1;
     std::string output_filename = "-";
+    size_t max_cached_records = DEFAULT_MAX_CACHED_RECORDS;
     FileList tracelist;
 
     trace_tools::CommandLineParser parser("stf_merge");
@@ -38,11 +44,13 @@ static std::pair<FileList, std::string> parseCommandLine (int argc, char **argv)
     parser.addMultiFlag('r', "K", "repeat the specified intruction interval [N, M) K times. Default is 1.");
     parser.addMultiFlag('f', "trace", "filename of input trace", true, "Must specify at least 1 input trace.");
     parser.addFlag('o', "trace", "output trace filename. stdout is default");
+    parser.addFlag('c', "N", "cache up to N records from intervals that are repeated or used again, so they can be written again without re-reading the trace. Traces whose intervals are used out of order are read forward once to fill the cache. Also limits the number of PID/PTE records logged per trace for replays. 0 disables the cache. Default is " + std::to_string(DEFAULT_MAX_CACHED_RECORDS) + ".");
     parser.appendHelpText("-b, -e, -r, and -f flags can be specified multiple times for merging multiple traces");
 
     parser.parseArguments(argc, argv);
 
     parser.getArgumentValue('o', output_filename);
+    parser.getArgumentValue('c', max_cached_records);
 
     for(const auto& arg: parser) {
         switch(arg.getFlag()) {
@@ -69,21 +77,166 @@ static std::pair<FileList, std::string> parseCommandLine (int argc, char **argv)
         }
     }
 
-    return std::make_pair(tracelist, output_filename);
+    return std::make_tuple(tracelist, output_filename, max_cached_records);
+}
+
+/**
+ * \brief Checks whether extracting an interval requires reopening its trace
+ */
+static bool needsReopen(const FileList& tracelist, const size_t idx) {
+    return idx == 0 ||
+           tracelist[idx].filename != tracelist[idx - 1].filename ||
+           tracelist[idx].start < tracelist[idx - 1].end;
+}
+
+/**
+ * \brief Checks whether an interval can be replayed from the cache
+ *
+ * A replay produces the same PID and page table state as reopening the trace and skipping to the interval, so the
+ * interval itself has to be one that reopens the trace. The interval after it must also reopen the trace, since a
+ * replay does not leave the reader at the end of the interval.
+ */
+static bool isReplayable(const FileList& tracelist, const size_t idx) {
+    return needsReopen(tracelist, idx) && (idx + 1 == tracelist.size() || needsReopen(tracelist, idx + 1));
+}
+
+/**
+ * \brief Finds the last time each interval will be written, so that intervals can be cached for as long
+ * as they are needed
+ *
+ * Later occurrences of an interval are only replayed from the cache if isReplayable() allows it. Otherwise they
+ * are extracted from the trace again.
+ */
+static std::vector<size_t> findLastUses(const FileList& tracelist) {
+    std::vector<size_t> last_use(tracelist.size());
+    std::map<std::tuple<std::string, uint64_t, uint64_t>, size_t> last_replayable;
+
+    for(size_t i = tracelist.size(); i-- > 0;) {
+        const auto& f = tracelist[i];
+        const auto key = std::make_tuple(f.filename, f.start, f.end);
+        const auto it = last_replayable.find(key);
+        last_use[i] = it == last_replayable.end() ? i : it->second;
+
+        if(isReplayable(tracelist, i)) {
+            last_replayable.emplace(key, last_use[i]);
+        }
+    }
+
+    return last_use;
+}
+
+/**
+ * \brief Finds the traces that would be reopened and skipped through more than once if their intervals were
+ * extracted in command-line order
+ */
+static std::set<std::string> findRereadTraces(const FileList& tracelist) {
+    std::map<std::string, size_t> num_reopens;
+    std::set<std::string> reread_traces;
+
+    for(size_t i = 0; i < tracelist.size(); ++i) {
+        if(needsReopen(tracelist, i) && ++num_reopens[tracelist[i].filename] > 1) {
+            reread_traces.insert(tracelist[i].filename);
+        }
+    }
+
+    return reread_traces;
 }
 
-void processFiles(stf::STFWriter& writer, const FileList& tracelist) {
+void processFiles(stf::STFWriter& writer, const FileList& tracelist, const size_t max_cached_records) {
+    using IntervalKey = std::tuple<std::string, uint64_t, uint64_t>;
+
     stf::STF_PTE page_table(nullptr, nullptr, true);
     stf::STFReader reader;
-    STFMergeExtractor extractor;
+    std::string reader_filename;
+    STFMergeExtractor extractor(max_cached_records);
     bool reopen_trace = true;
     auto last_it = tracelist.begin();
 
+    const auto last_use = findLastUses(tracelist);
+    std::map<IntervalKey, STFMergeExtractor::CachedInterval> cache;
+    size_t num_cached_records = 0;
+
+    // Traces whose intervals are revisited out of order are read forward once, in order of interval start point,
+    // and all of their intervals are cached up front. The output order is still the command-line order.
+    const auto reread_traces = max_cached_records ? findRereadTraces(tracelist) : std::set<std::string>();
+    std::set<std::string> precached_traces;
+
+    const auto precache_trace = [&](const std::string& filename) {
+        // Only intervals that can be replayed at least once are worth caching
+        std::vector<STFMergeExtractor::PendingInterval> intervals;
+        for(size_t i = 0; i < tracelist.size(); ++i) {
+            const auto& f = tracelist[i];
+            const auto key = std::make_tuple(f.filename, f.start, f.end);
+            if(f.filename == filename && isReplayable(tracelist, i) && cache.count(key) == 0) {
+                intervals.push_back({f.start, f.end, &cache[key]});
+            }
+        }
+
+        std::sort(intervals.begin(),
+                  intervals.end(),
+                  [](const auto& lhs, const auto& rhs) { return lhs.start < rhs.start; });
+
+        stf::STFReader precache_reader(filename);
+        stf_assert(precache_reader, "Failed to open input trace " << filename);
+        STFMergeExtractor precache_extractor(max_cached_records);
+        num_cached_records += precache_extractor.cacheIntervals(precache_reader,
+                                                                intervals,
+                                                                max_cached_records - num_cached_records);
+
+        for(const auto& interval: intervals) {
+            if(!interval.cache->complete) {
+                cache.erase(std::make_tuple(filename, interval.start, interval.end));
+            }
+        }
+    };
+
+    const auto open_trace = [&reader, &reader_filename, &extractor](const std::string& filename) {
+        if(reader) {
+            reader.close();
+        }
+        reader.open(filename);
+        stf_assert(reader, "Failed to open input trace " << filename);
+        reader_filename = filename;
+        extractor.startTrace();
+    };
+
     for (auto it = tracelist.begin(); it != tracelist.end(); ++it) {
         const auto& f = *it;
+        const size_t idx = static_cast<size_t>(std::distance(tracelist.begin(), it));
+        const auto key = std::make_tuple(f.filename, f.start, f.end);
         uint64_t num_to_skip = f.start - 1;
         const uint64_t num_to_extract = f.end - f.start;
 
+        if(reread_traces.count(f.filename) != 0 &&
+           precached_traces.insert(f.filename).second &&
+           max_cached_records > num_cached_records) {
+            precache_trace(f.filename);
+        }
+
+        const bool replayable = isReplayable(tracelist, idx);
+        const auto cache_it = cache.find(key);
+
+        if(cache_it != cache.end() && replayable) {
+            // This interval has already been extracted, so replay it instead of skipping to it again.
+            // The trace only needs to be opened for its header.
+            if(reader_filename != f.filename) {
+                open_trace(f.filename);
+            }
+
+            for(uint64_t i = 0; i < f.repeat; ++i) {
+                extractor.replayInsts(reader, writer, cache_it->second, page_table);
+            }
+
+            if(last_use[idx] == idx) {
+                num_cached_records -= cache_it->second.records.size();
+                cache.erase(cache_it);
+            }
+
+            last_it = it;
+            reopen_trace = true;
+            continue;
+        }
+
         if(!reopen_trace) {
             if(f.filename != last_it->filename || f.start < last_it->end) {
                 reopen_trace = true;
@@ -93,23 +246,56 @@ void processFiles(stf::STFWriter& writer, const FileList& tracelist) {
             }
         }
 
+        STFMergeExtractor::CachedInterval* cached_interval = nullptr;
+        bool fill_cache = false;
+        if(cache_it != cache.end()) {
+            cached_interval = &cache_it->second;
+        }
+        else if(max_cached_records > num_cached_records && (f.repeat > 1 || last_use[idx] != idx)) {
+            cached_interval = &cache[key];
+            fill_cache = true;
+        }
+
         for(uint64_t i = 0; i < f.repeat; ++i) {
+            if(i > 0 && cached_interval && cached_interval->complete) {
+                extractor.replayInsts(reader, writer, *cached_interval, page_table);
+                continue;
+            }
+
             if(reopen_trace || i > 0) {
-                if(reader) {
-                    reader.close();
-                }
-                reader.open(f.filename);
+                open_trace(f.filename);
             }
 
-            stf_assert(reader, "Failed to open input trace " << f.filename);
+            // A repeat always starts from the beginning of the trace
+            if(i > 0) {
+                num_to_skip = f.start - 1;
+            }
 
             stf_assert(extractor.extractSkip(reader, num_to_skip, page_table) == num_to_skip,
                        "Tried to skip past the end of the trace.");
 
-            stf_assert(extractor.extractInsts(reader, writer, num_to_extract, page_table) == num_to_extract,
+            stf_assert(extractor.extractInsts(reader,
+                                              writer,
+                                              num_to_extract,
+                                              page_table,
+                                              fill_cache && i == 0 ? cached_interval : nullptr,
+                                              max_cached_records - num_cached_records) == num_to_extract,
                        "Tried to extract past the end of the trace.");
         }
 
+        if(fill_cache) {
+            if(cached_interval->complete && last_use[idx] != idx) {
+                num_cached_records += cached_interval->records.size();
+            }
+            else {
+                cache.erase(key);
+            }
+        }
+        else if(cached_interval && last_use[idx] == idx) {
+            num_cached_records -= cached_interval->records.size();
+            cache.erase(key);
+        }
+
         last_it = it;
         reopen_trace = false;
     }
@@ -118,9 +304,10 @@ void processFiles(stf::STFWriter& writer, const FileList& tracelist) {
 int main(int argc, char **argv) {
     FileList tracelist;
     std::string output_filename;
+    size_t max_cached_records;
 
     try {
-        std::tie(tracelist, output_filename) = parseCommandLine (argc, argv);
+        std::tie(tracelist, output_filename, max_cached_records) = parseCommandLine (argc, argv);
     }
     catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
         std::cerr << e.what() << std::endl;
@@ -131,7 +318,7 @@ int main(int argc, char **argv) {
     stf::STFWriter writer(output_filename);
     stf_assert(writer, "Failed to open output trace.");
 
-    processFiles(writer, tracelist);
+    processFiles(writer, tracelist, max_cached_records);
 
     writer.close();
 
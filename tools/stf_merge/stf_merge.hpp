@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "stf_pte.hpp"
@@ -31,13 +34,144 @@ struct ExtractFileInfo {
 using FileList = std::vector<ExtractFileInfo>;
 
 class STFMergeExtractor {
+    public:
+        /**
+         * List of records, each tagged with the instruction count it was processed with
+         */
+        using RecordLog = std::vector<std::pair<uint64_t, stf::STFRecord::UniqueHandle>>;
+
+        /**
+         * \struct CachedInterval
+         * \brief Records from an extracted interval, kept so that the interval can be replayed without
+         * reopening the trace and skipping to it again
+         */
+        struct CachedInterval {
+            std::shared_ptr<const RecordLog> state_log; /**< PID and PTE records read since the trace was opened */
+            size_t num_state_records = 0; /**< Number of state_log records that precede the interval */
+            uint64_t pc = 0; /**< PC at the start of the interval */
+            uint64_t num_insts = 0; /**< Number of instructions in the interval */
+            RecordLog records; /**< Every record in the interval */
+            bool complete = false; /**< Set if every record in the interval fit in the cache */
+        };
+
+        /**
+         * \struct PendingInterval
+         * \brief An interval to be read into the cache by cacheIntervals()
+         */
+        struct PendingInterval {
+            uint64_t start; /**< First instruction of the interval (1-based, inclusive) */
+            uint64_t end; /**< End of the interval (exclusive) */
+            CachedInterval* cache; /**< Where to save the interval's records */
+        };
+
     private:
         uint32_t inst_hw_tid_ = 0;
         uint32_t inst_pid_ = 0;
         uint32_t inst_tid_ = 0;
         stf::RecordMap record_map_;
+        std::shared_ptr<RecordLog> state_log_ = std::make_shared<RecordLog>(); /**< PID and PTE records read since the trace was opened */
+        size_t max_state_records_; /**< Maximum size of state_log_ */
+        bool state_log_overflowed_ = false; /**< Set if state_log_ hit its limit, so later intervals cannot be cached */
+
+        static inline bool isStateRecord_(const stf::STFRecord& rec) {
+            return rec.getId() == stf::descriptors::internal::Descriptor::STF_PROCESS_ID_EXT ||
+                   rec.getId() == stf::descriptors::internal::Descriptor::STF_PAGE_TABLE_WALK;
+        }
+
+        /**
+         * Saves a copy of a record that affects the PID or page table state, along with the absolute
+         * instruction count that skipping over it from the beginning of the trace would process it with
+         */
+        inline void logState_(const stf::STFRecord::UniqueHandle& rec, const uint64_t abs_inst_count) {
+            if(STF_EXPECT_FALSE(isStateRecord_(*rec) && !state_log_overflowed_)) {
+                if(STF_EXPECT_FALSE(state_log_->size() == max_state_records_)) {
+                    // Intervals from here on can't be replayed, so there is no point in logging any more
+                    state_log_overflowed_ = true;
+                    return;
+                }
+                state_log_->emplace_back(abs_inst_count, rec->clone());
+            }
+        }
+
+        /**
+         * Starts saving an interval to a cache at the current position of the reader
+         */
+        inline void beginCache_(const stf::STFReader& stf_reader, CachedInterval& cache) const {
+            cache.state_log = state_log_;
+            cache.num_state_records = state_log_->size();
+            cache.pc = stf_reader.getPC();
+            // The state preceding the interval is unknown if the log overflowed
+            cache.complete = !state_log_overflowed_;
+        }
+
+        /**
+         * Saves a record to an interval's cache, or marks the interval incomplete if the cache is full
+         * \returns true if the record was saved
+         */
+        static inline bool cacheRecord_(CachedInterval& cache,
+                                        const stf::STFRecord::UniqueHandle& rec,
+                                        const uint64_t count,
+                                        const bool full) {
+            if(!cache.complete) {
+                return false;
+            }
+            if(STF_EXPECT_FALSE(full)) {
+                // Too big to cache - it will have to be re-read from the trace instead
+                cache.complete = false;
+                cache.records = RecordLog();
+                return false;
+            }
+            cache.records.emplace_back(count, rec->clone());
+            return true;
+        }
+
+        /**
+         * Writes the header of an extracted interval
+         */
+        void writeHeader_(stf::STFReader& stf_reader,
+                          stf::STFWriter& stf_writer,
+                          const uint64_t pc,
+                          stf::STF_PTE& page_table) const {
+            // Indicate the input file had been read in the past;
+            // The trace_info and instruction initial info, such as
+            // pc, physical pc are required to written in new output file.
+            stf_reader.copyHeader(stf_writer);
+            stf_writer.addTraceInfo(stf::TraceInfoRecord(stf::STF_GEN::STF_GEN_STF_MERGE,
+                                                         stf::STF_CUR_VERSION_MAJOR,
+                                                         stf::STF_CUR_VERSION_MINOR,
+                                                         0,
+                                                         "Merge trace generated by stf_merge"));
+            stf_writer.setHeaderPC(pc);
+            if(stf_reader.getTraceFeatures()->hasFeature(stf::TRACE_FEATURES::STF_CONTAIN_PROCESS_ID)) {
+                stf_writer << stf::ProcessIDExtRecord(inst_hw_tid_, inst_pid_, inst_tid_);
+            }
+
+            stf_writer.finalizeHeader();
+
+            if(stf_reader.getTraceFeatures()->hasFeature(stf::TRACE_FEATURES::STF_CONTAIN_PTE)) {
+                page_table.DumpPTEtoSTF(stf_writer);
+            }
+        }
 
     public:
+        /**
+         * \brief Constructs an STFMergeExtractor
+         * \param max_state_records Maximum number of PID and PTE records to log for replaying cached intervals
+         */
+        explicit STFMergeExtractor(const size_t max_state_records) :
+            max_state_records_(max_state_records)
+        {
+        }
+
+        /**
+         * \brief Must be called whenever the input trace is (re)opened
+         */
+        void startTrace() {
+            // Cached intervals may still refer to the old log, so start a new one instead of clearing it
+            state_log_ = std::make_shared<RecordLog>();
+            state_log_overflowed_ = false;
+        }
+
         /**
          * \brief Helper function to parse the Escape record for thread id information;
          *  return 1 if the record is opcode record, otherwise return 0;
@@ -114,6 +248,7 @@ class STFMergeExtractor {
             // Process trace records
             try {
                 while ((stf_reader.numInstsRead() < end_inst) && (stf_reader >> rec)) {
+                    logState_(rec, stf_reader.numInstsRead());
                     processRecord(rec, page_table, stf_reader.numInstsRead()) ;
                 }
             }
@@ -126,32 +261,23 @@ class STFMergeExtractor {
         /**
          * \brief extract instcount instructions; and update TLB page table;
          * return number of instructions written;
+         *
+         * \param cache If not null, the interval's records are saved to it so that it can be replayed later
+         * \param max_cached_records Maximum number of records to save to cache
          */
         uint64_t extractInsts(stf::STFReader& stf_reader,
                                stf::STFWriter& stf_writer,
                                const uint64_t instcount,
-                               stf::STF_PTE &page_table) {
+                               stf::STF_PTE &page_table,
+                               CachedInterval* cache = nullptr,
+                               const size_t max_cached_records = 0) {
             stf::STFRecord::UniqueHandle rec;
 
-            // Indicate the input file had been read in the past;
-            // The trace_info and instruction initial info, such as
-            // pc, physical pc are required to written in new output file.
-            stf_reader.copyHeader(stf_writer);
-            stf_writer.addTraceInfo(stf::TraceInfoRecord(stf::STF_GEN::STF_GEN_STF_MERGE,
-                                                         stf::STF_CUR_VERSION_MAJOR,
-                                                         stf::STF_CUR_VERSION_MINOR,
-                                                         0,
-                                                         "Merge trace generated by stf_merge"));
-            stf_writer.setHeaderPC(stf_reader.getPC());
-            if(stf_reader.getTraceFeatures()->hasFeature(stf::TRACE_FEATURES::STF_CONTAIN_PROCESS_ID)) {
-                stf_writer << stf::ProcessIDExtRecord(inst_hw_tid_, inst_pid_, inst_tid_);
+            if(cache) {
+                beginCache_(stf_reader, *cache);
             }
 
-            stf_writer.finalizeHeader();
-
-            if(stf_reader.getTraceFeatures()->hasFeature(stf::TRACE_FEATURES::STF_CONTAIN_PTE)) {
-                page_table.DumpPTEtoSTF(stf_writer);
-            }
+            writeHeader_(stf_reader, stf_writer, stf_reader.getPC(), page_table);
 
             const uint64_t init_count = stf_reader.numInstsRead();
             uint64_t count = 0;
@@ -159,6 +285,10 @@ class STFMergeExtractor {
             try {
                 while ((count < instcount) && (stf_reader >> rec)) {
                     count = stf_reader.numInstsRead() - init_count;
+                    if(cache) {
+                        cacheRecord_(*cache, rec, count, cache->records.size() == max_cached_records);
+                    }
+                    logState_(rec, stf_reader.numInstsRead());
                     processRecord(rec, page_table, count);
                     stf_writer << *rec;
                 }
@@ -166,7 +296,125 @@ class STFMergeExtractor {
             catch(const stf::EOFException&) {
             }
 
+            if(cache) {
+                cache->num_insts = count;
+            }
+
             std::cerr << "Output " << count << " instructions" << std::endl;
             return count;
         }
+
+        /**
+         * \brief Reads a freshly opened trace forward once, saving the records of every interval to its cache
+         * without writing anything. Intervals may overlap. Intervals that do not fit in the cache are marked
+         * incomplete.
+         * return number of records cached;
+         *
+         * \param intervals Intervals to cache, sorted by start point
+         * \param max_cached_records Maximum number of records to save across all of the intervals
+         */
+        size_t cacheIntervals(stf::STFReader& stf_reader,
+                              const std::vector<PendingInterval>& intervals,
+                              const size_t max_cached_records) {
+            stf::STFRecord::UniqueHandle rec;
+            std::vector<const PendingInterval*> active;
+            size_t num_cached = 0;
+            auto next_it = intervals.begin();
+
+            try {
+                while(true) {
+                    const uint64_t inst_count = stf_reader.numInstsRead();
+
+                    // Skipping start - 1 instructions leaves the reader exactly here
+                    for(; next_it != intervals.end() && next_it->start - 1 == inst_count; ++next_it) {
+                        beginCache_(stf_reader, *next_it->cache);
+                        active.emplace_back(&*next_it);
+                    }
+
+                    // An interval ends once its last instruction has been read
+                    active.erase(std::remove_if(active.begin(),
+                                                active.end(),
+                                                [inst_count](const PendingInterval* const interval) {
+                                                    if(interval->end - 1 == inst_count) {
+                                                        interval->cache->num_insts = interval->end - interval->start;
+                                                        return true;
+                                                    }
+                                                    return false;
+                                                }),
+                                 active.end());
+
+                    if((active.empty() && next_it == intervals.end()) || num_cached == max_cached_records) {
+                        break;
+                    }
+
+                    if(!(stf_reader >> rec)) {
+                        break;
+                    }
+
+                    logState_(rec, stf_reader.numInstsRead());
+                    for(const auto* const interval: active) {
+                        const uint64_t count = stf_reader.numInstsRead() - (interval->start - 1);
+                        if(cacheRecord_(*interval->cache, rec, count, num_cached == max_cached_records)) {
+                            ++num_cached;
+                        }
+                    }
+                }
+            }
+            catch(const stf::EOFException&) {
+            }
+
+            // Anything that was not read to the end (e.g. because the cache filled up) has to be re-read later
+            for(const auto* const interval: active) {
+                interval->cache->complete = false;
+                interval->cache->records = RecordLog();
+            }
+            for(; next_it != intervals.end(); ++next_it) {
+                next_it->cache->complete = false;
+            }
+
+            num_cached = 0;
+            for(const auto& interval: intervals) {
+                if(interval.cache->complete) {
+                    num_cached += interval.cache->records.size();
+                }
+                else {
+                    interval.cache->records = RecordLog();
+                }
+            }
+
+            return num_cached;
+        }
+
+        /**
+         * \brief Writes a cached interval, updating the PID and page table state exactly as reopening the trace,
+         * skipping to the interval and extracting it would;
+         * return number of instructions written;
+         *
+         * \param stf_reader Reader opened on the trace the interval came from. Only its header is used.
+         */
+        uint64_t replayInsts(stf::STFReader& stf_reader,
+                             stf::STFWriter& stf_writer,
+                             const CachedInterval& cache,
+                             stf::STF_PTE &page_table) {
+            stf_assert(cache.complete, "Attempted to replay an incomplete interval");
+
+            for(size_t i = 0; i < cache.num_state_records; ++i) {
+                const auto& logged = (*cache.state_log)[i];
+                auto rec = logged.second->clone();
+                processRecord(rec, page_table, logged.first);
+            }
+
+            writeHeader_(stf_reader, stf_writer, cache.pc, page_table);
+
+            for(const auto& [count, rec]: cache.records) {
+                if(STF_EXPECT_FALSE(isStateRecord_(*rec))) {
+                    auto copy = rec->clone();
+                    processRecord(copy, page_table, count);
+                }
+                stf_writer << *rec;
+            }
+
+            std::cerr << "Output " << cache.num_insts << " instructions" << std::endl;
+            return cache.num_insts;
+        }
 };
@@ -1,11 +1,13 @@
 #include <iostream>
 
 #include "print_utils.hpp"
+#include "profiling.hpp"
 #include "stf_reader.hpp"
 #include "stf_record_types.hpp"
 
 #include "command_line_parser.hpp"
 #include "stf_record_dump.hpp"
+#include "text_writer.hpp"
 #include "tools_util.hpp"
 
 static STFRecordDumpConfig parseCommandLine(int argc, char **argv) {
@@ -56,6 +58,10 @@ int main (int argc, char **argv)
         stf::STFReader stf_reader(config.trace_filename);
         stf_reader.checkVersion();
 
+        TextWriter out;
+        // The record formatters print to std::cout
+        const TextWriter::Redirect cout_redirect(out, std::cout);
+
         if(config.start_inst || config.end_inst) {
             std::cout << "Start Inst:" << config.start_inst;
 
@@ -93,9 +99,10 @@ int main (int argc, char **argv)
                 }
             }
 
-            while(stf_reader >> rec) {
+            while(TRACE_TOOLS_PROFILE_EXPR("reader.record", stf_reader >> rec)) {
+                TRACE_TOOLS_PROFILE_SCOPE("output.format");
                 rec->format(std::cout);
-                std::cout << std::endl;
+                out.newline();
                 if(STF_EXPECT_FALSE((config.end_inst && (stf_reader.numInstsRead() == config.end_inst)) ||
                                     (config.end_record && (stf_reader.numRecordsRead() == config.end_record)))) {
                     break;
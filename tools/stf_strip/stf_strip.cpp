@@ -1,19 +1,27 @@
+#include <exception>
+#include <thread>
 #include <unordered_set>
 
 #include "stf_record_types.hpp"
 #include "stf_reader.hpp"
 #include "stf_writer.hpp"
 
+#include "batch_buffer.hpp"
 #include "command_line_parser.hpp"
 #include "file_utils.hpp"
 #include "stf_descriptor_map.hpp"
 
 using DescriptorSet = std::unordered_set<stf::descriptors::internal::Descriptor>;
+using RecordBatchBuffer = BatchBuffer<stf::STFRecord::UniqueHandle>;
+
+static constexpr size_t PIPELINE_NUM_SLOTS = 8;
+static constexpr size_t PIPELINE_BATCH_SIZE = 4096;
 
 void parseCommandLine(int argc,
                       char** argv,
                       DescriptorSet& stripped_records,
                       bool& overwrite,
+                      bool& pipeline,
                       int& compression_level,
                       std::string& input_trace,
                       std::string& output_filename) {
@@ -21,6 +29,7 @@ void parseCommandLine(int argc,
     parser.addMultiFlag('r', "type", "Record type to remove. Can be specified multiple times.");
     parser.addFlag('f', "Allow overwriting the output file");
     parser.addFlag('c', "#", "Compression level (ZSTD: 1-22, default 3)");
+    parser.addFlag('p', "Read and write on separate threads");
     parser.addPositionalArgument("trace", "Trace in STF format");
     parser.addPositionalArgument("output", "Output filename");
     parser.appendHelpText("Allowed record types:");
@@ -45,20 +54,110 @@ void parseCommandLine(int argc,
     parser.assertCondition(!stripped_records.empty(), "No records were specified for removal. Exiting.");
 
     overwrite = parser.hasArgument('f');
+    pipeline = parser.hasArgument('p');
     parser.getArgumentValue('c', compression_level);
     parser.getPositionalArgument(0, input_trace);
     parser.getPositionalArgument(1, output_filename);
 }
 
+/**
+ * Copies every record that is not being stripped from reader to writer
+ */
+void stripRecords(stf::STFReader& reader, stf::STFWriter& writer, const DescriptorSet& stripped_records) {
+    try {
+        stf::STFRecord::UniqueHandle r;
+        while(reader) {
+            reader >> r;
+            if(STF_EXPECT_FALSE(stripped_records.count(r->getId()) != 0)) {
+                continue;
+            }
+
+            writer << *r;
+        }
+    }
+    catch(const stf::EOFException&) {
+    }
+}
+
+/**
+ * Same as stripRecords, but decompresses and filters records on a separate thread while the calling thread
+ * compresses and writes them
+ */
+void pipelinedStripRecords(stf::STFReader& reader, stf::STFWriter& writer, const DescriptorSet& stripped_records) {
+    RecordBatchBuffer buffer(1, PIPELINE_NUM_SLOTS, PIPELINE_BATCH_SIZE);
+    std::exception_ptr read_exception;
+    std::exception_ptr write_exception;
+
+    std::thread read_thread([&reader, &stripped_records, &buffer, &read_exception]() {
+        try {
+            auto* batch = &buffer.acquire();
+            try {
+                stf::STFRecord::UniqueHandle r;
+                while(reader) {
+                    reader >> r;
+                    if(STF_EXPECT_FALSE(stripped_records.count(r->getId()) != 0)) {
+                        continue;
+                    }
+
+                    batch->emplace_back(std::move(r));
+                    if(STF_EXPECT_FALSE(batch->size() == PIPELINE_BATCH_SIZE)) {
+                        buffer.publish();
+                        batch = &buffer.acquire();
+                    }
+                }
+            }
+            catch(const stf::EOFException&) {
+            }
+
+            if(!batch->empty()) {
+                buffer.publish();
+            }
+        }
+        catch(...) {
+            read_exception = std::current_exception();
+        }
+
+        buffer.finish();
+        // Records have to be returned to the reader's pool on the thread that allocated them
+        buffer.recycleAll();
+    });
+
+    buffer.consumeAll([&writer, &write_exception](const RecordBatchBuffer::Batch& batch) {
+        // Keep draining the buffer after a failure so that the read thread can finish
+        if(STF_EXPECT_FALSE(write_exception)) {
+            return;
+        }
+
+        try {
+            for(const auto& r: batch) {
+                writer << *r;
+            }
+        }
+        catch(...) {
+            write_exception = std::current_exception();
+        }
+    });
+
+    read_thread.join();
+
+    if(read_exception) {
+        std::rethrow_exception(read_exception);
+    }
+    if(write_exception) {
+        std::rethrow_exception(write_exception);
+    }
+}
+
 int main(int argc, char** argv) {
     DescriptorSet stripped_records;
     bool overwrite = false;
+    bool pipeline = false;
     std::string input_trace;
     std::string output_filename;
     int compression_level = -1;
 
     try {
-        parseCommandLine(argc, argv, stripped_records, overwrite, compression_level, input_trace, output_filename);
+        parseCommandLine(argc, argv, stripped_records, overwrite, pipeline, compression_level, input_trace, output_filename);
     }
     catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
         std::cerr << e.what() << std::endl;
@@ -81,18 +180,11 @@ int main(int argc, char** argv) {
     reader.copyHeader(writer);
     writer.finalizeHeader();
 
-    try {
-        stf::STFRecord::UniqueHandle r;
-        while(reader) {
-            reader >> r;
-            if(STF_EXPECT_FALSE(stripped_records.count(r->getId()) != 0)) {
-                continue;
-            }
-
-            writer << *r;
-        }
+    if(pipeline) {
+        pipelinedStripRecords(reader, writer, stripped_records);
     }
-    catch(const stf::EOFException&) {
+    else {
+        stripRecords(reader, writer, stripped_records);
     }
 
     reader.close();
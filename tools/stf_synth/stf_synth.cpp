@@ -0,0 +1,158 @@
+// <STF_synth> -*- C++ -*-
+
+/**
+ * \brief  Generates deterministic synthetic traces with controllable characteristics
+ *
+ */
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "command_line_parser.hpp"
+#include "stf_synth.hpp"
+#include "stf_writer.hpp"
+
+/**
+ * Parses a list of name:weight pairs
+ * \param parser Parser used to report errors
+ * \param flag Flag containing the pairs
+ * \param names Valid names
+ * \param weights Weights to update
+ */
+template<size_t N>
+static void parseWeights(const trace_tools::CommandLineParser& parser,
+                         const char flag,
+                         const std::array<std::string_view, N>& names,
+                         std::array<uint64_t, N>& weights) {
+    for(const auto& spec: parser.getMultipleValueArgument(flag)) {
+        const auto colon = spec.find(':');
+        parser.assertCondition(colon != std::string::npos, "Invalid -", flag, " parameter: ", spec);
+
+        const std::string_view name(spec.data(), colon);
+        const auto it = std::find(names.begin(), names.end(), name);
+        parser.assertCondition(it != names.end(), "Unknown instruction class: ", name);
+
+        try {
+            weights[static_cast<size_t>(std::distance(names.begin(), it))] = std::stoull(spec.substr(colon + 1));
+        }
+        catch(const std::exception&) {
+            parser.assertCondition(false, "Invalid weight: ", spec);
+        }
+    }
+
+    uint64_t total = 0;
+    for(const auto weight: weights) {
+        total += weight;
+    }
+    parser.assertCondition(total > 0, "At least one -", flag, " weight must be nonzero");
+}
+
+static void parseCommandLine(int argc,
+                             char** argv,
+                             SynthConfig& config,
+                             std::string& output,
+                             int& compression_level) {
+    trace_tools::CommandLineParser parser("stf_synth");
+    parser.addFlag('n', "N", "number of instructions to generate (default " + std::to_string(config.num_insts) + ")");
+    parser.addFlag('s', "seed", "random seed (default " + std::to_string(config.seed) + ")");
+    parser.addMultiFlag('m', "class:weight", "weight of a basic block body instruction class. Can be specified multiple times.");
+    parser.addMultiFlag('M', "class:weight", "weight of a basic block terminator class. Can be specified multiple times.");
+    parser.addFlag('l', "N", "average basic block length (default " + std::to_string(config.block_length) + ")");
+    parser.addFlag('C', "bytes", "user code size (default " + std::to_string(config.code_size) + ")");
+    parser.addFlag('b', "prob", "taken (or not-taken) probability of biased conditional branches (default 0.9)");
+    parser.addFlag('T', "fraction", "fraction of conditional branches that follow a periodic pattern (default 0.2)");
+    parser.addFlag('t', "N", "period of patterned conditional branches (default " + std::to_string(config.pattern_period) + ")");
+    parser.addFlag('i', "N", "number of targets of each indirect jump (default " + std::to_string(config.indirect_fanout) + ")");
+    parser.addFlag('D', "bytes", "data footprint (default " + std::to_string(config.data_footprint) + ")");
+    parser.addFlag('S', "bytes", "stride of sequential loads and stores (default " + std::to_string(config.stride) + ")");
+    parser.addFlag('R', "fraction", "fraction of loads and stores that access random addresses (default 0.2)");
+    parser.addFlag('K', "N", "number of kernel instructions executed per syscall (default " + std::to_string(config.kernel_length) + ")");
+    parser.addFlag('p', "embed page table walks");
+    parser.addFlag('P', "N", "forget page table walks every N instructions, so that they are embedded again");
+    parser.addFlag('v', "vlen", "vector register length in bits. Required by the vector instruction class.");
+    parser.addFlag('r', "record register operand values");
+    parser.addFlag('c', "#", "compression level (ZSTD: 1-22, default 3)");
+    parser.addPositionalArgument("trace", "output trace");
+    parser.setDependentArgument('P', 'p');
+
+    std::string body_classes;
+    for(const auto name: SynthConfig::BODY_CLASS_NAMES) {
+        body_classes += ' ';
+        body_classes += name;
+    }
+    std::string terminator_classes;
+    for(const auto name: SynthConfig::TERMINATOR_CLASS_NAMES) {
+        terminator_classes += ' ';
+        terminator_classes += name;
+    }
+    parser.appendHelpText("Body instruction classes:" + body_classes);
+    parser.appendHelpText("Terminator classes:" + terminator_classes);
+    parser.appendHelpText("The same parameters and seed always produce the same trace.");
+    parser.appendHelpText("Example:");
+    parser.appendHelpText("    stf_synth -n 10000000 -m load:40 -m syscall:1 -R 0.5 -p synth.zstf");
+
+    parser.parseArguments(argc, argv);
+
+    parser.getArgumentValue('n', config.num_insts);
+    parser.getArgumentValue('s', config.seed);
+    parser.getArgumentValue('l', config.block_length);
+    parser.getArgumentValue('C', config.code_size);
+    parser.getArgumentValue('b', config.branch_bias);
+    parser.getArgumentValue('T', config.pattern_fraction);
+    parser.getArgumentValue('t', config.pattern_period);
+    parser.getArgumentValue('i', config.indirect_fanout);
+    parser.getArgumentValue('D', config.data_footprint);
+    parser.getArgumentValue('S', config.stride);
+    parser.getArgumentValue('R', config.random_fraction);
+    parser.getArgumentValue('K', config.kernel_length);
+    config.embed_ptes = parser.hasArgument('p');
+    parser.getArgumentValue('P', config.pte_flush_interval);
+    parser.getArgumentValue('v', config.vlen);
+    config.reg_values = parser.hasArgument('r');
+    parser.getArgumentValue('c', compression_level);
+    parser.getPositionalArgument(0, output);
+
+    parseWeights(parser, 'm', SynthConfig::BODY_CLASS_NAMES, config.body_weights);
+    parseWeights(parser, 'M', SynthConfig::TERMINATOR_CLASS_NAMES, config.terminator_weights);
+
+    parser.assertCondition(config.num_insts > 0, "-n parameter must be nonzero");
+    parser.assertCondition(config.block_length > 0, "-l parameter must be nonzero");
+    parser.assertCondition(config.code_size > 0 && config.code_size < (1 << 20), "-C parameter must be between 1 and 1048575");
+    parser.assertCondition(config.branch_bias >= 0 && config.branch_bias <= 1, "-b parameter must be between 0 and 1");
+    parser.assertCondition(config.pattern_fraction >= 0 && config.pattern_fraction <= 1, "-T parameter must be between 0 and 1");
+    parser.assertCondition(config.pattern_period > 1, "-t parameter must be greater than 1");
+    parser.assertCondition(config.indirect_fanout > 0, "-i parameter must be nonzero");
+    parser.assertCondition(config.data_footprint >= 8, "-D parameter must be at least 8");
+    parser.assertCondition(config.random_fraction >= 0 && config.random_fraction <= 1, "-R parameter must be between 0 and 1");
+    parser.assertCondition(!parser.hasArgument('P') || config.pte_flush_interval > 0, "-P parameter must be nonzero");
+    parser.assertCondition(!parser.hasArgument('v') || (config.vlen >= 64 && (config.vlen & (config.vlen - 1)) == 0),
+                           "-v parameter must be a power of 2 of at least 64");
+    parser.assertCondition(config.vlen || !config.body_weights[SynthConfig::VECTOR],
+                           "The vector instruction class requires -v");
+}
+
+int main(int argc, char** argv) {
+    SynthConfig config;
+    std::string output;
+    int compression_level = -1; // -1 == default compression level
+
+    try {
+        parseCommandLine(argc, argv, config, output, compression_level);
+    }
+    catch(const trace_tools::CommandLineParser::EarlyExitException& e) {
+        std::cerr << e.what() << std::endl;
+        return e.getCode();
+    }
+
+    SyntheticTraceGenerator generator(config);
+    stf::STFWriter writer(output, compression_level);
+    generator.write(writer);
+    writer.close();
+
+    return 0;
+}
@@ -0,0 +1,703 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "stf_enums.hpp"
+#include "stf_record_types.hpp"
+#include "stf_writer.hpp"
+#include "tools_util.hpp"
+
+/**
+ * \class SynthRandom
+ * \brief Seeded random number generator that produces the same sequence on every platform
+ *
+ * The output of std::mt19937_64 is fully specified by the standard, but the std distributions are not, so
+ * the distributions are implemented here.
+ */
+class SynthRandom {
+    private:
+        std::mt19937_64 rng_;
+
+    public:
+        explicit SynthRandom(const uint64_t seed) :
+            rng_(seed)
+        {
+        }
+
+        inline uint64_t next() {
+            return rng_();
+        }
+
+        /**
+         * Returns a uniform integer in [0, n)
+         */
+        inline uint64_t below(const uint64_t n) {
+            return rng_() % n;
+        }
+
+        /**
+         * Returns a uniform real number in [0, 1)
+         */
+        inline double real() {
+            return static_cast<double>(rng_() >> 11) * 0x1.0p-53;
+        }
+
+        /**
+         * Returns true with probability p
+         */
+        inline bool chance(const double p) {
+            return real() < p;
+        }
+
+        /**
+         * Picks an index with probability proportional to its weight
+         */
+        template<size_t N>
+        inline size_t weighted(const std::array<uint64_t, N>& weights) {
+            uint64_t total = 0;
+            for(const auto weight: weights) {
+                total += weight;
+            }
+
+            auto pick = below(total);
+            for(size_t i = 0; i < N; ++i) {
+                if(pick < weights[i]) {
+                    return i;
+                }
+                pick -= weights[i];
+            }
+
+            return N - 1;
+        }
+};
+
+/**
+ * \struct SynthConfig
+ * \brief Parameters of a synthetic trace
+ */
+struct SynthConfig {
+    /**
+     * \enum BodyClass
+     * Instruction classes that make up the body of a basic block
+     */
+    enum BodyClass : size_t {
+        ALU,
+        MUL,
+        FP,
+        LOAD,
+        STORE,
+        VECTOR,
+        SYSCALL,
+        NUM_BODY_CLASSES
+    };
+
+    /**
+     * \enum TerminatorClass
+     * Instruction classes that end a basic block
+     */
+    enum TerminatorClass : size_t {
+        COND,
+        JUMP,
+        INDIRECT,
+        NUM_TERMINATOR_CLASSES
+    };
+
+    static constexpr std::array<std::string_view, NUM_BODY_CLASSES> BODY_CLASS_NAMES {
+        "alu", "mul", "fp", "load", "store", "vector", "syscall"
+    };
+
+    static constexpr std::array<std::string_view, NUM_TERMINATOR_CLASSES> TERMINATOR_CLASS_NAMES {
+        "cond", "jump", "indirect"
+    };
+
+    uint64_t num_insts = 1000000;           /**< Number of instructions to generate */
+    uint64_t seed = 1;                      /**< Random seed */
+    std::array<uint64_t, NUM_BODY_CLASSES> body_weights {50, 5, 5, 25, 15, 0, 0};      /**< Basic block body mix */
+    std::array<uint64_t, NUM_TERMINATOR_CLASSES> terminator_weights {70, 20, 10};      /**< Basic block terminator mix */
+    uint32_t block_length = 6;              /**< Average basic block length, including the terminator */
+    uint64_t code_size = 64 * 1024;         /**< Size of the user code in bytes */
+    double branch_bias = 0.9;               /**< Taken (or not-taken) probability of a biased conditional branch */
+    double pattern_fraction = 0.2;          /**< Fraction of conditional branches that follow a periodic pattern */
+    uint32_t pattern_period = 8;            /**< Period of patterned branches */
+    uint32_t indirect_fanout = 4;           /**< Number of targets of each indirect jump */
+    uint64_t data_footprint = 16 * 1024 * 1024; /**< Size of the user data region in bytes */
+    uint64_t stride = 8;                    /**< Stride of sequential memory streams in bytes */
+    double random_fraction = 0.2;           /**< Fraction of loads/stores that access random addresses */
+    uint32_t kernel_length = 64;            /**< Number of kernel instructions executed per syscall */
+    bool embed_ptes = false;                /**< If true, embed a page table walk the first time a page is touched */
+    uint64_t pte_flush_interval = 0;        /**< Forget every page table walk after this many instructions (0 = never) */
+    uint32_t vlen = 0;                      /**< Vector register length in bits (0 = no vector support) */
+    bool reg_values = false;                /**< If true, record register operand values */
+};
+
+/**
+ * \class SyntheticTraceGenerator
+ * \brief Writes a deterministic synthetic trace
+ *
+ * A static program is generated first: a sequence of basic blocks laid out contiguously in memory, each
+ * ending with a conditional branch, a direct jump or an indirect jump, plus a kernel syscall handler. The
+ * trace is produced by executing that program, so static instructions always have the same opcode at the
+ * same PC and the branch, memory and mode change behavior seen by the tools is consistent with the code.
+ */
+class SyntheticTraceGenerator {
+    private:
+        static constexpr uint64_t USER_CODE_BASE_ = 0x10000;
+        static constexpr uint64_t USER_DATA_BASE_ = 0x10000000;
+        static constexpr uint64_t KERNEL_CODE_BASE_ = 0xffffffff80000000ULL;
+        static constexpr uint64_t PAGE_TABLE_BASE_ = 0x80000000;
+        static constexpr uint64_t PAGE_SIZE_ = 4096;
+        static constexpr uint64_t MAX_COND_OFFSET_ = 4094;
+        static constexpr uint64_t MAX_JUMP_OFFSET_ = (1 << 20) - 2;
+        static constexpr size_t COND_TARGET_WINDOW_ = 32;
+        static constexpr size_t JUMP_TARGET_WINDOW_ = 64;
+        static constexpr uint32_t INST_SIZE_ = 4;
+        static constexpr uint16_t ACCESS_SIZE_ = 8;
+
+        // Registers used by the generated code. x1 and x5 are avoided so that no jump looks like a call or return.
+        static constexpr uint32_t FIRST_REG_ = 8;
+        static constexpr uint32_t NUM_REGS_ = 24;
+        static constexpr uint32_t INDIRECT_REG_ = 6;
+
+        // RISC-V encodings
+        static constexpr uint32_t OP_ = 0x33;
+        static constexpr uint32_t OP_IMM_ = 0x13;
+        static constexpr uint32_t OP_FP_ = 0x53;
+        static constexpr uint32_t OP_V_ = 0x57;
+        static constexpr uint32_t LOAD_ = 0x03;
+        static constexpr uint32_t STORE_ = 0x23;
+        static constexpr uint32_t BRANCH_ = 0x63;
+        static constexpr uint32_t JAL_ = 0x6f;
+        static constexpr uint32_t JALR_ = 0x67;
+        static constexpr uint32_t ECALL_ = 0x00000073;
+        static constexpr uint32_t SRET_ = 0x10200073;
+        static constexpr std::array<uint32_t, 4> BRANCH_FUNCT3_ {0, 1, 4, 5}; // beq, bne, blt, bge
+
+        /**
+         * \struct BodyInst_
+         * \brief Static non-control-flow instruction
+         */
+        struct BodyInst_ {
+            SynthConfig::BodyClass cls = SynthConfig::ALU;
+            uint32_t opcode = 0;
+            uint32_t rd = 0;
+            uint32_t rs1 = 0;
+            uint32_t rs2 = 0;
+            size_t stream = 0;  /**< Memory stream used by loads and stores */
+        };
+
+        /**
+         * \struct Block_
+         * \brief Static basic block
+         */
+        struct Block_ {
+            uint64_t pc = 0;
+            std::vector<BodyInst_> body;
+            SynthConfig::TerminatorClass terminator = SynthConfig::COND;
+            uint32_t terminator_opcode = 0;
+            std::vector<size_t> targets;    /**< Target blocks. Indirect jumps have more than one. */
+            double taken_prob = 0;          /**< Taken probability of a biased conditional branch */
+            uint32_t period = 0;            /**< Period of a patterned conditional branch (0 = biased) */
+            uint64_t count = 0;             /**< Number of times a patterned conditional branch has executed */
+
+            inline uint64_t terminatorPC() const {
+                return pc + body.size() * INST_SIZE_;
+            }
+
+            inline uint64_t endPC() const {
+                return terminatorPC() + INST_SIZE_;
+            }
+        };
+
+        /**
+         * \struct MemStream_
+         * \brief Address generator for a static load or store
+         */
+        struct MemStream_ {
+            uint64_t offset = 0;
+            bool random = false;
+        };
+
+        const SynthConfig config_;
+        SynthRandom rng_;
+        std::vector<Block_> blocks_;
+        std::vector<BodyInst_> kernel_body_;
+        std::vector<MemStream_> streams_;
+
+        uint64_t num_insts_ = 0;
+        std::unordered_set<uint64_t> walked_pages_;
+        std::unordered_map<uint64_t, uint64_t> phys_pages_;
+
+        static inline uint32_t encodeR_(const uint32_t opcode,
+                                        const uint32_t funct3,
+                                        const uint32_t funct7,
+                                        const uint32_t rd,
+                                        const uint32_t rs1,
+                                        const uint32_t rs2) {
+            return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+        }
+
+        static inline uint32_t encodeI_(const uint32_t opcode,
+                                        const uint32_t funct3,
+                                        const uint32_t rd,
+                                        const uint32_t rs1,
+                                        const uint32_t imm) {
+            return ((imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+        }
+
+        static inline uint32_t encodeS_(const uint32_t funct3, const uint32_t rs1, const uint32_t rs2) {
+            return (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | STORE_;
+        }
+
+        static inline uint32_t encodeB_(const uint32_t funct3, const uint32_t rs1, const uint32_t rs2, const int64_t offset) {
+            const auto imm = static_cast<uint32_t>(offset);
+            return (((imm >> 12) & 1) << 31) |
+                   (((imm >> 5) & 0x3f) << 25) |
+                   (rs2 << 20) |
+                   (rs1 << 15) |
+                   (funct3 << 12) |
+                   (((imm >> 1) & 0xf) << 8) |
+                   (((imm >> 11) & 1) << 7) |
+                   BRANCH_;
+        }
+
+        static inline uint32_t encodeJ_(const uint32_t rd, const int64_t offset) {
+            const auto imm = static_cast<uint32_t>(offset);
+            return (((imm >> 20) & 1) << 31) |
+                   (((imm >> 1) & 0x3ff) << 21) |
+                   (((imm >> 11) & 1) << 20) |
+                   (((imm >> 12) & 0xff) << 12) |
+                   (rd << 7) |
+                   JAL_;
+        }
+
+        inline uint32_t randomReg_() {
+            return FIRST_REG_ + static_cast<uint32_t>(rng_.below(NUM_REGS_));
+        }
+
+        BodyInst_ makeBodyInst_(const SynthConfig::BodyClass cls) {
+            BodyInst_ inst;
+            inst.cls = cls;
+            inst.rd = randomReg_();
+            inst.rs1 = randomReg_();
+            inst.rs2 = randomReg_();
+
+            switch(cls) {
+                case SynthConfig::ALU:
+                    if(rng_.chance(0.5)) {
+                        inst.opcode = encodeR_(OP_, 0, 0, inst.rd, inst.rs1, inst.rs2); // add
+                    }
+                    else {
+                        inst.opcode = encodeI_(OP_IMM_, 0, inst.rd, inst.rs1, static_cast<uint32_t>(rng_.below(2048))); // addi
+                    }
+                    break;
+                case SynthConfig::MUL:
+                    inst.opcode = encodeR_(OP_, 0, 1, inst.rd, inst.rs1, inst.rs2); // mul
+                    break;
+                case SynthConfig::FP:
+                    inst.opcode = encodeR_(OP_FP_, 7, 1, inst.rd, inst.rs1, inst.rs2); // fadd.d
+                    break;
+                case SynthConfig::LOAD:
+                    inst.opcode = encodeI_(LOAD_, 3, inst.rd, inst.rs1, 0); // ld
+                    inst.stream = addStream_();
+                    break;
+                case SynthConfig::STORE:
+                    inst.opcode = encodeS_(3, inst.rs1, inst.rs2); // sd
+                    inst.stream = addStream_();
+                    break;
+                case SynthConfig::VECTOR:
+                    inst.opcode = (1 << 25) | encodeR_(OP_V_, 0, 0, inst.rd, inst.rs1, inst.rs2); // vadd.vv
+                    break;
+                case SynthConfig::SYSCALL:
+                    inst.opcode = ECALL_;
+                    break;
+                case SynthConfig::NUM_BODY_CLASSES:
+                    stf_throw("Invalid instruction class");
+            }
+
+            return inst;
+        }
+
+        size_t addStream_() {
+            MemStream_ stream;
+            stream.random = rng_.chance(config_.random_fraction);
+            stream.offset = rng_.below(config_.data_footprint / ACCESS_SIZE_) * ACCESS_SIZE_;
+            streams_.emplace_back(stream);
+            return streams_.size() - 1;
+        }
+
+        /**
+         * Picks a random block within window blocks of idx whose PC is within max_offset bytes of pc
+         */
+        size_t pickNearbyBlock_(const size_t idx, const size_t window, const uint64_t pc, const uint64_t max_offset) {
+            const size_t first = idx > window ? idx - window : 0;
+            const size_t last = std::min(idx + window, blocks_.size() - 1);
+
+            for(size_t attempt = 0; attempt < 8; ++attempt) {
+                const size_t target = first + rng_.below(last - first + 1);
+                const uint64_t target_pc = blocks_[target].pc;
+                if((target_pc > pc ? target_pc - pc : pc - target_pc) <= max_offset) {
+                    return target;
+                }
+            }
+
+            // The next block is always in range
+            return idx + 1;
+        }
+
+        void generateProgram_() {
+            const uint64_t body_length = config_.block_length - 1;
+
+            // Lay out the blocks first so that branch offsets can be computed
+            uint64_t pc = USER_CODE_BASE_;
+            while(pc < USER_CODE_BASE_ + config_.code_size || blocks_.size() < 2) {
+                auto& block = blocks_.emplace_back();
+                block.pc = pc;
+                const uint64_t num_body = body_length / 2 + rng_.below(body_length + 1);
+                for(uint64_t i = 0; i < num_body; ++i) {
+                    block.body.emplace_back(makeBodyInst_(static_cast<SynthConfig::BodyClass>(rng_.weighted(config_.body_weights))));
+                }
+                block.terminator = static_cast<SynthConfig::TerminatorClass>(rng_.weighted(config_.terminator_weights));
+                pc = block.endPC();
+            }
+
+            // The last block jumps back to the start of the program
+            blocks_.back().terminator = SynthConfig::JUMP;
+            stf_assert(blocks_.back().terminatorPC() - USER_CODE_BASE_ <= MAX_JUMP_OFFSET_,
+                       "Code size must be less than 1MB");
+
+            for(size_t i = 0; i < blocks_.size(); ++i) {
+                auto& block = blocks_[i];
+                const uint64_t term_pc = block.terminatorPC();
+                const bool is_last = i == blocks_.size() - 1;
+
+                switch(block.terminator) {
+                    case SynthConfig::COND:
+                        block.targets.emplace_back(pickNearbyBlock_(i, COND_TARGET_WINDOW_, term_pc, MAX_COND_OFFSET_));
+                        block.terminator_opcode = encodeB_(BRANCH_FUNCT3_[rng_.below(BRANCH_FUNCT3_.size())],
+                                                           randomReg_(),
+                                                           randomReg_(),
+                                                           static_cast<int64_t>(blocks_[block.targets.front()].pc - term_pc));
+                        if(rng_.chance(config_.pattern_fraction)) {
+                            block.period = config_.pattern_period;
+                        }
+                        else {
+                            block.taken_prob = rng_.chance(0.5) ? config_.branch_bias : 1.0 - config_.branch_bias;
+                        }
+                        break;
+                    case SynthConfig::JUMP:
+                        // Jumps only go forward so that the program cannot get stuck in a loop without a conditional exit
+                        block.targets.emplace_back(is_last ? 0 : i + 1 + rng_.below(std::min(JUMP_TARGET_WINDOW_, blocks_.size() - i - 1)));
+                        block.terminator_opcode = encodeJ_(0, static_cast<int64_t>(blocks_[block.targets.front()].pc - term_pc));
+                        break;
+                    case SynthConfig::INDIRECT:
+                        for(uint32_t j = 0; j < config_.indirect_fanout; ++j) {
+                            block.targets.emplace_back(rng_.below(blocks_.size()));
+                        }
+                        block.terminator_opcode = encodeI_(JALR_, 0, 0, INDIRECT_REG_, 0);
+                        break;
+                    case SynthConfig::NUM_TERMINATOR_CLASSES:
+                        stf_throw("Invalid terminator class");
+                }
+            }
+
+            for(uint32_t i = 0; i < config_.kernel_length; ++i) {
+                kernel_body_.emplace_back(makeBodyInst_(SynthConfig::ALU));
+            }
+        }
+
+        inline uint64_t nextAddress_(const size_t stream_idx) {
+            auto& stream = streams_[stream_idx];
+            if(stream.random) {
+                return USER_DATA_BASE_ + rng_.below(config_.data_footprint / ACCESS_SIZE_) * ACCESS_SIZE_;
+            }
+
+            const uint64_t address = USER_DATA_BASE_ + stream.offset;
+            stream.offset = (stream.offset + config_.stride) % config_.data_footprint;
+            return address;
+        }
+
+        /**
+         * Embeds a page table walk if the page containing address has not been walked yet
+         */
+        void touchPage_(stf::STFWriter& writer, const uint64_t address, const bool user) {
+            const uint64_t vpage = address & ~(PAGE_SIZE_ - 1);
+            if(!walked_pages_.insert(vpage).second) {
+                return;
+            }
+
+            const auto result = phys_pages_.try_emplace(vpage, PAGE_TABLE_BASE_ + (phys_pages_.size() + 1) * PAGE_SIZE_);
+            const uint64_t ppage = result.first->second;
+            // V | R | W | X | A | D, plus U for user pages
+            const uint64_t pte = ((ppage >> 12) << 10) | (user ? 0xdf : 0xcf);
+            const uint64_t pte_address = PAGE_TABLE_BASE_ + ((vpage >> 12) & 0x1ff) * sizeof(uint64_t);
+            writer << stf::PageTableWalkRecord(vpage,
+                                               num_insts_,
+                                               static_cast<uint32_t>(PAGE_SIZE_),
+                                               {stf::PageTableWalkRecord::PTE(pte_address, pte)});
+        }
+
+        void writeRegValues_(stf::STFWriter& writer, const BodyInst_& inst) {
+            using stf::Registers::STF_REG_TYPE;
+            using stf::Registers::STF_REG_OPERAND_TYPE;
+
+            switch(inst.cls) {
+                case SynthConfig::ALU:
+                case SynthConfig::MUL:
+                case SynthConfig::LOAD:
+                case SynthConfig::STORE:
+                    writer << stf::InstRegRecord(inst.rs1, STF_REG_TYPE::INTEGER, STF_REG_OPERAND_TYPE::REG_SOURCE, rng_.next());
+                    if(inst.cls == SynthConfig::STORE) {
+                        writer << stf::InstRegRecord(inst.rs2, STF_REG_TYPE::INTEGER, STF_REG_OPERAND_TYPE::REG_SOURCE, rng_.next());
+                    }
+                    else {
+                        writer << stf::InstRegRecord(inst.rd, STF_REG_TYPE::INTEGER, STF_REG_OPERAND_TYPE::REG_DEST, rng_.next());
+                    }
+                    break;
+                case SynthConfig::FP:
+                    writer << stf::InstRegRecord(inst.rs1, STF_REG_TYPE::FLOATING_POINT, STF_REG_OPERAND_TYPE::REG_SOURCE, rng_.next());
+                    writer << stf::InstRegRecord(inst.rs2, STF_REG_TYPE::FLOATING_POINT, STF_REG_OPERAND_TYPE::REG_SOURCE, rng_.next());
+                    writer << stf::InstRegRecord(inst.rd, STF_REG_TYPE::FLOATING_POINT, STF_REG_OPERAND_TYPE::REG_DEST, rng_.next());
+                    break;
+                case SynthConfig::VECTOR:
+                case SynthConfig::SYSCALL:
+                case SynthConfig::NUM_BODY_CLASSES:
+                    break;
+            }
+        }
+
+        /**
+         * Writes the destination register of a vector instruction. Vector contents are always recorded,
+         * since they are what makes vector traces large.
+         */
+        void writeVectorValue_(stf::STFWriter& writer, const BodyInst_& inst) {
+            stf::InstRegRecord::VectorType data(stf::InstRegRecord::calcVectorLen(config_.vlen));
+            for(auto& word: data) {
+                word = rng_.next();
+            }
+
+            stf::InstRegRecord rec(inst.rd,
+                                   stf::Registers::STF_REG_TYPE::VECTOR,
+                                   stf::Registers::STF_REG_OPERAND_TYPE::REG_DEST,
+                                   0);
+            rec.setVectorData(data);
+            writer << rec;
+        }
+
+        /**
+         * Writes a non-control-flow instruction
+         * \returns The PC of the next instruction
+         */
+        uint64_t writeBodyInst_(stf::STFWriter& writer, const BodyInst_& inst, const uint64_t pc, const bool user) {
+            const bool is_mem = inst.cls == SynthConfig::LOAD || inst.cls == SynthConfig::STORE;
+            const uint64_t address = is_mem ? nextAddress_(inst.stream) : 0;
+
+            if(config_.embed_ptes) {
+                touchPage_(writer, pc, user);
+                if(is_mem) {
+                    touchPage_(writer, address, user);
+                }
+            }
+
+            if(config_.reg_values) {
+                writeRegValues_(writer, inst);
+            }
+            if(inst.cls == SynthConfig::VECTOR) {
+                writeVectorValue_(writer, inst);
+            }
+
+            if(inst.cls == SynthConfig::SYSCALL) {
+                writer << stf::EventRecord(stf::EventRecord::TYPE::USER_ECALL, {0});
+                writer << stf::EventRecord(stf::EventRecord::TYPE::MODE_CHANGE,
+                                           {stf::enums::to_int(stf::EXECUTION_MODE::SUPERVISOR_MODE)});
+                writer << stf::EventPCTargetRecord(KERNEL_CODE_BASE_);
+            }
+
+            if(is_mem) {
+                writer << stf::InstMemAccessRecord(address,
+                                                   ACCESS_SIZE_,
+                                                   0,
+                                                   inst.cls == SynthConfig::LOAD ? stf::INST_MEM_ACCESS::READ : stf::INST_MEM_ACCESS::WRITE);
+                writer << stf::InstMemContentRecord(rng_.next());
+            }
+
+            writer << stf::InstOpcode32Record(inst.opcode);
+            countInst_();
+
+            if(inst.cls == SynthConfig::SYSCALL) {
+                runKernel_(writer, pc + INST_SIZE_);
+            }
+
+            return pc + INST_SIZE_;
+        }
+
+        /**
+         * Runs the syscall handler and returns to user mode
+         */
+        void runKernel_(stf::STFWriter& writer, const uint64_t return_pc) {
+            uint64_t pc = KERNEL_CODE_BASE_;
+            for(const auto& inst: kernel_body_) {
+                if(done_()) {
+                    return;
+                }
+                pc = writeBodyInst_(writer, inst, pc, false);
+            }
+
+            if(done_()) {
+                return;
+            }
+
+            if(config_.embed_ptes) {
+                touchPage_(writer, pc, false);
+            }
+            writer << stf::EventRecord(stf::EventRecord::TYPE::MODE_CHANGE,
+                                       {stf::enums::to_int(stf::EXECUTION_MODE::USER_MODE)});
+            writer << stf::EventPCTargetRecord(return_pc);
+            writer << stf::InstOpcode32Record(SRET_);
+            countInst_();
+        }
+
+        /**
+         * Counts a written instruction and forgets every page table walk at each pte_flush_interval boundary
+         */
+        inline void countInst_() {
+            ++num_insts_;
+            if(config_.pte_flush_interval && num_insts_ % config_.pte_flush_interval == 0) {
+                walked_pages_.clear();
+            }
+        }
+
+        inline bool done_() const {
+            return num_insts_ >= config_.num_insts;
+        }
+
+        /**
+         * Decides the outcome of a conditional branch
+         */
+        inline bool isTaken_(Block_& block) {
+            if(block.period) {
+                return (block.count++ % block.period) != block.period - 1;
+            }
+            return rng_.chance(block.taken_prob);
+        }
+
+        /**
+         * Writes the terminator of a block
+         * \returns The index of the next block
+         */
+        size_t writeTerminator_(stf::STFWriter& writer, const size_t idx) {
+            auto& block = blocks_[idx];
+            const uint64_t pc = block.terminatorPC();
+
+            size_t next = idx + 1;
+            bool taken = false;
+            switch(block.terminator) {
+                case SynthConfig::COND:
+                    taken = isTaken_(block);
+                    if(taken) {
+                        next = block.targets.front();
+                    }
+                    break;
+                case SynthConfig::JUMP:
+                    taken = true;
+                    next = block.targets.front();
+                    break;
+                case SynthConfig::INDIRECT:
+                    taken = true;
+                    next = block.targets[rng_.below(block.targets.size())];
+                    break;
+                case SynthConfig::NUM_TERMINATOR_CLASSES:
+                    stf_throw("Invalid terminator class");
+            }
+
+            if(config_.embed_ptes) {
+                touchPage_(writer, pc, true);
+            }
+            if(config_.reg_values && block.terminator == SynthConfig::INDIRECT) {
+                writer << stf::InstRegRecord(INDIRECT_REG_,
+                                             stf::Registers::STF_REG_TYPE::INTEGER,
+                                             stf::Registers::STF_REG_OPERAND_TYPE::REG_SOURCE,
+                                             blocks_[next].pc);
+            }
+            if(taken) {
+                writer << stf::InstPCTargetRecord(blocks_[next].pc);
+            }
+            writer << stf::InstOpcode32Record(block.terminator_opcode);
+            countInst_();
+
+            return next;
+        }
+
+    public:
+        /**
+         * Constructs a SyntheticTraceGenerator and generates the static program
+         * \param config Trace parameters
+         */
+        explicit SyntheticTraceGenerator(const SynthConfig& config) :
+            config_(config),
+            rng_(config.seed)
+        {
+            stf_assert(config_.block_length > 0, "Block length must be greater than 0");
+            stf_assert(config_.data_footprint >= ACCESS_SIZE_, "Data footprint must be at least " << ACCESS_SIZE_ << " bytes");
+            stf_assert(config_.indirect_fanout > 0, "Indirect fan-out must be greater than 0");
+            stf_assert(config_.pattern_period > 1, "Pattern period must be greater than 1");
+            stf_assert(config_.vlen || !config_.body_weights[SynthConfig::VECTOR], "Vector instructions require a vector length");
+            generateProgram_();
+        }
+
+        /**
+         * Gets the number of static basic blocks
+         */
+        inline size_t getNumBlocks() const {
+            return blocks_.size();
+        }
+
+        /**
+         * Writes the trace
+         * \param writer Writer to use. Must be open and must not have a finalized header.
+         */
+        void write(stf::STFWriter& writer) {
+            writer.addTraceInfo(stf::TraceInfoRecord(stf::STF_GEN::STF_GEN_STF_MORPH,
+                                                     TRACE_TOOLS_VERSION_MAJOR,
+                                                     TRACE_TOOLS_VERSION_MINOR,
+                                                     TRACE_TOOLS_VERSION_MINOR_MINOR,
+                                                     "Synthetic trace generated by stf_synth (seed " + std::to_string(config_.seed) + ")"));
+            writer.setISA(stf::ISA::RISCV);
+            writer.setHeaderIEM(stf::INST_IEM::STF_INST_IEM_RV64);
+            writer.setTraceFeature(stf::TRACE_FEATURES::STF_CONTAIN_RV64);
+            if(config_.body_weights[SynthConfig::SYSCALL]) {
+                writer.setTraceFeature(stf::TRACE_FEATURES::STF_CONTAIN_EVENT);
+            }
+            if(config_.embed_ptes) {
+                writer.setTraceFeature(stf::TRACE_FEATURES::STF_CONTAIN_PTE);
+            }
+            if(config_.reg_values) {
+                writer.setTraceFeature(stf::TRACE_FEATURES::STF_CONTAIN_OPERAND_VALUE);
+            }
+            if(config_.vlen) {
+                writer.setTraceFeature(stf::TRACE_FEATURES::STF_CONTAIN_VEC);
+                writer.setVLen(static_cast<stf::vlen_t>(config_.vlen));
+            }
+            writer.setHeaderPC(blocks_.front().pc);
+            writer.finalizeHeader();
+
+            size_t idx = 0;
+            while(!done_()) {
+                uint64_t pc = blocks_[idx].pc;
+                for(const auto& inst: blocks_[idx].body) {
+                    pc = writeBodyInst_(writer, inst, pc, true);
+                    if(done_()) {
+                        return;
+                    }
+                }
+                idx = writeTerminator_(writer, idx);
+            }
+        }
+};